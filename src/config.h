@@ -138,6 +138,50 @@
 #define NBLIST
 #endif
 
+/* threaded force loop with neighbor lists; covalent neighbor tables
+   and the dipole iteration are not thread safe and remain serial */
+#if defined(NBL) && defined(_OPENMP) && !defined(COVALENT) && \
+    !defined(DIPOLE) && !defined(KERMODE) && !defined(CBE)
+#define NBL_OMP
+#endif
+
+/* full neighbor lists without Newton's third law (parameter nbl_full)
+   are available for pair, EAM and ADP like interactions */
+#if defined(NBL) && !defined(COVALENT) && !defined(DIPOLE) && \
+    !defined(KERMODE) && !defined(SM) && !defined(LOADBALANCE) && \
+    !defined(CBE) && !defined(KIM)
+#define NBL_FULL
+#endif
+
+/* blocked force kernels for tabulated pair and EAM potentials; 
+   interactions not handled there use the scalar force loop */
+#if defined(NBL_SIMD) && (!defined(NBL) || !defined(PAIR) || \
+    defined(LINPOT) || defined(COULOMB) || defined(ADP) || defined(EEAM) || \
+    defined(TWOD) || defined(MONOLJ) || defined(ORDPAR) || \
+    defined(FLAGEDATOMS) || defined(CBE) || defined(KIM))
+#undef NBL_SIMD
+#endif
+
+/* number of neighbors per block, e.g. 4, 8 or 16 */
+#if defined(NBL_SIMD) && !defined(NBL_BLOCK)
+#define NBL_BLOCK 8
+#endif
+
+/* cluster pair lists (parameter nbl_cluster) for tabulated pair and 
+   EAM potentials */
+#if defined(NBL) && defined(PAIR) && !defined(LINPOT) && \
+    !defined(COULOMB) && !defined(ADP) && !defined(EEAM) && \
+    !defined(TWOD) && !defined(MONOLJ) && !defined(ORDPAR) && \
+    !defined(NNBR) && !defined(FLAGEDATOMS) && !defined(COVALENT) && \
+    !defined(LOADBALANCE) && !defined(CBE) && !defined(KIM)
+#define NBL_CLUSTER
+#endif
+
+/* number of atoms per cluster, e.g. 4 or 8 */
+#if defined(NBL_CLUSTER) && !defined(NBL_CLSIZE)
+#define NBL_CLSIZE 4
+#endif
+
 #ifdef BUFCELLS
 
 /* AR is the default. We could make the default machine dependent */
@@ -265,12 +309,21 @@
 #define NEIGH_LEN_INC  2
 #endif
 
+/* maximal order of SPME B-splines */
+#define EW_MAXORDER 12
+
+/* number of k-vectors per reduction of the Ewald structure factors */
+#define EW_KBATCH 256
+
 #ifdef CNA
 #define MAX_NEIGH 12
 #define MAX_BONDS 24
 #define MAX_TYPES 25
 #endif
 
+/* max. number of in-situ distributions */
+#define MAX_INSITU 10
+
 /* pressure relaxation */
 #define RELAX_FULL     0
 #define RELAX_AXIAL    1
@@ -284,3 +337,9 @@
 
 /* maximum number of items per atom in config file (plus number and type) */
 #define MAX_ITEMS_CONFIG 16
+
+/* last value of a compressed config file, "IMDZ" */
+#define ZIP_MAGIC 0x5a444d49LL
+
+/* last value of a trajectory file, "IMDT" */
+#define TRAJ_MAGIC 0x54444d49LL
@@ -317,8 +317,29 @@ EXTERN int dist_chunk_size       INIT(2*1024*1024); /* size of dist reduct. */
 EXTERN ivektor dist_dim          INIT(einsivektor); /* resolution of dist */
 EXTERN vektor  dist_ur           INIT(nullvektor);  /* lower left  corner */
 EXTERN vektor  dist_ll           INIT(nullvektor);  /* upper right corner */
+EXTERN int     insitu_int  [MAX_INSITU]; /* periods of in-situ dists */
+EXTERN int     insitu_quant[MAX_INSITU]; /* their quantities */
+EXTERN int     insitu_mode [MAX_INSITU]; /* their output formats */
+EXTERN ivektor insitu_dim  [MAX_INSITU]; /* their resolutions */
 
 EXTERN int binary_output INIT(0);  /* write binary atoms data? */
+EXTERN int traj_int INIT(0);       /* period of trajectory frames */
+EXTERN ivektor traj_blocks INIT(einsivektor); /* trajectory blocks per CPU */
+#ifdef DELTA
+EXTERN int  delta_checkpt INIT(0);    /* every n-th checkpoint is full */
+EXTERN real delta_eps_pos INIT(1e-4); /* quantum of displacements */
+EXTERN real delta_eps_vel INIT(1e-5); /* quantum of velocity changes */
+EXTERN str255 delta_base;             /* file of last full checkpoint */
+EXTERN long delta_natoms  INIT(0);    /* number of atoms in delta_base */
+#endif
+#ifdef ZLIB
+EXTERN int  compress_output  INIT(0);   /* zlib level of checkpoints */
+EXTERN real compress_eps_pos INIT(0.0); /* error bound of positions */
+EXTERN real compress_eps_vel INIT(0.0); /* error bound of velocities */
+EXTERN int  out_zip          INIT(0);   /* zlib level of current file */
+EXTERN real out_zip_pos      INIT(0.0); /* quantum of positions */
+EXTERN real out_zip_vel      INIT(0.0); /* quantum of velocities */
+#endif
 
 #ifdef WRITEF
 EXTERN int force_all INIT(0); /* write all forces, or only of virtual types */
@@ -419,7 +440,24 @@ EXTERN int  box_from_header INIT(0); /* read box from config file */
 EXTERN real nbl_margin INIT(0.4);    /* neighbor list margin */
 EXTERN real nbl_size   INIT(1.1);    /* neighbor list size */
 EXTERN int  nbl_count  INIT(0);      /* counting neighbor list rebuild */
-EXTERN int  have_valid_nbl INIT(0);
+EXTERN int  nbl_incremental INIT(0); /* rebuild only rows of moved cells */
+EXTERN int  nbl_full   INIT(0);      /* full neighbor list, no Newton */
+EXTERN int  nbl_sort   INIT(0);      /* sort atoms every nbl_sort rebuilds */
+EXTERN int  nbl_hilbert INIT(0);     /* order cells along Hilbert curve */
+EXTERN int  nbl_cluster INIT(0);     /* use cluster pair list */
+EXTERN int  nbl_autotune INIT(0);    /* tune margin every nbl_autotune rebuilds */
+EXTERN int  nbl_overlap INIT(0);     /* overlap halo exchange with forces */
+EXTERN real nbl_rcut   INIT(0.0);    /* neighbor list cutoff without margin */
+#ifdef TIMING
+EXTERN real nbl_npairs INIT(0.0);    /* pairs computed in force loop */
+#endif
+#ifdef NBL_SIMD
+EXTERN int  nbl_simd   INIT(1);      /* 0: scalar, 1: blocked, 2: check */
+EXTERN long nbl_simd_diff INIT(0);   /* values differing from scalar code */
+#endif
+EXTERN int  nbl_update_count INIT(0); /* counting incremental updates */
+EXTERN char *nbl_moved INIT(NULL);   /* cells with reset reference positions */
+EXTERN int  have_valid_nbl INIT(0);  /* <0: incremental update needed */
 EXTERN int  last_nbl_len   INIT(0);
 #endif
 
@@ -461,6 +499,9 @@ EXTERN int myid INIT(0);                  /* Who am I? (0 if serial) */
 EXTERN int num_cpus INIT(1);              /* How many cpus are there */
 EXTERN int parallel_output INIT(0);       /* Flag for parallel output */
 EXTERN int parallel_input  INIT(1);       /* Flag for parallel input */
+#ifdef ASYNC_IO
+EXTERN int async_output    INIT(1);       /* max. pending output files */
+#endif
 EXTERN ivektor my_coord INIT(nullivektor);/* Cartesian coordinates of cpu */
 EXTERN ivektor cpu_dim INIT(einsivektor); /* Dimensions of CPU-Array */
 EXTERN int binc INIT(0);                  /* buffer size per atom */
@@ -496,6 +537,9 @@ EXTERN msgbuf recv_buf_down  INIT(nullbuffer);
 EXTERN msgbuf dump_buf       INIT(nullbuffer);
 EXTERN real   msgbuf_size    INIT(1.2);
 EXTERN int    atom_size      INIT(0);
+EXTERN int    direct_halo    INIT(0);  /* buffer cells from all 26 neighbors,
+                                          2: via shared memory */
+EXTERN int    direct_halo_node INIT(0); /* max. CPUs sharing memory, 0: node */
 
 /* Neighbours */
 EXTERN int nbwest, nbeast, nbnorth, nbsouth, nbup, nbdown; /* Faces */
@@ -516,6 +560,13 @@ EXTERN imd_timer time_fft_plan;
 EXTERN imd_timer time_input;
 EXTERN imd_timer time_integrate;
 EXTERN imd_timer time_forces;
+#ifdef NBLIST
+EXTERN imd_timer time_nblist;
+#endif
+#ifdef TIMING
+EXTERN real io_bytes_out INIT(0.0);  /* configuration bytes written */
+EXTERN real io_bytes_in  INIT(0.0);  /* configuration bytes read */
+#endif
 
 /* Parameters for the various ensembles */
 
@@ -1353,6 +1404,17 @@ EXTERN real     *coskr;
 EXTERN real     *sinkr;
 EXTERN real     ew_vorf;
 EXTERN real     twopi;
+#ifdef EWALD
+EXTERN ivektor  ew_mesh INIT(nullivektor); /* SPME mesh, 0 for k-vector sum */
+EXTERN int      ew_order INIT(4);        /* order of SPME B-splines */
+EXTERN double   *ew_grid;                /* SPME charge mesh */
+EXTERN real     *ew_gmesh;               /* SPME influence function */
+EXTERN real     *ew_vmesh;               /* SPME virial factors */
+EXTERN double   *ew_mbuf;                /* SPME mesh reduction buffer */
+EXTERN imd_timer ewald_time_sf;          /* k-space: structure factors */
+EXTERN imd_timer ewald_time_comm;        /* k-space: sum over CPUs */
+EXTERN imd_timer ewald_time_back;        /* k-space: forces */
+#endif
 EXTERN pot_table_t coul_table; /* one table to hold all coul. and dipole fn */
 EXTERN real     coul_res   INIT(0); /* function table resolution */
 EXTERN real     coul_begin INIT(0.2); /* start of function table */
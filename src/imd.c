@@ -66,6 +66,14 @@ int main(int argc, char **argv)
   imd_init_timer( &time_input,      1, "input",     "orange");
   imd_init_timer( &time_integrate,  1, "integrate", "green" );
   imd_init_timer( &time_forces,     1, "forces",    "yellow");
+#ifdef NBLIST
+  imd_init_timer( &time_nblist,     1, "nblist",    "red"   );
+#endif
+#ifdef EWALD
+  imd_init_timer( &ewald_time_sf,   1, "ewald_sf",  "blue"  );
+  imd_init_timer( &ewald_time_comm, 1, "ewald_comm","magenta");
+  imd_init_timer( &ewald_time_back, 1, "ewald_back","brown" );
+#endif
 #if defined(CBE)
   tick0 = ticks();
 #endif
@@ -281,6 +289,10 @@ int main(int argc, char **argv)
     }
   }
 
+#ifdef ASYNC_IO
+  /* wait for pending output */
+  finish_output();
+#endif
 
 #if defined(CBE)
   tick1=ticks();
@@ -290,6 +302,14 @@ int main(int argc, char **argv)
   PAPI_flops(&rtime,&ptime,&flpins,&mflops);
 #endif
 
+#if defined(NBL_SIMD) && defined(MPI)
+  /* collect differences of the blocked force kernel */
+  if (nbl_simd > 1) {
+    long ndiff = nbl_simd_diff;
+    MPI_Reduce( &ndiff, &nbl_simd_diff, 1, MPI_LONG, MPI_SUM, 0, cpugrid );
+  }
+#endif
+
   /* write execution time summary */
   if ((0 == myid) && (0 == myrank)){
     if (NULL!= eng_file) fclose( eng_file);
@@ -320,6 +340,15 @@ int main(int argc, char **argv)
 #ifdef NBLIST
     printf("Neighbor list update every %d steps on average\n\n",
            steps_max / MAX(nbl_count,1));
+    if (nbl_incremental) 
+      printf("%d incremental neighbor list updates\n\n", nbl_update_count);
+    if (nbl_autotune) 
+      printf("Neighbor list margin tuned to %f\n\n", nbl_margin);
+#endif
+#ifdef NBL_SIMD
+    if (nbl_simd > 1) 
+      printf("%ld values of the blocked force kernel differ from scalar code\n\n",
+             nbl_simd_diff);
 #endif
 
 #ifdef EPITAX
@@ -370,6 +399,26 @@ int main(int argc, char **argv)
            time_input.total,100*time_input.total/time_main.total);
     printf("Force  time:   %e seconds or %.1f %% of main loop\n",
            time_forces.total,100*time_forces.total/time_main.total);
+    if (io_bytes_out > 0)
+      printf("Output rate:   %e bytes per second in output time\n",
+             io_bytes_out / time_output.total);
+    if (io_bytes_in > 0)
+      printf("Input  rate:   %e bytes per second in input time\n",
+             io_bytes_in / time_input.total);
+#ifdef NBLIST
+    printf("Nblist time:   %e seconds or %.1f %% of main loop (%s list)\n",
+           time_nblist.total,100*time_nblist.total/time_main.total,
+           nbl_full ? "full" : "half");
+    if (nbl_npairs > 0)
+      printf("Pair rate:     %e pairs per second in force time (%s list)\n",
+             nbl_npairs / time_forces.total, nbl_cluster ? "cluster" : "atom");
+#endif
+#ifdef EWALD
+    if (ew_kcut > 0)
+      printf("Ewald k-space: %e seconds structure factors, %e seconds "
+             "reduction, %e seconds forces\n", ewald_time_sf.total,
+             ewald_time_comm.total, ewald_time_back.total);
+#endif
 #endif
 
      fflush(stdout);
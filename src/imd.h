@@ -56,9 +56,12 @@
 #ifdef OMP
 #include <omp.h>
 #endif
+#ifdef ASYNC_IO
+#include <pthread.h>
+#endif
 
-/* FFT for diffraction patterns */
-#ifdef DIFFPAT
+/* FFT for diffraction patterns, and optionally for SPME */
+#if defined(DIFFPAT) || (defined(EWALD) && defined(FFTW))
 #include <fftw3.h>
 #endif
 
@@ -266,6 +266,16 @@ void copy_atom_cell_cell(cell *to, int i, cell *from, int j)
   to->refpos Z(i) = from->refpos Z(j);
 #endif
 #endif /* REFPOS */
+#ifdef DELTA
+  to->dltpos X(i) = from->dltpos X(j);
+  to->dltpos Y(i) = from->dltpos Y(j);
+  to->dltvel X(i) = from->dltvel X(j);
+  to->dltvel Y(i) = from->dltvel Y(j);
+#ifndef TWOD
+  to->dltpos Z(i) = from->dltpos Z(j);
+  to->dltvel Z(i) = from->dltvel Z(j);
+#endif
+#endif
 #ifdef HC
   to->hcaveng[i]  = from->hcaveng[j];   
 #endif
@@ -650,6 +660,10 @@ void alloc_cell(cell *p, int n)
 #ifdef REFPOS
   memalloc( &p->refpos,   n*SDIM, sizeof(real), al, ncopy*SDIM, 1, "refpos" );
 #endif
+#ifdef DELTA
+  memalloc( &p->dltpos,   n*SDIM, sizeof(real), al, ncopy*SDIM, 1, "dltpos" );
+  memalloc( &p->dltvel,   n*SDIM, sizeof(real), al, ncopy*SDIM, 1, "dltvel" );
+#endif
 #ifdef HC
   memalloc( &p->hcaveng,  n,      sizeof(real), al, ncopy,      0, "hcaveng");
 #endif
@@ -0,0 +1,420 @@
+/******************************************************************************
+*
+* IMD -- The ITAP Molecular Dynamics Program
+*
+* Copyright 1996-2012 Institute for Theoretical and Applied Physics,
+* University of Stuttgart, D-70550 Stuttgart
+*
+******************************************************************************/
+
+/******************************************************************************
+*
+* imd_ascii.c -- fast conversion of numbers for ASCII configurations
+*
+*  ascii_fixed writes a number like printf("%.*f"), with the same digits,
+*  but without the overhead of the format parser. ascii_short writes a
+*  short decimal representation which reads back to the same double
+*  (Grisu2 algorithm; the shortest one in all but a few cases).
+*  ascii_scan_line parses a line of a configuration file like
+*  sscanf("%d %d %lf %lf ..."). Numbers with at most 19 digits
+*  and a small decimal exponent are converted exactly with one floating
+*  point operation; all other numbers are passed to strtod.
+*
+******************************************************************************/
+
+/******************************************************************************
+* $Revision$
+* $Date$
+******************************************************************************/
+
+#include "imd.h"
+#include <ctype.h>
+
+typedef unsigned long long u64;
+
+static const u64 pow10_u64[20] = {
+  1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL,
+  10000000ULL, 100000000ULL, 1000000000ULL, 10000000000ULL,
+  100000000000ULL, 1000000000000ULL, 10000000000000ULL,
+  100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL,
+  100000000000000000ULL, 1000000000000000000ULL, 10000000000000000000ULL
+};
+
+static const double pow10_dbl[23] = {
+  1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/******************************************************************************
+*
+*  put_u64 - write the decimal digits of an unsigned number, at least
+*  ndig of them (with leading zeros), and return their number
+*
+******************************************************************************/
+
+static int put_u64(char *s, u64 x, int ndig)
+{
+  char tmp[24];
+  int  n = 0, k;
+
+  do { tmp[n++] = '0' + (char) (x % 10); x /= 10; } while (x);
+  while (n < ndig) tmp[n++] = '0';
+  for (k=0; k<n; k++) s[k] = tmp[n-1-k];
+  return n;
+}
+
+/******************************************************************************
+*
+*  ascii_int - write an integer, return the number of characters
+*
+******************************************************************************/
+
+int ascii_int(char *s, long x)
+{
+  if (x < 0) {
+    s[0] = '-';
+    return 1 + put_u64(s+1, (u64) (-(x+1)) + 1, 1);
+  }
+  return put_u64(s, (u64) x, 1);
+}
+
+/******************************************************************************
+*
+*  ascii_fixed - write x like printf("%.*f", prec, x), 0 < prec < 10
+*
+*  The scaled fraction is computed exactly as the sum of two doubles,
+*  so that the rounding of printf, including ties, is reproduced.
+*  Very large numbers, infinities and NaNs are left to sprintf.
+*
+******************************************************************************/
+
+int ascii_fixed(char *s, double x, int prec)
+{
+  double ax = fabs(x), ip, hi, lo, r;
+  u64 i, f;
+  int n = 0;
+
+  if ((ax < 1e15) && (prec > 0) && (prec < 10)) {
+    if (signbit(x)) s[n++] = '-';
+    ip = floor(ax);
+    i  = (u64) ip;
+    hi = (ax - ip) * pow10_dbl[prec];
+    lo = fma(ax - ip, pow10_dbl[prec], -hi);
+    r  = nearbyint(hi);
+    /* hi is a tie only by rounding, decide with the remainder */
+    if ((fabs(hi - r) == 0.5) && (lo != 0.0))
+      r = (lo > 0.0) ? ceil(hi) : floor(hi);
+    f  = (u64) r;
+    if (f >= pow10_u64[prec]) { f -= pow10_u64[prec]; i++; }
+    n += put_u64(s+n, i, 1);
+    s[n++] = '.';
+    n += put_u64(s+n, f, prec);
+    return n;
+  }
+  /* the result must fit in the space reserved for a number */
+  if (fabs(x) < 1e15) return sprintf(s, "%.*f", prec, x);
+  return sprintf(s, "%.17g", x);
+}
+
+/******************************************************************************
+*
+*  Grisu2 - shortest digits of a double, after F. Loitsch, "Printing
+*  floating-point numbers quickly and accurately with integers", PLDI 2010
+*
+******************************************************************************/
+
+typedef struct { u64 f; int e; } diy_fp;
+
+/* normalized powers of ten 10^k, k = -348, -340, ..., 340 */
+static const diy_fp cached_pow[] = {
+  { 0xfa8fd5a0081c0288ULL, -1220 }, { 0xbaaee17fa23ebf76ULL, -1193 },
+  { 0x8b16fb203055ac76ULL, -1166 }, { 0xcf42894a5dce35eaULL, -1140 },
+  { 0x9a6bb0aa55653b2dULL, -1113 }, { 0xe61acf033d1a45dfULL, -1087 },
+  { 0xab70fe17c79ac6caULL, -1060 }, { 0xff77b1fcbebcdc4fULL, -1034 },
+  { 0xbe5691ef416bd60cULL, -1007 }, { 0x8dd01fad907ffc3cULL,  -980 },
+  { 0xd3515c2831559a83ULL,  -954 }, { 0x9d71ac8fada6c9b5ULL,  -927 },
+  { 0xea9c227723ee8bcbULL,  -901 }, { 0xaecc49914078536dULL,  -874 },
+  { 0x823c12795db6ce57ULL,  -847 }, { 0xc21094364dfb5637ULL,  -821 },
+  { 0x9096ea6f3848984fULL,  -794 }, { 0xd77485cb25823ac7ULL,  -768 },
+  { 0xa086cfcd97bf97f4ULL,  -741 }, { 0xef340a98172aace5ULL,  -715 },
+  { 0xb23867fb2a35b28eULL,  -688 }, { 0x84c8d4dfd2c63f3bULL,  -661 },
+  { 0xc5dd44271ad3cdbaULL,  -635 }, { 0x936b9fcebb25c996ULL,  -608 },
+  { 0xdbac6c247d62a584ULL,  -582 }, { 0xa3ab66580d5fdaf6ULL,  -555 },
+  { 0xf3e2f893dec3f126ULL,  -529 }, { 0xb5b5ada8aaff80b8ULL,  -502 },
+  { 0x87625f056c7c4a8bULL,  -475 }, { 0xc9bcff6034c13053ULL,  -449 },
+  { 0x964e858c91ba2655ULL,  -422 }, { 0xdff9772470297ebdULL,  -396 },
+  { 0xa6dfbd9fb8e5b88fULL,  -369 }, { 0xf8a95fcf88747d94ULL,  -343 },
+  { 0xb94470938fa89bcfULL,  -316 }, { 0x8a08f0f8bf0f156bULL,  -289 },
+  { 0xcdb02555653131b6ULL,  -263 }, { 0x993fe2c6d07b7facULL,  -236 },
+  { 0xe45c10c42a2b3b06ULL,  -210 }, { 0xaa242499697392d3ULL,  -183 },
+  { 0xfd87b5f28300ca0eULL,  -157 }, { 0xbce5086492111aebULL,  -130 },
+  { 0x8cbccc096f5088ccULL,  -103 }, { 0xd1b71758e219652cULL,   -77 },
+  { 0x9c40000000000000ULL,   -50 }, { 0xe8d4a51000000000ULL,   -24 },
+  { 0xad78ebc5ac620000ULL,     3 }, { 0x813f3978f8940984ULL,    30 },
+  { 0xc097ce7bc90715b3ULL,    56 }, { 0x8f7e32ce7bea5c70ULL,    83 },
+  { 0xd5d238a4abe98068ULL,   109 }, { 0x9f4f2726179a2245ULL,   136 },
+  { 0xed63a231d4c4fb27ULL,   162 }, { 0xb0de65388cc8ada8ULL,   189 },
+  { 0x83c7088e1aab65dbULL,   216 }, { 0xc45d1df942711d9aULL,   242 },
+  { 0x924d692ca61be758ULL,   269 }, { 0xda01ee641a708deaULL,   295 },
+  { 0xa26da3999aef774aULL,   322 }, { 0xf209787bb47d6b85ULL,   348 },
+  { 0xb454e4a179dd1877ULL,   375 }, { 0x865b86925b9bc5c2ULL,   402 },
+  { 0xc83553c5c8965d3dULL,   428 }, { 0x952ab45cfa97a0b3ULL,   455 },
+  { 0xde469fbd99a05fe3ULL,   481 }, { 0xa59bc234db398c25ULL,   508 },
+  { 0xf6c69a72a3989f5cULL,   534 }, { 0xb7dcbf5354e9beceULL,   561 },
+  { 0x88fcf317f22241e2ULL,   588 }, { 0xcc20ce9bd35c78a5ULL,   614 },
+  { 0x98165af37b2153dfULL,   641 }, { 0xe2a0b5dc971f303aULL,   667 },
+  { 0xa8d9d1535ce3b396ULL,   694 }, { 0xfb9b7cd9a4a7443cULL,   720 },
+  { 0xbb764c4ca7a44410ULL,   747 }, { 0x8bab8eefb6409c1aULL,   774 },
+  { 0xd01fef10a657842cULL,   800 }, { 0x9b10a4e5e9913129ULL,   827 },
+  { 0xe7109bfba19c0c9dULL,   853 }, { 0xac2820d9623bf429ULL,   880 },
+  { 0x80444b5e7aa7cf85ULL,   907 }, { 0xbf21e44003acdd2dULL,   933 },
+  { 0x8e679c2f5e44ff8fULL,   960 }, { 0xd433179d9c8cb841ULL,   986 },
+  { 0x9e19db92b4e31ba9ULL,  1013 }, { 0xeb96bf6ebadf77d9ULL,  1039 },
+  { 0xaf87023b9bf0ee6bULL,  1066 }
+};
+
+/* product of two diy_fp, rounded to 64 bits */
+static diy_fp diy_mul(diy_fp x, diy_fp y)
+{
+  const u64 M32 = 0xFFFFFFFFULL;
+  u64 a = x.f >> 32, b = x.f & M32, c = y.f >> 32, d = y.f & M32;
+  u64 ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+  u64 tmp = (bd >> 32) + (ad & M32) + (bc & M32) + (1ULL << 31);
+  diy_fp r;
+
+  r.f = ac + (ad >> 32) + (bc >> 32) + (tmp >> 32);
+  r.e = x.e + y.e + 64;
+  return r;
+}
+
+static diy_fp diy_normalize(diy_fp x)
+{
+  while (0 == (x.f & 0x8000000000000000ULL)) { x.f <<= 1; x.e--; }
+  return x;
+}
+
+/* cached power c with -60 <= e + c.e <= -32, and its decimal exponent */
+static diy_fp cached_power(int e, int *k)
+{
+  double dk = (-61 - e) * 0.30102999566398114 + 347;
+  int    ik = (int) dk, idx;
+
+  if (dk - ik > 0.0) ik++;
+  idx = (ik >> 3) + 1;
+  *k  = -(-348 + (idx << 3));
+  return cached_pow[idx];
+}
+
+static void grisu_round(char *buf, int len, u64 delta, u64 rest,
+                        u64 ten_kappa, u64 wp_w)
+{
+  while ((rest < wp_w) && (delta - rest >= ten_kappa) &&
+         ((rest + ten_kappa < wp_w) || 
+          (wp_w - rest > rest + ten_kappa - wp_w))) {
+    buf[len-1]--;
+    rest += ten_kappa;
+  }
+}
+
+static int digit_gen(diy_fp w, diy_fp mp, u64 delta, char *buf, int *k)
+{
+  int  sh = -mp.e, kappa = 0, len = 0;
+  u64  one = 1ULL << sh, wp_w = mp.f - w.f, p2 = mp.f & (one - 1);
+  unsigned p1 = (unsigned) (mp.f >> sh), d;
+
+  while (pow10_u64[kappa] <= p1 && kappa < 10) kappa++;
+  while (kappa > 0) {
+    d   = p1 / (unsigned) pow10_u64[kappa-1];
+    p1 %= (unsigned) pow10_u64[kappa-1];
+    if (d || len) buf[len++] = '0' + (char) d;
+    kappa--;
+    if ((((u64) p1 << sh) + p2) <= delta) {
+      *k += kappa;
+      grisu_round(buf, len, delta, ((u64) p1 << sh) + p2, 
+                  pow10_u64[kappa] << sh, wp_w);
+      return len;
+    }
+  }
+  while (1) {
+    p2    *= 10;
+    delta *= 10;
+    d  = (unsigned) (p2 >> sh);
+    if (d || len) buf[len++] = '0' + (char) d;
+    p2 &= one - 1;
+    kappa--;
+    if (p2 < delta) {
+      *k += kappa;
+      grisu_round(buf, len, delta, p2, one, 
+                  (-kappa < 20) ? wp_w * pow10_u64[-kappa] : 0);
+      return len;
+    }
+  }
+}
+
+/* digits of a positive, finite double v = digits * 10^k */
+static int grisu2(double v, char *buf, int *k)
+{
+  union { double d; u64 u; } bits;
+  diy_fp w, wp, wm, c;
+  int    fe;
+
+  bits.d = v;
+  fe     = (int) ((bits.u >> 52) & 0x7FF);
+  w.f    = bits.u & 0x000FFFFFFFFFFFFFULL;
+  if (fe) { w.f += 0x0010000000000000ULL; w.e = fe - 1075; }
+  else    { w.e = -1074; }
+
+  /* boundaries m+ and m-, with the exponent of the normalized m+ */
+  wp.f = (w.f << 1) + 1;  wp.e = w.e - 1;
+  while (0 == (wp.f & 0x0020000000000000ULL)) { wp.f <<= 1; wp.e--; }
+  wp.f <<= 10; wp.e -= 10;
+  if (w.f == 0x0010000000000000ULL) { wm.f = (w.f << 2) - 1; wm.e = w.e - 2; }
+  else                              { wm.f = (w.f << 1) - 1; wm.e = w.e - 1; }
+  wm.f <<= wm.e - wp.e; wm.e = wp.e;
+
+  c  = cached_power(wp.e, k);
+  w  = diy_mul(diy_normalize(w), c);
+  wp = diy_mul(wp, c);
+  wm = diy_mul(wm, c);
+  wm.f++; wp.f--;
+  return digit_gen(w, wp, wp.f - wm.f, buf, k);
+}
+
+/******************************************************************************
+*
+*  ascii_short - write a short representation of x which reads back
+*  to x, in fixed notation if it is not too long, and return its length;
+*  at most 25 characters are written
+*
+******************************************************************************/
+
+int ascii_short(char *s, double x)
+{
+  char buf[24];
+  int  n = 0, len, k, kk, i;
+
+  if (!isfinite(x)) return sprintf(s, "%g", x);
+  if (signbit(x)) { s[n++] = '-'; x = -x; }
+  if (x == 0.0) { s[n++] = '0'; s[n++] = '.'; s[n++] = '0'; return n; }
+
+  len = grisu2(x, buf, &k);
+  kk  = len + k;                        /* 10^(kk-1) <= x < 10^kk */
+  if ((k >= 0) && (kk <= 17)) {         /* 1234e2 -> 123400.0 */
+    for (i=0; i<len; i++) s[n++] = buf[i];
+    for (   ; i<kk;  i++) s[n++] = '0';
+    s[n++] = '.'; s[n++] = '0';
+  } 
+  else if ((kk > 0) && (kk <= 17)) {    /* 1234e-2 -> 12.34 */
+    for (i=0; i<kk;  i++) s[n++] = buf[i];
+    s[n++] = '.';
+    for (   ; i<len; i++) s[n++] = buf[i];
+  }
+  else if ((kk > -5) && (kk <= 0)) {    /* 1234e-6 -> 0.001234 */
+    s[n++] = '0'; s[n++] = '.';
+    for (i=kk; i<0;   i++) s[n++] = '0';
+    for (i=0;  i<len; i++) s[n++] = buf[i];
+  }
+  else {                                /* 1234e30 -> 1.234e33 */
+    s[n++] = buf[0];
+    if (len > 1) {
+      s[n++] = '.';
+      for (i=1; i<len; i++) s[n++] = buf[i];
+    }
+    s[n++] = 'e';
+    n += ascii_int(s+n, kk - 1);
+  }
+  return n;
+}
+
+/******************************************************************************
+*
+*  scan_int, scan_real - read a number, skipping leading white space;
+*  on success, advance *ps behind it and return 1, else return 0
+*
+******************************************************************************/
+
+static int scan_int(char **ps, int *x)
+{
+  char *s = *ps;
+  long  v = 0;
+  int   neg = 0;
+
+  while (isspace((unsigned char) *s)) s++;
+  if      (*s == '-') { neg = 1; s++; }
+  else if (*s == '+') s++;
+  if (!isdigit((unsigned char) *s)) return 0;
+  while (isdigit((unsigned char) *s)) {
+    if (v < 1000000000000L) v = 10 * v + (*s - '0');
+    s++;
+  }
+  *x  = (int) (neg ? -v : v);
+  *ps = s;
+  return 1;
+}
+
+static int scan_real(char **ps, real *x)
+{
+  char  *s = *ps, *t, *end;
+  u64    m = 0;
+  int    nd = 0, e = 0, ee = 0, neg = 0, any = 0, exact = 1, eneg = 0;
+  double v;
+
+  while (isspace((unsigned char) *s)) s++;
+  t = s;
+  if      (*s == '-') { neg = 1; s++; }
+  else if (*s == '+') s++;
+  for ( ; isdigit((unsigned char) *s); s++, any=1) {
+    if (nd < 19) { m = 10 * m + (*s - '0'); if (m) nd++; }
+    else { e++; if (*s != '0') exact = 0; }
+  }
+  if (*s == '.') {
+    for (s++; isdigit((unsigned char) *s); s++, any=1) {
+      if (nd < 19) { m = 10 * m + (*s - '0'); if (m) nd++; e--; }
+      else if (*s != '0') exact = 0;
+    }
+  }
+  if ((*s == 'e') || (*s == 'E')) {
+    char *u = s+1;
+    if      (*u == '-') { eneg = 1; u++; }
+    else if (*u == '+') u++;
+    if (isdigit((unsigned char) *u)) {
+      for ( ; isdigit((unsigned char) *u); u++) 
+        if (ee < 10000) ee = 10 * ee + (*u - '0');
+      e += eneg ? -ee : ee;
+      s  = u;
+    }
+    else exact = 0;  /* let strtod decide */
+  }
+  /* exact if mantissa and power of ten are exact doubles */
+  if ((*s == 'x') || (*s == 'X')) exact = 0;
+  if (any && exact && (m <= (1ULL << 53)) && (e >= -22) && (e <= 22)) {
+    v = (e < 0) ? (double) m / pow10_dbl[-e] : (double) m * pow10_dbl[e];
+    *x  = (real) (neg ? -v : v);
+    *ps = s;
+    return 1;
+  }
+  v = strtod(t, &end);
+  if (end == t) return 0;
+  *x  = (real) v;
+  *ps = end;
+  return 1;
+}
+
+/******************************************************************************
+*
+*  ascii_scan_line - read number, type and up to max reals from a line;
+*  returns the number of items read, like sscanf
+*
+******************************************************************************/
+
+int ascii_scan_line(char *buf, int *n, int *s, real *d, int max)
+{
+  char *p = buf;
+  int   k;
+
+  if (!scan_int(&p, n)) return 0;
+  if (!scan_int(&p, s)) return 1;
+  for (k=0; k<max; k++)
+    if (!scan_real(&p, d+k)) break;
+  return k+2;
+}
@@ -22,6 +22,433 @@
 #define INDEXED_ACCESS
 #include "imd.h"
 
+/* In AR mode, the west buffer cell wall is needed only for covalent
+   interactions and for full neighbor lists */
+#if !defined(AR) || defined(COVALENT)
+#define WEST_BUFFERS 1
+#elif defined(NBL_FULL)
+#define WEST_BUFFERS nbl_full
+#else
+#define WEST_BUFFERS 0
+#endif
+
+/* reals per atom in position updates of the buffer cells */
+#if defined(UNIAX) && defined(VARCHG)
+#define POS_SIZE 7
+#elif defined(UNIAX)
+#define POS_SIZE 6
+#elif defined(VARCHG)
+#define POS_SIZE 4
+#else
+#define POS_SIZE 3
+#endif
+
+#if defined(MPI) && !defined(LOADBALANCE)
+
+/******************************************************************************
+*
+*  Direct exchange of the buffer cells with all 26 neighbors (direct_halo)
+*
+*  Instead of three rounds along the axes, in which edge and corner
+*  cells are forwarded, each block of buffer cells is filled by a single
+*  message from the CPU owning the cells, and all messages are posted at
+*  once. Block m holds the inner cells lo..hi, which are sent to the CPU
+*  at offset off, where they end up in the buffer cells starting at dst.
+*  Conversely, we receive block m from the CPU at offset -off. The tag
+*  tells the blocks apart if a CPU is a neighbor more than once. For
+*  send_forces, the same blocks are used in the opposite direction.
+*
+*  With direct_halo 2 (MPI-3), the block buffers of the CPUs on a node
+*  are allocated in a shared memory window, at the same offsets on all
+*  CPUs. A CPU on the same node then only announces the size of a
+*  packed block in a short message, and the receiver unpacks (or adds)
+*  it right from the memory of the sender. When done, the receiver
+*  tells the sender, which waits for this before the buffer is reused.
+*  Blocks from other nodes are still sent as messages. For testing,
+*  direct_halo_node splits a node into groups of that many CPUs, which
+*  then exchange blocks as if they were on different nodes.
+*
+******************************************************************************/
+
+#if MPI_VERSION >= 3
+#define SHM_HALO
+#endif
+
+typedef struct {
+  ivektor off;            /* offset of the CPU the block is sent to */
+  ivektor lo, hi, dst;    /* inner cells sent, first buffer cell filled */
+  int     to, from;       /* CPU to send to, and to receive from */
+  msgbuf  sbuf, rbuf;
+  real    *peer_s;        /* sbuf of CPU from, if on the same node */
+  real    *peer_r;        /* rbuf of CPU to, if on the same node */
+  int     cnt;            /* size of the block in peer_s or peer_r */
+} direct_block;
+
+static direct_block dblk[26];
+static ivektor      dblk_dim = {0,0,0};
+static int          dblk_size = 0;
+
+#ifdef SHM_HALO
+static MPI_Comm     shm_comm = MPI_COMM_NULL;
+static MPI_Win      shm_win  = MPI_WIN_NULL;
+static int          *shm_rank = NULL;  /* rank on this node, or -1 */
+
+#define SHM_SYNC() if (MPI_WIN_NULL != shm_win) MPI_Win_sync( shm_win )
+#else
+#define SHM_SYNC()
+#endif
+
+/* tag of the message telling that a shared block has been read */
+#define SHM_DONE_TAG (BUFFER_TAG + 26)
+
+/* without west buffer cells, blocks sent west are not needed */
+#define DIRECT_SKIP(b,west) ((1==(b)->off.x) && (0==(west)))
+
+#ifdef SHM_HALO
+
+/******************************************************************************
+*
+*  make_shm_blocks - block buffers in a shared memory window of the node
+*
+******************************************************************************/
+
+static void make_shm_blocks(int *size)
+{
+  MPI_Group grid_grp, shm_grp;
+  MPI_Comm  node_comm;
+  MPI_Aint  len;
+  real      *base;
+  int       m, n, disp, *ranks, off[27];
+
+  if (MPI_COMM_NULL == shm_comm) {
+    MPI_Comm_split_type( cpugrid, MPI_COMM_TYPE_SHARED, myid, MPI_INFO_NULL,
+                         &shm_comm );
+    /* smaller groups than the node, the others are reached by messages */
+    if (direct_halo_node > 0) {
+      MPI_Comm_rank( shm_comm, &n );
+      MPI_Comm_split( shm_comm, n / direct_halo_node, n, &node_comm );
+      MPI_Comm_free( &shm_comm );
+      shm_comm = node_comm;
+    }
+    shm_rank = (int *) malloc( 2 * num_cpus * sizeof(int) );
+    if (NULL==shm_rank) error("cannot allocate shared memory ranks");
+    ranks = shm_rank + num_cpus;
+    for (n=0; n<num_cpus; n++) ranks[n] = n;
+    MPI_Comm_group( cpugrid,  &grid_grp );
+    MPI_Comm_group( shm_comm, &shm_grp  );
+    MPI_Group_translate_ranks( grid_grp, num_cpus, ranks, shm_grp, shm_rank );
+    for (n=0; n<num_cpus; n++)
+      if (MPI_UNDEFINED == shm_rank[n]) shm_rank[n] = -1;
+    MPI_Group_free( &grid_grp );
+    MPI_Group_free( &shm_grp  );
+  }
+  else {
+    MPI_Win_unlock_all( shm_win );
+    MPI_Win_free( &shm_win );
+  }
+
+  /* same layout on all CPUs of the node */
+  MPI_Allreduce( MPI_IN_PLACE, size, 26, MPI_INT, MPI_MAX, shm_comm );
+  off[0] = 0;
+  for (m=0; m<26; m++) off[m+1] = off[m] + 2 * size[m];
+
+  MPI_Win_allocate_shared( off[26] * sizeof(real), sizeof(real),
+                           MPI_INFO_NULL, shm_comm, &base, &shm_win );
+  MPI_Win_lock_all( MPI_MODE_NOCHECK, shm_win );
+
+  for (m=0; m<26; m++) {
+    direct_block *b = dblk + m;
+    real *p;
+    b->sbuf.data = base + off[m];
+    b->rbuf.data = base + off[m] + size[m];
+    b->sbuf.n_max = b->rbuf.n_max = size[m];
+    b->sbuf.n     = b->rbuf.n     = 0;
+    b->peer_s = b->peer_r = NULL;
+    if (b->to == myid) continue;
+    if (shm_rank[b->from] >= 0) {
+      MPI_Win_shared_query( shm_win, shm_rank[b->from], &len, &disp, &p );
+      b->peer_s = p + off[m];
+    }
+    if (shm_rank[b->to] >= 0) {
+      MPI_Win_shared_query( shm_win, shm_rank[b->to], &len, &disp, &p );
+      b->peer_r = p + off[m] + size[m];
+    }
+  }
+}
+
+#endif /* SHM_HALO */
+
+/******************************************************************************
+*
+*  make_direct_blocks - set up the blocks and their message buffers
+*
+******************************************************************************/
+
+static void make_direct_blocks(void)
+{
+  int  m=0, pc, slack, size[26];
+  ivektor o;
+
+  /* space per cell, as in the buffers of the staged exchange; small
+     blocks cannot average over many cells, so a row of cells is added */
+  pc    = send_buf_east.n_max / (cell_dim.y * cell_dim.z) + 1;
+  slack = MAX( cell_dim.x, MAX( cell_dim.y, cell_dim.z ) );
+
+  for (o.x=-1; o.x<=1; o.x++)
+    for (o.y=-1; o.y<=1; o.y++)
+      for (o.z=-1; o.z<=1; o.z++) {
+        direct_block *b = dblk + m;
+        ivektor nb;
+        int     n;
+        if ((0==o.x) && (0==o.y) && (0==o.z)) continue;
+        b->off = o;
+#define DIRECT_RANGE(c)                                               \
+        if      (o.c < 0) { b->lo.c = b->hi.c = 1; b->dst.c = cell_dim.c-1; } \
+        else if (o.c > 0) { b->lo.c = b->hi.c = cell_dim.c-2; b->dst.c = 0; } \
+        else { b->lo.c = b->dst.c = 1; b->hi.c = cell_dim.c-2; }
+        DIRECT_RANGE(x)
+        DIRECT_RANGE(y)
+        DIRECT_RANGE(z)
+#undef DIRECT_RANGE
+        nb.x = my_coord.x + o.x; nb.y = my_coord.y + o.y; nb.z = my_coord.z + o.z;
+        b->to   = cpu_grid_coord( nb );
+        nb.x = my_coord.x - o.x; nb.y = my_coord.y - o.y; nb.z = my_coord.z - o.z;
+        b->from = cpu_grid_coord( nb );
+        n = (b->hi.x - b->lo.x + 1) * (b->hi.y - b->lo.y + 1) 
+          * (b->hi.z - b->lo.z + 1);
+        size[m] = (n + slack) * pc;
+        m++;
+      }
+
+#ifdef SHM_HALO
+  if (2==direct_halo) make_shm_blocks(size);
+  else
+#endif
+  for (m=0; m<26; m++)
+    if (dblk[m].to != myid) {
+      alloc_msgbuf( &dblk[m].sbuf, size[m] );
+      alloc_msgbuf( &dblk[m].rbuf, size[m] );
+    }
+  dblk_dim  = cell_dim;
+  dblk_size = send_buf_east.n_max;
+}
+
+/******************************************************************************
+*
+*  direct_shift - shift vector of the atoms of block b
+*
+******************************************************************************/
+
+static vektor direct_shift(direct_block *b)
+{
+  vektor v = {0.0, 0.0, 0.0};
+#ifdef NBLIST
+  if (pbc_dirs.x==1) {
+    if ((b->off.x < 0) && (my_coord.x==0)) {
+      v.x += box_x.x; v.y += box_x.y; v.z += box_x.z;
+    }
+    if ((b->off.x > 0) && (my_coord.x==cpu_dim.x-1)) {
+      v.x -= box_x.x; v.y -= box_x.y; v.z -= box_x.z;
+    }
+  }
+  if (pbc_dirs.y==1) {
+    if ((b->off.y < 0) && (my_coord.y==0)) {
+      v.x += box_y.x; v.y += box_y.y; v.z += box_y.z;
+    }
+    if ((b->off.y > 0) && (my_coord.y==cpu_dim.y-1)) {
+      v.x -= box_y.x; v.y -= box_y.y; v.z -= box_y.z;
+    }
+  }
+  if (pbc_dirs.z==1) {
+    if ((b->off.z < 0) && (my_coord.z==0)) {
+      v.x += box_z.x; v.y += box_z.y; v.z += box_z.z;
+    }
+    if ((b->off.z > 0) && (my_coord.z==cpu_dim.z-1)) {
+      v.x -= box_z.x; v.y -= box_z.y; v.z -= box_z.z;
+    }
+  }
+#endif
+  return v;
+}
+
+/* loop over the cells of block b; (i,j,k) inner cell, (r,s,t) buffer cell */
+#define DIRECT_LOOP(b)                                                  \
+  for (i=(b)->lo.x, r=(b)->dst.x; i<=(b)->hi.x; i++, r++)               \
+    for (j=(b)->lo.y, s=(b)->dst.y; j<=(b)->hi.y; j++, s++)             \
+      for (k=(b)->lo.z, t=(b)->dst.z; k<=(b)->hi.z; k++, t++)
+
+/******************************************************************************
+*
+*  send_cells_direct - fill the buffer cells by direct exchange;
+*  work_func is called once, while the messages are in flight
+*
+******************************************************************************/
+
+static void send_cells_direct(
+                void (*copy_func)  (int, int, int, int, int, int, vektor),
+                void (*pack_func)  (msgbuf*, int, int, int, vektor),
+                void (*unpack_func)(msgbuf*, int, int, int),
+                void (*work_func)  (int, int))
+{
+  MPI_Request req[26], sreq[26], dreq[26], areq[26];
+  MPI_Status  stat[26];
+  int m, n, i, j, k, r, s, t;
+
+  if ((dblk_dim.x != cell_dim.x) || (dblk_dim.y != cell_dim.y) ||
+      (dblk_dim.z != cell_dim.z) || (dblk_size != send_buf_east.n_max))
+    make_direct_blocks();
+#ifdef VEC
+  atoms.n_buf = atoms.n;
+#endif
+
+  /* post all receives and sends; blocks staying on this CPU are copied */
+  for (m=0; m<26; m++) {
+    direct_block *b = dblk + m;
+    req[m] = sreq[m] = dreq[m] = areq[m] = MPI_REQUEST_NULL;
+    if (DIRECT_SKIP(b,WEST_BUFFERS)) continue;
+    if (b->to == myid) {
+      vektor v = direct_shift(b);
+      DIRECT_LOOP(b) (*copy_func)( i, j, k, r, s, t, v );
+      continue;
+    }
+    if (b->peer_s)
+      MPI_Irecv( &b->cnt, 1, MPI_INT, b->from, BUFFER_TAG + m,
+                 cpugrid, req + m );
+    else
+      MPI_Irecv( b->rbuf.data, b->rbuf.n_max, REAL, b->from, BUFFER_TAG + m,
+                 cpugrid, req + m );
+    if (b->peer_r)
+      MPI_Irecv( NULL, 0, MPI_INT, b->to, SHM_DONE_TAG + m, cpugrid, dreq + m );
+  }
+  for (m=0; m<26; m++) {
+    direct_block *b = dblk + m;
+    vektor v;
+    if ((DIRECT_SKIP(b,WEST_BUFFERS)) || (b->to == myid)) continue;
+    v = direct_shift(b);
+    b->sbuf.n = 0;
+    DIRECT_LOOP(b) (*pack_func)( &b->sbuf, i, j, k, v );
+    if (b->peer_r) {
+      SHM_SYNC();
+      MPI_Isend( &b->sbuf.n, 1, MPI_INT, b->to, BUFFER_TAG + m,
+                 cpugrid, sreq + m );
+    }
+    else
+      MPI_Isend( b->sbuf.data, b->sbuf.n, REAL, b->to, BUFFER_TAG + m,
+                 cpugrid, sreq + m );
+  }
+
+  if (work_func) (*work_func)(0, 1);
+
+  /* unpack the blocks in the order in which they arrive */
+  for (n=0; n<26; n++) {
+    direct_block *b;
+    MPI_Waitany( 26, req, &m, stat );
+    if (MPI_UNDEFINED == m) break;
+    b = dblk + m;
+    if (b->peer_s) {
+      msgbuf p;
+      p.data = b->peer_s; p.n = 0; p.n_max = b->cnt;
+      SHM_SYNC();
+      DIRECT_LOOP(b) (*unpack_func)( &p, r, s, t );
+      MPI_Isend( NULL, 0, MPI_INT, b->from, SHM_DONE_TAG + m, cpugrid,
+                 areq + m );
+    }
+    else {
+      b->rbuf.n = 0;
+      DIRECT_LOOP(b) (*unpack_func)( &b->rbuf, r, s, t );
+    }
+  }
+  MPI_Waitall( 26, sreq, stat );
+  MPI_Waitall( 26, areq, stat );
+  /* our shared blocks must have been read before they are packed anew */
+  MPI_Waitall( 26, dreq, stat );
+}
+
+/******************************************************************************
+*
+*  send_forces_direct - add the forces in the buffer cells directly to
+*  the original cells; the blocks are added in a fixed order
+*
+******************************************************************************/
+
+static void send_forces_direct(
+                void (*add_func)   (int, int, int, int, int, int),
+                void (*pack_func)  (msgbuf*, int, int, int),
+                void (*unpack_func)(msgbuf*, int, int, int))
+{
+  MPI_Request req[26], sreq[26], dreq[26], areq[26];
+  MPI_Status  stat[26];
+#if defined(COVALENT) || defined(KIM)
+  int west = 1;
+#else
+  int west = 0;
+#endif
+  int m, i, j, k, r, s, t;
+
+  if ((dblk_dim.x != cell_dim.x) || (dblk_dim.y != cell_dim.y) ||
+      (dblk_dim.z != cell_dim.z) || (dblk_size != send_buf_east.n_max))
+    make_direct_blocks();
+
+  /* block m goes back to where it came from, and comes back from
+     where we have sent it */
+  for (m=0; m<26; m++) {
+    direct_block *b = dblk + m;
+    req[m] = sreq[m] = dreq[m] = areq[m] = MPI_REQUEST_NULL;
+    if ((DIRECT_SKIP(b,west)) || (b->to == myid)) continue;
+    if (b->peer_r)
+      MPI_Irecv( &b->cnt, 1, MPI_INT, b->to, BUFFER_TAG + m,
+                 cpugrid, req + m );
+    else
+      MPI_Irecv( b->sbuf.data, b->sbuf.n_max, REAL, b->to, BUFFER_TAG + m,
+                 cpugrid, req + m );
+    if (b->peer_s)
+      MPI_Irecv( NULL, 0, MPI_INT, b->from, SHM_DONE_TAG + m, cpugrid,
+                 dreq + m );
+  }
+  for (m=0; m<26; m++) {
+    direct_block *b = dblk + m;
+    if ((DIRECT_SKIP(b,west)) || (b->to == myid)) continue;
+    b->rbuf.n = 0;
+    DIRECT_LOOP(b) (*pack_func)( &b->rbuf, r, s, t );
+    if (b->peer_s) {
+      SHM_SYNC();
+      MPI_Isend( &b->rbuf.n, 1, MPI_INT, b->from, BUFFER_TAG + m,
+                 cpugrid, sreq + m );
+    }
+    else
+      MPI_Isend( b->rbuf.data, b->rbuf.n, REAL, b->from, BUFFER_TAG + m,
+                 cpugrid, sreq + m );
+  }
+
+  /* add the contributions, always in the same order */
+  MPI_Waitall( 26, req, stat );
+  SHM_SYNC();
+  for (m=0; m<26; m++) {
+    direct_block *b = dblk + m;
+    if (DIRECT_SKIP(b,west)) continue;
+    if (b->to == myid) {
+      DIRECT_LOOP(b) (*add_func)( r, s, t, i, j, k );
+    }
+    else if (b->peer_r) {
+      msgbuf p;
+      p.data = b->peer_r; p.n = 0; p.n_max = b->cnt;
+      DIRECT_LOOP(b) (*unpack_func)( &p, i, j, k );
+      MPI_Isend( NULL, 0, MPI_INT, b->to, SHM_DONE_TAG + m, cpugrid,
+                 areq + m );
+    }
+    else {
+      b->sbuf.n = 0;
+      DIRECT_LOOP(b) (*unpack_func)( &b->sbuf, i, j, k );
+    }
+  }
+  MPI_Waitall( 26, sreq, stat );
+  MPI_Waitall( 26, areq, stat );
+  /* our shared blocks must have been read before they are packed anew */
+  MPI_Waitall( 26, dreq, stat );
+}
+
+#endif /* MPI && !LOADBALANCE */
+
 #ifdef LOADBALANCE
 /* send_cells is located in imd_loadBalance_direct.c*/
 #else
@@ -51,6 +478,10 @@ void send_cells(void (*copy_func)  (int, int, int, int, int, int, vektor),
 
 #ifdef MPI
   MPI_Status  stat;
+  if (direct_halo) {
+    send_cells_direct(copy_func, pack_func, unpack_func, NULL);
+    return;
+  }
   empty_mpi_buffers();
 #endif
 
@@ -166,9 +597,8 @@ void send_cells(void (*copy_func)  (int, int, int, int, int, int, vektor),
     for (i=0; i < cell_dim.y; ++i)
       for (j=0; j < cell_dim.z; ++j) {
         (*copy_func)( 1, i, j, cell_dim.x-1, i, j, evec );
-#if !defined(AR) || defined(COVALENT)
-        (*copy_func)( cell_dim.x-2, i, j, 0, i, j, wvec );
-#endif
+        if (WEST_BUFFERS)
+          (*copy_func)( cell_dim.x-2, i, j, 0, i, j, wvec );
       }
   }
 #ifdef MPI
@@ -187,21 +617,21 @@ void send_cells(void (*copy_func)  (int, int, int, int, int, int, vektor),
       for (j=0; j < cell_dim.z; ++j)
         (*unpack_func)( &recv_buf_west, cell_dim.x-1, i, j );
 
-#if !defined(AR) || defined(COVALENT)
-    /* copy west atoms into send buffer */
-    for (i=0; i < cell_dim.y; ++i)
-      for (j=0; j < cell_dim.z; ++j)
-        (*pack_func)( &send_buf_west, cell_dim.x-2, i, j, wvec );
+    if (WEST_BUFFERS) {
+      /* copy west atoms into send buffer */
+      for (i=0; i < cell_dim.y; ++i)
+        for (j=0; j < cell_dim.z; ++j)
+          (*pack_func)( &send_buf_west, cell_dim.x-2, i, j, wvec );
 
-    /* send west, receive east */
-    sendrecv_buf(&send_buf_west, nbwest, &recv_buf_east, nbeast, &stat);
+      /* send west, receive east */
+      sendrecv_buf(&send_buf_west, nbwest, &recv_buf_east, nbeast, &stat);
 
-    /* unpack atoms from east */
-    recv_buf_east.n = 0;
-    for (i=0; i < cell_dim.y; ++i)
-      for (j=0; j < cell_dim.z; ++j)
-        (*unpack_func)( &recv_buf_east, 0, i, j );
-#endif
+      /* unpack atoms from east */
+      recv_buf_east.n = 0;
+      for (i=0; i < cell_dim.y; ++i)
+        for (j=0; j < cell_dim.z; ++j)
+          (*unpack_func)( &recv_buf_east, 0, i, j );
+    }
   }
 #endif
 }
@@ -223,24 +653,234 @@ void send_cells(void (*copy_func)  (int, int, int, int, int, int, vektor),
                 void (*pack_func)  (msgbuf*, int, int, int, vektor),
                 void (*unpack_func)(msgbuf*, int, int, int))
 {
-  int i,j;
+  send_cells_overlap(copy_func, pack_func, unpack_func, NULL);
+}
+
+#endif /* not SR */
+
+/******************************************************************************
+*
+*  Halo plans for send_cells_overlap
+*
+*  For each of the six directions, the cells packed into the send buffer
+*  and the buffer cells unpacked from the receive buffer are listed once
+*  per cell decomposition, in the order of the loops over the cell walls.
+*  Cell n of the send list is the source of buffer cell n of the receive
+*  list, which is used directly for the copies within a CPU. For each set
+*  of pack functions, persistent requests are kept; they are set up anew
+*  only if a message buffer or the size of a send message changes, i.e.
+*  after fix_cells has moved atoms between cells.
+*
+******************************************************************************/
+
+#define HALO_NPLANS 4   /* sets of pack functions with persistent requests */
+
+typedef struct {
+  void (*pack_func)(msgbuf*, int, int, int, vektor);
+#ifdef MPI
+  MPI_Request sreq[6], rreq[6];
+  real        *sbuf[6], *rbuf[6];
+  int         scnt[6], rcnt[6];
+#endif
+} halo_plan;
+
+static ivektor   halo_dim = {0,0,0};
+static ivektor   *halo_send[6], *halo_recv[6];
+static int       halo_ncells[6];
+static halo_plan halo_plans[HALO_NPLANS];
+static int       halo_nplans = 0;
+
+/******************************************************************************
+*
+*  make_halo_lists - cell lists of the six directions
+*
+******************************************************************************/
+
+static void make_halo_lists(void)
+{
+  int d, i, j, n;
+
+  for (d=0; d<6; d++) {
+    int dim1 = (d<4) ? cell_dim.x-2 : cell_dim.y;
+    int dim2 = (d<2) ? cell_dim.y-2 : cell_dim.z;
+    halo_ncells[d] = dim1 * dim2;
+    halo_send[d] = (ivektor *) realloc(halo_send[d], dim1*dim2*sizeof(ivektor));
+    halo_recv[d] = (ivektor *) realloc(halo_recv[d], dim1*dim2*sizeof(ivektor));
+    if ((NULL==halo_send[d]) || (NULL==halo_recv[d]))
+      error("cannot allocate halo cell lists");
+    n = 0;
+    for (i=0; i<dim1; ++i)
+      for (j=0; j<dim2; ++j) {
+        ivektor *s = halo_send[d] + n, *r = halo_recv[d] + n;
+        switch (d) {
+          /* up, down */
+          case 0: s->x=i+1; s->y=j+1; s->z=1;            r->z=cell_dim.z-1;
+                  break;
+          case 1: s->x=i+1; s->y=j+1; s->z=cell_dim.z-2; r->z=0;
+                  break;
+          /* north, south */
+          case 2: s->x=i+1; s->y=1;            s->z=j;   r->y=cell_dim.y-1;
+                  break;
+          case 3: s->x=i+1; s->y=cell_dim.y-2; s->z=j;   r->y=0;
+                  break;
+          /* east, west */
+          case 4: s->x=1;            s->y=i;   s->z=j;   r->x=cell_dim.x-1;
+                  break;
+          case 5: s->x=cell_dim.x-2; s->y=i;   s->z=j;   r->x=0;
+                  break;
+        }
+        if (d>=2) r->z = s->z;
+        if ((d<2) || (d>=4)) r->y = s->y;
+        if (d<4) r->x = s->x;
+        n++;
+      }
+  }
+  halo_dim = cell_dim;
+}
+
+/******************************************************************************
+*
+*  get_halo_plan - persistent requests for a set of pack functions
+*
+******************************************************************************/
+
+static halo_plan *get_halo_plan(void (*pack_func)(msgbuf*,int,int,int,vektor))
+{
+  static int next = 0;
+  halo_plan *h;
+  int d;
+
+  for (d=0; d<halo_nplans; d++)
+    if (halo_plans[d].pack_func == pack_func) return halo_plans + d;
+
+  /* take a new plan, or recycle the oldest one */
+  if (halo_nplans < HALO_NPLANS) h = halo_plans + halo_nplans++;
+  else {
+    h = halo_plans + next;
+    next = (next + 1) % HALO_NPLANS;
+#ifdef MPI
+    for (d=0; d<6; d++) {
+      if (h->sbuf[d]) MPI_Request_free( &h->sreq[d] );
+      if (h->rbuf[d]) MPI_Request_free( &h->rreq[d] );
+    }
+#endif
+  }
+  memset( h, 0, sizeof(halo_plan) );
+  h->pack_func = pack_func;
+  return h;
+}
+
+#ifdef MPI
+
+/******************************************************************************
+*
+*  start_halo - pack the cells of direction d and start its messages
+*
+******************************************************************************/
+
+static void start_halo(halo_plan *h, int d, msgbuf *s, int to, msgbuf *r,
+                       int from, vektor v,
+                       void (*pack_func)(msgbuf*, int, int, int, vektor))
+{
+  ivektor *c = halo_send[d];
+  int     n;
+
+  for (n=0; n<halo_ncells[d]; n++) (*pack_func)( s, c[n].x, c[n].y, c[n].z, v );
+
+  /* set up persistent requests if the messages have changed */
+  if ((h->rbuf[d] != r->data) || (h->rcnt[d] != r->n_max)) {
+    if (h->rbuf[d]) MPI_Request_free( &h->rreq[d] );
+    MPI_Recv_init( r->data, r->n_max, REAL, from, BUFFER_TAG, cpugrid,
+                   &h->rreq[d] );
+    h->rbuf[d] = r->data;
+    h->rcnt[d] = r->n_max;
+  }
+  if ((h->sbuf[d] != s->data) || (h->scnt[d] != s->n)) {
+    if (h->sbuf[d]) MPI_Request_free( &h->sreq[d] );
+    MPI_Send_init( s->data, s->n, REAL, to, BUFFER_TAG, cpugrid,
+                   &h->sreq[d] );
+    h->sbuf[d] = s->data;
+    h->scnt[d] = s->n;
+  }
+  MPI_Start( &h->rreq[d] );
+  MPI_Start( &h->sreq[d] );
+}
+
+/******************************************************************************
+*
+*  finish_halo - wait for the messages of direction d, unpack buffer cells
+*
+******************************************************************************/
+
+static void finish_halo(halo_plan *h, int d, msgbuf *r,
+                        void (*unpack_func)(msgbuf*, int, int, int))
+{
+  MPI_Status stat;
+  ivektor    *c = halo_recv[d];
+  int        n;
+
+  MPI_Wait( &h->rreq[d], &stat );
+  MPI_Wait( &h->sreq[d], &stat );
+  r->n = 0;
+  for (n=0; n<halo_ncells[d]; n++) (*unpack_func)( r, c[n].x, c[n].y, c[n].z );
+}
+
+#endif /* MPI */
+
+/******************************************************************************
+*
+*  copy_halo - copy the cells of direction d within the CPU
+*
+******************************************************************************/
+
+static void copy_halo(int d, vektor v,
+                      void (*copy_func)(int, int, int, int, int, int, vektor))
+{
+  ivektor *s = halo_send[d], *r = halo_recv[d];
+  int     n;
+
+  for (n=0; n<halo_ncells[d]; n++)
+    (*copy_func)( s[n].x, s[n].y, s[n].z, r[n].x, r[n].y, r[n].z, v );
+}
+
+/******************************************************************************
+*
+*  send_cells_overlap - like send_cells, but while the messages of each
+*  direction are in flight, work_func(part, nparts) is called, so that
+*  computations not depending on the buffer cells (e.g. the forces in
+*  the interior cells) can be overlapped with the communication. Each
+*  part 0..nparts-1 is done exactly once; without communicating
+*  directions, work_func(0,1) is called after the buffer cells are filled.
+*  Used by the non-SR send_cells with work_func==NULL.
+*
+******************************************************************************/
+
+void send_cells_overlap(
+                void (*copy_func)  (int, int, int, int, int, int, vektor),
+                void (*pack_func)  (msgbuf*, int, int, int, vektor),
+                void (*unpack_func)(msgbuf*, int, int, int),
+                void (*work_func)  (int, int))
+{
+  int part=0, nparts=0;
+  halo_plan *h;
 
   vektor uvec={0,0,0}, dvec={0,0,0};
   vektor nvec={0,0,0}, svec={0,0,0};
   vektor evec={0,0,0}, wvec={0,0,0};
 
 #ifdef MPI
-  MPI_Status  stateast[2],  statwest[2];
-  MPI_Status statnorth[2], statsouth[2];
-  MPI_Status    statup[2],  statdown[2];
-
-  MPI_Request  reqeast[2],   reqwest[2];
-  MPI_Request reqnorth[2],  reqsouth[2];
-  MPI_Request    requp[2],   reqdown[2];
-
+  if (direct_halo) {
+    send_cells_direct(copy_func, pack_func, unpack_func, work_func);
+    return;
+  }
   empty_mpi_buffers();
+  nparts = (cpu_dim.x > 1) + (cpu_dim.y > 1) + (cpu_dim.z > 1);
 #endif
 
+  if ((halo_dim.x != cell_dim.x) || (halo_dim.y != cell_dim.y) ||
+      (halo_dim.z != cell_dim.z)) make_halo_lists();
+  h = get_halo_plan(pack_func);
+
 #ifdef VEC
   atoms.n_buf = atoms.n;
 #endif
@@ -268,134 +908,66 @@ void send_cells(void (*copy_func)  (int, int, int, int, int, int, vektor),
   /* exchange up/down */
   if (cpu_dim.z==1) {
     /* simply copy up/down atoms to buffer cells*/
-    for (i=1; i < cell_dim.x-1; ++i)
-      for (j=1; j < cell_dim.y-1; ++j) {
-        (*copy_func)( i, j, 1, i, j, cell_dim.z-1, uvec );
-        (*copy_func)( i, j, cell_dim.z-2, i, j, 0, dvec );
-      }
+    copy_halo( 0, uvec, copy_func );
+    copy_halo( 1, dvec, copy_func );
   }
 #ifdef MPI
   else {
-    /* copy up atoms into send buffer, send up */
-    for (i=1; i < cell_dim.x-1; ++i)
-      for (j=1; j < cell_dim.y-1; ++j)
-        (*pack_func)( &send_buf_up, i, j, 1, uvec );
-    irecv_buf( &recv_buf_down , nbdown, &reqdown[1]);
-    isend_buf( &send_buf_up   , nbup  , &reqdown[0]);
-
-    /* copy down atoms into send buffer, send down */
-    for (i=1; i < cell_dim.x-1; ++i)
-      for (j=1; j < cell_dim.y-1; ++j)
-        (*pack_func)( &send_buf_down, i, j, cell_dim.z-2, dvec );
-    irecv_buf( &recv_buf_up  , nbup  , &requp[1] );
-    isend_buf( &send_buf_down, nbdown, &requp[0] );
-
-    /* wait for atoms from down, move them to buffer cells */
-    MPI_Waitall(2, reqdown, statdown);
-    recv_buf_down.n = 0;
-    for (i=1; i < cell_dim.x-1; ++i)
-      for (j=1; j < cell_dim.y-1; ++j)
-        (*unpack_func)( &recv_buf_down, i, j, cell_dim.z-1 );
-
-    /* wait for atoms from up, move them to buffer cells*/
-    MPI_Waitall(2, requp, statup);
-    recv_buf_up.n = 0;
-    for (i=1; i < cell_dim.x-1; ++i)
-      for (j=1; j < cell_dim.y-1; ++j)
-        (*unpack_func)( &recv_buf_up, i, j, 0 );
+    /* send up and down, receive from down and up */
+    start_halo( h, 0, &send_buf_up,   nbup,   &recv_buf_down, nbdown, 
+                uvec, pack_func );
+    start_halo( h, 1, &send_buf_down, nbdown, &recv_buf_up,   nbup,
+                dvec, pack_func );
+    if (work_func) (*work_func)(part++, nparts);
+    finish_halo( h, 0, &recv_buf_down, unpack_func );
+    finish_halo( h, 1, &recv_buf_up,   unpack_func );
   }
 #endif
 
   /* exchange north/south */
   if (cpu_dim.y==1) {
     /* simply copy north/south atoms to buffer cells */
-    for (i=1; i < cell_dim.x-1; ++i)
-      for (j=0; j < cell_dim.z; ++j) {
-        (*copy_func)( i, 1, j, i, cell_dim.y-1, j, nvec );
-        (*copy_func)( i, cell_dim.y-2, j, i, 0, j, svec );
-      }
+    copy_halo( 2, nvec, copy_func );
+    copy_halo( 3, svec, copy_func );
   }
 #ifdef MPI
   else {
-    /* copy north atoms into send buffer, send north */
-    for (i=1; i < cell_dim.x-1; ++i)
-      for (j=0; j < cell_dim.z; ++j)
-        (*pack_func)( &send_buf_north, i, 1, j, nvec );
-    irecv_buf( &recv_buf_south, nbsouth, &reqsouth[1] );
-    isend_buf( &send_buf_north, nbnorth, &reqsouth[0] );
-
-    /* copy south atoms into send buffer, send south*/
-    for (i=1; i < cell_dim.x-1; ++i)
-      for (j=0; j < cell_dim.z; ++j)
-        (*pack_func)( &send_buf_south, i, cell_dim.y-2, j, svec );
-    irecv_buf( &recv_buf_north, nbnorth, &reqnorth[1] );
-    isend_buf( &send_buf_south, nbsouth, &reqnorth[0] );
-
-    /* wait for atoms from south, move them to buffer cells */
-    MPI_Waitall(2, reqsouth, statsouth);
-    recv_buf_south.n = 0;
-    for (i=1; i < cell_dim.x-1; ++i)
-      for (j=0; j < cell_dim.z; ++j)
-        (*unpack_func)( &recv_buf_south, i, cell_dim.y-1, j );
-
-    /* wait for atoms from north, move them to buffer cells*/
-    MPI_Waitall(2, reqnorth, statnorth);
-    recv_buf_north.n = 0;
-    for (i=1; i < cell_dim.x-1; ++i)
-      for (j=0; j < cell_dim.z; ++j)
-        (*unpack_func)( &recv_buf_north, i, 0, j );
+    /* send north and south, receive from south and north */
+    start_halo( h, 2, &send_buf_north, nbnorth, &recv_buf_south, nbsouth, 
+                nvec, pack_func );
+    start_halo( h, 3, &send_buf_south, nbsouth, &recv_buf_north, nbnorth,
+                svec, pack_func );
+    if (work_func) (*work_func)(part++, nparts);
+    finish_halo( h, 2, &recv_buf_south, unpack_func );
+    finish_halo( h, 3, &recv_buf_north, unpack_func );
   }
 #endif
 
   /* exchange east/west*/
   if (cpu_dim.x==1) {
-  /* simply copy east/west atoms to buffer cells*/
-    for (i=0; i < cell_dim.y; ++i)
-      for (j=0; j < cell_dim.z; ++j) {
-        (*copy_func)( 1, i, j, cell_dim.x-1, i, j, evec );
-#if !defined(AR) || defined(COVALENT)
-        (*copy_func)( cell_dim.x-2, i, j, 0, i, j, wvec );
-#endif
-      }
+    /* simply copy east/west atoms to buffer cells*/
+    copy_halo( 4, evec, copy_func );
+    if (WEST_BUFFERS) copy_halo( 5, wvec, copy_func );
   }
 #ifdef MPI
   else {
-  /* copy east atoms into send buffer, send east*/
-    for (i=0; i < cell_dim.y; ++i)
-      for (j=0; j < cell_dim.z; ++j)
-        (*pack_func)( &send_buf_east, 1, i, j, evec );
-    irecv_buf( &recv_buf_west, nbwest, &reqwest[1] );
-    isend_buf( &send_buf_east, nbeast, &reqwest[0] );
-
-#if !defined(AR) || defined(COVALENT)
-    /* copy west atoms into send buffer, send west*/
-    for (i=0; i < cell_dim.y; ++i)
-      for (j=0; j < cell_dim.z; ++j)
-        (*pack_func)( &send_buf_west, cell_dim.x-2, i, j, wvec );
-    irecv_buf( &recv_buf_east, nbeast, &reqeast[1] );
-    isend_buf( &send_buf_west, nbwest, &reqeast[0] );
-#endif
-
-    /* wait for atoms from west, move them to buffer cells*/
-    MPI_Waitall(2, reqwest, statwest);
-    recv_buf_west.n = 0;
-    for (i=0; i < cell_dim.y; ++i)
-      for (j=0; j < cell_dim.z; ++j)
-        (*unpack_func)( &recv_buf_west, cell_dim.x-1, i, j );
-
-#if !defined(AR) || defined(COVALENT)
-    /* wait for atoms from east, move them to buffer cells*/
-    MPI_Waitall(2, reqeast, stateast);
-    recv_buf_east.n = 0;
-    for (i=0; i < cell_dim.y; ++i)
-      for (j=0; j < cell_dim.z; ++j)
-        (*unpack_func)( &recv_buf_east, 0, i, j );
-#endif
+    /* send east and west, receive from west and east */
+    start_halo( h, 4, &send_buf_east, nbeast, &recv_buf_west, nbwest, 
+                evec, pack_func );
+    if (WEST_BUFFERS)
+      start_halo( h, 5, &send_buf_west, nbwest, &recv_buf_east, nbeast,
+                  wvec, pack_func );
+    if (work_func) (*work_func)(part++, nparts);
+    finish_halo( h, 4, &recv_buf_west, unpack_func );
+    if (WEST_BUFFERS)
+      finish_halo( h, 5, &recv_buf_east, unpack_func );
   }
 #endif
+
+  /* without messages, there is nothing to overlap with */
+  if ((work_func) && (0==nparts)) (*work_func)(0, 1);
 }
 
-#endif /* not SR */
 #endif /*not LOADBALANCE*/
 
 #ifdef LOADBALANCE
@@ -422,6 +994,10 @@ void send_forces(void (*add_func)   (int, int, int, int, int, int),
 
 #ifdef MPI
   MPI_Status  stat;
+  if (direct_halo) {
+    send_forces_direct(add_func, pack_func, unpack_func);
+    return;
+  }
   empty_mpi_buffers();
 #endif
 
@@ -581,6 +1157,10 @@ void send_forces(void (*add_func)   (int, int, int, int, int, int),
   MPI_Request reqnorth[2],  reqsouth[2];
   MPI_Request    requp[2],   reqdown[2];
 
+  if (direct_halo) {
+    send_forces_direct(add_func, pack_func, unpack_func);
+    return;
+  }
   empty_mpi_buffers();
 #endif
 
@@ -888,6 +1468,188 @@ void unpack_cell( msgbuf *b, int k, int l, int m )
     error("Buffer overflow in unpack_cell - increase msgbuf_size");
 }
 
+#ifdef NBLIST
+
+/******************************************************************************
+*
+*  copy positions of one cell to the same atoms in another (buffer) cell;
+*  as long as the neighbor list is valid, the buffer cells keep their
+*  atoms in the same order, so that everything else is still there
+*
+******************************************************************************/
+
+void copy_pos( int k, int l, int m, int r, int s, int t, vektor v )
+{
+  int i;
+  minicell *from, *to;
+
+  from = PTR_3D_V(cell_array, k, l, m, cell_dim);
+  to   = PTR_3D_V(cell_array, r, s, t, cell_dim);
+
+  for (i=0; i<to->n; ++i) {
+    ORT(to,i,X)   = ORT(from,i,X) + v.x;
+    ORT(to,i,Y)   = ORT(from,i,Y) + v.y;
+    ORT(to,i,Z)   = ORT(from,i,Z) + v.z;
+#ifdef UNIAX
+    ACHSE(to,i,X) = ACHSE(from,i,X);
+    ACHSE(to,i,Y) = ACHSE(from,i,Y);
+    ACHSE(to,i,Z) = ACHSE(from,i,Z);
+#endif
+#ifdef VARCHG
+    CHARGE(to,i)  = CHARGE(from,i);
+#endif
+  }
+}
+
+/******************************************************************************
+*
+*  pack positions into MPI buffer, without atom numbers and types
+*
+******************************************************************************/
+
+void pack_pos( msgbuf *b, int k, int l, int m, vektor v )
+{
+  int i, j = b->n;
+  minicell *from;
+
+  from = PTR_3D_V(cell_array, k, l, m, cell_dim);
+
+  if (b->n_max < j + from->n * POS_SIZE)
+    error("Buffer overflow in pack_pos - increase msgbuf_size");
+
+  for (i=0; i<from->n; ++i) {
+    b->data[ j++ ] = ORT(from,i,X) + v.x;
+    b->data[ j++ ] = ORT(from,i,Y) + v.y;
+    b->data[ j++ ] = ORT(from,i,Z) + v.z;
+#ifdef UNIAX
+    b->data[ j++ ] = ACHSE(from,i,X);
+    b->data[ j++ ] = ACHSE(from,i,Y);
+    b->data[ j++ ] = ACHSE(from,i,Z);
+#endif
+#ifdef VARCHG
+    b->data[ j++ ] = CHARGE(from,i);
+#endif
+  }
+  b->n = j;
+}
+
+/******************************************************************************
+*
+*  unpack positions from MPI buffer into the atoms of a buffer cell
+*
+******************************************************************************/
+
+void unpack_pos( msgbuf *b, int k, int l, int m )
+{
+  int i, j = b->n;
+  minicell *to;
+
+  to = PTR_3D_V(cell_array, k, l, m, cell_dim);
+
+  if (b->n_max < j + to->n * POS_SIZE)
+    error("Buffer overflow in unpack_pos - increase msgbuf_size");
+
+  for (i=0; i<to->n; ++i) {
+    ORT(to,i,X)   = b->data[ j++ ];
+    ORT(to,i,Y)   = b->data[ j++ ];
+    ORT(to,i,Z)   = b->data[ j++ ];
+#ifdef UNIAX
+    ACHSE(to,i,X) = b->data[ j++ ];
+    ACHSE(to,i,Y) = b->data[ j++ ];
+    ACHSE(to,i,Z) = b->data[ j++ ];
+#endif
+#ifdef VARCHG
+    CHARGE(to,i)  = b->data[ j++ ];
+#endif
+  }
+  b->n = j;
+}
+
+/******************************************************************************
+*
+*  copy neighbor list reference positions of one cell to another cell,
+*  and mark the target cell if they have changed
+*
+******************************************************************************/
+
+void copy_nblpos( int k, int l, int m, int r, int s, int t, vektor v )
+{
+  int i, moved=0;
+  minicell *from, *to;
+  vektor x;
+
+  from = PTR_3D_V(cell_array, k, l, m, cell_dim);
+  to   = PTR_3D_V(cell_array, r, s, t, cell_dim);
+
+  for (i=0; i<to->n; ++i) {
+    x.x = NBL_POS(from,i,X) + v.x;
+    x.y = NBL_POS(from,i,Y) + v.y;
+    x.z = NBL_POS(from,i,Z) + v.z;
+    if ((x.x != NBL_POS(to,i,X)) || (x.y != NBL_POS(to,i,Y)) || 
+        (x.z != NBL_POS(to,i,Z))) moved = 1;
+    NBL_POS(to,i,X) = x.x;
+    NBL_POS(to,i,Y) = x.y;
+    NBL_POS(to,i,Z) = x.z;
+  }
+  if (moved) nbl_moved[ to - cell_array ] = 1;
+}
+
+/******************************************************************************
+*
+*  pack neighbor list reference positions into MPI buffer
+*
+******************************************************************************/
+
+void pack_nblpos( msgbuf *b, int k, int l, int m, vektor v )
+{
+  int i, j = b->n;
+  minicell *from;
+
+  from = PTR_3D_V(cell_array, k, l, m, cell_dim);
+
+  for (i=0; i<from->n; ++i) {
+    b->data[ j++ ] = NBL_POS(from,i,X) + v.x;
+    b->data[ j++ ] = NBL_POS(from,i,Y) + v.y;
+    b->data[ j++ ] = NBL_POS(from,i,Z) + v.z;
+  }
+  b->n = j;
+  if (b->n_max < b->n)
+    error("Buffer overflow in pack_nblpos - increase msgbuf_size");
+}
+
+/******************************************************************************
+*
+*  unpack neighbor list reference positions from MPI buffer into cell,
+*  and mark the cell if they have changed
+*
+******************************************************************************/
+
+void unpack_nblpos( msgbuf *b, int k, int l, int m )
+{
+  int i, j = b->n, moved=0;
+  minicell *to;
+  vektor x;
+
+  to = PTR_3D_V(cell_array, k, l, m, cell_dim);
+
+  for (i=0; i<to->n; ++i) {
+    x.x = b->data[ j++ ];
+    x.y = b->data[ j++ ];
+    x.z = b->data[ j++ ];
+    if ((x.x != NBL_POS(to,i,X)) || (x.y != NBL_POS(to,i,Y)) || 
+        (x.z != NBL_POS(to,i,Z))) moved = 1;
+    NBL_POS(to,i,X) = x.x;
+    NBL_POS(to,i,Y) = x.y;
+    NBL_POS(to,i,Z) = x.z;
+  }
+  if (moved) nbl_moved[ to - cell_array ] = 1;
+  b->n = j;
+  if (b->n_max < b->n)
+    error("Buffer overflow in unpack_nblpos - increase msgbuf_size");
+}
+
+#endif /* NBLIST */
+
 /******************************************************************************
 *
 *  add forces of one cell to those of another cell
@@ -0,0 +1,355 @@
+/******************************************************************************
+*
+* IMD -- The ITAP Molecular Dynamics Program
+*
+* Copyright 1996-2012 Institute for Theoretical and Applied Physics,
+* University of Stuttgart, D-70550 Stuttgart
+*
+******************************************************************************/
+
+/******************************************************************************
+*
+* imd_delta.c -- delta checkpoints between full checkpoints (option delta)
+*
+*  With delta_checkpt > 0, every delta_checkpt-th numbered checkpoint is
+*  a full one; the checkpoints in between are written to .dchkpt files,
+*  which contain only the atoms that moved since the last full checkpoint.
+*  For each such atom, the file holds its number and its displacement
+*  and change of velocity, as integer multiples of delta_eps_pos and
+*  delta_eps_vel. The header names the full checkpoint, which must be
+*  kept. Restoring a delta checkpoint reproduces positions and velocities
+*  within half a quantum, plus the rounding of the full checkpoint.
+*  The Epot column is that of the full checkpoint.
+*
+*  The reference positions move with the atoms, and are shifted with them
+*  at periodic boundaries, so that displacements stay small. If the number
+*  of atoms has changed, or after a restart from a full checkpoint, a full
+*  checkpoint is written instead. A restart from a delta checkpoint reads
+*  its full checkpoint, which stays the reference.
+*
+******************************************************************************/
+
+/******************************************************************************
+* $Revision$
+* $Date$
+******************************************************************************/
+
+#include "imd.h"
+
+/* integer multiple of eps closest to x */
+static integer quantize(real x, real eps)
+{
+  real q = rint(x / eps);
+  if (fabs(q) > 2147483647.0)
+    error("displacement too large for delta checkpoint");
+  return (integer) q;
+}
+
+/******************************************************************************
+*
+*  set_delta_ref - make the current atoms, which are those of the full
+*  checkpoint delta_base, the reference of the following delta checkpoints
+*
+******************************************************************************/
+
+void set_delta_ref(void)
+{
+  real qp = 0.0, qv = 0.0;
+  int  k;
+
+#ifdef ZLIB
+  /* the reference is what is stored in a quantized checkpoint */
+  qp = out_zip_pos;
+  qv = out_zip_vel;
+#endif
+#define QREF(x,q) (((q) > 0.0) ? (q) * rint((x) / (q)) : (x))
+  for (k=0; k<NCELLS; k++) {
+    int  i;
+    cell *p = CELLPTR(k);
+    for (i=0; i<p->n; i++) {
+      DLT_POS(p,i,X) = QREF( ORT(p,i,X), qp );
+      DLT_POS(p,i,Y) = QREF( ORT(p,i,Y), qp );
+#ifndef TWOD
+      DLT_POS(p,i,Z) = QREF( ORT(p,i,Z), qp );
+#endif
+      if (ensemble != ENS_CG) {
+        DLT_VEL(p,i,X) = QREF( IMPULS(p,i,X) / MASSE(p,i), qv );
+        DLT_VEL(p,i,Y) = QREF( IMPULS(p,i,Y) / MASSE(p,i), qv );
+#ifndef TWOD
+        DLT_VEL(p,i,Z) = QREF( IMPULS(p,i,Z) / MASSE(p,i), qv );
+#endif
+      }
+    }
+  }
+#undef QREF
+  delta_natoms = natoms;
+}
+
+/******************************************************************************
+*
+*  write_header_delta - header of a delta checkpoint
+*
+******************************************************************************/
+
+static void write_header_delta(FILE *out)
+{
+  int nv = (ensemble != ENS_CG) ? DIM : 0;
+
+  fprintf(out, "#F D %c %d %d\n", is_big_endian ? 'B' : 'L', DIM, nv);
+#ifdef TWOD
+  fprintf(out, "#C number dx dy%s\n", nv ? " dvx dvy" : "");
+#else
+  fprintf(out, "#C number dx dy dz%s\n", nv ? " dvx dvy dvz" : "");
+#endif
+  fprintf(out, "#B %s\n", delta_base);
+  fprintf(out, "#Q %.16e %.16e\n", delta_eps_pos, delta_eps_vel);
+#ifdef TWOD
+  fprintf(out, "#X \t%.16e %.16e\n", box_x.x , box_x.y);
+  fprintf(out, "#Y \t%.16e %.16e\n", box_y.x , box_y.y);
+#else
+  fprintf(out, "#X \t%.16e %.16e %.16e\n", box_x.x , box_x.y , box_x.z);
+  fprintf(out, "#Y \t%.16e %.16e %.16e\n", box_y.x , box_y.y , box_y.z);
+  fprintf(out, "#Z \t%.16e %.16e %.16e\n", box_z.x , box_z.y , box_z.z);
+#endif
+  fprintf(out, "#E\n");
+}
+
+/******************************************************************************
+*
+*  write_atoms_delta - write the records of the atoms which moved
+*
+******************************************************************************/
+
+static void write_atoms_delta(FILE *out)
+{
+  int k, len=0;
+
+  for (k=0; k<NCELLS; k++) {
+    int  i, n, m;
+    cell *p = CELLPTR(k);
+    for (i=0; i<p->n; i++) {
+      integer *data = (integer *) (outbuf+len);
+      n = 0;
+      data[n++] = NUMMER(p,i);
+      data[n++] = quantize( ORT(p,i,X) - DLT_POS(p,i,X), delta_eps_pos );
+      data[n++] = quantize( ORT(p,i,Y) - DLT_POS(p,i,Y), delta_eps_pos );
+#ifndef TWOD
+      data[n++] = quantize( ORT(p,i,Z) - DLT_POS(p,i,Z), delta_eps_pos );
+#endif
+      if (ensemble != ENS_CG) {
+        data[n++] = quantize( IMPULS(p,i,X) / MASSE(p,i) - DLT_VEL(p,i,X),
+                              delta_eps_vel );
+        data[n++] = quantize( IMPULS(p,i,Y) / MASSE(p,i) - DLT_VEL(p,i,Y),
+                              delta_eps_vel );
+#ifndef TWOD
+        data[n++] = quantize( IMPULS(p,i,Z) / MASSE(p,i) - DLT_VEL(p,i,Z),
+                              delta_eps_vel );
+#endif
+      }
+      /* keep the record only if something changed */
+      for (m=1; (m<n) && (0==data[m]); m++);
+      if (m<n) len += n * sizeof(integer);
+      /* flush or send outbuf if it is full */
+      if (len > outbuf_size - 256) flush_outbuf(out,&len,OUTBUF_TAG);
+    }
+  }
+  flush_outbuf(out,&len,OUTBUF_TAG+1);
+}
+
+/******************************************************************************
+*
+*  write_delta - write checkpoint fzhlr as delta checkpoint, if it
+*  should be one; returns 0 if a full checkpoint is needed
+*
+******************************************************************************/
+
+int write_delta(int fzhlr)
+{
+  int uh = use_header;
+
+  if ((delta_checkpt <= 0) || (fzhlr < 0) || ('\0' == delta_base[0]))
+    return 0;
+  if ((0 == fzhlr % delta_checkpt) || (natoms != delta_natoms)) return 0;
+
+  /* a delta is useless without the name of its full checkpoint */
+  use_header = 1;
+  write_config_select(fzhlr, "dchkpt", write_atoms_delta, write_header_delta);
+  use_header = uh;
+  return 1;
+}
+
+/******************************************************************************
+*
+*  is_delta_config - is fname a delta checkpoint?
+*
+******************************************************************************/
+
+int is_delta_config(char *fname)
+{
+  int n = strlen(fname);
+  return (n > 7) && (0 == strcmp(fname + n - 7, ".dchkpt"));
+}
+
+/* compare the atom numbers of two delta records */
+static int cmp_delta(const void *a, const void *b)
+{
+  integer x = *(const integer *) a, y = *(const integer *) b;
+  return (x > y) - (x < y);
+}
+
+/******************************************************************************
+*
+*  read_delta_records - read the header and records of a delta checkpoint
+*  on CPU 0; returns the records, and their number in *nrec
+*
+******************************************************************************/
+
+static integer *read_delta_records(char *infilename, int *nv, real *eps,
+                                   long *nrec)
+{
+  FILE    *in;
+  str255  line, fname;
+  integer *rec = NULL;
+  long    max = 0, n = 0;
+  int     dim = 0, swap = 0, head = 0, part = 0, rlen, got;
+  char    c = 'L';
+
+#ifdef MPI
+  /* with parallel_output 1, the records are in per group files */
+  if (1==parallel_input) {
+    sprintf(fname, "%s.head", infilename);
+    in = fopen(fname, "r");
+    if (NULL != in) head = 1;
+    else in = fopen(infilename, "r");
+  } else
+#endif
+  in = fopen(infilename, "r");
+  if (NULL==in) error_str("cannot open input file %s", infilename);
+
+  delta_base[0] = '\0';
+  eps[0] = eps[1] = 0.0;
+  while (NULL != fgets(line, sizeof(str255), in)) {
+    if (line[0] != '#') error_str("Header of delta file %s corrupt",
+                                  infilename);
+    if      (line[1]=='F') sscanf(line+2, " D %c %d %d", &c, &dim, nv);
+    else if (line[1]=='B') sscanf(line+2, "%254s", delta_base);
+    else if (line[1]=='Q') {
+      double e0, e1;
+      sscanf(line+2, "%lf %lf", &e0, &e1);
+      eps[0] = e0; eps[1] = e1;
+    }
+    else if (line[1]=='E') break;
+  }
+  if ((dim != DIM) || ('\0' == delta_base[0]) || (eps[0] <= 0.0))
+    error_str("Header of delta file %s corrupt", infilename);
+  swap = ((c == 'B') != (is_big_endian != 0));
+  rlen = 1 + DIM + *nv;
+
+  /* read the records, from this file or from the per group files */
+  while (1) {
+    if (head) {
+      fclose(in);
+      sprintf(fname, "%s.%d", infilename, part++);
+      in = fopen(fname, "r");
+      if (NULL==in) break;
+    }
+    do {
+      if (n + 1024 * rlen > max) {
+        max = 2 * max + 1024 * rlen;
+        rec = (integer *) realloc(rec, max * sizeof(integer));
+        if (NULL==rec) error("cannot allocate delta records");
+      }
+      got = fread(rec + n, sizeof(integer), 1024 * rlen, in);
+      n  += got;
+    } while (got > 0);
+    if (!head) { fclose(in); break; }
+  }
+  if (n % rlen) error_str("Delta file %s truncated", infilename);
+  if (swap) {
+    long i;
+    for (i=0; i<n; i++) rec[i] = SwappedInteger(rec[i]);
+  }
+  *nrec = n / rlen;
+  return rec;
+}
+
+/******************************************************************************
+*
+*  read_delta - restore a delta checkpoint: read its full checkpoint,
+*  make it the reference, and apply the displacements
+*
+******************************************************************************/
+
+void read_delta(char *infilename)
+{
+  integer *rec = NULL;
+  long    nrec = 0;
+  int     nv = 0, rlen, k, bfh = box_from_header;
+#ifdef MPI
+  long    m, len;
+#endif
+  real    eps[2] = {0.0, 0.0};
+
+  if (0==myid) {
+    rec = read_delta_records(infilename, &nv, eps, &nrec);
+    printf("Delta checkpoint %s: %ld atoms moved since %s.\n",
+           infilename, nrec, delta_base);
+    fflush(stdout);
+  }
+#ifdef MPI
+  MPI_Bcast( delta_base, 255, MPI_CHAR, 0, MPI_COMM_WORLD);
+  MPI_Bcast( &nv,      1, MPI_INT,  0, MPI_COMM_WORLD);
+  MPI_Bcast( eps,      2, REAL,     0, MPI_COMM_WORLD);
+  MPI_Bcast( &nrec,    1, MPI_LONG, 0, MPI_COMM_WORLD);
+#endif
+  rlen = 1 + DIM + nv;
+#ifdef MPI
+  if (0!=myid) {
+    rec = (integer *) malloc( (nrec * rlen + 1) * sizeof(integer) );
+    if (NULL==rec) error("cannot allocate delta records");
+  }
+  /* in pieces, as the number of items may exceed an int */
+  for (m=0; m<nrec * rlen; m+=len) {
+    len = MIN( nrec * rlen - m, 1L << 30 );
+    MPI_Bcast( rec + m, (int) len, INTEGER, 0, MPI_COMM_WORLD);
+  }
+#endif
+
+  /* the atoms of the full checkpoint, in the box of the delta */
+  if (box_from_header) read_box(infilename);
+  box_from_header = 0;
+  read_atoms(delta_base);
+  box_from_header = bfh;
+  set_delta_ref();
+
+  /* apply the displacements */
+  qsort(rec, nrec, rlen * sizeof(integer), cmp_delta);
+  for (k=0; k<NCELLS; k++) {
+    int     i;
+    integer key, *r;
+    cell    *p = CELLPTR(k);
+    for (i=0; i<p->n; i++) {
+      key = NUMMER(p,i);
+      r = (integer *) bsearch(&key, rec, nrec, rlen * sizeof(integer),
+                              cmp_delta);
+      if (NULL==r) continue;
+      ORT(p,i,X) = DLT_POS(p,i,X) + r[1] * eps[0];
+      ORT(p,i,Y) = DLT_POS(p,i,Y) + r[2] * eps[0];
+#ifndef TWOD
+      ORT(p,i,Z) = DLT_POS(p,i,Z) + r[3] * eps[0];
+#endif
+      if ((nv) && (ensemble != ENS_CG)) {
+        IMPULS(p,i,X) = (DLT_VEL(p,i,X) + r[1+DIM] * eps[1]) * MASSE(p,i);
+        IMPULS(p,i,Y) = (DLT_VEL(p,i,Y) + r[2+DIM] * eps[1]) * MASSE(p,i);
+#ifndef TWOD
+        IMPULS(p,i,Z) = (DLT_VEL(p,i,Z) + r[3+DIM] * eps[1]) * MASSE(p,i);
+#endif
+      }
+    }
+  }
+  free(rec);
+
+  /* moved atoms may belong to other cells now */
+  do_boundaries();
+  fix_cells();
+}
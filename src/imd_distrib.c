@@ -620,6 +620,18 @@ void make_write_distrib_select(int n, void (*fun)(float*, cell*, int),
 ******************************************************************************/
 
 void write_distrib_header(FILE *out, int mode, int n, char *cont)
+{
+  write_distrib_header_dim(out, mode, n, cont, dist_dim);
+}
+
+/******************************************************************************
+*
+*  write header of distribution files with resolution dim
+*
+******************************************************************************/
+
+void write_distrib_header_dim(FILE *out, int mode, int n, char *cont,
+                              ivektor dim)
 {
   char c;
   int  n_coord;
@@ -646,18 +658,18 @@ void write_distrib_header(FILE *out, int mode, int n, char *cont)
 
   /* dimension line */
 #ifdef TWOD
-  fprintf(out, "#D %d %d\n",    dist_dim.x, dist_dim.y);
+  fprintf(out, "#D %d %d\n",    dim.x, dim.y);
 #else
-  fprintf(out, "#D %d %d %d\n", dist_dim.x, dist_dim.y, dist_dim.z);
+  fprintf(out, "#D %d %d %d\n", dim.x, dim.y, dim.z);
 #endif
 
   /* bin size line */
-  s.x = (dist_ur.x - dist_ll.x) / dist_dim.x;
-  s.y = (dist_ur.y - dist_ll.y) / dist_dim.y;
+  s.x = (dist_ur.x - dist_ll.x) / dim.x;
+  s.y = (dist_ur.y - dist_ll.y) / dim.y;
 #ifdef TWOD
   fprintf(out, "#S %e %e\n",    s.x, s.y);
 #else
-  s.z = (dist_ur.z - dist_ll.z) / dist_dim.z;
+  s.z = (dist_ur.z - dist_ll.z) / dim.z;
   fprintf(out, "#S %e %e %e\n", s.x, s.y, s.z);
 #endif
 
@@ -669,6 +681,313 @@ void write_distrib_header(FILE *out, int mode, int n, char *cont)
 
 }
 
+/******************************************************************************
+*
+*  In-situ distributions
+*
+*  Up to MAX_INSITU distributions can be registered with the parameter
+*  insitu_dist, each with its own quantity, resolution and interval.
+*  The distributions due in a step are accumulated in one sweep over
+*  the cells. Their reduction to CPU 0 is started with a nonblocking
+*  MPI_Ireduce, and completed only when the result is needed, so that
+*  the simulation goes on meanwhile. With ASYNC_IO, the result is
+*  written by the output thread.
+*
+******************************************************************************/
+
+#if defined(MPI) && (MPI_VERSION >= 3)
+#define INSITU_IREDUCE
+#endif
+
+typedef struct {
+  char *name;                            /* name of quantity, file suffix */
+  int  n;                                /* number of components */
+  void (*fun)(float*, cell*, int);       /* selection function */
+  char *cont;                            /* contents line */
+} insitu_quant_t;
+
+static insitu_quant_t insitu_quants[] = {
+  { "dens",      0, NULL,                "dens" },
+  { "Ekin",      1, dist_Ekin_fun,       "Ekin" },
+  { "Epot",      1, dist_Epot_fun,       "Epot" },
+#ifdef STRESS_TENS
+  { "press",     1, dist_press_fun,      "press" },
+#ifdef TWOD
+  { "presstens", 3, dist_presstens_fun,  "P_xx P_yy P_xy" },
+#else
+  { "presstens", 6, dist_presstens_fun,  "P_xx P_yy P_zz P_yz P_zx P_xy" },
+#endif
+#endif
+#ifdef SHOCK
+  { "vxavg",     1, dist_vxavg_fun,      "vxavg" },
+  { "Ekin_long", 1, dist_Ekin_long_fun,  "Ekin_long" },
+  { "Ekin_trans",1, dist_Ekin_trans_fun, "Ekin_trans" },
+  { "Ekin_comp", 1, dist_Ekin_comp_fun,  "Ekin_comp" },
+#endif
+};
+
+#define N_INSITU_QUANTS ((int) (sizeof(insitu_quants) / sizeof(insitu_quant_t)))
+
+/* state of an in-situ distribution: the local sums, which are the atom
+   numbers of the bins followed by the n components of each bin, and
+   their reduction on CPU 0 */
+typedef struct {
+  float *dat, *res;
+  int   size, max, fzhlr, pending;
+#ifdef INSITU_IREDUCE
+  MPI_Request req;
+#endif
+} insitu_t;
+
+static insitu_t insitu[MAX_INSITU];
+
+/******************************************************************************
+*
+*  insitu_quantity - number of quantity name, -1 if unknown
+*
+******************************************************************************/
+
+int insitu_quantity(char *name)
+{
+  int q;
+
+  for (q=0; q<N_INSITU_QUANTS; q++)
+    if (0==strcasecmp(name, insitu_quants[q].name)) return q;
+  return -1;
+}
+
+/******************************************************************************
+*
+*  write_insitu - normalize and write in-situ distribution r (CPU 0 only)
+*
+******************************************************************************/
+
+static void write_insitu(int r)
+{
+  insitu_quant_t *q = insitu_quants + insitu_quant[r];
+  insitu_t *is = insitu + r;
+  ivektor dim = insitu_dim[r];
+  int   n = MAX(q->n, 1), mode = insitu_mode[r], i, k, s, t, u;
+  float *num = is->res, *dat = is->res + (q->n ? is->size : 0), fac;
+  char  fname[255], *buf=NULL, *c;
+  long  len=0;
+  FILE  *out;
+  real  vol;
+
+  /* densities, or averages over the atoms of a bin */
+  if (0==q->n) {
+    vol = (dist_ur.x - dist_ll.x) * (dist_ur.y - dist_ll.y);
+#ifndef TWOD
+    vol *= (dist_ur.z - dist_ll.z);
+#endif
+    fac = is->size / vol;
+    for (i=0; i<is->size; i++) dat[i] = num[i] * fac;
+  }
+  else {
+    for (i=0; i<is->size; i++)
+      if (num[i] > 0.0)
+        for (k=0; k<n; k++) dat[n*i+k] /= num[i];
+  }
+
+  /* open file, write header */
+  if (snprintf(fname, sizeof(fname), "%s.is%d.%u.%s", outfilename, r,
+               is->fzhlr, q->name) >= (int) sizeof(fname))
+    error("name of distribution file too long");
+  out = fopen(fname, "w");
+  if (NULL == out) error_str("Cannot open distribution file %s", fname);
+  write_distrib_header_dim(out, mode, n, q->cont, dim);
+
+  /* format the data in a buffer of its own, which the output
+     thread may still be writing while the next one is collected */
+  if (mode==DIST_FORMAT_BINARY) {
+    len = n * is->size * sizeof(float);
+    buf = (char *) malloc( len + 1 );
+    if (NULL==buf) error("Cannot allocate distribution output buffer");
+    memcpy(buf, dat, len);
+  }
+  else if ((mode==DIST_FORMAT_ASCII) || (mode==DIST_FORMAT_ASCII_COORD)) {
+    buf = (char *) malloc( is->size * (3 * 12 + 16 * n + 1) + 1 );
+    if (NULL==buf) error("Cannot allocate distribution output buffer");
+    c = buf;
+    s = t = u = 0;
+    for (i=0; i<is->size; i++) {
+      if (mode==DIST_FORMAT_ASCII_COORD) {
+#ifdef TWOD
+        c += sprintf(c, "%d %d", s, t++);
+        if (t==dim.y) { t=0; s++; }
+#else
+        c += sprintf(c, "%d %d %d", s, t, u++);
+        if (u==dim.z) { u=0; t++; }
+        if (t==dim.y) { t=0; s++; }
+#endif
+      }
+      for (k=0; k<n; k++) c += sprintf(c, " %e", dat[n*i+k]);
+      *c++ = '\n';
+    }
+    len = c - buf;
+  }
+  else error("unknown distribution output format");
+
+#ifdef ASYNC_IO
+  if (async_output > 0) {
+    queue_output(out, buf, len);
+    return;
+  }
+#endif
+  if ((long) fwrite(buf, 1, len, out) < len)
+    warning("distribution write incomplete!");
+  fclose(out);
+  free(buf);
+}
+
+/******************************************************************************
+*
+*  complete_insitu - complete the reduction of distribution r, and write it
+*
+******************************************************************************/
+
+static void complete_insitu(int r)
+{
+#ifdef INSITU_IREDUCE
+  MPI_Wait(&insitu[r].req, MPI_STATUS_IGNORE);
+#endif
+  insitu[r].pending = 0;
+  if (0==myid) write_insitu(r);
+}
+
+/******************************************************************************
+*
+*  update_insitu - make the in-situ distributions due in this step
+*
+******************************************************************************/
+
+void update_insitu(int steps)
+{
+  int    due[MAX_INSITU], ndue=0, r, j, k, i, num, numx, numy, numz, flag;
+  vektor scale[MAX_INSITU];
+  insitu_quant_t *q;
+  insitu_t *is;
+  cell   *p;
+
+  for (r=0; r<MAX_INSITU; r++) {
+    is = insitu + r;
+    /* progress and complete pending reductions */
+    if (is->pending) {
+#ifdef INSITU_IREDUCE
+      MPI_Test(&is->req, &flag, MPI_STATUS_IGNORE);
+#else
+      flag = 1;
+#endif
+      if ((flag) || ((insitu_int[r] > 0) && (0 == steps % insitu_int[r])))
+        complete_insitu(r);
+    }
+    if ((insitu_int[r] > 0) && (0 == steps % insitu_int[r])) due[ndue++] = r;
+  }
+  if (0==ndue) return;
+
+  is_big_endian = endian();
+
+  /* backup if dist_ur is not set */
+  if (0.0==dist_ur.x) {
+    dist_ur.x = box_x.x;
+    dist_ur.y = box_y.y;
+#ifndef TWOD
+    dist_ur.z = box_z.z;
+#endif
+  }
+
+  /* clear the distributions; the bins are orthogonal boxes in space */
+  for (j=0; j<ndue; j++) {
+    r  = due[j];
+    is = insitu + r;
+    q  = insitu_quants + insitu_quant[r];
+    is->size  = insitu_dim[r].x * insitu_dim[r].y;
+#ifndef TWOD
+    is->size *= insitu_dim[r].z;
+#endif
+    if (is->max < (q->n + 1) * is->size) {
+      is->max = (q->n + 1) * is->size;
+      free(is->dat);
+      is->dat = (float *) malloc( is->max * sizeof(float) );
+#ifdef MPI
+      if (0==myid) {
+        free(is->res);
+        is->res = (float *) malloc( is->max * sizeof(float) );
+        if (NULL==is->res) error("Cannot allocate distribution data.");
+      }
+#endif
+      if (NULL==is->dat) error("Cannot allocate distribution data.");
+    }
+#ifndef MPI
+    is->res = is->dat;
+#endif
+    for (i=0; i<(q->n + 1) * is->size; i++) is->dat[i] = 0.0;
+    scale[j].x = insitu_dim[r].x / (dist_ur.x - dist_ll.x);
+    scale[j].y = insitu_dim[r].y / (dist_ur.y - dist_ll.y);
+#ifndef TWOD
+    scale[j].z = insitu_dim[r].z / (dist_ur.z - dist_ll.z);
+#endif
+  }
+
+  /* one sweep over all atoms for all distributions */
+  for (k=0; k<NCELLS; ++k) {
+    p = CELLPTR(k);
+    for (i=0; i<p->n; ++i) {
+      for (j=0; j<ndue; j++) {
+        r  = due[j];
+        is = insitu + r;
+        q  = insitu_quants + insitu_quant[r];
+        /* which bin? */
+        numx = scale[j].x * (ORT(p,i,X) - dist_ll.x);
+        if ((numx < 0) || (numx >= insitu_dim[r].x)) continue;
+        numy = scale[j].y * (ORT(p,i,Y) - dist_ll.y);
+        if ((numy < 0) || (numy >= insitu_dim[r].y)) continue;
+        num = numx * insitu_dim[r].y + numy;
+#ifndef TWOD
+        numz = scale[j].z * (ORT(p,i,Z) - dist_ll.z);
+        if ((numz < 0) || (numz >= insitu_dim[r].z)) continue;
+        num = num * insitu_dim[r].z + numz;
+#endif
+        is->dat[num] += 1.0;
+        if (q->fun) (*q->fun)(is->dat + is->size + q->n * num, p, i);
+      }
+    }
+  }
+
+  /* add up results from different CPUs */
+  for (j=0; j<ndue; j++) {
+    r  = due[j];
+    is = insitu + r;
+    q  = insitu_quants + insitu_quant[r];
+    is->fzhlr = steps / insitu_int[r];
+#ifdef INSITU_IREDUCE
+    MPI_Ireduce(is->dat, is->res, (q->n + 1) * is->size, MPI_FLOAT, MPI_SUM,
+                0, cpugrid, &is->req);
+    is->pending = 1;
+#else
+#ifdef MPI
+    MPI_Reduce(is->dat, is->res, (q->n + 1) * is->size, MPI_FLOAT, MPI_SUM,
+               0, cpugrid);
+#endif
+    if (0==myid) write_insitu(r);
+#endif
+  }
+}
+
+/******************************************************************************
+*
+*  finish_insitu - complete and write all pending in-situ distributions
+*
+******************************************************************************/
+
+void finish_insitu(void)
+{
+  int r;
+
+  for (r=0; r<MAX_INSITU; r++)
+    if (insitu[r].pending) complete_insitu(r);
+}
+
 #ifdef ATDIST
 
 /******************************************************************************
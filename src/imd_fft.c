@@ -0,0 +1,199 @@
+
+/******************************************************************************
+*
+* IMD -- The ITAP Molecular Dynamics Program
+*
+* Copyright 1996-2012 Institute for Theoretical and Applied Physics,
+* University of Stuttgart, D-70550 Stuttgart
+*
+******************************************************************************/
+
+/******************************************************************************
+*
+* imd_fft.c -- complex 3D FFT for the particle mesh Ewald sum
+*
+*  The data is an array of nx*ny*nz complex numbers, stored as pairs of
+*  doubles, with z running fastest. Transforms are in place and not
+*  normalized; sign -1 is the forward, sign +1 the backward transform.
+*  With option fftw, FFTW 3 is used, otherwise a mixed radix
+*  Cooley-Tukey FFT for arbitrary mesh sizes (efficient for sizes
+*  with small prime factors).
+*
+******************************************************************************/
+
+/******************************************************************************
+* $Revision$
+* $Date$
+******************************************************************************/
+
+#include "imd.h"
+
+#ifdef FFTW
+
+static fftw_plan fft_plan_fwd, fft_plan_bwd;
+
+/******************************************************************************
+*
+*  init_fft_3d - make FFTW plans for the array data
+*
+******************************************************************************/
+
+void init_fft_3d(int nx, int ny, int nz, double *data)
+{
+  fft_plan_fwd = fftw_plan_dft_3d( nx, ny, nz, (fftw_complex *) data,
+                   (fftw_complex *) data, FFTW_FORWARD,  FFTW_ESTIMATE );
+  fft_plan_bwd = fftw_plan_dft_3d( nx, ny, nz, (fftw_complex *) data,
+                   (fftw_complex *) data, FFTW_BACKWARD, FFTW_ESTIMATE );
+  if ((NULL==fft_plan_fwd) || (NULL==fft_plan_bwd))
+    error("cannot make FFTW plan");
+}
+
+/******************************************************************************
+*
+*  fft_3d - transform data, which must be the array of init_fft_3d
+*
+******************************************************************************/
+
+void fft_3d(double *data, int sign)
+{
+  fftw_execute( (sign < 0) ? fft_plan_fwd : fft_plan_bwd );
+}
+
+#else /* not FFTW */
+
+#define FFT_MAXFAC 32
+
+typedef struct {
+  int    n, fac[FFT_MAXFAC];  /* length and its prime factors */
+  double *w;                  /* cos and sin of 2 pi k / n */
+} fft_line;
+
+static fft_line fft_dim[3];
+static double   *fft_in=NULL, *fft_out=NULL, *fft_tmp=NULL;
+
+/******************************************************************************
+*
+*  init_fft_line - factorize n and tabulate the twiddle factors
+*
+******************************************************************************/
+
+static void init_fft_line(fft_line *l, int n)
+{
+  int k, p, m = n, nf = 0;
+
+  l->n = n;
+  for (p=2; m>1; ) {
+    if (0 == m % p) { l->fac[nf++] = p; m /= p; }
+    else p++;
+  }
+  l->fac[nf] = 1;
+
+  l->w = (double *) malloc( 2 * n * sizeof(double) );
+  if (NULL==l->w) error("cannot allocate FFT tables");
+  for (k=0; k<n; k++) {
+    l->w[2*k  ] = cos( 2.0 * M_PI * k / n );
+    l->w[2*k+1] = sin( 2.0 * M_PI * k / n );
+  }
+}
+
+/******************************************************************************
+*
+*  fft_rec - recursive decimation in time, from in (stride s) to out
+*
+*  The sub-transforms of length m = n/p are written to consecutive
+*  blocks of out, and then combined by a radix-p butterfly.
+*
+******************************************************************************/
+
+static void fft_rec(fft_line *l, double *in, double *out, int n, int s,
+                    int *fac, int sign)
+{
+  int p = fac[0], m = n / p, step = l->n / n, j, k, q;
+
+  if (1==n) {
+    out[0] = in[0];
+    out[1] = in[1];
+    return;
+  }
+  for (j=0; j<p; j++)
+    fft_rec( l, in + 2*j*s, out + 2*j*m, m, s*p, fac+1, sign );
+
+  for (k=0; k<m; k++) {
+    for (j=0; j<p; j++) {
+      fft_tmp[2*j  ] = out[2*(j*m+k)  ];
+      fft_tmp[2*j+1] = out[2*(j*m+k)+1];
+    }
+    for (q=0; q<p; q++) {
+      int    r = k + q*m;
+      double re = fft_tmp[0], im = fft_tmp[1];
+      for (j=1; j<p; j++) {
+        int    e  = (int) (((long) j * r * step) % l->n);
+        double wr = l->w[2*e], wi = sign * l->w[2*e+1];
+        re += fft_tmp[2*j] * wr - fft_tmp[2*j+1] * wi;
+        im += fft_tmp[2*j] * wi + fft_tmp[2*j+1] * wr;
+      }
+      out[2*r  ] = re;
+      out[2*r+1] = im;
+    }
+  }
+}
+
+/******************************************************************************
+*
+*  init_fft_3d - prepare the transforms for an nx*ny*nz mesh
+*
+******************************************************************************/
+
+void init_fft_3d(int nx, int ny, int nz, double *data)
+{
+  int n = MAX( nx, MAX( ny, nz ) );
+
+  init_fft_line( fft_dim,   nx );
+  init_fft_line( fft_dim+1, ny );
+  init_fft_line( fft_dim+2, nz );
+  fft_in  = (double *) malloc( 2 * n * sizeof(double) );
+  fft_out = (double *) malloc( 2 * n * sizeof(double) );
+  fft_tmp = (double *) malloc( 2 * n * sizeof(double) );
+  if ((NULL==fft_in) || (NULL==fft_out) || (NULL==fft_tmp))
+    error("cannot allocate FFT buffers");
+}
+
+/******************************************************************************
+*
+*  fft_3d - transform all lines along x, y, and z
+*
+******************************************************************************/
+
+void fft_3d(double *data, int sign)
+{
+  int nx = fft_dim[0].n, ny = fft_dim[1].n, nz = fft_dim[2].n;
+  int d, a, b, i;
+
+  for (d=0; d<3; d++) {
+
+    fft_line *l = fft_dim + d;
+    int n, na, nb, sa, sb, s;
+
+    /* lines along d, labelled by the other two indices a and b */
+    if      (0==d) { n = nx; s = ny*nz; na = ny; sa = nz;    nb = nz; sb = 1; }
+    else if (1==d) { n = ny; s = nz;    na = nx; sa = ny*nz; nb = nz; sb = 1; }
+    else           { n = nz; s = 1;     na = nx; sa = ny*nz; nb = ny; sb = nz; }
+    if (1==n) continue;
+
+    for (a=0; a<na; a++)
+      for (b=0; b<nb; b++) {
+        double *line = data + 2 * (a*sa + b*sb);
+        for (i=0; i<n; i++) {
+          fft_in[2*i  ] = line[2*i*s  ];
+          fft_in[2*i+1] = line[2*i*s+1];
+        }
+        fft_rec( l, fft_in, fft_out, n, 1, l->fac, sign );
+        for (i=0; i<n; i++) {
+          line[2*i*s  ] = fft_out[2*i  ];
+          line[2*i*s+1] = fft_out[2*i+1];
+        }
+      }
+  }
+}
+
+#endif /* FFTW */
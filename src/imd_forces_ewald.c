@@ -88,8 +88,11 @@ void do_forces_ewald(int steps)
     clear_forces();
   }
 
-  /* Fourier space part */
-  if (ew_kcut > 0) do_forces_ewald_fourier();
+  /* Fourier space part, directly or on a mesh */
+  if (ew_kcut > 0) {
+    if (ew_mesh.x > 0) do_forces_ewald_spme();
+    else               do_forces_ewald_fourier();
+  }
 
   if ((steps==0) && (ew_test) && (ew_kcut>0)) {
     imd_stop_timer( &ewald_time );
@@ -123,31 +126,90 @@ void do_forces_ewald(int steps)
   }
 }
 
+/******************************************************************************
+*
+*  ew_expikr - exp(ik.r) of local atom i for k-vector k, from the tables
+*              of exp(ik_x x), exp(ik_y y), exp(ik_z z) (n local atoms)
+*
+******************************************************************************/
+
+static void ew_expikr(int k, int i, int n, real *ckr, real *skr)
+{
+  int  x = ew_ivek[k].x * n + i, y = ew_ivek[k].y * n + i;
+  int  z = ew_ivek[k].z * n + i;
+
+  *ckr =   coskx[x] * cosky[y] * coskz[z] - sinkx[x] * sinky[y] * coskz[z]
+         - sinkx[x] * cosky[y] * sinkz[z] - coskx[x] * sinky[y] * sinkz[z];
+  *skr = - sinkx[x] * sinky[y] * sinkz[z] + sinkx[x] * cosky[y] * coskz[z]
+         + coskx[x] * sinky[y] * coskz[z] + coskx[x] * cosky[y] * sinkz[z];
+}
+
 /******************************************************************************
 *
 *  do_forces_ewald_fourier
 *
 *  computes the fourier part of the Ewald sum
 *
+*  Each CPU computes the structure factors of its own atoms. They are
+*  summed up over all CPUs in batches of EW_KBATCH k-vectors, and then
+*  the forces on the local atoms are computed. The exp(ikr) tables
+*  only hold the local atoms. 
+*
 ******************************************************************************/
 
 void do_forces_ewald_fourier(void)
 {
-
-  int    i, j, k, l, m, n, c;
-  int    cnt, typ, offx, offy, offz;
+  static int    nloc_max = 0;
+  static real   *qloc = NULL;
+  static double sums[2*EW_KBATCH];
+#ifdef MPI
+  static double sums_loc[2*EW_KBATCH];
+#endif
+  int    i, j, k, c, n, cnt, k0, kb;
   int    px, py, pz, mx, my, mz;
-  real   tmp, tmp_virial=0.0, sum_cos, sum_sin;
+  real   tmp, tmp_virial=0.0, ckr, skr;
   real   kforce, kpot;
 
+  /* number of local atoms */
+  n = 0;
+  for (c=0; c<ncells; c++) n += CELLPTR(c)->n;
+
+  /* (re)allocate exp(ikr) tables */
+  if (n > nloc_max) {
+    nloc_max = (int) (1.1 * n) + 1;
+    coskx = (real *) realloc( coskx, nloc_max * ew_dx * sizeof(real));
+    sinkx = (real *) realloc( sinkx, nloc_max * ew_dx * sizeof(real));
+    cosky = (real *) realloc( cosky, nloc_max * ew_dy * sizeof(real));
+    sinky = (real *) realloc( sinky, nloc_max * ew_dy * sizeof(real));
+    coskz = (real *) realloc( coskz, nloc_max * ew_dz * sizeof(real));
+    sinkz = (real *) realloc( sinkz, nloc_max * ew_dz * sizeof(real));
+    qloc  = (real *) realloc( qloc,  nloc_max         * sizeof(real));
+    if( coskx == NULL || sinkx == NULL || cosky == NULL || sinky == NULL
+        || coskz == NULL || sinkz == NULL || qloc == NULL )
+      error("EWALD: Cannot allocate memory for exp(ikr)");
+  }
+
+  imd_start_timer( &ewald_time_sf );
+
   /* Compute exp(ikr) recursively */
-  px = (ew_nx+1) * natoms;  mx = (ew_nx-1) * natoms;
-  py = (ew_ny+1) * natoms;  my = (ew_ny-1) * natoms;
-  pz = (ew_nz+1) * natoms;  mz = (ew_nz-1) * natoms;
+  px = (ew_nx+1) * n;  mx = (ew_nx-1) * n;
+  py = (ew_ny+1) * n;  my = (ew_ny-1) * n;
+  pz = (ew_nz+1) * n;
   cnt = 0;
   for (c=0; c<ncells; c++) {
     cell *p = CELLPTR(c);
     for (i=0; i<p->n; i++) {
+#ifdef VARCHG
+      qloc[cnt] = CHARGE(p,i);
+#else
+      qloc[cnt] = charge[ SORTE(p,i) ];
+#endif
+      coskx[ew_nx*n+cnt] = 1.0;
+      sinkx[ew_nx*n+cnt] = 0.0;
+      cosky[ew_ny*n+cnt] = 1.0;
+      sinky[ew_ny*n+cnt] = 0.0;
+      coskz[ew_nz*n+cnt] = 1.0;
+      sinkz[ew_nz*n+cnt] = 0.0;
       tmp = twopi * SPRODX(ORT,p,i,tbox_x);
       coskx[px+cnt] =  cos(tmp);
       coskx[mx+cnt] =  coskx[px+cnt];
@@ -167,122 +229,112 @@ void do_forces_ewald_fourier(void)
 
   for (j=2; j<=ew_nx; j++) {
     int pp, qq, mm, ee, i;
-    pp  = (ew_nx+j  ) * natoms;
-    qq  = (ew_nx+j-1) * natoms;
-    mm  = (ew_nx-j  ) * natoms;
-    ee  = (ew_nx  +1) * natoms;
-    for (i=0; i<natoms; i++) {
+    pp  = (ew_nx+j  ) * n;
+    qq  = (ew_nx+j-1) * n;
+    mm  = (ew_nx-j  ) * n;
+    ee  = (ew_nx  +1) * n;
+    for (i=0; i<n; i++) {
       coskx[pp+i] =   coskx[qq+i] * coskx[ee+i] - sinkx[qq+i] * sinkx[ee+i];
       coskx[mm+i] =   coskx[pp+i];
-      sinkx[pp+i] =   coskx[qq+i] * sinkx[ee+i] - sinkx[qq+i] * coskx[ee+i];
+      sinkx[pp+i] =   coskx[qq+i] * sinkx[ee+i] + sinkx[qq+i] * coskx[ee+i];
       sinkx[mm+i] = - sinkx[pp+i];
     }
   }
 
   for (j=2; j<=ew_ny; j++) {
     int pp, qq, mm, ee, i;
-    pp  = (ew_ny+j  ) * natoms;
-    qq  = (ew_ny+j-1) * natoms;
-    mm  = (ew_ny-j  ) * natoms;
-    ee  = (ew_ny  +1) * natoms;
-    for (i=0; i<natoms; i++) {
+    pp  = (ew_ny+j  ) * n;
+    qq  = (ew_ny+j-1) * n;
+    mm  = (ew_ny-j  ) * n;
+    ee  = (ew_ny  +1) * n;
+    for (i=0; i<n; i++) {
       cosky[pp+i] =   cosky[qq+i] * cosky[ee+i] - sinky[qq+i] * sinky[ee+i];
       cosky[mm+i] =   cosky[pp+i];
-      sinky[pp+i] =   cosky[qq+i] * sinky[ee+i] - sinky[qq+i] * cosky[ee+i];
+      sinky[pp+i] =   cosky[qq+i] * sinky[ee+i] + sinky[qq+i] * cosky[ee+i];
       sinky[mm+i] = - sinky[pp+i];
     }
   }
 
   for (j=2; j<=ew_nz; j++) {
     int pp, qq, ee, i;
-    pp  = (ew_nz+j  ) * natoms;
-    qq  = (ew_nz+j-1) * natoms;
-    ee  = (ew_nz  +1) * natoms;
-    for (i=0; i<natoms; i++) {
+    pp  = (ew_nz+j  ) * n;
+    qq  = (ew_nz+j-1) * n;
+    ee  = (ew_nz  +1) * n;
+    for (i=0; i<n; i++) {
       coskz[pp+i] =   coskz[qq+i] * coskz[ee+i] - sinkz[qq+i] * sinkz[ee+i];
-      sinkz[pp+i] =   coskz[qq+i] * sinkz[ee+i] - sinkz[qq+i] * coskz[ee+i];
+      sinkz[pp+i] =   coskz[qq+i] * sinkz[ee+i] + sinkz[qq+i] * coskz[ee+i];
     }
   }
 
-  /* Loop over all reciprocal vectors */
-  for (k=0; k<ew_totk; k++) {
+  imd_stop_timer( &ewald_time_sf );
 
-    cnt     = 0; 
-    offx    = ew_ivek[k].x * natoms;
-    offy    = ew_ivek[k].y * natoms;
-    offz    = ew_ivek[k].z * natoms;
-    sum_cos = 0.0;
-    sum_sin = 0.0;
+  /* Loop over batches of reciprocal vectors */
+  for (k0=0; k0<ew_totk; k0+=EW_KBATCH) {
 
-    /* Compute exp(ikr) and sums thereof */
-    for (c=0; c<ncells; c++) {
+    kb = MIN( EW_KBATCH, ew_totk - k0 );
 
-      cell *p = CELLPTR(c);
+    /* structure factors of the local atoms */
+    imd_start_timer( &ewald_time_sf );
+    for (k=0; k<kb; k++) {
+      double sum_cos = 0.0, sum_sin = 0.0;
+      for (i=0; i<n; i++) {
+        ew_expikr( k0+k, i, n, &ckr, &skr );
+        sum_cos += qloc[i] * ckr;
+        sum_sin += qloc[i] * skr;
+      }
+#ifdef MPI
+      sums_loc[2*k  ] = sum_cos;
+      sums_loc[2*k+1] = sum_sin;
+#else
+      sums[2*k  ] = sum_cos;
+      sums[2*k+1] = sum_sin;
+#endif
+    }
+    imd_stop_timer( &ewald_time_sf );
 
-      for (i=0; i<p->n; i++) {
+    /* sum up over all CPUs */
+#ifdef MPI
+    imd_start_timer( &ewald_time_comm );
+    MPI_Allreduce( sums_loc, sums, 2*kb, MPI_DOUBLE, MPI_SUM, cpugrid );
+    imd_stop_timer( &ewald_time_comm );
+#endif
 
-        coskr[cnt] =   coskx[offx+cnt] * cosky[offy+cnt] * coskz[offz+cnt]
-                     - sinkx[offx+cnt] * sinky[offy+cnt] * coskz[offz+cnt]
-                     - sinkx[offx+cnt] * cosky[offy+cnt] * sinkz[offz+cnt] 
-                     - coskx[offx+cnt] * sinky[offy+cnt] * sinkz[offz+cnt];
+    imd_start_timer( &ewald_time_back );
+    for (k=0; k<kb; k++) {
 
-        sinkr[cnt] = - sinkx[offx+cnt] * sinky[offy+cnt] * sinkz[offz+cnt]
-                     + sinkx[offx+cnt] * cosky[offy+cnt] * coskz[offz+cnt]
-                     + coskx[offx+cnt] * sinky[offy+cnt] * coskz[offz+cnt]
-                     + coskx[offx+cnt] * cosky[offy+cnt] * sinkz[offz+cnt];
+      real expk = ew_expk[k0+k], sum_cos = sums[2*k], sum_sin = sums[2*k+1];
 
-#ifdef VARCHG
-        sum_cos += CHARGE(p,i) * coskr[cnt];
-        sum_sin += CHARGE(p,i) * sinkr[cnt];
-#else
-        typ      = SORTE(p,i);
-        sum_cos += charge[typ] * coskr[cnt];
-        sum_sin += charge[typ] * sinkr[cnt];
-#endif
-        cnt++;
-      }
-    }
+      /* update total potential energy, which is summed up over CPUs */
+      if (0==myid) tot_pot_energy += expk * (SQR(sum_sin) + SQR(sum_cos));
 
-    /* update total potential energy */
-    tot_pot_energy += ew_expk[k] * (SQR(sum_sin) + SQR(sum_cos));
+      /* updates of the local atoms */
+      cnt = 0;
+      for (c=0; c<ncells; c++) {
 
-    /* updates */
-    cnt = 0;
-    for (c=0; c<ncells; c++) {
+        cell *p = CELLPTR(c);
 
-      cell *p = CELLPTR(c);
+        for (i=0; i<p->n; i++) {
 
-      for (i=0; i<p->n; i++) {
+          ew_expikr( k0+k, cnt, n, &ckr, &skr );
 
-        /* update potential energy */
-#ifdef VARCHG
-        kpot   = CHARGE(p,i) * ew_expk[k]
-	         * (sinkr[cnt] * sum_sin + coskr[cnt] * sum_cos);
-#else
-        typ    = SORTE(p,i);
-        kpot   = charge[typ] * ew_expk[k]
-	         * (sinkr[cnt] * sum_sin + coskr[cnt] * sum_cos);
-#endif
-        POTENG(p,i)  += kpot;
+          /* update potential energy */
+          kpot   = qloc[cnt] * expk * (skr * sum_sin + ckr * sum_cos);
+          POTENG(p,i)  += kpot;
 
-        /* update force */
-#ifdef VARCHG
-        kforce = CHARGE(p,i) * ew_expk[k] 
-                 * (sinkr[cnt] * sum_cos - coskr[cnt] * sum_sin);
-#else
-        kforce = charge[typ] * ew_expk[k] 
-                 * (sinkr[cnt] * sum_cos - coskr[cnt] * sum_sin);
-#endif
-        KRAFT(p,i,X) += ew_kvek[k].x * kforce;
-        KRAFT(p,i,Y) += ew_kvek[k].y * kforce;
-        KRAFT(p,i,Z) += ew_kvek[k].z * kforce;
-        tmp_virial   += kforce * SPRODX(ORT,p,i,ew_kvek[k]);
+          /* update force; each atom appears twice in |S(k)|^2 */
+          kforce = 2.0 * qloc[cnt] * expk * (skr * sum_cos - ckr * sum_sin);
+          KRAFT(p,i,X) += ew_kvek[k0+k].x * kforce;
+          KRAFT(p,i,Y) += ew_kvek[k0+k].y * kforce;
+          KRAFT(p,i,Z) += ew_kvek[k0+k].z * kforce;
+          tmp_virial   += kforce * SPRODX(ORT,p,i,ew_kvek[k0+k]);
 
-        cnt++;
+          cnt++;
+        }
       }
     }
+    imd_stop_timer( &ewald_time_back );
 
-  }  /* k */
+  }  /* k0 */
 
   virial += tmp_virial;
 
@@ -446,6 +498,284 @@ void do_forces_ewald_real(void)
 }
 
 
+/******************************************************************************
+*
+*  spme_spline
+*
+*  B-spline weights th[j] and their derivatives dth[j] for the mesh 
+*  points k0+j of an atom at mesh coordinate u (Essmann et al., 
+*  J. Chem. Phys. 103, 8577 (1995)); the indices are wrapped into [0,K)
+*
+******************************************************************************/
+
+static void spme_spline(real u, int K, int *idx, real *th, real *dth)
+{
+  int  n = ew_order, j, k, k0;
+  real w, div;
+
+  k0 = (int) floor(u);
+  w  = u - k0;
+  th[n-1] = 0.0;
+  th[1]   = w;
+  th[0]   = 1.0 - w;
+  for (k=3; k<n; k++) {
+    div     = 1.0 / (k-1);
+    th[k-1] = div * w * th[k-2];
+    for (j=1; j<k-1; j++)
+      th[k-j-1] = div * ((w+j) * th[k-j-2] + (k-j-w) * th[k-j-1]);
+    th[0] = div * (1.0-w) * th[0];
+  }
+  dth[0] = -th[0];
+  for (j=1; j<n; j++) dth[j] = th[j-1] - th[j];
+  div     = 1.0 / (n-1);
+  th[n-1] = div * w * th[n-2];
+  for (j=1; j<n-1; j++)
+    th[n-j-1] = div * ((w+j) * th[n-j-2] + (n-j-w) * th[n-j-1]);
+  th[0] = div * (1.0-w) * th[0];
+
+  k0 = k0 - n + 1;
+  for (j=0; j<n; j++) {
+    k = k0 + j;
+    if (k <  0) k += K;
+    if (k >= K) k -= K;
+    idx[j] = k;
+  }
+}
+
+/******************************************************************************
+*
+*  spme_splines - weights of an atom in all three directions
+*
+******************************************************************************/
+
+static void spme_splines(cell *p, int i, int *ix, int *iy, int *iz,
+                         real *thx, real *thy, real *thz,
+                         real *dthx, real *dthy, real *dthz)
+{
+  real s;
+
+  s = SPRODX(ORT,p,i,tbox_x);  s -= floor(s);
+  spme_spline( s * ew_mesh.x, ew_mesh.x, ix, thx, dthx );
+  s = SPRODX(ORT,p,i,tbox_y);  s -= floor(s);
+  spme_spline( s * ew_mesh.y, ew_mesh.y, iy, thy, dthy );
+  s = SPRODX(ORT,p,i,tbox_z);  s -= floor(s);
+  spme_spline( s * ew_mesh.z, ew_mesh.z, iz, thz, dthz );
+}
+
+/******************************************************************************
+*
+*  do_forces_ewald_spme
+*
+*  computes the fourier part of the Ewald sum with the smooth particle
+*  mesh Ewald method: the charges are spread on the mesh with B-splines,
+*  the mesh is convoluted with the influence function by FFT, and the
+*  resulting potential is interpolated back to the atoms. With MPI,
+*  each CPU spreads its own atoms, and the meshes are summed up.
+*
+******************************************************************************/
+
+void do_forces_ewald_spme(void)
+{
+  int    nx = ew_mesh.x, ny = ew_mesh.y, nz = ew_mesh.z;
+  int    n = ew_order, c, i, a, b, d, m;
+  int    ix[EW_MAXORDER], iy[EW_MAXORDER], iz[EW_MAXORDER];
+  real   thx[EW_MAXORDER], thy[EW_MAXORDER], thz[EW_MAXORDER];
+  real   dthx[EW_MAXORDER], dthy[EW_MAXORDER], dthz[EW_MAXORDER];
+  real   q;
+  double *grid = ew_grid, epot=0.0, vir=0.0;
+
+  /* charge assignment */
+  imd_start_timer( &ewald_time_sf );
+  memset( grid, 0, 2 * nx * ny * nz * sizeof(double) );
+  for (c=0; c<ncells; c++) {
+    cell *p = CELLPTR(c);
+    for (i=0; i<p->n; i++) {
+#ifdef VARCHG
+      q = CHARGE(p,i);
+#else
+      q = charge[ SORTE(p,i) ];
+#endif
+      if (0.0==q) continue;
+      spme_splines(p, i, ix, iy, iz, thx, thy, thz, dthx, dthy, dthz);
+      for (a=0; a<n; a++)
+        for (b=0; b<n; b++) {
+          double qab = q * thx[a] * thy[b], *g = grid + 2 * nz * (ix[a]*ny + iy[b]);
+          for (d=0; d<n; d++) g[2*iz[d]] += qab * thz[d];
+        }
+    }
+  }
+
+  imd_stop_timer( &ewald_time_sf );
+
+#ifdef MPI
+  /* sum up the charge meshes of all CPUs; each CPU then does the FFT */
+  imd_start_timer( &ewald_time_comm );
+  for (m=0; m<nx*ny*nz; m++) ew_mbuf[m] = grid[2*m];
+  MPI_Allreduce( ew_mbuf, ew_mbuf + nx*ny*nz, nx*ny*nz, MPI_DOUBLE, MPI_SUM,
+                 cpugrid );
+  for (m=0; m<nx*ny*nz; m++) grid[2*m] = ew_mbuf[nx*ny*nz+m];
+  imd_stop_timer( &ewald_time_comm );
+#endif
+
+  /* convolution with the influence function */
+  imd_start_timer( &ewald_time_back );
+  fft_3d( grid, -1 );
+  for (m=0; m<nx*ny*nz; m++) {
+    double s2 = SQR(grid[2*m]) + SQR(grid[2*m+1]);
+    epot += ew_gmesh[m] * s2;
+    vir  += ew_vmesh[m] * s2;
+    grid[2*m  ] *= ew_gmesh[m];
+    grid[2*m+1] *= ew_gmesh[m];
+  }
+  fft_3d( grid, 1 );
+
+  /* energy and virial are summed up over CPUs */
+  if (0==myid) {
+    tot_pot_energy += 0.5 * epot;
+    virial         += 0.5 * vir;
+  }
+
+  /* interpolate potential and forces */
+  for (c=0; c<ncells; c++) {
+    cell *p = CELLPTR(c);
+    for (i=0; i<p->n; i++) {
+      real   fx=0.0, fy=0.0, fz=0.0, phi=0.0;
+#ifdef VARCHG
+      q = CHARGE(p,i);
+#else
+      q = charge[ SORTE(p,i) ];
+#endif
+      if (0.0==q) continue;
+      spme_splines(p, i, ix, iy, iz, thx, thy, thz, dthx, dthy, dthz);
+      for (a=0; a<n; a++)
+        for (b=0; b<n; b++) {
+          double *g = grid + 2 * nz * (ix[a]*ny + iy[b]);
+          real   t = 0.0, dt = 0.0;
+          for (d=0; d<n; d++) {
+            t  +=  thz[d] * g[2*iz[d]];
+            dt += dthz[d] * g[2*iz[d]];
+          }
+          phi +=  thx[a] *  thy[b] * t;
+          fx  += dthx[a] *  thy[b] * t;
+          fy  +=  thx[a] * dthy[b] * t;
+          fz  +=  thx[a] *  thy[b] * dt;
+        }
+      POTENG(p,i)  += 0.5 * q * phi;
+      fx *= q * nx;
+      fy *= q * ny;
+      fz *= q * nz;
+      KRAFT(p,i,X) -= fx * tbox_x.x + fy * tbox_y.x + fz * tbox_z.x;
+      KRAFT(p,i,Y) -= fx * tbox_x.y + fy * tbox_y.y + fz * tbox_z.y;
+      KRAFT(p,i,Z) -= fx * tbox_x.z + fy * tbox_y.z + fz * tbox_z.z;
+    }
+  }
+  imd_stop_timer( &ewald_time_back );
+}
+
+/******************************************************************************
+*
+*  spme_bspline - cardinal B-spline M_n(x)
+*
+******************************************************************************/
+
+static real spme_bspline(int n, real x)
+{
+  if (2==n) return ((x <= 0.0) || (x >= 2.0)) ? 0.0 : 1.0 - ABS(x - 1.0);
+  return (x * spme_bspline(n-1, x) + (n-x) * spme_bspline(n-1, x-1.0)) / (n-1);
+}
+
+/******************************************************************************
+*
+*  spme_bmod - squared modulus of the B-spline structure factor
+*
+******************************************************************************/
+
+static void spme_bmod(real *bmod, int K)
+{
+  int m, k;
+
+  for (m=0; m<K; m++) {
+    real re = 0.0, im = 0.0;
+    for (k=0; k<ew_order-1; k++) {
+      real w = spme_bspline(ew_order, k+1.0);
+      re += w * cos( twopi * m * k / K );
+      im += w * sin( twopi * m * k / K );
+    }
+    bmod[m] = SQR(re) + SQR(im);
+  }
+  /* zeros occur only for odd order; interpolate there */
+  for (m=0; m<K; m++)
+    if (bmod[m] < 1e-7) bmod[m] = 0.5 * (bmod[(m-1+K)%K] + bmod[(m+1)%K]);
+}
+
+/******************************************************************************
+*
+*  init_spme
+*
+*  setup the mesh, the FFT, and the influence function
+*
+******************************************************************************/
+
+static void init_spme(real vorf1)
+{
+  int  nx = ew_mesh.x, ny = ew_mesh.y, nz = ew_mesh.z, i, j, k, m;
+  real *bx, *by, *bz;
+  str255 msg;
+
+  if ((ew_order < 3) || (ew_order > EW_MAXORDER)) {
+    sprintf(msg, "EWALD: ew_order must be between 3 and %d", EW_MAXORDER);
+    error(msg);
+  }
+  if ((nx < ew_order) || (ny < ew_order) || (nz < ew_order))
+    error("EWALD: ew_mesh must not be smaller than ew_order");
+
+  if (0==myid)
+    printf("EWALD: SPME mesh %d x %d x %d, order %d\n", nx, ny, nz, ew_order);
+
+  ew_grid  = (double *) malloc( 2 * nx * ny * nz * sizeof(double) );
+  ew_gmesh = (real   *) malloc(     nx * ny * nz * sizeof(real) );
+  ew_vmesh = (real   *) malloc(     nx * ny * nz * sizeof(real) );
+  bx       = (real   *) malloc( (nx + ny + nz) * sizeof(real) );
+  if ((NULL==ew_grid) || (NULL==ew_gmesh) || (NULL==ew_vmesh) || (NULL==bx))
+    error("EWALD: Cannot allocate memory for SPME mesh");
+#ifdef MPI
+  ew_mbuf  = (double *) malloc( 2 * nx * ny * nz * sizeof(double) );
+  if (NULL==ew_mbuf) error("EWALD: Cannot allocate memory for SPME mesh");
+#endif
+  by = bx + nx;
+  bz = by + ny;
+  spme_bmod( bx, nx );
+  spme_bmod( by, ny );
+  spme_bmod( bz, nz );
+
+  /* influence function, and its virial factor 1 - k^2 / (2 kappa^2) */
+  m = 0;
+  for (i=0; i<nx; i++)
+    for (j=0; j<ny; j++)
+      for (k=0; k<nz; k++, m++) {
+        int    mx = (2*i > nx) ? i - nx : i;
+        int    my = (2*j > ny) ? j - ny : j;
+        int    mz = (2*k > nz) ? k - nz : k;
+        vektor kv;
+        real   kvek2;
+        if ((0==mx) && (0==my) && (0==mz)) {
+          ew_gmesh[m] = 0.0;
+          ew_vmesh[m] = 0.0;
+          continue;
+        }
+        kv.x  = twopi * (mx*tbox_x.x + my*tbox_y.x + mz*tbox_z.x);
+        kv.y  = twopi * (mx*tbox_x.y + my*tbox_y.y + mz*tbox_z.y);
+        kv.z  = twopi * (mx*tbox_x.z + my*tbox_y.z + mz*tbox_z.z);
+        kvek2 = SPROD(kv,kv);
+        ew_gmesh[m] = vorf1 * exp( -kvek2 / (4.0*SQR(ew_kappa)) ) / kvek2
+                      / (bx[i] * by[j] * bz[k]);
+        ew_vmesh[m] = ew_gmesh[m] * (1.0 - kvek2 / (2.0*SQR(ew_kappa)));
+      }
+  free(bx);
+
+  init_fft_3d( nx, ny, nz, ew_grid );
+}
+
 /******************************************************************************
 *
 *  init_ewald
@@ -457,7 +787,7 @@ void do_forces_ewald_real(void)
 void init_ewald(void)
 {
 
-  int    i, j, k, offx, offy, offz, count, num;
+  int    i, j, k, num;
   real   kvek2, vorf1;
 
   /* we implicitly assume a system of units, in which lengths are
@@ -471,14 +801,27 @@ void init_ewald(void)
   twopi    = 2.0 * M_PI;
 
   ew_vorf  = ew_kappa / SQRT( M_PI );
-  vorf1    = twopi * coul_eng / volume;
+  /* 4 pi / V, as only half of the k-vectors are summed up */
+  vorf1    = 2.0 * twopi * coul_eng / volume;
 
   /* SM ?
   ew_vorf  = 2.0 * ew_kappa / SQRT( M_PI );
   vorf1    = 2.0 * twopi / volume; */
 
+#ifdef MPI
+  /* the real space sum with image boxes needs all atoms on one CPU */
+  if (ew_nmax >= 0) 
+    error("EWALD: ew_nmax >= 0 is not parallelized, use ew_nmax -1");
+#endif
+
   if (!(ew_kcut > 0)) return;
 
+  /* particle mesh instead of k-vectors and exp(ikr) tables */
+  if (ew_mesh.x > 0) {
+    init_spme(vorf1);
+    return;
+  }
+
   ew_nx = (int) (ew_kcut * SQRT( SPROD(box_x,box_x) ) / twopi) + 1;
   ew_ny = (int) (ew_kcut * SQRT( SPROD(box_y,box_y) ) / twopi) + 1;
   ew_nz = (int) (ew_kcut * SQRT( SPROD(box_z,box_z) ) / twopi) + 1;
@@ -525,10 +868,13 @@ void init_ewald(void)
   if (0==myid)
     printf("EWALD: %d k-vectors\n", ew_totk); 
 
-  /* Allocate memory for exp(ikr) */
+  /* the exp(ikr) tables of the local atoms are allocated later */
   ew_dx = 2 * ew_nx + 1;
   ew_dy = 2 * ew_ny + 1;
   ew_dz = 2 * ew_nz + 1;
+
+#ifdef SM
+  /* SM uses tables of all atoms, see imd_sm.c */
   coskx = (real *) malloc( natoms * ew_dx * sizeof(real));
   sinkx = (real *) malloc( natoms * ew_dx * sizeof(real));
   cosky = (real *) malloc( natoms * ew_dy * sizeof(real));
@@ -543,15 +889,13 @@ void init_ewald(void)
     error("EWALD: Cannot allocate memory for exp(ikr)");
 
   /* Position independent initializations */
-  offx = ew_nx * natoms; 
-  offy = ew_ny * natoms; 
-  offz = ew_nz * natoms;
   for (i=0; i<natoms; i++) {
-    coskx[offx+i] = 1.0;
-    sinkx[offx+i] = 0.0;
-    cosky[offy+i] = 1.0;
-    sinky[offy+i] = 0.0;
-    coskz[offz+i] = 1.0;
-    sinkz[offz+i] = 0.0;
+    coskx[ew_nx*natoms+i] = 1.0;
+    sinkx[ew_nx*natoms+i] = 0.0;
+    cosky[ew_ny*natoms+i] = 1.0;
+    sinky[ew_ny*natoms+i] = 0.0;
+    coskz[ew_nz*natoms+i] = 1.0;
+    sinkz[ew_nz*natoms+i] = 0.0;
   }
+#endif
 }
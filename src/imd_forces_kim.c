@@ -743,7 +743,16 @@ void make_nblist()
       pa_max = MAX(pa_max, tn - tl[n]);
       tl[++n] = tn;
       if (tn > nb_max - 2 * pa_max) {
-	error("neighbor table full - increase nbl_size");
+	/* grow the neighbor table geometrically */
+	nb_max = (int)(MAX(nbl_size, 1.5) * nb_max);
+	tb = (int *)realloc(tb, nb_max * sizeof(int));
+	kim_nbl = (int *)realloc(kim_nbl, nb_max * sizeof(int));
+	if (kim.model_using_Rij == 1) {
+	  free(Rij);
+	  Rij = (real *)malloc(3 * nb_max * sizeof(real));
+	}
+	if ((tb == NULL) || (kim_nbl == NULL))
+	  error("cannot allocate neighbor table");
       }
     }
   }
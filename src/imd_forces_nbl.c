@@ -46,6 +46,109 @@
 
 int  *tl=NULL, *tb=NULL, *cl_off=NULL, *cl_num=NULL, nb_max=0;
 
+/* previous list, kept for incremental updates */
+int  *tl_old=NULL, *tb_old=NULL, nb_max_old=0;
+
+/*****************************************************************************
+
+  Half and full neighbor lists
+
+  By default, each pair of atoms is stored only once, and the force
+  loop updates both atoms (Newton's third law). With nbl_full, the
+  rows of the inner atoms contain all their neighbors, and the force
+  loop updates only atom i. Each pair is then computed twice, but no
+  forces need to be sent back to other CPUs, and the threads write
+  to disjoint atoms. The cells from which the row of the atoms in 
+  cell c are taken are nbl_nq[c*NBL_NQ] .. nbl_nq[c*NBL_NQ+NBL_NQ-1].
+
+******************************************************************************/
+
+#define NBL_NQ 27
+
+int  *nbl_nq=NULL;
+
+/*****************************************************************************
+
+  Threading of the force loop
+
+  The inner cells are grouped into colors, such that no two cells of
+  the same color write to the same cell (the cell itself and the
+  cells of its neighbor list). The cells of one color can thus be 
+  treated concurrently without locks. tl_off[k] is the index of the
+  first atom of inner cell k in tl. Energy and virial are first summed
+  per cell, and then added up in a fixed order, so that the results
+  do not depend on the number of threads.
+
+  With nbl_overlap, the interior cells of each color, whose rows are
+  taken from inner cells only, come first, and the boundary cells
+  follow from nbl_color_inner[color] on. The forces of the interior
+  cells are computed while the buffer cells are being filled.
+
+******************************************************************************/
+
+#define NBL_MAXCOLORS 128
+
+typedef struct {
+  real epot, virial, vir_xx, vir_yy, vir_zz;
+#ifdef SM
+  real sm_es_energy;
+#endif
+#ifdef TIMING
+  real npairs;
+#endif
+} nbl_sums;
+
+int  *tl_off=NULL, *nbl_cells=NULL, nbl_ncolors=0;
+int  nbl_color_start[NBL_MAXCOLORS+1];
+int  nbl_color_inner[NBL_MAXCOLORS];
+nbl_sums *cell_sums=NULL;
+
+/******************************************************************************
+
+  The force kernels for the atoms of one cell take the flag press,
+  which is always a constant at the call site. As they are inlined,
+  the compiler generates a variant with and one without the
+  pressure tensor, and calc_forces selects one of them for each step
+  with do_press_calc. On most steps, the tensor is not needed.
+
+******************************************************************************/
+
+#if defined(__GNUC__) || defined(__INTEL_COMPILER)
+#define NBL_KERNEL static inline __attribute__((always_inline))
+#else
+#define NBL_KERNEL static inline
+#endif
+
+#if defined(DIPOLE) || defined(KERMODE)
+static int dp_E_calc=0;  /* Number of field iterations */
+static int dp_p_calc=0;  /* Calculate dipoles or keep them */
+#endif
+
+#ifdef NBL_CLUSTER
+
+/*****************************************************************************
+
+  Cluster pair lists (parameter nbl_cluster)
+
+  The atoms of each cell are grouped into clusters of NBL_CLSIZE 
+  consecutive atoms (spatially compact with nbl_sort). Cluster ci
+  belongs to cell clu_cell[ci], the clusters of cell k are clu_off[k] 
+  .. clu_off[k+1]-1, and clu_bb holds their bounding boxes. Instead 
+  of atom pairs, the list stores pairs of clusters whose bounding 
+  boxes are closer than the list cutoff: the partners of i-cluster 
+  r are cp_list[cp_row[r]] .. cp_list[cp_row[r+1]-1], and the rows 
+  of inner cell c start at cr_off[c]. The force loop then computes 
+  all NBL_CLSIZE x NBL_CLSIZE atom pairs of a cluster pair from 
+  contiguous positions, without an index per atom pair.
+
+******************************************************************************/
+
+int  *clu_off=NULL, *clu_cell=NULL, *cr_off=NULL, *cp_row=NULL;
+int  *cp_list=NULL, cp_max=0;
+real *clu_bb=NULL;
+
+#endif
+
 
 /******************************************************************************
 *
@@ -61,7 +164,15 @@ void deallocate_nblist(void)
            nb_max * sizeof(int) / SQR(1024) );
 #endif
   if (tb) free(tb);
+  if (tb_old) free(tb_old);
   tb = NULL;
+  tb_old = NULL;
+  nb_max_old = 0;
+#ifdef NBL_CLUSTER
+  if (cp_list) free(cp_list);
+  cp_list = NULL;
+  cp_max  = 0;
+#endif
   have_valid_nbl = 0;
 }
 
@@ -127,20 +238,366 @@ int estimate_nblist_size(void)
   return tn;
 }
 
+/******************************************************************************
+*
+*  make_nbl_rows - neighbor rows of the atoms in cell c (c < ncells2)
+*
+*  Distances are taken between reference positions NBL_POS. If fill==0,
+*  the number of neighbors of atom n is stored in tl[n+1], otherwise 
+*  the neighbors are written to tb, starting at tl[n].
+*
+******************************************************************************/
+
+static void make_nbl_rows(int c, int fill)
+{
+  int  c1 = cnbrs[c].np, n = tl_off[c], i, *nq = nbl_nq + c * NBL_NQ;
+  cell *p = cell_array + c1;
+
+  /* for each atom in cell */
+  for (i=0; i<p->n; i++, n++) {
+
+    int    m, cnt = 0, *row = fill ? tb + tl[n] : NULL;
+    vektor d1;
+
+    d1.x = NBL_POS(p,i,X);
+    d1.y = NBL_POS(p,i,Y);
+#ifndef TWOD
+    d1.z = NBL_POS(p,i,Z);
+#endif
+
+    /* for each neighboring atom */
+    for (m=0; m<NBL_NQ; m++) {   /* this is not TWOD ready! */
+      int  c2, jstart, j;
+      cell *q;
+      c2 = nq[m];
+      if (c2<0) continue;
+      if ((c2==c1) && (0==nbl_full)) jstart = i+1;
+      else                           jstart = 0;
+      q = cell_array + c2;
+#ifdef ia64
+#pragma ivdep
+#endif
+      for (j=jstart; j<q->n; j++) {
+        vektor d;
+        real   r2;
+        if ((c2==c1) && (j==i)) continue;
+        d.x = NBL_POS(q,j,X) - d1.x;
+        d.y = NBL_POS(q,j,Y) - d1.y;
+#ifndef TWOD
+        d.z = NBL_POS(q,j,Z) - d1.z;
+#endif
+        r2  = SPROD(d,d);
+        if (r2 < cellsz) {
+          if (fill) row[cnt] = cl_off[c2] + j;
+          cnt++;
+        }
+      }
+    }
+    if (0==fill) tl[n+1] = cnt;
+  }
+}
+
+/******************************************************************************
+*
+*  sum_nbl_rows - turn neighbor counts in tl into offsets, 
+*                 and make sure tb is large enough
+*
+******************************************************************************/
+
+static void sum_nbl_rows(void)
+{
+  int n, nrows = tl_off[ncells2];
+
+  tl[0] = 0;
+  for (n=0; n<nrows; n++) tl[n+1] += tl[n];
+
+  if (tl[nrows] > nb_max) {
+    free(tb);
+    nb_max = MAX( (int) (nbl_size * tl[nrows]), NBLMINLEN );
+    tb     = (int *) malloc(nb_max * sizeof(int));
+    if (NULL==tb) error("cannot allocate neighbor table");
+  }
+  last_nbl_len = tl[nrows];
+}
+
+#ifdef NBL_CLUSTER
+
+/******************************************************************************
+*
+*  make_cluster_rows - cluster pair rows of the clusters in inner cell c
+*
+*  Like make_nbl_rows: if fill==0, the number of partners of row r is
+*  stored in cp_row[r+1], otherwise the partners are written to cp_list.
+*
+******************************************************************************/
+
+static void make_cluster_rows(int c, int fill)
+{
+  int c1 = cnbrs[c].np, r = cr_off[c], ci, *nq = nbl_nq + c * NBL_NQ;
+
+  for (ci=clu_off[c1]; ci<clu_off[c1+1]; ci++, r++) {
+
+    int  m, cnt = 0, *row = fill ? cp_list + cp_row[r] : NULL;
+    real *bi = clu_bb + 6 * ci;
+
+    for (m=0; m<NBL_NQ; m++) {
+      int c2 = nq[m], cj;
+      if (c2<0) continue;
+      /* each pair of clusters in the same cell only once */
+      for (cj=((c2==c1) ? ci : clu_off[c2]); cj<clu_off[c2+1]; cj++) {
+        real *bj = clu_bb + 6 * cj;
+        vektor d;
+        d.x = MAX( 0.0, MAX( bj[0] - bi[3], bi[0] - bj[3] ) );
+        d.y = MAX( 0.0, MAX( bj[1] - bi[4], bi[1] - bj[4] ) );
+        d.z = MAX( 0.0, MAX( bj[2] - bi[5], bi[2] - bj[5] ) );
+        if (SPROD(d,d) < cellsz) {
+          if (fill) row[cnt] = cj;
+          cnt++;
+        }
+      }
+    }
+    if (0==fill) cp_row[r+1] = cnt;
+  }
+}
+
+/******************************************************************************
+*
+*  make_cluster_list - clusters, their bounding boxes, and cluster pairs
+*
+******************************************************************************/
+
+static void make_cluster_list(void)
+{
+  static int clu_max=0, cell_max=0, row_max=0;
+  int c, k, nclu, nrows;
+
+  if (nallcells >= cell_max) {
+    cell_max = nallcells + 1;
+    clu_off  = (int *) realloc( clu_off, cell_max * sizeof(int) );
+    cr_off   = (int *) realloc( cr_off,  cell_max * sizeof(int) );
+    if ((NULL==clu_off) || (NULL==cr_off)) 
+      error("cannot allocate cluster list");
+  }
+
+  /* number the clusters */
+  nclu = 0;
+  for (k=0; k<nallcells; k++) {
+    clu_off[k] = nclu;
+    nclu += (cell_array[k].n + NBL_CLSIZE - 1) / NBL_CLSIZE;
+  }
+  clu_off[nallcells] = nclu;
+  nrows = 0;
+  for (c=0; c<ncells2; c++) {
+    cr_off[c] = nrows;
+    k = cnbrs[c].np;
+    nrows += clu_off[k+1] - clu_off[k];
+  }
+  cr_off[ncells2] = nrows;
+
+  if (nclu > clu_max) {
+    clu_max  = (int) (nbl_size * nclu);
+    clu_cell = (int  *) realloc( clu_cell, clu_max * sizeof(int) );
+    clu_bb   = (real *) realloc( clu_bb, 6 * clu_max * sizeof(real) );
+    if ((NULL==clu_cell) || (NULL==clu_bb))
+      error("cannot allocate cluster list");
+  }
+  if (nrows >= row_max) {
+    row_max = (int) (nbl_size * nrows) + 1;
+    cp_row  = (int *) realloc( cp_row, row_max * sizeof(int) );
+    if (NULL==cp_row) error("cannot allocate cluster list");
+  }
+
+  /* bounding boxes of the reference positions */
+#ifdef NBL_OMP
+#pragma omp parallel for schedule(runtime)
+#endif
+  for (k=0; k<nallcells; k++) {
+    cell *p = cell_array + k;
+    int  ci, i;
+    for (ci=clu_off[k]; ci<clu_off[k+1]; ci++) {
+      int  i0 = (ci - clu_off[k]) * NBL_CLSIZE;
+      real *b = clu_bb + 6 * ci;
+      clu_cell[ci] = k;
+      b[0] = b[3] = NBL_POS(p,i0,X);
+      b[1] = b[4] = NBL_POS(p,i0,Y);
+      b[2] = b[5] = NBL_POS(p,i0,Z);
+      for (i=i0+1; i<MIN(i0+NBL_CLSIZE,p->n); i++) {
+        b[0] = MIN( b[0], NBL_POS(p,i,X) );  b[3] = MAX( b[3], NBL_POS(p,i,X) );
+        b[1] = MIN( b[1], NBL_POS(p,i,Y) );  b[4] = MAX( b[4], NBL_POS(p,i,Y) );
+        b[2] = MIN( b[2], NBL_POS(p,i,Z) );  b[5] = MAX( b[5], NBL_POS(p,i,Z) );
+      }
+    }
+  }
+
+  /* count the partner clusters */
+#ifdef NBL_OMP
+#pragma omp parallel for schedule(runtime)
+#endif
+  for (c=0; c<ncells2; c++) make_cluster_rows(c, 0);
+  cp_row[0] = 0;
+  for (k=0; k<nrows; k++) cp_row[k+1] += cp_row[k];
+  if (cp_row[nrows] > cp_max) {
+    free(cp_list);
+    cp_max  = MAX( (int) (nbl_size * cp_row[nrows]), NBLMINLEN );
+    cp_list = (int *) malloc( cp_max * sizeof(int) );
+    if (NULL==cp_list) error("cannot allocate cluster list");
+  }
+
+  /* fill in the partner clusters */
+#ifdef NBL_OMP
+#pragma omp parallel for schedule(runtime)
+#endif
+  for (c=0; c<ncells2; c++) make_cluster_rows(c, 1);
+}
+
+#endif /* NBL_CLUSTER */
+
+/******************************************************************************
+*
+*  sort_cell_atoms - order the atoms in each cell along a Morton curve
+*
+*  Atoms which are close in space are then also close in memory, both in
+*  the cells and in the neighbor list. Must be called before the buffer
+*  cells are filled, and before the neighbor list is rebuilt.
+*
+******************************************************************************/
+
+typedef struct { unsigned int key; int i; } nbl_key_t;
+
+static int cmp_nbl_key(const void *a, const void *b)
+{
+  const nbl_key_t *u = (const nbl_key_t *) a, *v = (const nbl_key_t *) b;
+  if (u->key != v->key) return (u->key < v->key) ? -1 : 1;
+  return u->i - v->i;
+}
+
+/* interleave the lower 10 bits of x, y, and z */
+static unsigned int morton_key(unsigned int x, unsigned int y, unsigned int z)
+{
+  unsigned int key = 0;
+  int b;
+  for (b=9; b>=0; b--)
+    key = (key << 3) | (((x >> b) & 1) << 2) | (((y >> b) & 1) << 1) 
+                     |  ((z >> b) & 1);
+  return key;
+}
+
+/* position within the cell, in units of 1/1024 of the cell size */
+static unsigned int cell_frac(real s)
+{
+  int f = (int) (1024 * (s - FLOOR(s)));
+  return (unsigned int) MAX( 0, MIN( f, 1023 ) );
+}
+
+void sort_cell_atoms(void)
+{
+  static cell      tmp;
+  static nbl_key_t *keys = NULL;
+  static int       keys_max = 0;
+  int k, i;
+
+  for (k=0; k<ncells; k++) {
+
+    cell *p = CELLPTR(k);
+    if (p->n < 2) continue;
+
+    if (p->n > keys_max) {
+      keys = (nbl_key_t *) realloc( keys, p->n * sizeof(nbl_key_t) );
+      if (NULL==keys) error("cannot allocate sort keys");
+      keys_max = p->n;
+    }
+    if (p->n > tmp.n_max) alloc_cell( &tmp, p->n );
+
+    /* keys from the fractional cell coordinates */
+    for (i=0; i<p->n; i++) {
+      vektor d;
+      unsigned int fx, fy, fz = 0;
+      d.x = ORT(p,i,X);
+      d.y = ORT(p,i,Y);
+#ifndef TWOD
+      d.z = ORT(p,i,Z);
+      fz  = cell_frac( global_cell_dim.z * SPROD(d,tbox_z) );
+#endif
+      fx  = cell_frac( global_cell_dim.x * SPROD(d,tbox_x) );
+      fy  = cell_frac( global_cell_dim.y * SPROD(d,tbox_y) );
+      keys[i].i   = i;
+      keys[i].key = morton_key( fx, fy, fz );
+    }
+    qsort( keys, p->n, sizeof(nbl_key_t), cmp_nbl_key );
+
+    /* permute the atoms */
+    for (i=0; i<p->n; i++) copy_atom_cell_cell( &tmp, i, p, keys[i].i );
+    for (i=0; i<p->n; i++) copy_atom_cell_cell( p, i, &tmp, i );
+  }
+}
+
+/******************************************************************************
+*
+*  make_nbl_stencil - cells from which the neighbor rows are taken
+*
+******************************************************************************/
+
+static void make_nbl_stencil(void)
+{
+  int c, m;
+
+  for (c=0; c<ncells2; c++) {
+
+    int *nq = nbl_nq + c * NBL_NQ;
+
+    for (m=0; m<NBL_NQ; m++) nq[m] = -1;
+
+    if (0==nbl_full) {
+      /* the half stencil of the cell neighbor lists */
+      for (m=0; m<NNBCELL; m++) nq[m] = cnbrs[c].nq[m];
+    }
+    else {
+      /* all 27 cells around the cell */
+      int i, j, k, l, n, r, nn=0;
+      k = cnbrs[c].np % cell_dim.z;
+      j = (cnbrs[c].np / cell_dim.z) % cell_dim.y;
+      i = cnbrs[c].np / (cell_dim.z * cell_dim.y);
+      for (l=-1; l<=1; l++)
+        for (m=-1; m<=1; m++)
+          for (n=-1; n<=1; n++) {
+            ivektor g;
+            /* cells beyond a non-periodic boundary are not used */
+            g.x = i + l - 1 + my_coord.x * (cell_dim.x - 2);
+            g.y = j + m - 1 + my_coord.y * (cell_dim.y - 2);
+            g.z = k + n - 1 + my_coord.z * (cell_dim.z - 2);
+            r   = ((i+l) * cell_dim.y + (j+m)) * cell_dim.z + (k+n);
+            if (((pbc_dirs.x==1) || ((g.x>=0) && (g.x<global_cell_dim.x))) &&
+                ((pbc_dirs.y==1) || ((g.y>=0) && (g.y<global_cell_dim.y))) &&
+                ((pbc_dirs.z==1) || ((g.z>=0) && (g.z<global_cell_dim.z))))
+              nq[nn] = r;
+            nn++;
+          }
+    }
+  }
+}
+
 /******************************************************************************
 *
 *  make_nblist
 *
+*  The list is built in two passes over the cells, which are done
+*  in parallel with OpenMP. The first pass counts the neighbors of
+*  each atom, the second one fills in the neighbors.
+*
 ******************************************************************************/
 
 void make_nblist(void)
 {
-  static int at_max=0, pa_max=0, ncell_max=0;
-  int  c, i, k, n, tn, at, cc;
+  static int at_max=0, ncell_max=0, ncell2_max=0;
+  int  c, k, n, at;
 
-  /* update reference positions */
-  for (k=0; k<ncells; k++) {
-    cell *p = cell_array + cnbrs[k].np;
+  /* update reference positions, also in buffer cells */
+#ifdef NBL_OMP
+#pragma omp parallel for schedule(runtime)
+#endif
+  for (k=0; k<nallcells; k++) {
+    int  i;
+    cell *p = cell_array + k;
 #ifdef ia64
 #pragma ivdep,swp
 #endif
@@ -160,6 +617,19 @@ void make_nblist(void)
     ncell_max = nallcells;
   }
 
+  /* (re)allocate per cell offsets into tl, and the cell coloring */
+  if (ncells2 >= ncell2_max) {
+    ncell2_max = ncells2 + 1;
+    tl_off    = (int *) realloc( tl_off,    ncell2_max * sizeof(int) );
+    nbl_cells = (int *) realloc( nbl_cells, ncell2_max * sizeof(int) );
+    cell_sums = (nbl_sums *) realloc( cell_sums, ncell2_max*sizeof(nbl_sums));
+    nbl_nq    = (int *) realloc( nbl_nq, ncell2_max * NBL_NQ * sizeof(int) );
+    if ((tl_off==NULL) || (nbl_cells==NULL) || (cell_sums==NULL) ||
+        (nbl_nq==NULL))
+      error("cannot allocate neighbor table");
+  }
+  make_nbl_stencil();
+
   /* count atom numbers (including buffer atoms) */
   at=0;
   for (k=0; k<nallcells; k++) {
@@ -171,814 +641,2086 @@ void make_nblist(void)
   /* (re-)allocate neighbor table */
   if (at >= at_max) {
     free(tl);
+    free(tl_old);
     free(cl_num);
     at_max = (int) (nbl_size * at);
     tl     = (int *) malloc(at_max * sizeof(int));
     cl_num = (int *) malloc(at_max * sizeof(int));
+    tl_old = nbl_incremental ? (int *) malloc(at_max * sizeof(int)) : NULL;
   }
   if (NULL==tb) {
-    if (0==last_nbl_len) 
-      nb_max = MAX(((int) (nbl_size * estimate_nblist_size())), (NBLMINLEN));
-    else
-      nb_max = (int) (nbl_size * last_nbl_len);
-    tb = (int *) malloc(nb_max * sizeof(int));
-  }
-  else if (last_nbl_len * sqrt(nbl_size) > nb_max) {
-    free(tb);
-    nb_max = (int  ) (nbl_size * last_nbl_len);
+    nb_max = MAX( (int) (nbl_size * last_nbl_len), NBLMINLEN );
     tb     = (int *) malloc(nb_max * sizeof(int));
   }
 
 #ifdef LOADBALANCE
   if (lb_need_nbl_update == 1){
 	free(tl);
+	free(tl_old);
 	free(cl_num);
 	at_max = (int) (nbl_size * 2 * at);
 	tl     = (int *) malloc(at_max * sizeof(int));
 	cl_num = (int *) malloc(at_max * sizeof(int));
-
-	free(tb);
+	tl_old = nbl_incremental ? (int *) malloc(at_max * sizeof(int)) : NULL;
 	lb_need_nbl_update = 0;
-	int reqSize = (int)(nbl_size * estimate_nblist_size());
-	nb_max = MAX(reqSize, NBLMINLEN);
-	tb = (int *) malloc(nb_max * sizeof(int));
   }
 #endif
 
-  if ((tl==NULL) || (tb==NULL) || (cl_num==NULL)) 
+  if ((tl==NULL) || (tb==NULL) || (cl_num==NULL) ||
+      (nbl_incremental && (tl_old==NULL)))
     error("cannot allocate neighbor table");
 
   /* set cl_num */
-  n=0;
+#ifdef NBL_OMP
+#pragma omp parallel for schedule(runtime)
+#endif
   for (k=0; k<nallcells; k++) {
+    int  i, n = cl_off[k];
     cell *p = cell_array + k;
     for (i=0; i<p->n; i++) cl_num[n++] = k;
   }
 
-  /* for all cells */
-  n=0; tn=0; tl[0]=0;
+  /* first row of each cell */
+  n=0;
   for (c=0; c<ncells2; c++) {
+    tl_off[c] = n;
+    n += cell_array[ cnbrs[c].np ].n;
+  }
+  tl_off[ncells2] = n;
 
-    int  c1 = cnbrs[c].np;
-    cell *p = cell_array + c1;
+#ifdef TIMING
+  imd_start_timer(&time_nblist);
+#endif
 
-    /* for each atom in cell */
-    for (i=0; i<p->n; i++) {
+#ifdef NBL_CLUSTER
+  if (nbl_cluster) {
+    if (nbl_full || nbl_incremental)
+      error("nbl_cluster cannot be combined with nbl_full or nbl_incremental");
+    make_cluster_list();
+  }
+  else {
+#endif
 
-      int    m;
-      vektor d1;
+  /* count the neighbors */
+#ifdef NBL_OMP
+#pragma omp parallel for schedule(runtime)
+#endif
+  for (c=0; c<ncells2; c++) make_nbl_rows(c, 0);
+  sum_nbl_rows();
 
-      d1.x = ORT(p,i,X);
-      d1.y = ORT(p,i,Y);
-#ifndef TWOD
-      d1.z = ORT(p,i,Z);
+  /* fill in the neighbors */
+#ifdef NBL_OMP
+#pragma omp parallel for schedule(runtime)
 #endif
+  for (c=0; c<ncells2; c++) make_nbl_rows(c, 1);
 
-      /* for each neighboring atom */
-      for (m=0; m<NNBCELL; m++) {   /* this is not TWOD ready! */
-        int  c2, jstart, j;
-        cell *q;
-        c2 = cnbrs[c].nq[m];
-        if (c2<0) continue;
-        if (c2==c1) jstart = i+1;
-        else        jstart = 0;
-        q = cell_array + c2;
-#ifdef ia64
-#pragma ivdep
+#ifdef NBL_CLUSTER
+  }
 #endif
-        for (j=jstart; j<q->n; j++) {
-          vektor d;
-          real   r2;
-          d.x = ORT(q,j,X) - d1.x;
-          d.y = ORT(q,j,Y) - d1.y;
-#ifndef TWOD
-          d.z = ORT(q,j,Z) - d1.z;
+
+#ifdef TIMING
+  imd_stop_timer(&time_nblist);
 #endif
-          r2  = SPROD(d,d);
-          if (r2 < cellsz) {
-            tb[tn++] = cl_off[c2] + j;
-          }
-        }
-      }
-      pa_max = MAX(pa_max,tn-tl[n]);
-      tl[++n] = tn;
-      if (tn > nb_max-2*pa_max || n>at_max) {
-        error("neighbor table full - increase nbl_size");
-      }
-    }
-  }
-  last_nbl_len   = tn;
+
   have_valid_nbl = 1;
   nbl_count++;
+
+  color_nblist();
+  split_nbl_colors();
 }
 
 /******************************************************************************
 *
-*  calc_forces
+*  update_nblist
+*
+*  Incremental update of the neighbor list, without changing the cell
+*  decomposition. The reference positions are reset only in cells
+*  containing an atom which has moved by more than half the margin
+*  (and in their images in the buffer cells), and only the rows of
+*  cells having such a cell as neighbor are rebuilt; all other rows
+*  are copied from the previous list. As the rows are built from
+*  reference positions, the list remains valid as long as no atom
+*  has moved more than half the margin from its reference position.
+*  check_nblist makes sure that the reset reference positions are
+*  still inside their cells.
 *
 ******************************************************************************/
 
-void calc_forces(int steps)
+void update_nblist(void)
 {
-  int  i, b, k, n=0, is_short=0, idummy=0;
-  real tmpvec1[8], tmpvec2[8] = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+  static char *redo=NULL;
+  static int  moved_max=0, redo_max=0;
+  int  c, k, nrows = tl_off[ncells2], *tmp;
+  real r2max = SQR(0.5*nbl_margin);
+
+  if (nallcells > moved_max) {
+    nbl_moved = (char *) realloc( nbl_moved, nallcells * sizeof(char) );
+    if (NULL==nbl_moved) error("cannot allocate neighbor table");
+    moved_max = nallcells;
+  }
+  if (ncells2 > redo_max) {
+    redo = (char *) realloc( redo, ncells2 * sizeof(char) );
+    if (NULL==redo) error("cannot allocate neighbor table");
+    redo_max = ncells2;
+  }
+  memset( nbl_moved, 0, nallcells * sizeof(char) );
 
-#if defined(DIPOLE) || defined(KERMODE)
-  static int dp_E_calc=0; 	/* Number of field iterations */
-  int dp_it=0;			/* Number of dipole iterations */
-  int dp_p_calc=0;		/* Calculate dipoles or keep them */
-  /* TODO: Communicate! */
-  int dp_converged=0;
-  real dp_sum_old, dp_sum=1.,dp_sum_global=1.0;
-#ifndef KERMODE
-  real max_diff=10.;
-#endif
-#ifdef KERMODE
-  real pot1,pot2;
-  real max_diff=500.;
-#endif
-  real *dp_E_shift;
-  dp_p_calc = ((dp_fix-1 + dp_fix*dp_E_calc)>0 ) ? 0 : 1;
+#ifdef TIMING
+  imd_start_timer(&time_nblist);
 #endif
 
-  if (0==have_valid_nbl) {
-#ifdef MPI
-    /* check message buffer size */
-    if (0 == nbl_count % BUFSTEP) setup_buffers();
+  /* find cells with moved atoms, and reset their reference positions */
+#ifdef NBL_OMP
+#pragma omp parallel for schedule(runtime)
+#endif
+  for (k=0; k<ncells; k++) {
+    int  i, c1 = cnbrs[k].np;
+    cell *p = cell_array + c1;
+    for (i=0; i<p->n; i++) {
+      vektor d;
+      d.x = ORT(p,i,X) - NBL_POS(p,i,X);
+      d.y = ORT(p,i,Y) - NBL_POS(p,i,Y);
+#ifndef TWOD
+      d.z = ORT(p,i,Z) - NBL_POS(p,i,Z);
+#endif
+      if (SPROD(d,d) > r2max) { nbl_moved[c1] = 1; break; }
+    }
+    if (nbl_moved[c1]) {
+      for (i=0; i<p->n; i++) {
+        NBL_POS(p,i,X) = ORT(p,i,X);
+        NBL_POS(p,i,Y) = ORT(p,i,Y);
+#ifndef TWOD
+        NBL_POS(p,i,Z) = ORT(p,i,Z);
+#endif
+      }
+    }
+  }
+
+  /* update reference positions in buffer cells; 
+     buffer cells whose reference positions change are marked */
+  send_cells(copy_nblpos,pack_nblpos,unpack_nblpos);
+
+  /* rows to be rebuilt */
+  for (c=0; c<ncells2; c++) {
+    int m, *nq = nbl_nq + c * NBL_NQ;
+    redo[c] = nbl_moved[ cnbrs[c].np ];
+    for (m=0; m<NBL_NQ; m++)
+      if ((nq[m] >= 0) && nbl_moved[ nq[m] ]) redo[c] = 1;
+  }
+
+  /* keep the old list */
+  memcpy( tl_old, tl, (nrows+1) * sizeof(int) );
+  tmp = tb_old; tb_old = tb; tb = tmp;
+  k   = nb_max_old; nb_max_old = nb_max; nb_max = k;
+
+  /* count the neighbors */
+#ifdef NBL_OMP
+#pragma omp parallel for schedule(runtime)
+#endif
+  for (c=0; c<ncells2; c++) {
+    int n;
+    if (redo[c]) make_nbl_rows(c, 0);
+    else for (n=tl_off[c]; n<tl_off[c+1]; n++) tl[n+1] = tl_old[n+1]-tl_old[n];
+  }
+  sum_nbl_rows();
+
+  /* fill in the neighbors, or copy the old ones */
+#ifdef NBL_OMP
+#pragma omp parallel for schedule(runtime)
+#endif
+  for (c=0; c<ncells2; c++) {
+    if (redo[c]) make_nbl_rows(c, 1);
+    else memcpy( tb + tl[tl_off[c]], tb_old + tl_old[tl_off[c]], 
+                 (tl[tl_off[c+1]] - tl[tl_off[c]]) * sizeof(int) );
+  }
+
+#ifdef TIMING
+  imd_stop_timer(&time_nblist);
+#endif
+
+  have_valid_nbl = 1;
+  nbl_update_count++;
+}
+
+/******************************************************************************
+*
+*  color_nblist - group inner cells into colors without write conflicts
+*
+******************************************************************************/
+
+void color_nblist(void)
+{
+#ifdef NBL_OMP
+  static unsigned char *used=NULL;
+  static int *color=NULL, used_max=0, color_max=0;
+  int ncol[NBL_MAXCOLORS];
+  int c, k, m;
+
+  /* with full lists, all cells write to disjoint atoms */
+  if (nbl_full) {
+    for (k=0; k<ncells; k++) nbl_cells[k] = k;
+    nbl_ncolors = 1;
+    nbl_color_start[0] = 0;
+    nbl_color_start[1] = ncells;
+    return;
+  }
+
+  if (nallcells > used_max) {
+    used = (unsigned char *) realloc( used, nallcells * NBL_MAXCOLORS/8 );
+    if (NULL==used) error("cannot allocate cell coloring");
+    used_max = nallcells;
+  }
+  if (ncells > color_max) {
+    color = (int *) realloc( color, ncells * sizeof(int) );
+    if (NULL==color) error("cannot allocate cell coloring");
+    color_max = ncells;
+  }
+  memset( used, 0, nallcells * NBL_MAXCOLORS/8 );
+  for (c=0; c<NBL_MAXCOLORS; c++) ncol[c] = 0;
+
+  /* greedy coloring: take the first color not yet used by any
+     other cell writing to one of the cells we write to */
+  nbl_ncolors = 0;
+  for (k=0; k<ncells; k++) {
+    unsigned char avail[NBL_MAXCOLORS/8];
+    int t = cnbrs[k].np;
+    for (c=0; c<NBL_MAXCOLORS/8; c++) avail[c] = ~used[t*NBL_MAXCOLORS/8+c];
+    for (m=0; m<NNBCELL; m++) {
+      t = cnbrs[k].nq[m];
+      if (t<0) continue;
+      for (c=0; c<NBL_MAXCOLORS/8; c++) avail[c] &= ~used[t*NBL_MAXCOLORS/8+c];
+    }
+    for (c=0; c<NBL_MAXCOLORS; c++) if (avail[c/8] & (1 << (c%8))) break;
+    if (c==NBL_MAXCOLORS) error("too many colors in neighbor list");
+    color[k] = c;
+    ncol[c]++;
+    nbl_ncolors = MAX(nbl_ncolors, c+1);
+    t = cnbrs[k].np;
+    used[t*NBL_MAXCOLORS/8+c/8] |= 1 << (c%8);
+    for (m=0; m<NNBCELL; m++) {
+      t = cnbrs[k].nq[m];
+      if (t<0) continue;
+      used[t*NBL_MAXCOLORS/8+c/8] |= 1 << (c%8);
+    }
+  }
+
+  /* sort cells by color, keeping the original order within a color */
+  nbl_color_start[0] = 0;
+  for (c=0; c<nbl_ncolors; c++) 
+    nbl_color_start[c+1] = nbl_color_start[c] + ncol[c];
+  for (c=0; c<nbl_ncolors; c++) ncol[c] = nbl_color_start[c];
+  for (k=0; k<ncells; k++) nbl_cells[ ncol[color[k]]++ ] = k;
+#else
+  int k;
+
+  /* serial force loop: a single color in the original cell order */
+  for (k=0; k<ncells; k++) nbl_cells[k] = k;
+  nbl_ncolors = 1;
+  nbl_color_start[0] = 0;
+  nbl_color_start[1] = ncells;
+#endif
+}
+
+/******************************************************************************
+*
+*  split_nbl_colors - move the interior cells of each color to the front
+*
+******************************************************************************/
+
+void split_nbl_colors(void)
+{
+  static int *bnd=NULL, bnd_max=0;
+  int c, kk, m;
+
+  for (c=0; c<nbl_ncolors; c++) nbl_color_inner[c] = nbl_color_start[c];
+  if (0==nbl_overlap) return;
+
+  if (ncells > bnd_max) {
+    bnd = (int *) realloc( bnd, ncells * sizeof(int) );
+    if (NULL==bnd) error("cannot allocate cell coloring");
+    bnd_max = ncells;
+  }
+
+  /* stable partition of each color into interior and boundary cells */
+  for (c=0; c<nbl_ncolors; c++) {
+    int n = nbl_color_start[c], nb = 0;
+    for (kk=nbl_color_start[c]; kk<nbl_color_start[c+1]; kk++) {
+      int k = nbl_cells[kk], *nq = nbl_nq + k * NBL_NQ, inner = 1;
+      for (m=0; m<NBL_NQ; m++) {
+        int r = nq[m], x, y, z;
+        if (r<0) continue;
+        z = r % cell_dim.z;
+        y = (r / cell_dim.z) % cell_dim.y;
+        x = r / (cell_dim.z * cell_dim.y);
+        if ((x==0) || (x==cell_dim.x-1) || (y==0) || (y==cell_dim.y-1) ||
+            (z==0) || (z==cell_dim.z-1)) { inner = 0; break; }
+      }
+      if (inner) nbl_cells[n++] = k;
+      else       bnd[nb++]      = k;
+    }
+    nbl_color_inner[c] = n;
+    memcpy( nbl_cells + n, bnd, nb * sizeof(int) );
+  }
+}
+
+/******************************************************************************
+*
+*  add_cell_sums - add per cell energies and virials in cell order
+*
+******************************************************************************/
+
+static void add_cell_sums(void)
+{
+  int k;
+  for (k=0; k<ncells; k++) {
+    tot_pot_energy   += cell_sums[k].epot;
+    virial           += cell_sums[k].virial;
+    vir_xx           += cell_sums[k].vir_xx;
+    vir_yy           += cell_sums[k].vir_yy;
+    vir_zz           += cell_sums[k].vir_zz;
+#ifdef SM
+    tot_sm_es_energy += cell_sums[k].sm_es_energy;
+#endif
+#ifdef TIMING
+    nbl_npairs       += cell_sums[k].npairs;
+#endif
+  }
+}
+
+#ifdef NBL_SIMD
+
+/******************************************************************************
+*
+*  Blocked force kernels (parameter nbl_simd)
+*
+*  The neighbors of an atom are processed in blocks of NBL_BLOCK.
+*  Distances and types are first gathered into small arrays, the
+*  tables are then evaluated in a loop the compiler can vectorize,
+*  and finally the results are accumulated in list order, so that
+*  all sums are formed exactly as in the scalar loop. With nbl_simd 2,
+*  each block is also evaluated with the scalar code, and table values
+*  which are not bitwise identical are counted in nbl_simd_diff.
+*
+******************************************************************************/
+
+#if defined(__GNUC__) && !defined(__INTEL_COMPILER) && !defined(__clang__)
+#define NBL_SCALAR __attribute__((optimize("no-tree-vectorize")))
+#else
+#define NBL_SCALAR
+#endif
+
+#define NBL_DIFFER(a,b) memcmp( &(a), &(b), sizeof(real) )
+
+/******************************************************************************
+*
+*  check_pair_block - compare blocked pair kernel with scalar code
+*
+******************************************************************************/
+
+NBL_SCALAR static int check_pair_block(int nl, int *col, int *col2, real *r2,
+                                       real *pot, real *grad, real *rho_i,
+                                       real *rho_j)
+{
+  int l, ndiff = 0, idummy = 0, inc = ntypes * ntypes;
+
+  for (l=0; l<nl; l++) {
+    real p, g;
+    PAIR_INT(p, g, pair_pot, col[l], inc, r2[l], idummy);
+    if (NBL_DIFFER(p,pot[l]) || NBL_DIFFER(g,grad[l])) ndiff++;
+#ifdef EAM2
+    VAL_FUNC(p, rho_h_tab, col [l], inc, r2[l], idummy);
+    VAL_FUNC(g, rho_h_tab, col2[l], inc, r2[l], idummy);
+    if (NBL_DIFFER(p,rho_i[l]) || NBL_DIFFER(g,rho_j[l])) ndiff++;
+#endif
+  }
+  return ndiff;
+}
+
+#ifdef EAM2
+
+/******************************************************************************
+*
+*  check_eam_block - compare blocked EAM force kernel with scalar code
+*
+******************************************************************************/
+
+NBL_SCALAR static int check_eam_block(int nl, int *col1, int *col2, real *r2,
+                                      real df_i, real *df_j, real *grad)
+{
+  int l, ndiff = 0, idummy = 0, inc = ntypes * ntypes;
+
+  for (l=0; l<nl; l++) {
+    real rho_i_strich, rho_j_strich, g;
+    DERIV_FUNC(rho_i_strich, rho_h_tab, col1[l], inc, r2[l], idummy);
+    DERIV_FUNC(rho_j_strich, rho_h_tab, col2[l], inc, r2[l], idummy);
+    g = 0.5 * (df_i * rho_j_strich + df_j[l] * rho_i_strich);
+    if (NBL_DIFFER(g,grad[l])) ndiff++;
+  }
+  return ndiff;
+}
+
+#endif /* EAM2 */
+
+#endif /* NBL_SIMD */
+
+#ifdef NBL_CLUSTER
+
+/******************************************************************************
+*
+*  cluster_pair_forces - pair forces and EAM densities of the clusters
+*                        in inner cell k, with the cluster pair list
+*
+******************************************************************************/
+
+NBL_KERNEL void cluster_pair_forces(int k, nbl_sums *s, int *is_short,
+                                    int press)
+{
+  int  c1 = cnbrs[k].np, r = cr_off[k], ci, inc = ntypes * ntypes;
+  cell *p = cell_array + c1;
+
+  for (ci=clu_off[c1]; ci<clu_off[c1+1]; ci++, r++) {
+
+    int    i0 = (ci - clu_off[c1]) * NBL_CLSIZE, ni, ii, m;
+    vektor ff[NBL_CLSIZE];
+    real   ee[NBL_CLSIZE], eam_r[NBL_CLSIZE];
+#ifdef STRESS_TENS
+    sym_tensor pp[NBL_CLSIZE];
+#endif
+
+    ni = MIN( NBL_CLSIZE, p->n - i0 );
+    for (ii=0; ii<ni; ii++) {
+      ff[ii].x = ff[ii].y = ff[ii].z = 0.0;
+      ee[ii] = eam_r[ii] = 0.0;
+#ifdef STRESS_TENS
+      pp[ii].xx = pp[ii].yy = pp[ii].zz = 0.0;
+      pp[ii].yz = pp[ii].zx = pp[ii].xy = 0.0;
+#endif
+    }
+
+    /* for each partner cluster */
+    for (m=cp_row[r]; m<cp_row[r+1]; m++) {
+
+      int  cj = cp_list[m], c2 = clu_cell[cj], j0, nj;
+      cell *q = cell_array + c2;
+      j0 = (cj - clu_off[c2]) * NBL_CLSIZE;
+      nj = MIN( NBL_CLSIZE, q->n - j0 );
+
+      for (ii=0; ii<ni; ii++) {
+
+        int    i = i0 + ii, it = SORTE(p,i), jj;
+        vektor d1;
+        d1.x = ORT(p,i,X);
+        d1.y = ORT(p,i,Y);
+        d1.z = ORT(p,i,Z);
+
+        /* within a cluster, each atom pair only once */
+        for (jj=((cj==ci) ? ii+1 : 0); jj<nj; jj++) {
+
+          vektor d, force;
+          real   pot, grad, r2, rho_h;
+          int    j = j0 + jj, jt, col, col2;
+
+          d.x  = ORT(q,j,X) - d1.x;
+          d.y  = ORT(q,j,Y) - d1.y;
+          d.z  = ORT(q,j,Z) - d1.z;
+          r2   = SPROD(d,d);
+          jt   = SORTE(q,j);
+          col  = it * ntypes + jt;
+          col2 = jt * ntypes + it;
+
+          if (r2 <= pair_pot.end[col]) {
+            PAIR_INT(pot, grad, pair_pot, col, inc, r2, *is_short);
+#ifdef TIMING
+            s->npairs += 1.0;
+#endif
+            s->epot  += pot;
+            force.x   = d.x * grad;
+            force.y   = d.y * grad;
+            force.z   = d.z * grad;
+            KRAFT(q,j,X) -= force.x;
+            KRAFT(q,j,Y) -= force.y;
+            KRAFT(q,j,Z) -= force.z;
+            ff[ii].x += force.x;
+            ff[ii].y += force.y;
+            ff[ii].z += force.z;
+            pot      *= 0.5;   /* avoid double counting */
+            ee[ii]   += pot;
+            POTENG(q,j) += pot;
+#ifdef P_AXIAL
+            s->vir_xx -= d.x * force.x;
+            s->vir_yy -= d.y * force.y;
+            s->vir_zz -= d.z * force.z;
+#else
+            s->virial -= r2  * grad;
+#endif
+#ifdef STRESS_TENS
+            if (press) {
+              /* avoid double counting of the virial */
+              force.x *= 0.5;
+              force.y *= 0.5;
+              force.z *= 0.5;
+              pp[ii].xx -= d.x * force.x;
+              pp[ii].yy -= d.y * force.y;
+              pp[ii].xy -= d.x * force.y;
+              pp[ii].zz -= d.z * force.z;
+              pp[ii].yz -= d.y * force.z;
+              pp[ii].zx -= d.z * force.x;
+              PRESSTENS(q,j,xx) -= d.x * force.x;
+              PRESSTENS(q,j,yy) -= d.y * force.y;
+              PRESSTENS(q,j,xy) -= d.x * force.y;
+              PRESSTENS(q,j,zz) -= d.z * force.z;
+              PRESSTENS(q,j,yz) -= d.y * force.z;
+              PRESSTENS(q,j,zx) -= d.z * force.x;
+            }
+#endif
+          }
+
+#ifdef EAM2
+          /* host electron density */
+          if (r2 < rho_h_tab.end[col]) {
+            VAL_FUNC(rho_h, rho_h_tab, col, inc, r2, *is_short);
+            eam_r[ii] += rho_h;
+            if (it==jt) EAM_RHO(q,j) += rho_h;
+          }
+          if ((it!=jt) && (r2 < rho_h_tab.end[col2])) {
+            VAL_FUNC(rho_h, rho_h_tab, col2, inc, r2, *is_short);
+            EAM_RHO(q,j) += rho_h;
+          }
+#endif
+        }
+      }
+    }
+
+    /* add up the contributions to the atoms of cluster ci */
+    for (ii=0; ii<ni; ii++) {
+      int i = i0 + ii;
+      KRAFT(p,i,X) += ff[ii].x;
+      KRAFT(p,i,Y) += ff[ii].y;
+      KRAFT(p,i,Z) += ff[ii].z;
+      POTENG(p,i)  += ee[ii];
+#ifdef EAM2
+      EAM_RHO(p,i) += eam_r[ii];
+#endif
+#ifdef STRESS_TENS
+      if (press) {
+        PRESSTENS(p,i,xx) += pp[ii].xx;
+        PRESSTENS(p,i,yy) += pp[ii].yy;
+        PRESSTENS(p,i,xy) += pp[ii].xy;
+        PRESSTENS(p,i,zz) += pp[ii].zz;
+        PRESSTENS(p,i,yz) += pp[ii].yz;
+        PRESSTENS(p,i,zx) += pp[ii].zx;
+      }
+#endif
+    }
+  }
+}
+
+#ifdef EAM2
+
+/******************************************************************************
+*
+*  cluster_eam_forces - EAM forces of the clusters in inner cell k, 
+*                       with the cluster pair list
+*
+******************************************************************************/
+
+NBL_KERNEL void cluster_eam_forces(int k, nbl_sums *s, int *is_short,
+                                   int press)
+{
+  int  c1 = cnbrs[k].np, r = cr_off[k], ci, inc = ntypes * ntypes;
+  cell *p = cell_array + c1;
+
+  for (ci=clu_off[c1]; ci<clu_off[c1+1]; ci++, r++) {
+
+    int    i0 = (ci - clu_off[c1]) * NBL_CLSIZE, ni, ii, m;
+    vektor ff[NBL_CLSIZE];
+#ifdef STRESS_TENS
+    sym_tensor pp[NBL_CLSIZE];
+#endif
+
+    ni = MIN( NBL_CLSIZE, p->n - i0 );
+    for (ii=0; ii<ni; ii++) {
+      ff[ii].x = ff[ii].y = ff[ii].z = 0.0;
+#ifdef STRESS_TENS
+      pp[ii].xx = pp[ii].yy = pp[ii].zz = 0.0;
+      pp[ii].yz = pp[ii].zx = pp[ii].xy = 0.0;
+#endif
+    }
+
+    /* for each partner cluster */
+    for (m=cp_row[r]; m<cp_row[r+1]; m++) {
+
+      int  cj = cp_list[m], c2 = clu_cell[cj], j0, nj;
+      cell *q = cell_array + c2;
+      j0 = (cj - clu_off[c2]) * NBL_CLSIZE;
+      nj = MIN( NBL_CLSIZE, q->n - j0 );
+
+      for (ii=0; ii<ni; ii++) {
+
+        int    i = i0 + ii, it = SORTE(p,i), jj;
+        real   df_i = EAM_DF(p,i);
+        vektor d1;
+        d1.x = ORT(p,i,X);
+        d1.y = ORT(p,i,Y);
+        d1.z = ORT(p,i,Z);
+
+        /* within a cluster, each atom pair only once */
+        for (jj=((cj==ci) ? ii+1 : 0); jj<nj; jj++) {
+
+          vektor d, force;
+          real   r2, grad, rho_i_strich, rho_j_strich;
+          int    j = j0 + jj, jt, col1, col2;
+
+          d.x  = ORT(q,j,X) - d1.x;
+          d.y  = ORT(q,j,Y) - d1.y;
+          d.z  = ORT(q,j,Z) - d1.z;
+          r2   = SPROD(d,d);
+          jt   = SORTE(q,j);
+          col1 = jt * ntypes + it;
+          col2 = it * ntypes + jt;
+
+          if ((r2 >= rho_h_tab.end[col1]) && (r2 >= rho_h_tab.end[col2])) 
+            continue;
+
+          DERIV_FUNC(rho_i_strich, rho_h_tab, col1, inc, r2, *is_short);
+          if (col1==col2) rho_j_strich = rho_i_strich;
+          else DERIV_FUNC(rho_j_strich, rho_h_tab, col2, inc, r2, *is_short);
+
+          /* dF_i and dF_j are by 0.5 too big */
+          grad    = 0.5 * (df_i * rho_j_strich + EAM_DF(q,j) * rho_i_strich);
+          force.x = d.x * grad;
+          force.y = d.y * grad;
+          force.z = d.z * grad;
+          KRAFT(q,j,X) -= force.x;
+          KRAFT(q,j,Y) -= force.y;
+          KRAFT(q,j,Z) -= force.z;
+          ff[ii].x += force.x;
+          ff[ii].y += force.y;
+          ff[ii].z += force.z;
+#ifdef P_AXIAL
+          s->vir_xx -= d.x * force.x;
+          s->vir_yy -= d.y * force.y;
+          s->vir_zz -= d.z * force.z;
+#else
+          s->virial -= SPROD(d,force);
+#endif
+#ifdef STRESS_TENS
+          if (press) {
+            /* avoid double counting of the virial */
+            force.x *= 0.5;
+            force.y *= 0.5;
+            force.z *= 0.5;
+            pp[ii].xx -= d.x * force.x;
+            pp[ii].yy -= d.y * force.y;
+            pp[ii].zz -= d.z * force.z;
+            pp[ii].yz -= d.y * force.z;
+            pp[ii].zx -= d.z * force.x;
+            pp[ii].xy -= d.x * force.y;
+            PRESSTENS(q,j,xx) -= d.x * force.x;
+            PRESSTENS(q,j,yy) -= d.y * force.y;
+            PRESSTENS(q,j,zz) -= d.z * force.z;
+            PRESSTENS(q,j,yz) -= d.y * force.z;
+            PRESSTENS(q,j,zx) -= d.z * force.x;
+            PRESSTENS(q,j,xy) -= d.x * force.y;
+          }
+#endif
+        }
+      }
+    }
+
+    /* add up the contributions to the atoms of cluster ci */
+    for (ii=0; ii<ni; ii++) {
+      int i = i0 + ii;
+      KRAFT(p,i,X) += ff[ii].x;
+      KRAFT(p,i,Y) += ff[ii].y;
+      KRAFT(p,i,Z) += ff[ii].z;
+#ifdef STRESS_TENS
+      if (press) {
+        PRESSTENS(p,i,xx) += pp[ii].xx;
+        PRESSTENS(p,i,yy) += pp[ii].yy;
+        PRESSTENS(p,i,zz) += pp[ii].zz;
+        PRESSTENS(p,i,yz) += pp[ii].yz;
+        PRESSTENS(p,i,zx) += pp[ii].zx;
+        PRESSTENS(p,i,xy) += pp[ii].xy;
+      }
+#endif
+    }
+  }
+}
+
+#endif /* EAM2 */
+
+#endif /* NBL_CLUSTER */
+
+/******************************************************************************
+*
+*  pair_cell_forces - pair forces and EAM densities of the atoms in
+*                     inner cell k
+*
+******************************************************************************/
+
+NBL_KERNEL void pair_cell_forces(int k, nbl_sums *sums, int *short_dist,
+                                 int newton, int press)
+{
+  int      i, n = tl_off[k], is_short = 0;
+  cell     *p = cell_array + cnbrs[k].np;
+  real     pw = newton ? 1.0 : 0.5;
+  nbl_sums s  = {0.0};
+#if defined(DIPOLE) || defined(KERMODE)
+  real     *dp_E_shift;
+#endif
+#ifdef KERMODE
+  real     pot1, pot2;
+#endif
+
+#ifdef NBL_CLUSTER
+  if (nbl_cluster) cluster_pair_forces(k, &s, &is_short, press);
+  else
+#endif
+  for (i=0; i<p->n; i++) {
+
+#ifdef STRESS_TENS
+#ifdef TWOD
+    sym_tensor pp = {0.0,0.0,0.0};
+#else
+    sym_tensor pp = {0.0,0.0,0.0,0.0,0.0,0.0};
+#endif
+#endif
+#ifdef ADP
+    vektor     mu = {0.0,0.0,0.0};
+    sym_tensor la = {0.0,0.0,0.0,0.0,0.0,0.0};
+#endif
+#ifdef COULOMB
+    real       phi, grphi, chg;
+#endif
+#if defined(DIPOLE) || defined(KERMODE)
+    real       tmp;
+    vektor     Estat = {0.0,0.0,0.0};
+    vektor     pstat = {0.0,0.0,0.0};
+#endif
+#ifdef TWOD
+    vektor d1, ff = {0.0,0.0};
+#else
+    vektor d1, ff = {0.0,0.0,0.0};
+#endif
+    real   ee = 0.0;
+    real   eam_r = 0.0, eam_p = 0.0;
+    int    m, it, nb = 0;
+
+    d1.x = ORT(p,i,X);
+    d1.y = ORT(p,i,Y);
+#ifndef TWOD
+    d1.z = ORT(p,i,Z);
+#endif
+    it   = SORTE(p,i);
+
+#ifdef NBL_SIMD
+    /* loop over neighbors, in blocks */
+    if (nbl_simd) for (m=tl[n]; m<tl[n+1]; m+=NBL_BLOCK) {
+
+      int    l, nl = MIN( NBL_BLOCK, tl[n+1] - m ), sh = 0;
+      int    inc = ntypes * ntypes;
+      int    j[NBL_BLOCK], col[NBL_BLOCK], col2[NBL_BLOCK];
+      cell   *q[NBL_BLOCK];
+      real   dx[NBL_BLOCK], dy[NBL_BLOCK], dz[NBL_BLOCK], r2[NBL_BLOCK];
+      real   pot[NBL_BLOCK], grad[NBL_BLOCK];
+      real   rho_i[NBL_BLOCK], rho_j[NBL_BLOCK];
+
+      /* gather the neighbors */
+      for (l=0; l<nl; l++) {
+        int c, jt;
+        c       = cl_num[ tb[m+l] ];
+        j[l]    = tb[m+l] - cl_off[c];
+        q[l]    = cell_array + c;
+        dx[l]   = ORT(q[l],j[l],X) - d1.x;
+        dy[l]   = ORT(q[l],j[l],Y) - d1.y;
+        dz[l]   = ORT(q[l],j[l],Z) - d1.z;
+        jt      = SORTE(q[l],j[l]);
+        col [l] = it * ntypes + jt;
+        col2[l] = jt * ntypes + it;
+      }
+
+      /* evaluate the tables; values beyond the cutoff are not used */
+#pragma omp simd reduction(|:sh)
+      for (l=0; l<nl; l++) {
+        r2[l] = dx[l] * dx[l] + dy[l] * dy[l] + dz[l] * dz[l];
+        PAIR_INT(pot[l], grad[l], pair_pot, col[l], inc, r2[l], sh);
+#ifdef EAM2
+        VAL_FUNC(rho_i[l], rho_h_tab, col [l], inc, r2[l], sh);
+        VAL_FUNC(rho_j[l], rho_h_tab, col2[l], inc, r2[l], sh);
+#endif
+      }
+      if (sh) is_short = 1;
+      if (nbl_simd > 1) {
+        int ndiff = check_pair_block(nl, col, col2, r2, pot, grad, 
+                                     rho_i, rho_j);
+        if (ndiff) {
+#ifdef NBL_OMP
+#pragma omp atomic
+#endif
+          nbl_simd_diff += ndiff;
+        }
+      }
+
+      /* accumulate in list order */
+      for (l=0; l<nl; l++) {
+        vektor d, force;
+        d.x = dx[l];
+        d.y = dy[l];
+        d.z = dz[l];
+        if (r2[l] <= pair_pot.end[col[l]]) {
+#ifdef TIMING
+          s.npairs += 1.0;
+#endif
+          s.epot += pw * pot[l];
+          force.x = d.x * grad[l];
+          force.y = d.y * grad[l];
+          force.z = d.z * grad[l];
+          if (newton) {
+            KRAFT(q[l],j[l],X) -= force.x;
+            KRAFT(q[l],j[l],Y) -= force.y;
+            KRAFT(q[l],j[l],Z) -= force.z;
+          }
+          ff.x += force.x;
+          ff.y += force.y;
+          ff.z += force.z;
+          pot[l] *= 0.5;   /* avoid double counting */
+#ifdef NNBR
+          if (r2[l] < nb_r2_cut[col [l]]) nb++;
+          if (newton && (r2[l] < nb_r2_cut[col2[l]])) NBANZ(q[l],j[l])++;
+#endif
+          ee += pot[l];
+          if (newton) POTENG(q[l],j[l]) += pot[l];
+#ifdef P_AXIAL
+          s.vir_xx -= pw * d.x * force.x;
+          s.vir_yy -= pw * d.y * force.y;
+          s.vir_zz -= pw * d.z * force.z;
+#else
+          s.virial -= pw * r2[l] * grad[l];
+#endif
+#ifdef STRESS_TENS
+          if (press) {
+            /* avoid double counting of the virial */
+            force.x *= 0.5;
+            force.y *= 0.5;
+            force.z *= 0.5;
+            pp.xx -= d.x * force.x;
+            pp.yy -= d.y * force.y;
+            pp.xy -= d.x * force.y;
+            pp.zz -= d.z * force.z;
+            pp.yz -= d.y * force.z;
+            pp.zx -= d.z * force.x;
+            if (newton) {
+              PRESSTENS(q[l],j[l],xx) -= d.x * force.x;
+              PRESSTENS(q[l],j[l],yy) -= d.y * force.y;
+              PRESSTENS(q[l],j[l],xy) -= d.x * force.y;
+              PRESSTENS(q[l],j[l],zz) -= d.z * force.z;
+              PRESSTENS(q[l],j[l],yz) -= d.y * force.z;
+              PRESSTENS(q[l],j[l],zx) -= d.z * force.x;
+            }
+          }
+#endif
+        }
+#ifdef EAM2
+        if (r2[l] < rho_h_tab.end[col[l]]) eam_r += rho_i[l];
+        if (newton && (r2[l] < rho_h_tab.end[col2[l]])) 
+          EAM_RHO(q[l],j[l]) += rho_j[l];
+#endif
+      }
+    }
+    else
+#endif /* NBL_SIMD */
+
+    /* loop over neighbors */
+#ifdef ia64
+#pragma ivdep
+#endif
+    for (m=tl[n]; m<tl[n+1]; m++) {
+
+      vektor d, force;
+      cell   *q;
+      real   pot, grad, r2, rho_h;
+      int    c, j, jt, col, col2, inc = ntypes * ntypes;
+
+      c = cl_num[ tb[m] ];
+      j = tb[m] - cl_off[c];
+      q = cell_array + c;
+
+      d.x = ORT(q,j,X) - d1.x;
+      d.y = ORT(q,j,Y) - d1.y;
+#ifndef TWOD
+      d.z = ORT(q,j,Z) - d1.z;
+#endif
+      r2  = SPROD(d,d);
+      jt  = SORTE(q,j);
+      col = it * ntypes + jt;
+      col2= jt * ntypes + it;
+
+      /* compute pair interactions */
+#if defined(PAIR) || defined(KEATING)
+      /* PAIR and KEATING are mutually exclusive */
+#if defined(PAIR)
+      if (r2 <= pair_pot.end[col])
+#elif defined(KEATING)
+      if (r2 < keat_r2_cut[it][jt]) 
+#endif
+      {
+#if defined(PAIR)
+#ifdef LINPOT
+        PAIR_INT_LIN(pot, grad, pair_pot_lin, col, inc, r2, is_short);
+#else
+	PAIR_INT(pot, grad, pair_pot, col, inc, r2, is_short);
+#endif
+#elif defined(KEATING)
+        PAIR_INT_KEATING(pot, grad, it, jt, r2);
+#endif
+#ifdef TIMING
+        s.npairs += 1.0;
+#endif
+        s.epot += pw * pot;
+        force.x = d.x * grad;
+        force.y = d.y * grad;
+#ifndef TWOD
+        force.z = d.z * grad;
+#endif
+        if (newton) {
+          KRAFT(q,j,X) -= force.x;
+          KRAFT(q,j,Y) -= force.y;
+#ifndef TWOD
+          KRAFT(q,j,Z) -= force.z;
+#endif
+        }
+        ff.x         += force.x;
+        ff.y         += force.y;
+#ifndef TWOD
+        ff.z         += force.z;
 #endif
-    /* update cell decomposition */
-    fix_cells();
-  }
-
-  /* fill the buffer cells */
-  send_cells(copy_cell,pack_cell,unpack_cell);
 
-  /* make new neighbor lists */
-  if (0==have_valid_nbl) make_nblist();
+#ifdef FLAGEDATOMS
+	if(VSORTE(q,j) == flagedatomstype && VSORTE(p,i) == flagedatomstype)
+	  {
+	    //	      printf("Atom nr %d of type %d interacting with %d: Pair forces : %e %e %e\n",
+	    printf("%d %d %d %e %e %e %e %e %e\n",
+		   NUMMER(p,i),VSORTE(p,i),NUMMER(q,j),d.x, d.y, d.z, force.x,force.y,force.z);
+	    fflush(stdout);
+	  }
+#endif
 
-  /* clear global accumulation variables */
-  tot_pot_energy = 0.0;
-#ifdef SM
-  tot_sm_es_energy = 0.0;
+#ifndef MONOLJ
+        pot *= 0.5;   /* avoid double counting */
+#ifdef NNBR
+        if (r2 < nb_r2_cut[col ]) nb++;
+        if (newton && (r2 < nb_r2_cut[col2])) NBANZ(q,j)++;
+#endif
+#ifdef ORDPAR
+        if (r2 < op_r2_cut[col ]) ee += op_weight[col ] * pot;
+        if (newton && (r2 < op_r2_cut[col2]))
+          POTENG(q,j) += op_weight[col2] * pot;
+#else
+        ee += pot;
+        if (newton) POTENG(q,j) += pot;
+#endif
+#endif
+#ifdef P_AXIAL
+        s.vir_xx -= pw * d.x * force.x;
+        s.vir_yy -= pw * d.y * force.y;
+#ifndef TWOD
+        s.vir_zz -= pw * d.z * force.z;
+#endif
+#else
+        s.virial -= pw * r2  * grad;
 #endif
-  virial = 0.0;
-  vir_xx = 0.0;
-  vir_yy = 0.0;
-  vir_xy = 0.0;
-  vir_zz = 0.0;
-  vir_yz = 0.0;
-  vir_zx = 0.0;
-  nfc++;
 
-  /* clear per atom accumulation variables, also in buffer cells */
-  for (k=0; k<nallcells; k++) {
-    cell *p = cell_array + k;
-#ifdef ia64
-#pragma ivdep,swp
+#ifdef STRESS_TENS
+        if (press) {
+          /* avoid double counting of the virial */
+          force.x *= 0.5;
+          force.y *= 0.5;
+#ifndef TWOD
+          force.z *= 0.5;
 #endif
-    for (i=0; i<p->n; i++) {
-      KRAFT(p,i,X) = 0.0;
-      KRAFT(p,i,Y) = 0.0;
+          pp.xx -= d.x * force.x;
+          pp.yy -= d.y * force.y;
+          pp.xy -= d.x * force.y;
 #ifndef TWOD
-      KRAFT(p,i,Z) = 0.0;
+          pp.zz -= d.z * force.z;
+          pp.yz -= d.y * force.z;
+          pp.zx -= d.z * force.x;
 #endif
-#if defined(STRESS_TENS)
-      PRESSTENS(p,i,xx) = 0.0;
-      PRESSTENS(p,i,yy) = 0.0;
-      PRESSTENS(p,i,xy) = 0.0;
+          if (newton) {
+            PRESSTENS(q,j,xx) -= d.x * force.x;
+            PRESSTENS(q,j,yy) -= d.y * force.y;
+            PRESSTENS(q,j,xy) -= d.x * force.y;
 #ifndef TWOD
-      PRESSTENS(p,i,zz) = 0.0;
-      PRESSTENS(p,i,yz) = 0.0;
-      PRESSTENS(p,i,zx) = 0.0;
+            PRESSTENS(q,j,zz) -= d.z * force.z;
+            PRESSTENS(q,j,yz) -= d.y * force.z;
+            PRESSTENS(q,j,zx) -= d.z * force.x;
 #endif
-#endif     
-#ifndef MONOLJ
-      POTENG(p,i) = 0.0;
+          }
+	}
 #endif
-#ifdef NNBR
-      NBANZ(p,i) = 0;
+      }
+
+#endif /* PAIR || KEATING */
+
+#ifdef EAM2
+      /* compute host electron density */
+      if (r2 < rho_h_tab.end[col])  {
+        VAL_FUNC(rho_h, rho_h_tab, col, inc, r2, is_short);
+        eam_r += rho_h;
+#ifdef EEAM
+        eam_p += rho_h*rho_h; 
 #endif
-#ifdef CNA
-      if (cna) MARK(p,i) = 0;
+      }
+      /* with full lists, atom j collects its density in its own row */
+      if (newton && (it==jt)) {
+        if (r2 < rho_h_tab.end[col]) {
+          EAM_RHO(q,j) += rho_h;
+#ifdef EEAM
+          EAM_P(q,j) += rho_h*rho_h;
+#endif
+        } 
+      } else if (newton) {
+        if (r2 < rho_h_tab.end[col2]) {
+          VAL_FUNC(rho_h, rho_h_tab, col2, inc, r2, is_short);
+          EAM_RHO(q,j) += rho_h; 
+#ifdef EEAM
+          EAM_P(q,j) += rho_h*rho_h; 
+#endif
+        }
+      }
+#endif
+
+#ifdef ADP
+      /* compute adp_mu */
+      if (r2 < adp_upot.end[col])  {
+        VAL_FUNC(pot, adp_upot, col, inc, r2, is_short);
+        mu.x += pot * d.x;
+        mu.y += pot * d.y;
+        mu.z += pot * d.z;
+        if (newton) {
+          ADP_MU(q,j,X) -= pot * d.x;
+          ADP_MU(q,j,Y) -= pot * d.y;
+          ADP_MU(q,j,Z) -= pot * d.z;
+        }
+      }
+      /* compute adp_lambda */
+      if (r2 < adp_wpot.end[col])  {
+        VAL_FUNC(pot, adp_wpot, col, inc, r2, is_short);
+        la.xx += pot * d.x * d.x;
+        la.yy += pot * d.y * d.y;
+        la.zz += pot * d.z * d.z;
+        la.yz += pot * d.y * d.z;
+        la.zx += pot * d.z * d.x;
+        la.xy += pot * d.x * d.y;
+        if (newton) {
+          ADP_LAMBDA(q,j,xx) += pot * d.x * d.x;
+          ADP_LAMBDA(q,j,yy) += pot * d.y * d.y;
+          ADP_LAMBDA(q,j,zz) += pot * d.z * d.z;
+          ADP_LAMBDA(q,j,yz) += pot * d.y * d.z;
+          ADP_LAMBDA(q,j,zx) += pot * d.z * d.x;
+          ADP_LAMBDA(q,j,xy) += pot * d.x * d.y;
+        }
+      }
+#endif /* ADP */
+
+#ifdef COULOMB
+#ifdef VARCHG
+      chg = CHARGE(p,i) * CHARGE(q,j);
+#else
+      chg = charge[it]  * charge[jt];
+#endif
+#ifndef KERMODE
+      if (r2 < ew_r2_cut) {
+#endif
+#ifdef KERMODE
+      if (r2 < ke_tot_r2cut) {
+#endif
+	if (SQR(chg)>0.) {
+#ifdef SM
+          real cr_pot=0.0, cr_gr=0.0, na_pot_p=0.0, na_pot_q=0.0, na_gr_p=0.0, na_gr_q=0.0, sm_es_energy=0.0;
+          real z_sm_p = sm_Z[it] * CHARGE(q,j) * coul_eng;
+          real z_sm_q = sm_Z[jt] * CHARGE(p,i) * coul_eng;
+#endif
+	  /* Constant electric field from charges */
+	  /* Coulomb potential is in column 0 */
+          int incr = coul_table.ncols;
+	  PAIR_INT(phi, grphi, coul_table, 0, incr, r2, is_short);
+
+	  /* Coulomb Energy */
+	  pot     = chg * phi;
+#ifdef SM
+	  sm_es_energy  = chg * phi;
+#endif
+	  grad    = chg * grphi;
+#ifdef SM
+          /* Coulomb repulsion potential */
+          if (r2 < cr_pot_tab.end[col]) {
+            PAIR_INT(cr_pot, cr_gr, cr_pot_tab, col, inc, r2, is_short);
+            pot  += cr_pot * (chg * coul_eng - z_sm_p - z_sm_q);
+	    sm_es_energy  += cr_pot * (chg * coul_eng - z_sm_p - z_sm_q);
+            grad += cr_gr * (chg * coul_eng - z_sm_p - z_sm_q);
+          }
+          /* nuclear attraction potential */
+          if (r2 < na_pot_tab.end[col]) {
+            PAIR_INT(na_pot_p, na_gr_p, na_pot_tab, col, inc, r2, is_short);
+          }
+          if (r2 < na_pot_tab.end[col2]) {
+            PAIR_INT(na_pot_q, na_gr_q, na_pot_tab, col2, inc, r2,is_short);
+          }
+            pot  += z_sm_q * na_pot_p + z_sm_p * na_pot_q;
+            sm_es_energy += z_sm_q * na_pot_p + z_sm_p * na_pot_q;
+            grad += z_sm_q * na_gr_p + z_sm_p * na_gr_q;
+
+#endif
+
+#ifdef SM
+	  s.sm_es_energy += sm_es_energy;	
+#endif
+
+	  s.epot += pw * pot;
+	  force.x = d.x * grad;
+	  force.y = d.y * grad;
+	  force.z = d.z * grad;
+
+#ifdef EXTF
+	  real chg_single;
+#ifdef VARCHG
+	  chg_single = CHARGE(p,i);
+#else
+	  chg_single = charge[it];
+#endif
+	  force.x += chg_single * extf.x; 
+	  force.y += chg_single * extf.y; 
+	  force.z += chg_single * extf.z; 
+#endif /* EXTF */
+          
+	  if (newton) {
+	    KRAFT(q,j,X) -= force.x;
+	    KRAFT(q,j,Y) -= force.y;
+	    KRAFT(q,j,Z) -= force.z;
+	  }
+	  ff.x         += force.x;
+	  ff.y         += force.y;
+	  ff.z         += force.z;
+          pot          *= 0.5;   /* avoid double counting */
+	  ee           += pot;
+	  if (newton) POTENG(q,j) += pot;
+#ifdef P_AXIAL
+	  s.vir_xx -= pw * d.x * force.x;
+	  s.vir_yy -= pw * d.y * force.y;
+	  s.vir_zz -= pw * d.z * force.z;
+#else
+	  s.virial -= pw * r2  * grad;
+#endif
+
+#ifdef STRESS_TENS
+	  if (press) {
+	    /* avoid double counting of the virial */
+	    force.x *= 0.5;
+	    force.y *= 0.5;
+	    force.z *= 0.5;
+	    pp.xx -= d.x * force.x;
+	    pp.yy -= d.y * force.y;
+	    pp.xy -= d.x * force.y;
+	    pp.zz -= d.z * force.z;
+	    pp.yz -= d.y * force.z;
+	    pp.zx -= d.z * force.x;
+	    if (newton) {
+	      PRESSTENS(q,j,xx) -= d.x * force.x;
+	      PRESSTENS(q,j,yy) -= d.y * force.y;
+	      PRESSTENS(q,j,xy) -= d.x * force.y;
+	      PRESSTENS(q,j,zz) -= d.z * force.z;
+	      PRESSTENS(q,j,yz) -= d.y * force.z;
+	      PRESSTENS(q,j,zx) -= d.z * force.x;
+	    }
+	  }
+#endif
+
+#if defined(DIPOLE) || defined(KERMODE)
+#ifdef VARCHG
+	  /* Field for Dipole calculation */
+	  if (dp_p_calc) {
+#ifdef SM
+	    Estat.x += d.x * grphi * CHARGE(q,j)
+	      + d.x * coul_eng * (CHARGE(q,j)-sm_Z[jt])*na_gr_q;
+	    Estat.y += d.y * grphi * CHARGE(q,j)
+	      + d.y * coul_eng * (CHARGE(q,j)-sm_Z[jt])*na_gr_q;
+	    Estat.z += d.z * grphi * CHARGE(q,j)
+	      + d.z * coul_eng * (CHARGE(q,j)-sm_Z[jt])*na_gr_q;
+	    DP_E_STAT(q,j,X) -= d.x * grphi * CHARGE(p,i)
+	      + d.x * coul_eng * (CHARGE(p,i)-sm_Z[it])*na_gr_p;
+	    DP_E_STAT(q,j,Y) -= d.y * grphi * CHARGE(p,i)
+	      + d.y * coul_eng * (CHARGE(p,i)-sm_Z[it])*na_gr_p;
+	    DP_E_STAT(q,j,Z) -= d.z * grphi * CHARGE(p,i)
+	      + d.z * coul_eng * (CHARGE(p,i)-sm_Z[it])*na_gr_p;
+#else
+	    Estat.x += d.x * grphi * CHARGE(q,j);
+	    Estat.y += d.y * grphi * CHARGE(q,j);
+	    Estat.z += d.z * grphi * CHARGE(q,j);
+	    DP_E_STAT(q,j,X) -= d.x * grphi * CHARGE(p,i);
+	    DP_E_STAT(q,j,Y) -= d.y * grphi * CHARGE(p,i);
+	    DP_E_STAT(q,j,Z) -= d.z * grphi * CHARGE(p,i);
+#endif
+          }
+#else
+	  /* Field for Dipole calculation */
+	  if (dp_p_calc) {
+#ifndef KERMODE
+	    Estat.x += d.x * grphi * charge[jt];
+	    Estat.y += d.y * grphi * charge[jt];
+	    Estat.z += d.z * grphi * charge[jt];
+	    DP_E_STAT(q,j,X) -= d.x * grphi * charge[it];
+	    DP_E_STAT(q,j,Y) -= d.y * grphi * charge[it];
+	    DP_E_STAT(q,j,Z) -= d.z * grphi * charge[it];
+#endif
+#ifdef KERMODE
+	    //{1/r*exp(-br)*fc}
+            VAL_FUNC(pot1,coul_table,0, 2+ntypepairs, r2, is_short);
+            pot1 /=r2;
+            Estat.x -= d.x * pot1 * charge[jt];
+            Estat.y -= d.y * pot1 * charge[jt];
+            Estat.z -= d.z * pot1 * charge[jt];
+            DP_E_STAT(q,j,X) += d.x * pot1 * charge[it];
+            DP_E_STAT(q,j,Y) += d.y * pot1 * charge[it];
+            DP_E_STAT(q,j,Z) += d.z * pot1 * charge[it];    
+#endif
+#ifdef EXTF
+	    Estat.x += extf.x;
+	    Estat.y += extf.y;
+	    Estat.z += extf.z;
+	    DP_E_STAT(q,j,X) += extf.x;
+	    DP_E_STAT(q,j,Y) += extf.y;
+	    DP_E_STAT(q,j,Z) += extf.z;
+#endif
+	  }
+#endif
+#endif
+	}
+#if defined(DIPOLE) || defined(KERMODE)
+#ifdef VARCHG
+	/* calculate short-range dipoles field */
+	/* short-range fn.: 3rd column ff. */
+	if (dp_p_calc) {
+	  col=(it <= jt) ?
+	    it * ntypes + jt - ((it * (it + 1))/2)
+	    : jt * ntypes + it - ((jt * (jt + 1))/2);
+	  VAL_FUNC(pot,coul_table,2+col, 2+ntypepairs, r2, is_short);
+	  tmp = pot*CHARGE(q,j)*dp_alpha[it];
+	  if (SQR(tmp)>0) {
+	    pstat.x -= tmp * d.x;
+	    pstat.y -= tmp * d.y;
+	    pstat.z -= tmp * d.z;
+	  }
+	  tmp = pot*CHARGE(p,i)*dp_alpha[jt];
+	  if (SQR(tmp)>0){
+	    DP_P_STAT(q,j,X) += tmp * d.x;
+	    DP_P_STAT(q,j,Y) += tmp * d.y;
+	    DP_P_STAT(q,j,Z) += tmp * d.z;
+	  }
+	}
+#else
+	/* calculate short-range dipoles field */
+	/* short-range fn.: 3rd column ff. */
+	if (dp_p_calc) {
+	  col=(it <= jt) ?
+	    it * ntypes + jt - ((it * (it + 1))/2)
+	    : jt * ntypes + it - ((jt * (jt + 1))/2);
+#ifndef KERMODE
+	  VAL_FUNC(pot,coul_table,2+col, 2+ntypepairs, r2, is_short);
+	  tmp = pot*charge[jt]*dp_alpha[it];
+#endif
+#ifdef KERMODE
+          //{gij}
+          VAL_FUNC(pot2,coul_table,2+col, 2+ntypepairs, r2, is_short);
+          tmp = pot2*charge[jt]*dp_alpha[it]*pot1;     
+#endif
+	  if (SQR(tmp)>0) {
+	    pstat.x -= tmp * d.x;
+	    pstat.y -= tmp * d.y;
+	    pstat.z -= tmp * d.z;
+#ifdef EXTF
+	    pstat.x += dp_alpha[it] * extf.x;
+	    pstat.y += dp_alpha[it] * extf.y;
+	    pstat.z += dp_alpha[it] * extf.z;
+#endif
+	  }
+#ifndef KERMODE
+	  tmp = pot*charge[it]*dp_alpha[jt];
+#endif
+#ifdef KERMODE
+          tmp = pot2*charge[it]*dp_alpha[jt]*pot1;      
+#endif
+	  if (SQR(tmp)>0){
+	    DP_P_STAT(q,j,X) += tmp * d.x;
+	    DP_P_STAT(q,j,Y) += tmp * d.y;
+	    DP_P_STAT(q,j,Z) += tmp * d.z;
+#ifdef EXTF
+	    DP_P_STAT(q,j,X) += dp_alpha[jt] * extf.x;
+	    DP_P_STAT(q,j,Y) += dp_alpha[jt] * extf.y;
+	    DP_P_STAT(q,j,Z) += dp_alpha[jt] * extf.z;
+#endif
+	  }
+	}
 #endif
+#endif /* DIPOLE */
+      }
+#endif /* COULOMB */
+
 #ifdef COVALENT
-      NEIGH(p,i)->n = 0;
+      /* make neighbor tables for covalent systems */
+      if (r2 < neightab_r2cut[col]) {
+
+        neightab *neigh;
+
+        /* update neighbor table of particle i */
+        neigh = NEIGH(p,i);
+        if (neigh->n_max <= neigh->n) {
+          increase_neightab( neigh, neigh->n_max + NEIGH_LEN_INC );
+        }
+        neigh->typ[neigh->n] = jt;
+        neigh->cl [neigh->n] = q;
+        neigh->num[neigh->n] = j;
+        neigh->dist[3*neigh->n  ] = d.x;
+        neigh->dist[3*neigh->n+1] = d.y;
+        neigh->dist[3*neigh->n+2] = d.z;
+        neigh->n++;
+
+        /* update neighbor table of particle j */
+        neigh = NEIGH(q,j);
+        if (neigh->n_max <= neigh->n) {
+          increase_neightab( neigh, neigh->n_max + NEIGH_LEN_INC );
+        }
+        neigh->typ[neigh->n] = it;
+        neigh->cl [neigh->n] = p;
+        neigh->num[neigh->n] = i;
+        neigh->dist[3*neigh->n  ] = -d.x;
+        neigh->dist[3*neigh->n+1] = -d.y;
+        neigh->dist[3*neigh->n+2] = -d.z;
+        neigh->n++;
+      }
+#endif  /* COVALENT */
+
+    }
+    KRAFT(p,i,X) += ff.x;
+    KRAFT(p,i,Y) += ff.y;
+    KRAFT(p,i,Z) += ff.z;
+#ifndef MONOLJ
+    POTENG(p,i)  += ee;
 #endif
 #ifdef EAM2
-      EAM_RHO(p,i) = 0.0;
+    EAM_RHO(p,i) += eam_r;
 #ifdef EEAM
-      EAM_P(p,i) = 0.0;
+    EAM_P(p,i)   += eam_p;
 #endif
 #endif
 #ifdef ADP
-      ADP_MU    (p,i,X)  = 0.0;
-      ADP_MU    (p,i,Y)  = 0.0;
-      ADP_MU    (p,i,Z)  = 0.0;
-      ADP_LAMBDA(p,i,xx) = 0.0;
-      ADP_LAMBDA(p,i,yy) = 0.0;
-      ADP_LAMBDA(p,i,xy) = 0.0;
-      ADP_LAMBDA(p,i,zz) = 0.0;
-      ADP_LAMBDA(p,i,yz) = 0.0;
-      ADP_LAMBDA(p,i,zx) = 0.0;
+    ADP_MU    (p,i,X)  += mu.x;
+    ADP_MU    (p,i,Y)  += mu.y;
+    ADP_MU    (p,i,Z)  += mu.z;
+    ADP_LAMBDA(p,i,xx) += la.xx;
+    ADP_LAMBDA(p,i,yy) += la.yy;
+    ADP_LAMBDA(p,i,zz) += la.zz;
+    ADP_LAMBDA(p,i,yz) += la.yz;
+    ADP_LAMBDA(p,i,zx) += la.zx;
+    ADP_LAMBDA(p,i,xy) += la.xy;
 #endif
 #if defined(DIPOLE) || defined(KERMODE)
-      DP_E_STAT(p,i,X) = 0.0;
-      DP_E_STAT(p,i,Y) = 0.0;
-      DP_E_STAT(p,i,Z) = 0.0;
-      DP_P_STAT(p,i,X) = 0.0;
-      DP_P_STAT(p,i,Y) = 0.0;
-      DP_P_STAT(p,i,Z) = 0.0;
-      DP_E_IND(p,i,X)  = 0.0;
-      DP_E_IND(p,i,Y)  = 0.0;
-      DP_E_IND(p,i,Z)  = 0.0;
-      if ( dp_p_calc ) {
-	DP_P_IND(p,i,X)  = 0.0;
-	DP_P_IND(p,i,Y)  = 0.0;
-	DP_P_IND(p,i,Z)  = 0.0;
+    if (dp_p_calc) {
+      DP_E_STAT(p,i,X)   += Estat.x;
+      DP_E_STAT(p,i,Y)   += Estat.y;
+      DP_E_STAT(p,i,Z)   += Estat.z;
+      DP_P_STAT(p,i,X)   += pstat.x;
+      DP_P_STAT(p,i,Y)   += pstat.y;
+      DP_P_STAT(p,i,Z)   += pstat.z;
+      /* Field Extrapolation */
+      if (dp_E_calc>2) {
+	DP_E_IND(p,i,X) = 3.*DP_E_OLD_1(p,i,X) - 3.*DP_E_OLD_2(p,i,X) +
+	  DP_E_OLD_3(p,i,X);
+	DP_E_IND(p,i,Y) = 3.*DP_E_OLD_1(p,i,Y) - 3.*DP_E_OLD_2(p,i,Y) +
+	  DP_E_OLD_3(p,i,Y);
+	DP_E_IND(p,i,Z) = 3.*DP_E_OLD_1(p,i,Z) - 3.*DP_E_OLD_2(p,i,Z) +
+	  DP_E_OLD_3(p,i,Z);
+	DP_E_OLD_3(p,i,X) = 0.;
+	DP_E_OLD_3(p,i,Y) = 0.;
+	DP_E_OLD_3(p,i,Z) = 0.;
+      } else {
+	DP_E_IND(p,i,X) = DP_E_OLD_1(p,i,X);
+	DP_E_IND(p,i,Y) = DP_E_OLD_1(p,i,Y);
+	DP_E_IND(p,i,Z) = DP_E_OLD_1(p,i,Z);
       }
-#endif /* dipole */
     }
-  }
-
-  /* clear total forces */
-#ifdef RIGID
-  if ( nsuperatoms>0 ) 
-    for(i=0; i<nsuperatoms; i++) {
-      superforce[i].x = 0.0;
-      superforce[i].y = 0.0;
+#endif
+#ifdef STRESS_TENS
+    if (press) {
+      PRESSTENS(p,i,xx) += pp.xx;
+      PRESSTENS(p,i,yy) += pp.yy;
+      PRESSTENS(p,i,xy) += pp.xy;
 #ifndef TWOD
-      superforce[i].z = 0.0;
+      PRESSTENS(p,i,zz) += pp.zz;
+      PRESSTENS(p,i,yz) += pp.yz;
+      PRESSTENS(p,i,zx) += pp.zx;
 #endif
     }
 #endif
-
-#ifdef EWALD
-  if (steps==0) {
-    ewald_time.total = 0.0;
-    imd_start_timer( &ewald_time );
-  }
+#ifdef NNBR
+    NBANZ(p,i)    += nb;
 #endif
+    n++;
+  }
+#if defined(DIPOLE) || defined(KERMODE)
+  if (dp_p_calc) {
+    dp_E_shift = p->dp_E_old_3;
+    p->dp_E_old_3 = p->dp_E_old_2;
+    p->dp_E_old_2 = p->dp_E_old_1;
+    p->dp_E_old_1 = dp_E_shift;
+  }
+#endif /* DIPOLE */
+  *sums = s;
+  if (is_short) *short_dist = 1;
+}
 
-  /* pair interactions - for all atoms */
-  n=0;
-  for (k=0; k<ncells; k++) {
-    cell *p = cell_array + cnbrs[k].np;
-    for (i=0; i<p->n; i++) {
+#ifdef EAM2
+
+/******************************************************************************
+*
+*  eam_cell_forces - EAM forces of the atoms in inner cell k
+*
+******************************************************************************/
+
+NBL_KERNEL void eam_cell_forces(int k, nbl_sums *sums, int *short_dist,
+                                int newton, int press)
+{
+  int      i, n = tl_off[k], is_short = 0;
+  cell     *p = CELLPTR(k);
+  real     pw = newton ? 1.0 : 0.5;
+  nbl_sums s  = {0.0};
+
+#ifdef NBL_CLUSTER
+  if (nbl_cluster) cluster_eam_forces(k, &s, &is_short, press);
+  else
+#endif
+  for (i=0; i<p->n; i++) {
 
 #ifdef STRESS_TENS
-#ifdef TWOD
-      sym_tensor pp = {0.0,0.0,0.0};
-#else
-      sym_tensor pp = {0.0,0.0,0.0,0.0,0.0,0.0};
-#endif
+    sym_tensor pp = {0.0,0.0,0.0,0.0,0.0,0.0};
 #endif
 #ifdef ADP
-      real       tmp;
-      vektor     mu = {0.0,0.0,0.0};
-      sym_tensor la = {0.0,0.0,0.0,0.0,0.0,0.0};
-#endif
-#ifdef COULOMB
-      real       phi, grphi, chg;
-#endif
-#if defined(DIPOLE) || defined(KERMODE)
-      real       tmp;
-      vektor     Estat = {0.0,0.0,0.0};
-      vektor     pstat = {0.0,0.0,0.0};
+    sym_tensor la1;
+    vektor mu1;
 #endif
-#ifdef TWOD
-      vektor d1, ff = {0.0,0.0};
+    vektor d1, ff = {0.0,0.0,0.0};
+    int m, it;
+
+    d1.x = ORT(p,i,X);
+    d1.y = ORT(p,i,Y);
+    d1.z = ORT(p,i,Z);
+#ifdef ADP
+    mu1.x  = ADP_MU    (p,i,X);
+    mu1.y  = ADP_MU    (p,i,Y);
+    mu1.z  = ADP_MU    (p,i,Z);
+    la1.xx = ADP_LAMBDA(p,i,xx);
+    la1.yy = ADP_LAMBDA(p,i,yy);
+    la1.zz = ADP_LAMBDA(p,i,zz);
+    la1.yz = ADP_LAMBDA(p,i,yz);
+    la1.zx = ADP_LAMBDA(p,i,zx);
+    la1.xy = ADP_LAMBDA(p,i,xy);
+#endif
+    it   = SORTE(p,i);
+
+#ifdef NBL_SIMD
+    /* loop over neighbors, in blocks */
+    if (nbl_simd) for (m=tl[n]; m<tl[n+1]; m+=NBL_BLOCK) {
+
+      int    l, nl = MIN( NBL_BLOCK, tl[n+1] - m ), sh = 0;
+      int    inc = ntypes * ntypes;
+      int    j[NBL_BLOCK], col1[NBL_BLOCK], col2[NBL_BLOCK];
+      cell   *q[NBL_BLOCK];
+      real   dx[NBL_BLOCK], dy[NBL_BLOCK], dz[NBL_BLOCK], r2[NBL_BLOCK];
+      real   df_j[NBL_BLOCK], grad[NBL_BLOCK], df_i = EAM_DF(p,i);
+
+      /* gather the neighbors */
+      for (l=0; l<nl; l++) {
+        int c, jt;
+        c       = cl_num[ tb[m+l] ];
+        j[l]    = tb[m+l] - cl_off[c];
+        q[l]    = cell_array + c;
+        dx[l]   = ORT(q[l],j[l],X) - d1.x;
+        dy[l]   = ORT(q[l],j[l],Y) - d1.y;
+        dz[l]   = ORT(q[l],j[l],Z) - d1.z;
+        df_j[l] = EAM_DF(q[l],j[l]);
+        jt      = SORTE(q[l],j[l]);
+        col1[l] = jt * ntypes + it;
+        col2[l] = it * ntypes + jt;
+      }
+
+      /* evaluate the tables; values beyond the cutoff are not used */
+#pragma omp simd reduction(|:sh)
+      for (l=0; l<nl; l++) {
+        real rho_i_strich, rho_j_strich;
+        r2[l] = dx[l] * dx[l] + dy[l] * dy[l] + dz[l] * dz[l];
+        DERIV_FUNC(rho_i_strich, rho_h_tab, col1[l], inc, r2[l], sh);
+        DERIV_FUNC(rho_j_strich, rho_h_tab, col2[l], inc, r2[l], sh);
+        /* dF_i and dF_j are by 0.5 too big */
+        grad[l] = 0.5 * (df_i * rho_j_strich + df_j[l] * rho_i_strich);
+      }
+      if (sh) is_short = 1;
+      if (nbl_simd > 1) {
+        int ndiff = check_eam_block(nl, col1, col2, r2, df_i, df_j, grad);
+        if (ndiff) {
+#ifdef NBL_OMP
+#pragma omp atomic
+#endif
+          nbl_simd_diff += ndiff;
+        }
+      }
+
+      /* accumulate in list order */
+      for (l=0; l<nl; l++) {
+        vektor d, force;
+        if ((r2[l] >= rho_h_tab.end[col1[l]]) && 
+            (r2[l] >= rho_h_tab.end[col2[l]])) continue;
+        d.x = dx[l];
+        d.y = dy[l];
+        d.z = dz[l];
+        force.x = d.x * grad[l];
+        force.y = d.y * grad[l];
+        force.z = d.z * grad[l];
+        if (newton) {
+          KRAFT(q[l],j[l],X) -= force.x;
+          KRAFT(q[l],j[l],Y) -= force.y;
+          KRAFT(q[l],j[l],Z) -= force.z;
+        }
+        ff.x += force.x;
+        ff.y += force.y;
+        ff.z += force.z;
+#ifdef P_AXIAL
+        s.vir_xx -= pw * d.x * force.x;
+        s.vir_yy -= pw * d.y * force.y;
+        s.vir_zz -= pw * d.z * force.z;
 #else
-      vektor d1, ff = {0.0,0.0,0.0};
+        s.virial -= pw * SPROD(d,force);
 #endif
-      real   ee = 0.0;
-      real   eam_r = 0.0, eam_p = 0.0;
-      int    m, it, nb = 0;
-
-      d1.x = ORT(p,i,X);
-      d1.y = ORT(p,i,Y);
-#ifndef TWOD
-      d1.z = ORT(p,i,Z);
+#ifdef STRESS_TENS
+        if (press) {
+          /* avoid double counting of the virial */
+          force.x *= 0.5;
+          force.y *= 0.5;
+          force.z *= 0.5;
+          pp.xx -= d.x * force.x;
+          pp.yy -= d.y * force.y;
+          pp.zz -= d.z * force.z;
+          pp.yz -= d.y * force.z;
+          pp.zx -= d.z * force.x;
+          pp.xy -= d.x * force.y;
+          if (newton) {
+            PRESSTENS(q[l],j[l],xx) -= d.x * force.x;
+            PRESSTENS(q[l],j[l],yy) -= d.y * force.y;
+            PRESSTENS(q[l],j[l],zz) -= d.z * force.z;
+            PRESSTENS(q[l],j[l],yz) -= d.y * force.z;
+            PRESSTENS(q[l],j[l],zx) -= d.z * force.x;
+            PRESSTENS(q[l],j[l],xy) -= d.x * force.y;
+          }
+        }
 #endif
-      it   = SORTE(p,i);
+      }
+    }
+    else
+#endif /* NBL_SIMD */
 
-      /* loop over neighbors */
+    /* loop over neighbors */
 #ifdef ia64
-#pragma ivdep
+#pragma ivdep,swp
 #endif
-      for (m=tl[n]; m<tl[n+1]; m++) {
+    for (m=tl[n]; m<tl[n+1]; m++) {
 
-        vektor d, force;
-        cell   *q;
-        real   pot, grad, r2, rho_h;
-        int    c, j, jt, col, col2, inc = ntypes * ntypes;
+      vektor d, force = {0.0,0.0,0.0};
+      real   r2;
+      int    c, j, jt, col1, col2, inc = ntypes * ntypes, have_force=0;
+      cell   *q;
 
-        c = cl_num[ tb[m] ];
-        j = tb[m] - cl_off[c];
-        q = cell_array + c;
+      c = cl_num[ tb[m] ];
+      j = tb[m] - cl_off[c];
+      q = cell_array + c;
 
-        d.x = ORT(q,j,X) - d1.x;
-        d.y = ORT(q,j,Y) - d1.y;
-#ifndef TWOD
-        d.z = ORT(q,j,Z) - d1.z;
-#endif
-        r2  = SPROD(d,d);
-        jt  = SORTE(q,j);
-        col = it * ntypes + jt;
-        col2= jt * ntypes + it;
+      d.x  = ORT(q,j,X) - d1.x;
+      d.y  = ORT(q,j,Y) - d1.y;
+      d.z  = ORT(q,j,Z) - d1.z;
+      r2   = SPROD(d,d);
+      jt   = SORTE(q,j);
+      col1 = jt * ntypes + it;
+      col2 = it * ntypes + jt;
 
-        /* compute pair interactions */
-#if defined(PAIR) || defined(KEATING)
-        /* PAIR and KEATING are mutually exclusive */
-#if defined(PAIR)
-        if (r2 <= pair_pot.end[col])
-#elif defined(KEATING)
-        if (r2 < keat_r2_cut[it][jt]) 
-#endif
-	{
-#if defined(PAIR)
-#ifdef LINPOT
-          PAIR_INT_LIN(pot, grad, pair_pot_lin, col, inc, r2, is_short);
+      if ((r2 < rho_h_tab.end[col1]) || (r2 < rho_h_tab.end[col2])) {
+
+        real pot, grad, rho_i_strich, rho_j_strich, rho_i, rho_j;
+
+        /* take care: particle i gets its rho from particle j.    */
+        /* This is tabulated in column it*ntypes+jt.              */
+        /* Here we need the giving part from column jt*ntypes+it. */
+
+        /* rho_strich_i(r_ij) */
+#ifndef EEAM
+        DERIV_FUNC(rho_i_strich, rho_h_tab, col1, inc, r2, is_short);
 #else
-	  PAIR_INT(pot, grad, pair_pot, col, inc, r2, is_short);
-#endif
-#elif defined(KEATING)
-          PAIR_INT_KEATING(pot, grad, it, jt, r2);
-#endif
-          tot_pot_energy += pot;
-          force.x = d.x * grad;
-          force.y = d.y * grad;
-#ifndef TWOD
-          force.z = d.z * grad;
+        /* rho_strich_i(r_ij) and rho_i(r_ij) */
+        PAIR_INT(rho_i, rho_i_strich, rho_h_tab, col1, inc, r2, is_short);
 #endif
-          KRAFT(q,j,X) -= force.x;
-          KRAFT(q,j,Y) -= force.y;
-#ifndef TWOD
-          KRAFT(q,j,Z) -= force.z;
+
+        /* rho_strich_j(r_ij) */
+        if (col1==col2) {
+          rho_j_strich = rho_i_strich;
+#ifdef EEAM
+          rho_j = rho_i;
 #endif
-          ff.x         += force.x;
-          ff.y         += force.y;
-#ifndef TWOD
-          ff.z         += force.z;
+        } else {
+#ifndef EEAM
+          DERIV_FUNC(rho_j_strich, rho_h_tab, col2, inc, r2, is_short);
+#else
+          PAIR_INT(rho_j, rho_j_strich, rho_h_tab, col2, inc, r2, is_short);
 #endif
+	}
 
-#ifdef FLAGEDATOMS
-	  if(VSORTE(q,j) == flagedatomstype && VSORTE(p,i) == flagedatomstype)
-	    {
-	      //	      printf("Atom nr %d of type %d interacting with %d: Pair forces : %e %e %e\n",
-	      printf("%d %d %d %e %e %e %e %e %e\n",
-		     NUMMER(p,i),VSORTE(p,i),NUMMER(q,j),d.x, d.y, d.z, force.x,force.y,force.z);
-	      fflush(stdout);
-	    }
+        /* put together (dF_i and dF_j are by 0.5 too big) */
+        grad = 0.5 * (EAM_DF(p,i)*rho_j_strich + EAM_DF(q,j)*rho_i_strich);
+#ifdef EEAM
+        /* 0.5 times 2 from derivative simplified to 1 */
+        grad += (EAM_DM(p,i) * rho_j * rho_j_strich +
+                 EAM_DM(q,j) * rho_i * rho_i_strich);
 #endif
 
-#ifndef MONOLJ
-          pot *= 0.5;   /* avoid double counting */
-#ifdef NNBR
-          if (r2 < nb_r2_cut[col ]) nb++;
-          if (r2 < nb_r2_cut[col2]) NBANZ(q,j)++;
-#endif
-#ifdef ORDPAR
-          if (r2 < op_r2_cut[col ]) ee          += op_weight[col ] * pot;
-          if (r2 < op_r2_cut[col2]) POTENG(q,j) += op_weight[col2] * pot;
-#else
-          ee          += pot;
-          POTENG(q,j) += pot;
+        /* store force in temporary variable */
+        force.x = d.x * grad;
+        force.y = d.y * grad;
+        force.z = d.z * grad;
+        have_force=1;
+      }
+
+#ifdef ADP
+      /* forces due to dipole distortion */
+      if (r2 < adp_upot.end[col1]) {
+        vektor mu;
+        real pot, grad, tmp;
+        PAIR_INT(pot, grad, adp_upot, col1, inc, r2, is_short);
+        mu.x = mu1.x - ADP_MU(q,j,X);
+        mu.y = mu1.y - ADP_MU(q,j,Y);
+        mu.z = mu1.z - ADP_MU(q,j,Z);
+        tmp  = SPROD(mu,d) * grad;
+        force.x += mu.x * pot + tmp * d.x;
+        force.y += mu.y * pot + tmp * d.y;
+        force.z += mu.z * pot + tmp * d.z;
+        have_force=1;
+      }
+      /* forces due to quadrupole distortion */
+      if (r2 < adp_wpot.end[col1]) {
+        sym_tensor la;
+        vektor v;
+        real pot, grad, nu, f1, f2;
+        PAIR_INT(pot, grad, adp_wpot, col1, inc, r2, is_short);
+        la.xx = la1.xx + ADP_LAMBDA(q,j,xx);
+        la.yy = la1.yy + ADP_LAMBDA(q,j,yy);
+        la.zz = la1.zz + ADP_LAMBDA(q,j,zz);
+        la.yz = la1.yz + ADP_LAMBDA(q,j,yz);
+        la.zx = la1.zx + ADP_LAMBDA(q,j,zx);
+        la.xy = la1.xy + ADP_LAMBDA(q,j,xy);
+        v.x = la.xx * d.x + la.xy * d.y + la.zx * d.z;
+        v.y = la.xy * d.x + la.yy * d.y + la.yz * d.z;
+        v.z = la.zx * d.x + la.yz * d.y + la.zz * d.z;
+        nu  = (la.xx + la.yy + la.zz) / 3.0;
+        f1  = 2.0 * pot;
+        f2  = (SPROD(v,d) - nu * r2) * grad - nu * f1; 
+        force.x += f1 * v.x + f2 * d.x;
+        force.y += f1 * v.y + f2 * d.y;
+        force.z += f1 * v.z + f2 * d.z;
+        have_force=1;
+      }
 #endif
+
+#ifdef FLAGEDATOMS
+	if(VSORTE(q,j) == flagedatomstype && VSORTE(p,i) == flagedatomstype)
+	  {
+	    //	      printf("Atom nr %d of type %d interacting with %d: Embed forces : %e %e %e\n",
+	    //     NUMMER(p,i),VSORTE(p,i),NUMMER(q,j),force.x,force.y,force.z);
+	    printf("%d %d %d %e %e %e %e %e %e\n",
+		   NUMMER(p,i),VSORTE(p,i),NUMMER(q,j),d.x, d.y, d.z, force.x,force.y,force.z);
+	    fflush(stdout);
+	  }
 #endif
+      /* accumulate forces */
+      if (have_force) {
+        if (newton) {
+          KRAFT(q,j,X) -= force.x;
+          KRAFT(q,j,Y) -= force.y;
+          KRAFT(q,j,Z) -= force.z;
+        }
+        ff.x         += force.x;
+        ff.y         += force.y;
+        ff.z         += force.z;
 #ifdef P_AXIAL
-          vir_xx -= d.x * force.x;
-          vir_yy -= d.y * force.y;
-#ifndef TWOD
-          vir_zz -= d.z * force.z;
-#endif
+        s.vir_xx     -= pw * d.x * force.x;
+        s.vir_yy     -= pw * d.y * force.y;
+        s.vir_zz     -= pw * d.z * force.z;
 #else
-          virial -= r2  * grad;
+        s.virial     -= pw * SPROD(d,force);
 #endif
 
 #ifdef STRESS_TENS
-          if (do_press_calc) {
-            /* avoid double counting of the virial */
-            force.x *= 0.5;
-            force.y *= 0.5;
-#ifndef TWOD
-            force.z *= 0.5;
-#endif
-            pp.xx             -= d.x * force.x;
+        if (press) {
+          /* avoid double counting of the virial */
+          force.x *= 0.5;
+          force.y *= 0.5;
+          force.z *= 0.5;
+
+          pp.xx -= d.x * force.x;
+          pp.yy -= d.y * force.y;
+          pp.zz -= d.z * force.z;
+          pp.yz -= d.y * force.z;
+          pp.zx -= d.z * force.x;
+          pp.xy -= d.x * force.y;
+
+          if (newton) {
             PRESSTENS(q,j,xx) -= d.x * force.x;
-            pp.yy             -= d.y * force.y;
             PRESSTENS(q,j,yy) -= d.y * force.y;
-            pp.xy             -= d.x * force.y;
-            PRESSTENS(q,j,xy) -= d.x * force.y;
-#ifndef TWOD
-            pp.zz             -= d.z * force.z;
             PRESSTENS(q,j,zz) -= d.z * force.z;
-            pp.yz             -= d.y * force.z;
             PRESSTENS(q,j,yz) -= d.y * force.z;
-            pp.zx             -= d.z * force.x;
             PRESSTENS(q,j,zx) -= d.z * force.x;
+            PRESSTENS(q,j,xy) -= d.x * force.y;
+          }
+        }
 #endif
-	  }
+      }
+    }
+    KRAFT(p,i,X) += ff.x;
+    KRAFT(p,i,Y) += ff.y;
+    KRAFT(p,i,Z) += ff.z;
+#ifdef STRESS_TENS
+    if (press) {
+      PRESSTENS(p,i,xx) += pp.xx;
+      PRESSTENS(p,i,yy) += pp.yy;
+      PRESSTENS(p,i,zz) += pp.zz;
+      PRESSTENS(p,i,yz) += pp.yz;
+      PRESSTENS(p,i,zx) += pp.zx;
+      PRESSTENS(p,i,xy) += pp.xy;
+    }
 #endif
-        }
+    n++;
+  }
+  *sums = s;
+  if (is_short) *short_dist = 1;
+}
 
-#endif /* PAIR || KEATING */
+#endif /* EAM2 */
 
-#ifdef EAM2
-        /* compute host electron density */
-        if (r2 < rho_h_tab.end[col])  {
-          VAL_FUNC(rho_h, rho_h_tab, col, inc, r2, is_short);
-          eam_r += rho_h;
-#ifdef EEAM
-          eam_p += rho_h*rho_h; 
-#endif
-        }
-        if (it==jt) {
-          if (r2 < rho_h_tab.end[col]) {
-            EAM_RHO(q,j) += rho_h;
-#ifdef EEAM
-            EAM_P(q,j) += rho_h*rho_h;
-#endif
-          } 
-        } else {
-          if (r2 < rho_h_tab.end[col2]) {
-            VAL_FUNC(rho_h, rho_h_tab, col2, inc, r2, is_short);
-            EAM_RHO(q,j) += rho_h; 
-#ifdef EEAM
-            EAM_P(q,j) += rho_h*rho_h; 
-#endif
-          }
-        }
-#endif
+/******************************************************************************
+*
+*  tune_nbl_margin - adjust nbl_margin before a neighbor list rebuild
+*
+*  The time per force computation is averaged over windows of nbl_autotune
+*  rebuilds. Only calc_forces is timed, including the rebuilds of the
+*  list and the cell redistribution before them, so that output and
+*  other I/O do not disturb the tuning. The slowest CPU counts. After each window, the margin is changed by a relative
+*  step in the current direction; if the time got worse, the direction
+*  is reversed and the step is halved, otherwise the step grows again.
+*  The margin is limited by the actual cell size.
+*
+******************************************************************************/
 
-#ifdef ADP
-        /* compute adp_mu */
-        if (r2 < adp_upot.end[col])  {
-          VAL_FUNC(pot, adp_upot, col, inc, r2, is_short);
-          tmp = pot * d.x;  mu.x += tmp;  ADP_MU(q,j,X) -= tmp;
-          tmp = pot * d.y;  mu.y += tmp;  ADP_MU(q,j,Y) -= tmp;
-          tmp = pot * d.z;  mu.z += tmp;  ADP_MU(q,j,Z) -= tmp;
-        }
-        /* compute adp_lambda */
-        if (r2 < adp_wpot.end[col])  {
-          VAL_FUNC(pot, adp_wpot, col, inc, r2, is_short);
-          tmp = pot * d.x * d.x;  la.xx += tmp;  ADP_LAMBDA(q,j,xx) += tmp;
-          tmp = pot * d.y * d.y;  la.yy += tmp;  ADP_LAMBDA(q,j,yy) += tmp;
-          tmp = pot * d.z * d.z;  la.zz += tmp;  ADP_LAMBDA(q,j,zz) += tmp;
-          tmp = pot * d.y * d.z;  la.yz += tmp;  ADP_LAMBDA(q,j,yz) += tmp;
-          tmp = pot * d.z * d.x;  la.zx += tmp;  ADP_LAMBDA(q,j,zx) += tmp;
-          tmp = pot * d.x * d.y;  la.xy += tmp;  ADP_LAMBDA(q,j,xy) += tmp;
-        }
-#endif /* ADP */
+static imd_timer tune_timer;   /* calc_forces since the last adjustment */
 
-#ifdef COULOMB
-#ifdef VARCHG
-        chg = CHARGE(p,i) * CHARGE(q,j);
+static void tune_nbl_margin(int rebuild)
+{
+  static int    init=1, nrebuild=0, ncalls=0;
+  static double cost_old=0.0, step=-0.1;
+  static real   margin_min;
+  double cost, tmp;
+  real   margin_max;
+
+  if (init) {
+    imd_init_timer( &tune_timer, 0, NULL, NULL );
+    margin_min = 0.2 * nbl_margin;
+    nrebuild   = nbl_count;
+    init = 0;
+  }
+  if ((0==rebuild) || (nbl_count - nrebuild < nbl_autotune)) {
+    ncalls++;
+    return;
+  }
+
+  tmp = tune_timer.total / ncalls;
+#ifdef MPI
+  MPI_Allreduce( &tmp, &cost, 1, MPI_DOUBLE, MPI_MAX, cpugrid );
 #else
-	chg = charge[it]  * charge[jt];
+  cost = tmp;
 #endif
-#ifndef KERMODE
-	if (r2 < ew_r2_cut) {
-#endif
-#ifdef KERMODE
-        if (r2 < ke_tot_r2cut) {
-#endif
-	  if (SQR(chg)>0.) {
-#ifdef SM
-            real cr_pot=0.0, cr_gr=0.0, na_pot_p=0.0, na_pot_q=0.0, na_gr_p=0.0, na_gr_q=0.0, sm_es_energy=0.0;
-            real z_sm_p = sm_Z[it] * CHARGE(q,j) * coul_eng;
-            real z_sm_q = sm_Z[jt] * CHARGE(p,i) * coul_eng;
-#endif
-	    /* Constant electric field from charges */
-	    /* Coulomb potential is in column 0 */
-            int incr = coul_table.ncols;
-	    PAIR_INT(phi, grphi, coul_table, 0, incr, r2, is_short);
+  tune_timer.total = 0.0;
 
-	    /* Coulomb Energy */
-	    pot     = chg * phi;
-#ifdef SM
-	    sm_es_energy  = chg * phi;
+  if (cost_old > 0.0) {
+    if (cost > cost_old) step = -0.5 * step;
+    else                 step =  1.5 * step;
+    if (ABS(step) < 0.05) step = (step < 0.0) ? -0.05 : 0.05;
+    if (ABS(step) > 0.25) step = (step < 0.0) ? -0.25 : 0.25;
+  }
+  /* a rebuild at every step is a plateau, on which the time per step
+     does not tell in which direction the optimum lies */
+  if (ncalls <= nbl_count - nrebuild) step = ABS(step);
+  cost_old = cost;
+  ncalls   = 1;
+  nrebuild = nbl_count;
+
+  /* the list cutoff must not exceed the actual cell size */
+  margin_max = sqrt(height.x) / global_cell_dim.x;
+  margin_max = MIN( margin_max, sqrt(height.y) / global_cell_dim.y );
+#ifndef TWOD
+  margin_max = MIN( margin_max, sqrt(height.z) / global_cell_dim.z );
 #endif
-	    grad    = chg * grphi;
-#ifdef SM
-            /* Coulomb repulsion potential */
-            if (r2 < cr_pot_tab.end[col]) {
-              PAIR_INT(cr_pot, cr_gr, cr_pot_tab, col, inc, r2, is_short);
-              pot  += cr_pot * (chg * coul_eng - z_sm_p - z_sm_q);
-	      sm_es_energy  += cr_pot * (chg * coul_eng - z_sm_p - z_sm_q);
-              grad += cr_gr * (chg * coul_eng - z_sm_p - z_sm_q);
-            }
-            /* nuclear attraction potential */
-            if (r2 < na_pot_tab.end[col]) {
-              PAIR_INT(na_pot_p, na_gr_p, na_pot_tab, col, inc, r2, is_short);
-            }
-            if (r2 < na_pot_tab.end[col2]) {
-              PAIR_INT(na_pot_q, na_gr_q, na_pot_tab, col2, inc, r2,is_short);
-            }
-              pot  += z_sm_q * na_pot_p + z_sm_p * na_pot_q;
-              sm_es_energy += z_sm_q * na_pot_p + z_sm_p * na_pot_q;
-              grad += z_sm_q * na_gr_p + z_sm_p * na_gr_q;
+  margin_max -= nbl_rcut;
 
-#endif
+  nbl_margin = MAX( margin_min, MIN( margin_max, nbl_margin * (1.0+step) ) );
+  cellsz     = SQR( nbl_rcut + nbl_margin );
+}
 
-#ifdef SM
-	    tot_sm_es_energy += sm_es_energy;	
-#endif
+/******************************************************************************
+*
+*  interior_pair_forces - pair forces of part of the interior cells,
+*                         called while the buffer cells are filled
+*
+******************************************************************************/
 
-	    tot_pot_energy += pot;
-	    force.x = d.x * grad;
-	    force.y = d.y * grad;
-	    force.z = d.z * grad;
+#ifndef LOADBALANCE
 
-#ifdef EXTF
-	    real chg_single;
-#ifdef VARCHG
-	    chg_single = CHARGE(p,i);
-#else
-	    chg_single = charge[it];
+static int interior_short = 0;
+
+static void interior_pair_forces(int part, int nparts)
+{
+  int color, kk, is_short = 0, newton = (0==nbl_full);
+
+  for (color=0; color<nbl_ncolors; color++) {
+    int n  = nbl_color_inner[color] - nbl_color_start[color];
+    int lo = nbl_color_start[color] + (n *  part   ) / nparts;
+    int hi = nbl_color_start[color] + (n * (part+1)) / nparts;
+#ifdef NBL_OMP
+#pragma omp parallel for schedule(runtime) reduction(+:is_short)
 #endif
-	    force.x += chg_single * extf.x; 
-	    force.y += chg_single * extf.y; 
-	    force.z += chg_single * extf.z; 
-#endif /* EXTF */
-            
-	    KRAFT(q,j,X) -= force.x;
-	    KRAFT(q,j,Y) -= force.y;
-	    KRAFT(q,j,Z) -= force.z;
-	    ff.x         += force.x;
-	    ff.y         += force.y;
-	    ff.z         += force.z;
-            pot          *= 0.5;   /* avoid double counting */
-	    ee           += pot;
-	    POTENG(q,j)  += pot;
-#ifdef P_AXIAL
-	    vir_xx -= d.x * force.x;
-	    vir_yy -= d.y * force.y;
-	    vir_zz -= d.z * force.z;
-#else
-	    virial -= r2  * grad;
+  for (kk=lo; kk<hi; kk++) {
+    int k = nbl_cells[kk];
+#ifdef STRESS_TENS
+    if (do_press_calc)
+      pair_cell_forces(k, cell_sums + k, &is_short, newton, 1);
+    else
 #endif
+      pair_cell_forces(k, cell_sums + k, &is_short, newton, 0);
+  }
+  }
+  if (is_short) interior_short = 1;
+}
 
-#ifdef STRESS_TENS
-	    if (do_press_calc) {
-	      /* avoid double counting of the virial */
-	      force.x *= 0.5;
-	      force.y *= 0.5;
-	      force.z *= 0.5;
-	      pp.xx             -= d.x * force.x;
-	      PRESSTENS(q,j,xx) -= d.x * force.x;
-	      pp.yy             -= d.y * force.y;
-	      PRESSTENS(q,j,yy) -= d.y * force.y;
-	      pp.xy             -= d.x * force.y;
-	      PRESSTENS(q,j,xy) -= d.x * force.y;
-	      pp.zz             -= d.z * force.z;
-	      PRESSTENS(q,j,zz) -= d.z * force.z;
-	      pp.yz             -= d.y * force.z;
-	      PRESSTENS(q,j,yz) -= d.y * force.z;
-	      pp.zx             -= d.z * force.x;
-	      PRESSTENS(q,j,zx) -= d.z * force.x;
-	    }
 #endif
 
-#if defined(DIPOLE) || defined(KERMODE)
-#ifdef VARCHG
-	    /* Field for Dipole calculation */
-	    if (dp_p_calc) {
-#ifdef SM
-	      Estat.x += d.x * grphi * CHARGE(q,j)
-		+ d.x * coul_eng * (CHARGE(q,j)-sm_Z[jt])*na_gr_q;
-	      Estat.y += d.y * grphi * CHARGE(q,j)
-		+ d.y * coul_eng * (CHARGE(q,j)-sm_Z[jt])*na_gr_q;
-	      Estat.z += d.z * grphi * CHARGE(q,j)
-		+ d.z * coul_eng * (CHARGE(q,j)-sm_Z[jt])*na_gr_q;
-	      DP_E_STAT(q,j,X) -= d.x * grphi * CHARGE(p,i)
-		+ d.x * coul_eng * (CHARGE(p,i)-sm_Z[it])*na_gr_p;
-	      DP_E_STAT(q,j,Y) -= d.y * grphi * CHARGE(p,i)
-		+ d.y * coul_eng * (CHARGE(p,i)-sm_Z[it])*na_gr_p;
-	      DP_E_STAT(q,j,Z) -= d.z * grphi * CHARGE(p,i)
-		+ d.z * coul_eng * (CHARGE(p,i)-sm_Z[it])*na_gr_p;
+/******************************************************************************
+*
+*  calc_forces
+*
+******************************************************************************/
+
+void calc_forces(int steps)
+{
+  int  i, b, k, n=0, is_short=0, idummy=0, color, kk;
+  /* with a valid neighbor list, the interior cells can be done
+     while the buffer cells are filled */
+#ifdef LOADBALANCE
+  int  overlap = 0;
 #else
-	      Estat.x += d.x * grphi * CHARGE(q,j);
-	      Estat.y += d.y * grphi * CHARGE(q,j);
-	      Estat.z += d.z * grphi * CHARGE(q,j);
-	      DP_E_STAT(q,j,X) -= d.x * grphi * CHARGE(p,i);
-	      DP_E_STAT(q,j,Y) -= d.y * grphi * CHARGE(p,i);
-	      DP_E_STAT(q,j,Z) -= d.z * grphi * CHARGE(p,i);
+  int  overlap = (nbl_overlap) && (have_valid_nbl > 0);
 #endif
-            }
-#else
-	    /* Field for Dipole calculation */
-	    if (dp_p_calc) {
+  /* with full lists, each pair is seen twice and only atom i is updated */
+  int  newton = (0==nbl_full);
+  real tmpvec1[8], tmpvec2[8] = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+
+#if defined(DIPOLE) || defined(KERMODE)
+  int dp_it=0;			/* Number of dipole iterations */
+  /* TODO: Communicate! */
+  int dp_converged=0;
+  real dp_sum_old, dp_sum=1.,dp_sum_global=1.0;
 #ifndef KERMODE
-	      Estat.x += d.x * grphi * charge[jt];
-	      Estat.y += d.y * grphi * charge[jt];
-	      Estat.z += d.z * grphi * charge[jt];
-	      DP_E_STAT(q,j,X) -= d.x * grphi * charge[it];
-	      DP_E_STAT(q,j,Y) -= d.y * grphi * charge[it];
-	      DP_E_STAT(q,j,Z) -= d.z * grphi * charge[it];
+  real max_diff=10.;
 #endif
 #ifdef KERMODE
-	      //{1/r*exp(-br)*fc}
-              VAL_FUNC(pot1,coul_table,0, 2+ntypepairs, r2, is_short);
-              pot1 /=r2;
-              Estat.x -= d.x * pot1 * charge[jt];
-              Estat.y -= d.y * pot1 * charge[jt];
-              Estat.z -= d.z * pot1 * charge[jt];
-              DP_E_STAT(q,j,X) += d.x * pot1 * charge[it];
-              DP_E_STAT(q,j,Y) += d.y * pot1 * charge[it];
-              DP_E_STAT(q,j,Z) += d.z * pot1 * charge[it];    
+  real pot1,pot2;
+  real max_diff=500.;
 #endif
-#ifdef EXTF
-	      Estat.x += extf.x;
-	      Estat.y += extf.y;
-	      Estat.z += extf.z;
-	      DP_E_STAT(q,j,X) += extf.x;
-	      DP_E_STAT(q,j,Y) += extf.y;
-	      DP_E_STAT(q,j,Z) += extf.z;
+  real *dp_E_shift;
+  dp_p_calc = ((dp_fix-1 + dp_fix*dp_E_calc)>0 ) ? 0 : 1;
 #endif
-	    }
+
+  /* adjust the margin, before the cells are fixed for the new list */
+  if (nbl_autotune > 0) {
+    tune_nbl_margin(0==have_valid_nbl);
+    imd_start_timer( &tune_timer );
+  }
+
+  if (0==have_valid_nbl) {
+#ifdef MPI
+    /* check message buffer size */
+    if (0 == nbl_count % BUFSTEP) setup_buffers();
+#endif
+    /* update cell decomposition */
+    fix_cells();
+    /* restore spatial order of the atoms */
+    if ((nbl_sort > 0) && (0 == nbl_count % nbl_sort)) sort_cell_atoms();
+  }
+
+  if (0==overlap) {
+    /* fill the buffer cells; while the neighbor list is valid, they
+       hold the same atoms in the same order, which only have moved */
+    if (0==have_valid_nbl) send_cells(copy_cell,pack_cell,unpack_cell);
+    else                   send_cells(copy_pos, pack_pos, unpack_pos);
+
+    /* make new neighbor lists */
+    if      (0==have_valid_nbl) make_nblist();
+    else if (0 >have_valid_nbl) update_nblist();
+  }
+
+  /* clear global accumulation variables */
+  tot_pot_energy = 0.0;
+#ifdef SM
+  tot_sm_es_energy = 0.0;
+#endif
+  virial = 0.0;
+  vir_xx = 0.0;
+  vir_yy = 0.0;
+  vir_xy = 0.0;
+  vir_zz = 0.0;
+  vir_yz = 0.0;
+  vir_zx = 0.0;
+  nfc++;
+
+  /* clear per atom accumulation variables, also in buffer cells */
+#ifdef NBL_OMP
+#pragma omp parallel for schedule(runtime)
 #endif
+  for (k=0; k<nallcells; k++) {
+    int  i;
+    cell *p = cell_array + k;
+#ifdef ia64
+#pragma ivdep,swp
 #endif
-	  }
-#if defined(DIPOLE) || defined(KERMODE)
-#ifdef VARCHG
-	  /* calculate short-range dipoles field */
-	  /* short-range fn.: 3rd column ff. */
-	  if (dp_p_calc) {
-	    col=(it <= jt) ?
-	      it * ntypes + jt - ((it * (it + 1))/2)
-	      : jt * ntypes + it - ((jt * (jt + 1))/2);
-	    VAL_FUNC(pot,coul_table,2+col, 2+ntypepairs, r2, is_short);
-	    tmp = pot*CHARGE(q,j)*dp_alpha[it];
-	    if (SQR(tmp)>0) {
-	      pstat.x -= tmp * d.x;
-	      pstat.y -= tmp * d.y;
-	      pstat.z -= tmp * d.z;
-	    }
-	    tmp = pot*CHARGE(p,i)*dp_alpha[jt];
-	    if (SQR(tmp)>0){
-	      DP_P_STAT(q,j,X) += tmp * d.x;
-	      DP_P_STAT(q,j,Y) += tmp * d.y;
-	      DP_P_STAT(q,j,Z) += tmp * d.z;
-	    }
-	  }
-#else
-	  /* calculate short-range dipoles field */
-	  /* short-range fn.: 3rd column ff. */
-	  if (dp_p_calc) {
-	    col=(it <= jt) ?
-	      it * ntypes + jt - ((it * (it + 1))/2)
-	      : jt * ntypes + it - ((jt * (jt + 1))/2);
-#ifndef KERMODE
-	    VAL_FUNC(pot,coul_table,2+col, 2+ntypepairs, r2, is_short);
-	    tmp = pot*charge[jt]*dp_alpha[it];
+    for (i=0; i<p->n; i++) {
+      KRAFT(p,i,X) = 0.0;
+      KRAFT(p,i,Y) = 0.0;
+#ifndef TWOD
+      KRAFT(p,i,Z) = 0.0;
 #endif
-#ifdef KERMODE
-            //{gij}
-            VAL_FUNC(pot2,coul_table,2+col, 2+ntypepairs, r2, is_short);
-            tmp = pot2*charge[jt]*dp_alpha[it]*pot1;     
-#endif
-	    if (SQR(tmp)>0) {
-	      pstat.x -= tmp * d.x;
-	      pstat.y -= tmp * d.y;
-	      pstat.z -= tmp * d.z;
-#ifdef EXTF
-	      pstat.x += dp_alpha[it] * extf.x;
-	      pstat.y += dp_alpha[it] * extf.y;
-	      pstat.z += dp_alpha[it] * extf.z;
+#if defined(STRESS_TENS)
+#ifndef AVPOS
+      if (do_press_calc)
 #endif
-	    }
-#ifndef KERMODE
-	    tmp = pot*charge[it]*dp_alpha[jt];
+      {
+        PRESSTENS(p,i,xx) = 0.0;
+        PRESSTENS(p,i,yy) = 0.0;
+        PRESSTENS(p,i,xy) = 0.0;
+#ifndef TWOD
+        PRESSTENS(p,i,zz) = 0.0;
+        PRESSTENS(p,i,yz) = 0.0;
+        PRESSTENS(p,i,zx) = 0.0;
 #endif
-#ifdef KERMODE
-            tmp = pot2*charge[it]*dp_alpha[jt]*pot1;      
+      }
+#endif     
+#ifndef MONOLJ
+      POTENG(p,i) = 0.0;
 #endif
-	    if (SQR(tmp)>0){
-	      DP_P_STAT(q,j,X) += tmp * d.x;
-	      DP_P_STAT(q,j,Y) += tmp * d.y;
-	      DP_P_STAT(q,j,Z) += tmp * d.z;
-#ifdef EXTF
-	      DP_P_STAT(q,j,X) += dp_alpha[jt] * extf.x;
-	      DP_P_STAT(q,j,Y) += dp_alpha[jt] * extf.y;
-	      DP_P_STAT(q,j,Z) += dp_alpha[jt] * extf.z;
+#ifdef NNBR
+      NBANZ(p,i) = 0;
 #endif
-	    }
-	  }
+#ifdef CNA
+      if (cna) MARK(p,i) = 0;
 #endif
-#endif /* DIPOLE */
-	}
-#endif /* COULOMB */
-
 #ifdef COVALENT
-        /* make neighbor tables for covalent systems */
-        if (r2 < neightab_r2cut[col]) {
-
-          neightab *neigh;
-
-          /* update neighbor table of particle i */
-          neigh = NEIGH(p,i);
-          if (neigh->n_max <= neigh->n) {
-            increase_neightab( neigh, neigh->n_max + NEIGH_LEN_INC );
-          }
-          neigh->typ[neigh->n] = jt;
-          neigh->cl [neigh->n] = q;
-          neigh->num[neigh->n] = j;
-          neigh->dist[3*neigh->n  ] = d.x;
-          neigh->dist[3*neigh->n+1] = d.y;
-          neigh->dist[3*neigh->n+2] = d.z;
-          neigh->n++;
-
-          /* update neighbor table of particle j */
-          neigh = NEIGH(q,j);
-          if (neigh->n_max <= neigh->n) {
-            increase_neightab( neigh, neigh->n_max + NEIGH_LEN_INC );
-          }
-          neigh->typ[neigh->n] = it;
-          neigh->cl [neigh->n] = p;
-          neigh->num[neigh->n] = i;
-          neigh->dist[3*neigh->n  ] = -d.x;
-          neigh->dist[3*neigh->n+1] = -d.y;
-          neigh->dist[3*neigh->n+2] = -d.z;
-          neigh->n++;
-        }
-#endif  /* COVALENT */
-
-      }
-      KRAFT(p,i,X) += ff.x;
-      KRAFT(p,i,Y) += ff.y;
-      KRAFT(p,i,Z) += ff.z;
-#ifndef MONOLJ
-      POTENG(p,i)  += ee;
+      NEIGH(p,i)->n = 0;
 #endif
 #ifdef EAM2
-      EAM_RHO(p,i) += eam_r;
+      EAM_RHO(p,i) = 0.0;
 #ifdef EEAM
-      EAM_P(p,i)   += eam_p;
+      EAM_P(p,i) = 0.0;
 #endif
 #endif
 #ifdef ADP
-      ADP_MU    (p,i,X)  += mu.x;
-      ADP_MU    (p,i,Y)  += mu.y;
-      ADP_MU    (p,i,Z)  += mu.z;
-      ADP_LAMBDA(p,i,xx) += la.xx;
-      ADP_LAMBDA(p,i,yy) += la.yy;
-      ADP_LAMBDA(p,i,zz) += la.zz;
-      ADP_LAMBDA(p,i,yz) += la.yz;
-      ADP_LAMBDA(p,i,zx) += la.zx;
-      ADP_LAMBDA(p,i,xy) += la.xy;
+      ADP_MU    (p,i,X)  = 0.0;
+      ADP_MU    (p,i,Y)  = 0.0;
+      ADP_MU    (p,i,Z)  = 0.0;
+      ADP_LAMBDA(p,i,xx) = 0.0;
+      ADP_LAMBDA(p,i,yy) = 0.0;
+      ADP_LAMBDA(p,i,xy) = 0.0;
+      ADP_LAMBDA(p,i,zz) = 0.0;
+      ADP_LAMBDA(p,i,yz) = 0.0;
+      ADP_LAMBDA(p,i,zx) = 0.0;
 #endif
 #if defined(DIPOLE) || defined(KERMODE)
-      if (dp_p_calc) {
-	DP_E_STAT(p,i,X)   += Estat.x;
-	DP_E_STAT(p,i,Y)   += Estat.y;
-	DP_E_STAT(p,i,Z)   += Estat.z;
-	DP_P_STAT(p,i,X)   += pstat.x;
-	DP_P_STAT(p,i,Y)   += pstat.y;
-	DP_P_STAT(p,i,Z)   += pstat.z;
-	/* Field Extrapolation */
-	if (dp_E_calc>2) {
-	  DP_E_IND(p,i,X) = 3.*DP_E_OLD_1(p,i,X) - 3.*DP_E_OLD_2(p,i,X) +
-	    DP_E_OLD_3(p,i,X);
-	  DP_E_IND(p,i,Y) = 3.*DP_E_OLD_1(p,i,Y) - 3.*DP_E_OLD_2(p,i,Y) +
-	    DP_E_OLD_3(p,i,Y);
-	  DP_E_IND(p,i,Z) = 3.*DP_E_OLD_1(p,i,Z) - 3.*DP_E_OLD_2(p,i,Z) +
-	    DP_E_OLD_3(p,i,Z);
-	  DP_E_OLD_3(p,i,X) = 0.;
-	  DP_E_OLD_3(p,i,Y) = 0.;
-	  DP_E_OLD_3(p,i,Z) = 0.;
-	} else {
-	  DP_E_IND(p,i,X) = DP_E_OLD_1(p,i,X);
-	  DP_E_IND(p,i,Y) = DP_E_OLD_1(p,i,Y);
-	  DP_E_IND(p,i,Z) = DP_E_OLD_1(p,i,Z);
-	}
+      DP_E_STAT(p,i,X) = 0.0;
+      DP_E_STAT(p,i,Y) = 0.0;
+      DP_E_STAT(p,i,Z) = 0.0;
+      DP_P_STAT(p,i,X) = 0.0;
+      DP_P_STAT(p,i,Y) = 0.0;
+      DP_P_STAT(p,i,Z) = 0.0;
+      DP_E_IND(p,i,X)  = 0.0;
+      DP_E_IND(p,i,Y)  = 0.0;
+      DP_E_IND(p,i,Z)  = 0.0;
+      if ( dp_p_calc ) {
+	DP_P_IND(p,i,X)  = 0.0;
+	DP_P_IND(p,i,Y)  = 0.0;
+	DP_P_IND(p,i,Z)  = 0.0;
       }
-#endif
-#ifdef STRESS_TENS
-      if (do_press_calc) {
-        PRESSTENS(p,i,xx) += pp.xx;
-        PRESSTENS(p,i,yy) += pp.yy;
-        PRESSTENS(p,i,xy) += pp.xy;
+#endif /* dipole */
+    }
+  }
+
+  /* clear total forces */
+#ifdef RIGID
+  if ( nsuperatoms>0 ) 
+    for(i=0; i<nsuperatoms; i++) {
+      superforce[i].x = 0.0;
+      superforce[i].y = 0.0;
 #ifndef TWOD
-        PRESSTENS(p,i,zz) += pp.zz;
-        PRESSTENS(p,i,yz) += pp.yz;
-        PRESSTENS(p,i,zx) += pp.zx;
+      superforce[i].z = 0.0;
 #endif
-      }
+    }
 #endif
-#ifdef NNBR
-      NBANZ(p,i)    += nb;
+
+#ifdef EWALD
+  if (steps==0) {
+    ewald_time.total = 0.0;
+    imd_start_timer( &ewald_time );
+  }
 #endif
-      n++;
-    }
-#if defined(DIPOLE) || defined(KERMODE)
-    if (dp_p_calc) {
-      dp_E_shift = p->dp_E_old_3;
-      p->dp_E_old_3 = p->dp_E_old_2;
-      p->dp_E_old_2 = p->dp_E_old_1;
-      p->dp_E_old_1 = dp_E_shift;
-    }
-#endif /* DIPOLE */
+
+#ifndef LOADBALANCE
+  /* fill the buffer cells, doing the interior cells meanwhile;
+     the buffer cells keep their atom numbers, and unpacking does
+     not touch the accumulation variables cleared above */
+  if (overlap) {
+    interior_short = 0;
+    send_cells_overlap(copy_pos,pack_pos,unpack_pos,interior_pair_forces);
+    is_short = interior_short;
+  }
+#endif
+
+  /* pair interactions - for all atoms, one color of cells at a time;
+     with overlap, only the boundary cells are left */
+  for (color=0; color<nbl_ncolors; color++) {
+#ifdef NBL_OMP
+#pragma omp parallel for schedule(runtime) reduction(+:is_short)
+#endif
+  for (kk=(overlap ? nbl_color_inner[color] : nbl_color_start[color]); 
+       kk<nbl_color_start[color+1]; kk++) {
+    int k = nbl_cells[kk];
+#ifdef STRESS_TENS
+    if (do_press_calc)
+      pair_cell_forces(k, cell_sums + k, &is_short, newton, 1);
+    else
+#endif
+      pair_cell_forces(k, cell_sums + k, &is_short, newton, 0);
+  }
   }
+  add_cell_sums();
   if (is_short) fprintf(stderr,"Short distance, pair, step %d!\n",steps);
 
 #ifdef EWALD
@@ -990,6 +2732,7 @@ void calc_forces(int steps)
 #ifdef COVALENT
 
   /* complete neighbor tables for covalent systems */
+  n = tl_off[ncells];
   for (k=ncells; k<ncells2; k++) {
     cell *p = cell_array +cnbrs[k].np;
     for (i=0; i<p->n; i++) {
@@ -1073,12 +2816,16 @@ void calc_forces(int steps)
 #ifdef EAM2
 
   /* collect host electron density */
-  send_forces(add_rho,pack_rho,unpack_add_rho);
+  if (newton) send_forces(add_rho,pack_rho,unpack_add_rho);
 
   /* compute embedding energy and its derivative */
+#ifdef NBL_OMP
+#pragma omp parallel for schedule(runtime)
+#endif
   for (k=0; k<ncells; k++) {
     cell *p = CELLPTR(k);
-    real pot, tmp, tr;
+    real pot, tmp, tr, epot = 0.0;
+    int  i, idummy = 0;
 #ifdef ia64
 #pragma ivdep,swp
 #endif
@@ -1086,12 +2833,12 @@ void calc_forces(int steps)
       PAIR_INT( pot, EAM_DF(p,i), embed_pot, SORTE(p,i), 
                 ntypes, EAM_RHO(p,i), idummy);
       POTENG(p,i)    += pot;
-      tot_pot_energy += pot;
+      epot           += pot;
 #ifdef EEAM
       PAIR_INT( pot, EAM_DM(p,i), emod_pot, SORTE(p,i), 
                 ntypes, EAM_P(p,i), idummy);
       POTENG(p,i)    += pot;
-      tot_pot_energy += pot;
+      epot           += pot;
 #endif
 #ifdef ADP
       tr  = (ADP_LAMBDA(p,i,xx) + ADP_LAMBDA(p,i,yy) + ADP_LAMBDA(p,i,zz))/3.0;
@@ -1106,220 +2853,32 @@ void calc_forces(int steps)
       tmp = ADP_MU    (p,i,Z);       pot += SQR(tmp);
       pot *= 0.5;
       POTENG(p,i)    += pot;
-      tot_pot_energy += pot;
+      epot           += pot;
 #endif
     }
+    cell_sums[k].epot = epot;
   }
+  for (k=0; k<ncells; k++) tot_pot_energy += cell_sums[k].epot;
 
   /* distribute derivative of embedding energy */
   send_cells(copy_dF,pack_dF,unpack_dF);
 
-  /* EAM interactions - for all atoms */
-  n=0;
-  for (k=0; k<ncells; k++) {
-    cell *p = CELLPTR(k);
-    for (i=0; i<p->n; i++) {
-
-#ifdef STRESS_TENS
-      sym_tensor pp = {0.0,0.0,0.0,0.0,0.0,0.0};
-#endif
-#ifdef ADP
-      sym_tensor la1;
-      vektor mu1;
-#endif
-      vektor d1, ff = {0.0,0.0,0.0};
-      int m, it;
-
-      d1.x = ORT(p,i,X);
-      d1.y = ORT(p,i,Y);
-      d1.z = ORT(p,i,Z);
-#ifdef ADP
-      mu1.x  = ADP_MU    (p,i,X);
-      mu1.y  = ADP_MU    (p,i,Y);
-      mu1.z  = ADP_MU    (p,i,Z);
-      la1.xx = ADP_LAMBDA(p,i,xx);
-      la1.yy = ADP_LAMBDA(p,i,yy);
-      la1.zz = ADP_LAMBDA(p,i,zz);
-      la1.yz = ADP_LAMBDA(p,i,yz);
-      la1.zx = ADP_LAMBDA(p,i,zx);
-      la1.xy = ADP_LAMBDA(p,i,xy);
-#endif
-      it   = SORTE(p,i);
-
-      /* loop over neighbors */
-#ifdef ia64
-#pragma ivdep,swp
-#endif
-      for (m=tl[n]; m<tl[n+1]; m++) {
-
-        vektor d, force = {0.0,0.0,0.0};
-        real   r2;
-        int    c, j, jt, col1, col2, inc = ntypes * ntypes, have_force=0;
-        cell   *q;
-
-        c = cl_num[ tb[m] ];
-        j = tb[m] - cl_off[c];
-        q = cell_array + c;
-
-        d.x  = ORT(q,j,X) - d1.x;
-        d.y  = ORT(q,j,Y) - d1.y;
-        d.z  = ORT(q,j,Z) - d1.z;
-        r2   = SPROD(d,d);
-        jt   = SORTE(q,j);
-        col1 = jt * ntypes + it;
-        col2 = it * ntypes + jt;
-
-        if ((r2 < rho_h_tab.end[col1]) || (r2 < rho_h_tab.end[col2])) {
-
-          real pot, grad, rho_i_strich, rho_j_strich, rho_i, rho_j;
-
-          /* take care: particle i gets its rho from particle j.    */
-          /* This is tabulated in column it*ntypes+jt.              */
-          /* Here we need the giving part from column jt*ntypes+it. */
-
-          /* rho_strich_i(r_ij) */
-#ifndef EEAM
-          DERIV_FUNC(rho_i_strich, rho_h_tab, col1, inc, r2, is_short);
-#else
-          /* rho_strich_i(r_ij) and rho_i(r_ij) */
-          PAIR_INT(rho_i, rho_i_strich, rho_h_tab, col1, inc, r2, is_short);
-#endif
-
-          /* rho_strich_j(r_ij) */
-          if (col1==col2) {
-            rho_j_strich = rho_i_strich;
-#ifdef EEAM
-            rho_j = rho_i;
-#endif
-          } else {
-#ifndef EEAM
-            DERIV_FUNC(rho_j_strich, rho_h_tab, col2, inc, r2, is_short);
-#else
-            PAIR_INT(rho_j, rho_j_strich, rho_h_tab, col2, inc, r2, is_short);
-#endif
-	  }
-
-          /* put together (dF_i and dF_j are by 0.5 too big) */
-          grad = 0.5 * (EAM_DF(p,i)*rho_j_strich + EAM_DF(q,j)*rho_i_strich);
-#ifdef EEAM
-          /* 0.5 times 2 from derivative simplified to 1 */
-          grad += (EAM_DM(p,i) * rho_j * rho_j_strich +
-                   EAM_DM(q,j) * rho_i * rho_i_strich);
-#endif
-
-          /* store force in temporary variable */
-          force.x = d.x * grad;
-          force.y = d.y * grad;
-          force.z = d.z * grad;
-          have_force=1;
-        }
-
-#ifdef ADP
-        /* forces due to dipole distortion */
-        if (r2 < adp_upot.end[col1]) {
-          vektor mu;
-          real pot, grad, tmp;
-          PAIR_INT(pot, grad, adp_upot, col1, inc, r2, is_short);
-          mu.x = mu1.x - ADP_MU(q,j,X);
-          mu.y = mu1.y - ADP_MU(q,j,Y);
-          mu.z = mu1.z - ADP_MU(q,j,Z);
-          tmp  = SPROD(mu,d) * grad;
-          force.x += mu.x * pot + tmp * d.x;
-          force.y += mu.y * pot + tmp * d.y;
-          force.z += mu.z * pot + tmp * d.z;
-          have_force=1;
-        }
-        /* forces due to quadrupole distortion */
-        if (r2 < adp_wpot.end[col1]) {
-          sym_tensor la;
-          vektor v;
-          real pot, grad, nu, f1, f2;
-          PAIR_INT(pot, grad, adp_wpot, col1, inc, r2, is_short);
-          la.xx = la1.xx + ADP_LAMBDA(q,j,xx);
-          la.yy = la1.yy + ADP_LAMBDA(q,j,yy);
-          la.zz = la1.zz + ADP_LAMBDA(q,j,zz);
-          la.yz = la1.yz + ADP_LAMBDA(q,j,yz);
-          la.zx = la1.zx + ADP_LAMBDA(q,j,zx);
-          la.xy = la1.xy + ADP_LAMBDA(q,j,xy);
-          v.x = la.xx * d.x + la.xy * d.y + la.zx * d.z;
-          v.y = la.xy * d.x + la.yy * d.y + la.yz * d.z;
-          v.z = la.zx * d.x + la.yz * d.y + la.zz * d.z;
-          nu  = (la.xx + la.yy + la.zz) / 3.0;
-          f1  = 2.0 * pot;
-          f2  = (SPROD(v,d) - nu * r2) * grad - nu * f1; 
-          force.x += f1 * v.x + f2 * d.x;
-          force.y += f1 * v.y + f2 * d.y;
-          force.z += f1 * v.z + f2 * d.z;
-          have_force=1;
-        }
-#endif
-
-#ifdef FLAGEDATOMS
-	  if(VSORTE(q,j) == flagedatomstype && VSORTE(p,i) == flagedatomstype)
-	    {
-	      //	      printf("Atom nr %d of type %d interacting with %d: Embed forces : %e %e %e\n",
-	      //     NUMMER(p,i),VSORTE(p,i),NUMMER(q,j),force.x,force.y,force.z);
-	      printf("%d %d %d %e %e %e %e %e %e\n",
-		     NUMMER(p,i),VSORTE(p,i),NUMMER(q,j),d.x, d.y, d.z, force.x,force.y,force.z);
-	      fflush(stdout);
-	    }
-#endif
-        /* accumulate forces */
-        if (have_force) {
-          KRAFT(q,j,X) -= force.x;
-          KRAFT(q,j,Y) -= force.y;
-          KRAFT(q,j,Z) -= force.z;
-          ff.x         += force.x;
-          ff.y         += force.y;
-          ff.z         += force.z;
-#ifdef P_AXIAL
-          vir_xx       -= d.x * force.x;
-          vir_yy       -= d.y * force.y;
-          vir_zz       -= d.z * force.z;
-#else
-          virial       -= SPROD(d,force);
-#endif
-
-#ifdef STRESS_TENS
-          if (do_press_calc) {
-            /* avoid double counting of the virial */
-            force.x *= 0.5;
-            force.y *= 0.5;
-            force.z *= 0.5;
- 
-            pp.xx -= d.x * force.x;
-            pp.yy -= d.y * force.y;
-            pp.zz -= d.z * force.z;
-            pp.yz -= d.y * force.z;
-            pp.zx -= d.z * force.x;
-            pp.xy -= d.x * force.y;
-
-            PRESSTENS(q,j,xx) -= d.x * force.x;
-            PRESSTENS(q,j,yy) -= d.y * force.y;
-            PRESSTENS(q,j,zz) -= d.z * force.z;
-            PRESSTENS(q,j,yz) -= d.y * force.z;
-            PRESSTENS(q,j,zx) -= d.z * force.x;
-            PRESSTENS(q,j,xy) -= d.x * force.y;
-          }
+  /* EAM interactions - for all atoms, one color of cells at a time */
+  for (color=0; color<nbl_ncolors; color++) {
+#ifdef NBL_OMP
+#pragma omp parallel for schedule(runtime) reduction(+:is_short)
 #endif
-        }
-      }
-      KRAFT(p,i,X) += ff.x;
-      KRAFT(p,i,Y) += ff.y;
-      KRAFT(p,i,Z) += ff.z;
+  for (kk=nbl_color_start[color]; kk<nbl_color_start[color+1]; kk++) {
+    int k = nbl_cells[kk];
 #ifdef STRESS_TENS
-      if (do_press_calc) {
-        PRESSTENS(p,i,xx) += pp.xx;
-        PRESSTENS(p,i,yy) += pp.yy;
-        PRESSTENS(p,i,zz) += pp.zz;
-        PRESSTENS(p,i,yz) += pp.yz;
-        PRESSTENS(p,i,zx) += pp.zx;
-        PRESSTENS(p,i,xy) += pp.xy;
-      }
+    if (do_press_calc)
+      eam_cell_forces(k, cell_sums + k, &is_short, newton, 1);
+    else
 #endif
-      n++;
-    }
+      eam_cell_forces(k, cell_sums + k, &is_short, newton, 0);
   }
+  }
+  add_cell_sums();
   if (is_short) fprintf(stderr, "\n Short distance, EAM, step %d!\n",steps);
 
 #endif /* EAM2 */
@@ -1963,12 +3522,7 @@ real pconst_i=SQR(charge[it])+SQR(dp_alpha[it]);
   dp_E_calc++; 			/* increase field calc counter */
 #endif /* DIPOLE */
 
-  /* EWALD is only partially parallelized */
 #ifdef EWALD 
-#ifdef MPI
-  if ((ew_nmax >= 0) || (ew_kcut > 0)) 
-    error("option EWALD is only partially parallelized");
-#endif
   do_forces_ewald(steps);
 #endif 
 
@@ -1994,8 +3548,9 @@ real pconst_i=SQR(charge[it])+SQR(dp_alpha[it]);
 #endif
 
   /* add forces back to original cells/cpus */
-  send_forces(add_forces,pack_forces,unpack_forces);
+  if (newton) send_forces(add_forces,pack_forces,unpack_forces);
 
+  if (nbl_autotune > 0) imd_stop_timer( &tune_timer );
 }
 
 /******************************************************************************
@@ -2006,13 +3561,13 @@ real pconst_i=SQR(charge[it])+SQR(dp_alpha[it]);
 
 void check_nblist()
 {
-  real   r2, max1=0.0, max2;
+  real   r2, max1[2] = {0.0, 0.0}, max2[2];
   vektor d;
   int    k;
 
   /* compare with reference positions */
   for (k=0; k<NCELLS; k++) {
-    int  i;
+    int  i, moved=0;
     cell *p = CELLPTR(k);
 #ifdef ia64
 #pragma ivdep,swp
@@ -2024,16 +3579,56 @@ void check_nblist()
       d.z = ORT(p,i,Z) - NBL_POS(p,i,Z);
 #endif
       r2 = SPROD(d,d);
-      if (r2 > max1) max1 = r2;
+      if (r2 > max1[0]) max1[0] = r2;
+      if (r2 > SQR(0.5*nbl_margin)) moved = 1;
     }
+    /* for an incremental update, the reference positions to be
+       reset must still be inside their cell */
+    if ((nbl_incremental) && (moved) && (max1[1]==0.0) && 
+        (0==nbl_in_cell(CELLS(k)))) max1[1] = 1.0;
   }
 
 #ifdef MPI
-  MPI_Allreduce( &max1, &max2, 1, REAL, MPI_MAX, cpugrid); 
+  MPI_Allreduce( max1, max2, 2, REAL, MPI_MAX, cpugrid); 
 #else
-  max2 = max1;
+  max2[0] = max1[0];
+  max2[1] = max1[1];
 #endif
-  if (max2 > SQR(0.5*nbl_margin)) have_valid_nbl = 0;
+  if (max2[0] > SQR(0.5*nbl_margin)) 
+    have_valid_nbl = ((nbl_incremental) && (max2[1]==0.0)) ? -1 : 0;
+}
+
+/******************************************************************************
+*
+*  nbl_in_cell - check whether all atoms of cell k are inside that cell
+*
+******************************************************************************/
+
+int nbl_in_cell(int k)
+{
+  cell    *p = cell_array + k;
+  ivektor c;
+  int     i;
+
+  /* local coordinates of cell k */
+  c.z =  k % cell_dim.z;
+  c.y = (k / cell_dim.z) % cell_dim.y;
+  c.x =  k / (cell_dim.z * cell_dim.y);
+
+  for (i=0; i<p->n; i++) {
+    vektor  x;
+    ivektor g;
+    x.x = ORT(p,i,X);
+    x.y = ORT(p,i,Y);
+    x.z = ORT(p,i,Z);
+    /* like cell_coord, but without folding back into the box */
+    g.x = (int) FLOOR(global_cell_dim.x * SPROD(x,tbox_x));
+    g.y = (int) FLOOR(global_cell_dim.y * SPROD(x,tbox_y));
+    g.z = (int) FLOOR(global_cell_dim.z * SPROD(x,tbox_z));
+    g   = local_cell_coord(g);
+    if ((g.x != c.x) || (g.y != c.y) || (g.z != c.z)) return 0;
+  }
+  return 1;
 }
 
 
@@ -2138,6 +3733,9 @@ void calc_sm_chi()
 {
   int i, k, n=0, m, is_short=0;
 
+  /* buffer cells are not up to date here, so no incremental update */
+  if (0 >have_valid_nbl) have_valid_nbl = 0;
+
   if (0==have_valid_nbl) {
 #ifdef MPI
     /* check message buffer size */
@@ -121,8 +121,10 @@ void init_cells( void )
 
 #ifdef NBLIST
   /* add neighbor list margin (only the first time) */
-  if (NULL == cell_array)
-    cellsz = SQR( sqrt((double) cellsz) + nbl_margin );
+  if (NULL == cell_array) {
+    nbl_rcut = sqrt((double) cellsz);
+    cellsz   = SQR( nbl_rcut + nbl_margin );
+  }
 #endif
 
 #ifdef NPT
@@ -813,6 +815,98 @@ void check_pairs()
 
 #ifdef NBLIST
 
+/******************************************************************************
+*
+*  hilbert_key - index of point (x,y,z) on a 3D Hilbert curve of
+*  side 2^bits (J. Skilling, AIP Conf. Proc. 707, 381 (2004))
+*
+******************************************************************************/
+
+static unsigned long hilbert_key(int x, int y, int z, int bits)
+{
+  unsigned int  X[3], M = 1U << (bits-1), P, Q, t;
+  unsigned long key = 0;
+  int i, b;
+
+  X[0] = x; X[1] = y; X[2] = z;
+
+  /* inverse undo */
+  for (Q=M; Q>1; Q>>=1) {
+    P = Q - 1;
+    for (i=0; i<3; i++)
+      if (X[i] & Q) X[0] ^= P;
+      else {
+        t = (X[0] ^ X[i]) & P;
+        X[0] ^= t;
+        X[i] ^= t;
+      }
+  }
+
+  /* Gray encode */
+  for (i=1; i<3; i++) X[i] ^= X[i-1];
+  t = 0;
+  for (Q=M; Q>1; Q>>=1) if (X[2] & Q) t ^= Q - 1;
+  for (i=0; i<3; i++) X[i] ^= t;
+
+  /* interleave the transposed bits */
+  for (b=bits-1; b>=0; b--)
+    for (i=0; i<3; i++) key = (key << 1) | ((X[i] >> b) & 1);
+  return key;
+}
+
+typedef struct { unsigned long key; int k; } cell_key_t;
+
+static int cmp_cell_key(const void *a, const void *b)
+{
+  const cell_key_t *u = (const cell_key_t *) a, *v = (const cell_key_t *) b;
+  if (u->key != v->key) return (u->key < v->key) ? -1 : 1;
+  return u->k - v->k;
+}
+
+/******************************************************************************
+*
+*  hilbert_cell_order - order inner cells along a Hilbert curve, so that
+*  cells following each other in the force loop are neighbors in space
+*
+******************************************************************************/
+
+static void hilbert_cell_order(void)
+{
+  cell_key_t  *keys;
+  cell_nbrs_t *cn;
+  integer     *cl;
+  int k, bits = 1;
+
+  while ((1 << bits) < MAX( cell_dim.x, MAX( cell_dim.y, cell_dim.z ) )) 
+    bits++;
+
+  keys = (cell_key_t  *) malloc( ncells * sizeof(cell_key_t ) );
+  cn   = (cell_nbrs_t *) malloc( ncells * sizeof(cell_nbrs_t) );
+  cl   = (integer     *) malloc( ncells * sizeof(integer    ) );
+  if ((NULL==keys) || (NULL==cn) || (NULL==cl))
+    error("cannot allocate Hilbert cell order");
+
+  for (k=0; k<ncells; k++) {
+    int c = cnbrs[k].np;
+    keys[k].k   = k;
+    keys[k].key = hilbert_key( c / (cell_dim.y * cell_dim.z), 
+                              (c / cell_dim.z) % cell_dim.y, 
+                               c % cell_dim.z, bits );
+  }
+  qsort( keys, ncells, sizeof(cell_key_t), cmp_cell_key );
+
+  for (k=0; k<ncells; k++) {
+    cn[k] = cnbrs[ keys[k].k ];
+    cl[k] = cells[ keys[k].k ];
+  }
+  memcpy( cnbrs, cn, ncells * sizeof(cell_nbrs_t) );
+  memcpy( cells, cl, ncells * sizeof(integer    ) );
+
+  free(keys);
+  free(cn);
+  free(cl);
+}
+
 /******************************************************************************
 *
 *  In the neighbor list version, make_cell_lists creates for each cell 
@@ -1041,6 +1135,9 @@ void make_cell_lists(void)
     printf("    ************************* \n");fflush(stdout);
 #endif
 
+  /* order the inner cells along a Hilbert curve */
+  if (nbl_hilbert) hilbert_cell_order();
+
 }
 
 #endif
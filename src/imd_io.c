@@ -29,6 +29,302 @@
 #define FORMAT3 "%f %f %f"
 #endif
 
+/* the output buffer, kept from one output to the next */
+static char *out_mem=NULL;
+static int  out_mem_size=0;
+
+#if defined(MPI) || defined(ASYNC_IO)
+/* data of a file collected in memory, for MPI-IO or asynchronous output;
+   with io_inplace, the data is formatted directly into io_buf */
+static char *io_buf=NULL;
+static long io_len=0, io_max=0;
+static int  io_collect=0, io_inplace=0;
+#endif
+
+#ifdef ZLIB
+/* compressed chunks, and their offsets behind the header */
+static char      *zip_buf=NULL;
+static long long *zip_idx=NULL, zip_off=0;
+static int       zip_n=0, zip_max=0, zip_buf_size=0;
+#endif
+
+#ifdef ASYNC_IO
+
+/******************************************************************************
+*
+*  Asynchronous output (option async)
+*
+*  The output CPUs collect the formatted data of a file in io_buf, which
+*  is then a snapshot of the configuration. The file is opened and its
+*  header written immediately, but the data is written and the file
+*  closed by a separate thread, while the simulation goes on. At most
+*  async_output files can be pending; when the queue is full, the
+*  next output waits for the oldest one.
+*
+******************************************************************************/
+
+typedef struct {
+  FILE *out;
+  char *buf;
+  long len;
+} io_job;
+
+static pthread_t       io_thread;
+static pthread_mutex_t io_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  io_cond = PTHREAD_COND_INITIALIZER;
+static io_job          *io_queue = NULL;
+static int             io_first=0, io_njobs=0, io_active=0;
+
+/******************************************************************************
+*
+*  io_writer - the output thread, writes the queued files in order
+*
+******************************************************************************/
+
+static void *io_writer(void *arg)
+{
+  io_job job;
+
+  pthread_mutex_lock( &io_lock );
+  while (1) {
+    while ((0==io_njobs) && (io_active)) pthread_cond_wait(&io_cond,&io_lock);
+    if (0==io_njobs) break;
+    job = io_queue[io_first];
+    pthread_mutex_unlock( &io_lock );
+    if (NULL==job.out) {
+      /* a file written ahead, which gets its name only now */
+      if (rename(job.buf, job.buf + job.len))
+        fprintf(stderr, "CPU %d: cannot rename %s\n", myid, job.buf);
+    }
+    else {
+      if ((long) fwrite(job.buf, 1, job.len, job.out) < job.len)
+        fprintf(stderr, "CPU %d: error in asynchronous output\n", myid);
+      fclose(job.out);
+    }
+    free(job.buf);
+    pthread_mutex_lock( &io_lock );
+    /* the job is dequeued only now, so that it counts until done */
+    io_first = (io_first + 1) % async_output;
+    io_njobs--;
+    pthread_cond_broadcast( &io_cond );
+  }
+  pthread_mutex_unlock( &io_lock );
+  return NULL;
+}
+
+/******************************************************************************
+*
+*  queue_output - hand a file and its data over to the output thread
+*
+******************************************************************************/
+
+void queue_output(FILE *out, char *buf, long len)
+{
+  pthread_mutex_lock( &io_lock );
+  if (!io_active) {
+    io_queue = (io_job *) malloc( async_output * sizeof(io_job) );
+    if (NULL==io_queue) error("cannot allocate output queue");
+    io_active = 1;
+    if (pthread_create( &io_thread, NULL, io_writer, NULL ))
+      error("cannot start output thread");
+  }
+  /* back-pressure: wait for a free slot */
+  while (io_njobs >= async_output) pthread_cond_wait( &io_cond, &io_lock );
+  io_queue[(io_first + io_njobs) % async_output].out = out;
+  io_queue[(io_first + io_njobs) % async_output].buf = buf;
+  io_queue[(io_first + io_njobs) % async_output].len = len;
+  io_njobs++;
+  pthread_cond_broadcast( &io_cond );
+  pthread_mutex_unlock( &io_lock );
+}
+
+/******************************************************************************
+*
+*  queue_rename - rename a file once the files queued before are written;
+*  used for the iteration file, which must not name a checkpoint that
+*  is still incomplete
+*
+******************************************************************************/
+
+void queue_rename(char *from, char *to)
+{
+  long len = strlen(from) + 1;
+  char *buf = (char *) malloc( len + strlen(to) + 1 );
+
+  if (NULL==buf) error("cannot allocate output queue");
+  strcpy(buf, from);
+  strcpy(buf + len, to);
+  queue_output(NULL, buf, len);
+}
+
+/******************************************************************************
+*
+*  finish_output - wait until all pending files are written
+*
+******************************************************************************/
+
+void finish_output(void)
+{
+  if (!io_active) return;
+  pthread_mutex_lock( &io_lock );
+  io_active = 0;
+  pthread_cond_broadcast( &io_cond );
+  pthread_mutex_unlock( &io_lock );
+  pthread_join( io_thread, NULL );
+  free(io_queue);
+  io_queue = NULL;
+}
+
+#endif /* ASYNC_IO */
+
+#if defined(MPI) || defined(ASYNC_IO)
+
+/******************************************************************************
+*
+*  io_space - make room for len more bytes in io_buf, and return the
+*  place where they go
+*
+******************************************************************************/
+
+static char *io_space(long len)
+{
+  if (io_len + len > io_max) {
+    io_max = 2 * (io_len + len);
+    io_buf = (char *) realloc(io_buf, io_max);
+    if (NULL==io_buf) error("cannot allocate output buffer");
+  }
+  return io_buf + io_len;
+}
+
+#endif
+
+#if defined(MPI) && !defined(BG)
+
+/* with parallel_output 1, the bounds of the atoms of each file of a
+   configuration, in box coordinates; they go to the .head file, so that
+   a restart on a different number of CPUs reads only the files it needs */
+static real *chunk_bounds=NULL;
+
+/******************************************************************************
+*
+*  get_chunk_bounds - collect the bounds of the atoms of each output
+*  group on CPU 0
+*
+******************************************************************************/
+
+static void get_chunk_bounds(void)
+{
+  real   b[2*DIM], *all=NULL, s;
+  vektor tb[DIM];
+  int    k, i, d, g;
+
+  tb[0] = tbox_x;
+  tb[1] = tbox_y;
+#ifndef TWOD
+  tb[2] = tbox_z;
+#endif
+  for (d=0; d<DIM; d++) {
+    b[d]     =  1e30;
+    b[DIM+d] = -1e30;
+  }
+  for (k=0; k<NCELLS; ++k) {
+    cell *p = CELLPTR(k);
+    for (i=0; i<p->n; ++i)
+      for (d=0; d<DIM; d++) {
+        s = SPRODX(ORT,p,i,tb[d]);
+        b[d]     = MIN( b[d],     s );
+        b[DIM+d] = MAX( b[DIM+d], s );
+      }
+  }
+
+  if (0==myid) {
+    all = (real *) malloc( num_cpus * 2 * DIM * sizeof(real) );
+    chunk_bounds = (real *) malloc( n_out_grps * 2 * DIM * sizeof(real) );
+    if ((NULL==all) || (NULL==chunk_bounds))
+      error("cannot allocate chunk bounds");
+  }
+  MPI_Gather( b, 2*DIM, REAL, all, 2*DIM, REAL, 0, cpugrid );
+  if (0==myid) {
+    for (g=0; g<n_out_grps; g++)
+      for (d=0; d<DIM; d++) {
+        chunk_bounds[2*DIM*g+d]     =  1e30;
+        chunk_bounds[2*DIM*g+DIM+d] = -1e30;
+      }
+    for (i=0; i<num_cpus; i++) {
+      g = i / outputgrpsize;
+      for (d=0; d<DIM; d++) {
+        chunk_bounds[2*DIM*g+d] = 
+          MIN( chunk_bounds[2*DIM*g+d],     all[2*DIM*i+d] );
+        chunk_bounds[2*DIM*g+DIM+d] = 
+          MAX( chunk_bounds[2*DIM*g+DIM+d], all[2*DIM*i+DIM+d] );
+      }
+    }
+    free(all);
+  }
+}
+
+#endif /* MPI and not BG */
+
+/******************************************************************************
+*
+*  put_outbuf - write len bytes of buf to out, or collect them in io_buf
+*
+******************************************************************************/
+
+static void put_outbuf(FILE *out, char *buf, int len)
+{
+#ifdef TIMING
+  io_bytes_out += len;
+#endif
+#if defined(MPI) || defined(ASYNC_IO)
+  if (io_collect) {
+    /* data formatted or received in place needs no copy */
+    if (buf != io_buf + io_len) memcpy(io_space(len), buf, len);
+    io_len += len;
+    return;
+  }
+#endif
+  if (len>0) fwrite(buf, 1, len, out);
+}
+
+#ifdef ZLIB
+
+/******************************************************************************
+*
+*  put_chunk - write a compressed chunk and note its offset in the index
+*
+******************************************************************************/
+
+static void put_chunk(FILE *out, char *buf, int len)
+{
+  if (zip_n == zip_max) {
+    zip_max = 2 * zip_max + 64;
+    zip_idx = (long long *) realloc(zip_idx, zip_max * sizeof(long long));
+    if (NULL==zip_idx) error("cannot allocate chunk index");
+  }
+  zip_idx[zip_n++] = zip_off;
+  zip_off += len;
+  put_outbuf(out, buf, len);
+}
+
+/******************************************************************************
+*
+*  put_zip_index - write the chunk index behind the chunks
+*
+******************************************************************************/
+
+static void put_zip_index(FILE *out)
+{
+  long long t[2];
+
+  t[0] = zip_n;
+  t[1] = ZIP_MAGIC;
+  put_outbuf(out, (char *) zip_idx, zip_n * sizeof(long long));
+  put_outbuf(out, (char *) t, sizeof(t));
+}
+
+#endif /* ZLIB */
+
 /******************************************************************************
 *
 *  flush outbuf to disk, or send it to my output CPU
@@ -38,27 +334,119 @@
 
 void flush_outbuf(FILE *out, int *len, int tag)
 {
+  char *buf = outbuf;
+  int  n = *len;
+
   if (*len+1 > outbuf_size) error("outbuf overflow");
+#ifdef ZLIB
+  /* compress on the CPU where the data is, as one chunk */
+  if ((out_zip) && (n > 0)) {
+    buf = zip_buf;
+#if defined(MPI) || defined(ASYNC_IO)
+    if ((io_collect) && (myid==my_out_id)) buf = io_space( zip_bound(n) );
+#endif
+    n   = zip_chunk(outbuf, n, sizeof(i_or_r), buf, out_zip);
+  }
+#endif
   if (myid==my_out_id) {
-    if (*len>0) fwrite(outbuf, 1, *len, out);
+#ifdef ZLIB
+    if ((out_zip) && (n > 0)) put_chunk(out, buf, n);
+    else
+#endif
+    put_outbuf(out, buf, n);
+#if defined(MPI) || defined(ASYNC_IO)
+    if (io_inplace) outbuf = io_space( outbuf_size );
+#endif
   }
 #ifdef MPI
   else {
 #ifdef BG
     MPI_Status status;
-    int tmp=*len+1;
+    int tmp=n+1;
     /* tell CPU 0 that we have something (and how much) */
     MPI_Send( &tmp, 1, MPI_INT, my_out_id, ANNOUNCE_TAG, cpugrid );
     /* wait until CPU 0 is ready */
     MPI_Recv( &tmp, 1, MPI_INT, my_out_id, ANNOUNCE_TAG, cpugrid, &status );
 #endif
     /* we add 1 to the length so that even an empty message is sent */
-    MPI_Send( (void *) outbuf, *len+1, MPI_CHAR, my_out_id, tag, cpugrid );
+    MPI_Send( (void *) buf, n+1, MPI_CHAR, my_out_id, tag, cpugrid );
   }
 #endif
   *len=0;
 }
 
+#ifdef MPI
+
+/******************************************************************************
+*
+*  write_mpiio writes the data collected in io_buf to file fname, 
+*  behind the header of length hlen. The CPUs write their data in the 
+*  order of their ranks, at offsets obtained by a prefix sum, with
+*  collective MPI-IO calls of at most WRITE_CHUNK bytes each.
+*
+******************************************************************************/
+
+/* maximal number of bytes per MPI_File_write_at_all */
+#define WRITE_CHUNK (1<<30)
+
+static void write_mpiio(char *fname, long hlen)
+{
+  MPI_File   fh;
+  MPI_Status status;
+  long long  len = io_len, off = 0, tot, max, pos;
+  int        n;
+
+  MPI_Exscan( &len, &off, 1, MPI_LONG_LONG, MPI_SUM, cpugrid );
+  if (0==myid) off = 0;   /* MPI_Exscan leaves it undefined on CPU 0 */
+  MPI_Allreduce( &len, &tot, 1, MPI_LONG_LONG, MPI_SUM, cpugrid );
+  MPI_Allreduce( &len, &max, 1, MPI_LONG_LONG, MPI_MAX, cpugrid );
+
+  if (MPI_SUCCESS != MPI_File_open( cpugrid, fname, 
+        MPI_MODE_WRONLY | MPI_MODE_CREATE, MPI_INFO_NULL, &fh ))
+    error_str("Cannot open output file %s with MPI-IO", fname);
+  /* cut off what a previous, longer file might have left */
+#ifdef ZLIB
+  if (out_zip) {
+    /* the chunk index is gathered and appended by CPU 0 */
+    int *cnt, *dsp, i, n=0;
+    long long *idx=NULL;
+    cnt = (int *) malloc( 2 * num_cpus * sizeof(int) );
+    if (NULL==cnt) error("cannot allocate chunk index");
+    dsp = cnt + num_cpus;
+    for (i=0; i<zip_n; i++) zip_idx[i] += off;
+    MPI_Allgather( &zip_n, 1, MPI_INT, cnt, 1, MPI_INT, cpugrid );
+    for (i=0; i<num_cpus; i++) { dsp[i] = n; n += cnt[i]; }
+    if (0==myid) {
+      idx = (long long *) malloc( (n+2) * sizeof(long long) );
+      if (NULL==idx) error("cannot allocate chunk index");
+      idx[n  ] = n;
+      idx[n+1] = ZIP_MAGIC;
+    }
+    MPI_Gatherv( zip_idx, zip_n, MPI_LONG_LONG, idx, cnt, dsp, MPI_LONG_LONG,
+                 0, cpugrid );
+    MPI_File_set_size( fh, (MPI_Offset) (hlen + tot + (n+2) * sizeof(long long)) );
+    if (0==myid) 
+      MPI_File_write_at( fh, (MPI_Offset) (hlen + tot), idx, 
+                         (n+2) * sizeof(long long), MPI_CHAR, &status );
+    free(idx);
+    free(cnt);
+  } else
+#endif
+  MPI_File_set_size( fh, (MPI_Offset) (hlen + tot) );
+  /* the number of collective writes is the same on all CPUs */
+  for (pos=0; pos < max; pos += WRITE_CHUNK) {
+    n = (int) MAX( 0, MIN( WRITE_CHUNK, len - pos ) );
+    MPI_File_write_at_all( fh, (MPI_Offset) (hlen + off + pos),
+                           io_buf + MIN(pos,len), n, MPI_CHAR, &status );
+  }
+  MPI_File_close( &fh );
+
+  /* io_buf is kept for the next output */
+  io_len = 0;
+}
+
+#endif /* MPI */
+
 /******************************************************************************
 *
 *  write_config_select writes selected data of a configuration to a 
@@ -73,22 +461,56 @@ void write_config_select(int fzhlr, char *suffix,
 {
   FILE *out=NULL;
   str255 fname;
+  long hlen=0;
 
   is_big_endian = endian();
 
+#ifdef MPI
+  io_collect = (2==parallel_output);
+#endif
+#ifdef ASYNC_IO
+  if (async_output > 0) io_collect = 1;
+  /* files without a number may still be pending with the same name */
+  if ((fzhlr < 0) && (myid==my_out_id)) finish_output();
+#endif
+
 #if defined(BG) && defined(NBLIST)
   deallocate_nblist();
 #endif
 
+  /* the buffers are allocated once, and only grown if necessary */
+  if (out_mem_size < outbuf_size) {
 #ifdef MPI2
-  MPI_Alloc_mem(outbuf_size * sizeof(char), MPI_INFO_NULL, &outbuf);
+    if (out_mem) MPI_Free_mem(out_mem);
+    MPI_Alloc_mem(outbuf_size * sizeof(char), MPI_INFO_NULL, &out_mem);
 #else
-  outbuf = (char *) malloc(outbuf_size * sizeof(char));
+    free(out_mem);
+    out_mem = (char *) malloc(outbuf_size * sizeof(char));
+#endif
+    if (NULL==out_mem) error("cannot allocate output buffer");
+    out_mem_size = outbuf_size;
+  }
+  outbuf = out_mem;
+#ifdef ZLIB
+  if (out_zip) {
+    if (zip_buf_size < zip_bound(outbuf_size) + 1) {
+      zip_buf_size = zip_bound(outbuf_size) + 1;
+      free(zip_buf);
+      zip_buf = (char *) malloc( zip_buf_size );
+      if (NULL==zip_buf) error("cannot allocate output buffer");
+    }
+    zip_n = 0;
+    zip_off = 0;
+  }
 #endif
-  if (NULL==outbuf) error("cannot allocate output buffer");
 
 #ifdef MPI
   if (1==parallel_output) {
+#ifndef BG
+    /* configurations get the bounds of the atoms in each file */
+    if ((use_header) && (write_header_fun==write_header_config)) 
+      get_chunk_bounds();
+#endif
     /* write header to separate file */
     if ((myid==0) && (use_header)) {
       if (fzhlr>=0) sprintf(fname,"%s.%05d.%s.head",outfilename,fzhlr,suffix);
@@ -99,6 +521,10 @@ void write_config_select(int fzhlr, char *suffix,
       (*write_header_fun)(out);
       fclose(out);
     }
+#ifndef BG
+    free(chunk_bounds);
+    chunk_bounds = NULL;
+#endif
     /* open output file */
     if (myid == my_out_id) {
       if (fzhlr>=0) 
@@ -110,6 +536,20 @@ void write_config_select(int fzhlr, char *suffix,
       out = fopen(fname,"w");
       if (NULL == out) error_str("Cannot open output file %s",fname);
     }
+  } else if (2==parallel_output) {
+    /* CPU 0 writes the header, the rest is written with MPI-IO */
+    if (fzhlr >= 0) sprintf(fname,"%s.%05d.%s", outfilename,fzhlr,suffix);
+    else if (fzhlr==-1) sprintf(fname,"%s-final.%s", outfilename,suffix);
+    else sprintf(fname,"%s-interm.%s", outfilename,suffix);
+    if (0==myid) {
+      out = fopen(fname,"w");
+      if (NULL == out) error_str("Cannot open output file %s",fname);
+      if (use_header) (*write_header_fun)(out);
+      hlen = ftell(out);
+      fclose(out);
+      out = NULL;
+    }
+    MPI_Bcast( &hlen, 1, MPI_LONG, 0, cpugrid );
   } else
 #endif
   if (0==myid) {
@@ -123,44 +563,98 @@ void write_config_select(int fzhlr, char *suffix,
     if (use_header) (*write_header_fun)(out);
   }
 
+  /* an output CPU which collects the data formats it in place */
+#if defined(MPI) || defined(ASYNC_IO)
+  io_inplace = (io_collect) && (myid==my_out_id);
+#ifdef ZLIB
+  if (out_zip) io_inplace = 0;  /* only the chunks go to io_buf */
+#endif
+  if (io_inplace) outbuf = io_space( outbuf_size );
+#endif
+
   /* write or send own data */
   (*write_atoms_fun)(out);
 
 #ifdef MPI
+  if (2==parallel_output) write_mpiio(fname, hlen);
   /* if not fully parallel output, receive and write foreign data */
   if ((myid == my_out_id) && (out_grp_size > 1)) {
     MPI_Status status;
-    int m=1, len, source;
+    int m=1, len, source, rmax = outbuf_size;
+    char *rbuf = outbuf;
+#ifdef ZLIB
+    /* the messages are compressed chunks */
+    if (out_zip) { rbuf = zip_buf; rmax = zip_bound(outbuf_size) + 1; }
+#endif
     while (m < out_grp_size) {
+      /* receive directly into the collected data */
+      if (io_collect) rbuf = io_space( rmax );
 #ifdef BG
       MPI_Recv(&len, 1, MPI_INT,MPI_ANY_SOURCE,ANNOUNCE_TAG, cpugrid, &status);
       source = status.MPI_SOURCE;
       MPI_Send(&len, 1, MPI_INT, source, ANNOUNCE_TAG, cpugrid);
-      MPI_Recv(outbuf, len, MPI_CHAR, source, MPI_ANY_TAG, cpugrid, &status);
+      MPI_Recv(rbuf, len, MPI_CHAR, source, MPI_ANY_TAG, cpugrid, &status);
 #else
-      MPI_Recv(outbuf, outbuf_size, MPI_CHAR, MPI_ANY_SOURCE, 
+      MPI_Recv(rbuf, rmax, MPI_CHAR, MPI_ANY_SOURCE, 
                MPI_ANY_TAG, cpugrid, &status);
       MPI_Get_count(&status, MPI_CHAR, &len);
 #endif
       if ((status.MPI_TAG!=OUTBUF_TAG+1) && (status.MPI_TAG!=OUTBUF_TAG))
         error("messages mixed up");
       if (status.MPI_TAG==OUTBUF_TAG+1) m++;
-      if (len>1) fwrite(outbuf, 1, len-1, out);
+#ifdef ZLIB
+      if ((out_zip) && (len>1)) put_chunk(out, rbuf, len-1);
+      else
+#endif
+      if (len>1) put_outbuf(out, rbuf, len-1);
     }
   }
   /* don't send non-io messages before we are finished */
   MPI_Barrier(MPI_COMM_WORLD);
 #endif /* MPI */
+#ifdef ZLIB
+  /* with MPI-IO, the index has been written by write_mpiio */
+  if ((out_zip) && (out)) put_zip_index(out);
+#endif
+#ifdef ASYNC_IO
+  /* the output thread writes the data and closes the file */
+  if ((out) && (io_collect)) {
+    queue_output(out, io_buf, io_len);
+    out    = NULL;
+    io_buf = NULL;
+    io_len = io_max = 0;
+  }
+#endif
   if (out) fclose(out);
-
-#ifdef MPI2
-  MPI_Free_mem(outbuf);
-#else
-  free(outbuf);
+#if defined(MPI) || defined(ASYNC_IO)
+  io_collect = 0;
+  io_inplace = 0;
 #endif
+  outbuf = out_mem;
 
 }
 
+/******************************************************************************
+*
+*  write_itr_ordered writes the iteration file of a checkpoint only
+*  after the checkpoint, so that it never names an incomplete one
+*
+******************************************************************************/
+
+static void write_itr_ordered(int fzhlr, int steps, char *suffix)
+{
+#if defined(MPI) && defined(ASYNC_IO)
+  /* with several output CPUs, rank 0 cannot queue the iteration file
+     behind their pieces, which must therefore be finished first */
+  if ((async_output > 0) && (out_grp_size < num_cpus)) {
+    if (myid == my_out_id) finish_output();
+    MPI_Barrier(MPI_COMM_WORLD);
+  }
+#endif
+  /* otherwise, write_itr_file queues it behind the checkpoint */
+  if (myid == 0) write_itr_file(fzhlr, steps, suffix);
+}
+
 /******************************************************************************
 *
 *  write_config writes a configuration to a numbered file,
@@ -173,11 +667,40 @@ void write_config(int fzhlr, int steps)
   /* first make sure that every atom is inside the box and on the right CPU */
   if (1==parallel_output) fix_cells();
 
+#ifdef DELTA
+  /* between full checkpoints, only the atoms which moved are written */
+  if (write_delta(fzhlr)) {
+    write_itr_ordered(fzhlr, steps,"");
+    return;
+  }
+#endif
+
   /* write checkpoint */
+#ifdef ZLIB
+  /* numbered checkpoints may be quantized, restart files are lossless */
+  if ((compress_output) && (binary_output)) {
+    out_zip = compress_output;
+    if (fzhlr >= 0) {
+      out_zip_pos = zip_quantum(compress_eps_pos);
+      out_zip_vel = zip_quantum(compress_eps_vel);
+    }
+  }
+#endif
   write_config_select(fzhlr, "chkpt", write_atoms_config, write_header_config);
+#ifdef DELTA
+  /* a numbered full checkpoint is the reference of the next deltas */
+  if ((delta_checkpt > 0) && (fzhlr >= 0)) {
+    sprintf(delta_base, "%s.%05d.chkpt", outfilename, fzhlr);
+    set_delta_ref();
+  }
+#endif
+#ifdef ZLIB
+  out_zip = 0;
+  out_zip_pos = out_zip_vel = 0.0;
+#endif
 
   /* write iteration file */
-  if (myid == 0) write_itr_file(fzhlr, steps,"");
+  write_itr_ordered(fzhlr, steps,"");
 }
 
 #ifdef RELAX
@@ -197,7 +720,7 @@ void write_ssconfig(int steps)
   write_config_select(sscount,"ss", write_atoms_config, write_header_config);
 
   /* write iteration file */
-  if (myid == 0) write_itr_file(sscount, steps,"ss");
+  write_itr_ordered(sscount, steps,"ss");
 
   sscount++;
 
@@ -285,7 +808,7 @@ void write_cgconfig(int steps)
   write_config_select(steps,"cgchkpt",write_atoms_config, write_header_config);
 
   /* write iteration file */
-  if (myid == 0) write_itr_file(steps, steps,"cg");
+  write_itr_ordered(steps, steps,"cg");
 }
 #endif
 
@@ -3305,6 +3828,21 @@ void write_header_config(FILE *out)
   time(&now);
   fprintf(out, "## Generated on %s", ctime(&now) ); 
   fprintf(out, "## by %s (version of %s)\n", progname, DATE);
+#ifdef ZLIB
+  /* compressed data, with quanta of positions and velocities */
+  if (out_zip) fprintf(out, "#K zlib %.16e %.16e\n", out_zip_pos, out_zip_vel);
+#endif
+#if defined(MPI) && !defined(BG)
+  /* bounds of the atoms in file g, lower left and upper right */
+  if (chunk_bounds) {
+    int g, d;
+    for (g=0; g<n_out_grps; g++) {
+      fprintf(out, "#G %d", g);
+      for (d=0; d<2*DIM; d++) fprintf(out, " %.16e", chunk_bounds[2*DIM*g+d]);
+      fprintf(out, "\n");
+    }
+  }
+#endif
   fprintf(out, "#E\n");
 
 }
@@ -3384,6 +3922,7 @@ int read_header(header_info_t *info, str255 infilename)
   infile = fopen(infilename,"r");
   if (NULL==infile) error_str("cannot open input file %s", infilename);
 
+  info->zipped     =  0;
 #ifdef REFPOS
   info->n_refpos_x = -1;
 #endif
@@ -3450,6 +3989,10 @@ int read_header(header_info_t *info, str255 infilename)
         token = strtok(NULL, " \t\r\n");
       }
     }
+    /* compression line */
+    else if (line[1]=='K') {
+      info->zipped = 1;
+    }
     /* endheader line */
     else if (line[1]=='E') {
       if (have_format) have_header = 1;
@@ -3507,6 +4050,7 @@ void broadcast_header(header_info_t *info)
   MPI_Bcast( &(info->n_vel),      1, MPI_INT,  0, MPI_COMM_WORLD); 
   MPI_Bcast( &(info->n_data),     1, MPI_INT,  0, MPI_COMM_WORLD); 
   MPI_Bcast( &(info->n_items),    1, MPI_INT,  0, MPI_COMM_WORLD); 
+  MPI_Bcast( &(info->zipped),     1, MPI_INT,  0, MPI_COMM_WORLD); 
 #ifdef REFPOS
   MPI_Bcast( &(info->n_refpos_x), 1, MPI_INT,  0, MPI_COMM_WORLD); 
 #endif
@@ -21,6 +21,201 @@
 
 #include "imd.h"
 
+#ifdef MPI
+
+/* maximal number of bytes per MPI_File_read_at_all */
+#define READ_CHUNK (1<<30)
+
+/******************************************************************************
+*
+*  read_atoms_block - with parallel_input 2, each CPU reads a contiguous
+*  block of records of a binary configuration file with MPI-IO
+*
+******************************************************************************/
+
+static char *read_atoms_block(str255 infilename, header_info_t *info,
+                              long *len)
+{
+  MPI_File   fh;
+  MPI_Status status;
+  FILE   *infile;
+  char   line[1024], *data, *s;
+  long   hlen=0, size=0, nrec, r0, r1, rmax, pos;
+  int    recsize, n;
+
+  if ((info->format=='B') || (info->format=='L'))
+    recsize = (info->n_items-1) * sizeof(i_or_d);
+  else
+    recsize = info->n_items * sizeof(i_or_f);
+
+  /* CPU 0 determines the position of the data and the file size */
+  if (0==myid) {
+    infile = fopen(infilename,"r");
+    if (NULL==infile) error_str("File %s not found", infilename);
+    do {
+      s = fgets(line,sizeof(line),infile);
+    } while ((NULL!=s) && (('#'!=line[0]) || ('E'!=line[1])));
+    hlen = ftell(infile);
+    fseek(infile, 0, SEEK_END);
+    size = ftell(infile);
+    fclose(infile);
+  }
+  MPI_Bcast( &hlen, 1, MPI_LONG, 0, cpugrid );
+  MPI_Bcast( &size, 1, MPI_LONG, 0, cpugrid );
+  nrec = (size - hlen) / recsize;
+  r0   = (nrec *  myid   ) / num_cpus;
+  r1   = (nrec * (myid+1)) / num_cpus;
+  rmax = (nrec + num_cpus - 1) / num_cpus;
+
+  *len = (r1 - r0) * recsize;
+  data = (char *) malloc( MAX(*len,1) );
+  if (NULL==data) error("cannot allocate input block");
+
+  if (MPI_SUCCESS != MPI_File_open( cpugrid, infilename, MPI_MODE_RDONLY,
+                                    MPI_INFO_NULL, &fh ))
+    error_str("File %s not found", infilename);
+
+  /* the number of collective reads is the same on all CPUs */
+  for (pos=0; pos < rmax * recsize; pos += READ_CHUNK) {
+    n = (int) MAX( 0, MIN( READ_CHUNK, *len - pos ) );
+    MPI_File_read_at_all( fh, (MPI_Offset) (hlen + r0 * recsize + pos),
+                          data + MIN(pos,*len), n, MPI_BYTE, &status );
+  }
+  MPI_File_close( &fh );
+  return data;
+}
+
+/******************************************************************************
+*
+*  send_atoms_block - send the atoms collected in input_buf to their
+*  owners with a single MPI_Alltoallv
+*
+******************************************************************************/
+
+static void send_atoms_block(msgbuf *input_buf)
+{
+  msgbuf b = {NULL,0,0};
+  real   *sbuf;
+  int    *scnt, *sdsp, *rcnt, *rdsp;
+  int    i, j, n=0;
+
+  scnt = (int *) malloc( 4 * num_cpus * sizeof(int) );
+  if (NULL==scnt) error("cannot allocate input buffers");
+  sdsp = scnt + num_cpus;
+  rcnt = sdsp + num_cpus;
+  rdsp = rcnt + num_cpus;
+
+  for (i=0; i<num_cpus; i++) {
+    scnt[i] = input_buf[i].n;
+    sdsp[i] = n;
+    n += scnt[i];
+  }
+  sbuf = (real *) malloc( MAX(n,1) * sizeof(real) );
+  if (NULL==sbuf) error("cannot allocate input buffers");
+  for (i=0; i<num_cpus; i++)
+    for (j=0; j<scnt[i]; j++) sbuf[sdsp[i]+j] = input_buf[i].data[j];
+
+  MPI_Alltoall( scnt, 1, MPI_INT, rcnt, 1, MPI_INT, cpugrid );
+  n = 0;
+  for (i=0; i<num_cpus; i++) {
+    rdsp[i] = n;
+    n += rcnt[i];
+  }
+  alloc_msgbuf(&b, MAX(n,1));
+  MPI_Alltoallv( sbuf,   scnt, sdsp, REAL,
+                 b.data, rcnt, rdsp, REAL, cpugrid );
+  b.n = n;
+  process_buffer( &b );
+
+  free_msgbuf(&b);
+  free(sbuf);
+  free(scnt);
+}
+
+#ifndef BG
+
+/******************************************************************************
+*
+*  read_chunks - with parallel_input 1, a configuration may have been
+*  written on a different number of CPUs, with the bounds of the atoms
+*  of each file in the .head file. Each CPU reads the files whose atoms
+*  are centered in its domain, so that each file is read once. Returns
+*  the number of files for this CPU, or -1 if there are no bounds.
+*
+******************************************************************************/
+
+static int read_chunks(str255 infilename, int **chunks)
+{
+  FILE    *infile;
+  char    line[1024], *s, *t;
+  real    *b=NULL, c[DIM];
+  int     n=0, max=0, m=0, g, d;
+  vektor  pos;
+  ivektor cellc;
+
+  /* CPU 0 reads the bounds, lower left and upper right of each file */
+  if (0==myid) {
+    sprintf(line,"%s.head",infilename);
+    infile = fopen(line,"r");
+    if (NULL!=infile) {
+      while ((NULL!=fgets(line,sizeof(line),infile)) && ('#'==line[0]) &&
+             ('E'!=line[1])) {
+        if ('G'!=line[1]) continue;
+        g = (int) strtol(line+2, &s, 10);
+        if (g < 0) error_str("Bounds in %s.head corrupt", infilename);
+        while (g >= max) {
+          b = (real *) realloc( b, 2 * (2*max+8) * DIM * sizeof(real) );
+          if (NULL==b) error("cannot allocate chunk bounds");
+          for (d=2*DIM*max; d<2*DIM*(2*max+8); d++)
+            b[d] = (d % (2*DIM) < DIM) ? 1e30 : -1e30;
+          max = 2*max+8;
+        }
+        for (d=0; d<2*DIM; d++) {
+          b[2*DIM*g+d] = (real) strtod(s, &t);
+          if (t==s) error_str("Bounds in %s.head corrupt", infilename);
+          s = t;
+        }
+        n = MAX(n, g+1);
+      }
+      fclose(infile);
+    }
+  }
+  MPI_Bcast( &n, 1, MPI_INT, 0, cpugrid );
+  if (0==n) return -1;
+  if (0!=myid) {
+    b = (real *) malloc( 2 * n * DIM * sizeof(real) );
+    if (NULL==b) error("cannot allocate chunk bounds");
+  }
+  MPI_Bcast( b, 2*DIM*n, REAL, 0, cpugrid );
+
+  /* the files centered in my domain */
+  *chunks = (int *) malloc( n * sizeof(int) );
+  if (NULL==*chunks) error("cannot allocate chunk list");
+  for (g=0; g<n; g++) {
+    if (b[2*DIM*g] > b[2*DIM*g+DIM]) continue;  /* no atoms */
+    for (d=0; d<DIM; d++) c[d] = (b[2*DIM*g+d] + b[2*DIM*g+DIM+d]) / 2;
+#ifdef TWOD
+    pos.x = c[0] * box_x.x + c[1] * box_y.x;
+    pos.y = c[0] * box_x.y + c[1] * box_y.y;
+    pos   = back_into_box(pos);
+    cellc = cell_coord(pos.x,pos.y);
+#else
+    pos.x = c[0] * box_x.x + c[1] * box_y.x + c[2] * box_z.x;
+    pos.y = c[0] * box_x.y + c[1] * box_y.y + c[2] * box_z.y;
+    pos.z = c[0] * box_x.z + c[1] * box_y.z + c[2] * box_z.z;
+    pos   = back_into_box(pos);
+    cellc = cell_coord(pos.x,pos.y,pos.z);
+#endif
+    if (cpu_coord(cellc)==myid) (*chunks)[m++] = g;
+  }
+  free(b);
+  return m;
+}
+
+#endif /* not BG */
+
+#endif /* MPI */
+
 /******************************************************************************
 *
 * read_atoms - reads atoms and velocities into the cell-array
@@ -54,8 +249,24 @@ void read_atoms(str255 infilename)
   ivektor  cellc;
   real     m, d[MAX_ITEMS_CONFIG];
   minicell *to;
+  char     *inp_data=NULL;     /* records in memory, if mem_input */
+  long     inp_len=0, inp_pos=0;
+  int      mem_input=0, chunk_input=0, at_end;
 #ifdef MPI
   msgbuf   *input_buf=NULL, *b;
+  int      block_input=0, *chunks=NULL, n_chunks=0, next_chunk=0;
+#endif
+#ifdef ZLIB
+  long long *zip_idx=NULL, zip_next=0, zip_end=0;
+  long     zip_hlen=0, inp_max=0;
+#endif
+
+#ifdef DELTA
+  /* a delta checkpoint is applied to its full checkpoint */
+  if (is_delta_config(infilename)) {
+    read_delta(infilename);
+    return;
+  }
 #endif
 
    if ((0 == myid) && (0==myrank)) {
@@ -120,30 +331,61 @@ void read_atoms(str255 infilename)
 #ifndef BG
   /* Try opening first a per cpu file - not supported on BlueGene/L */
   if (1==parallel_input) {
-    sprintf(buf,"%s.%u",infilename,myid); 
-    infile = fopen(buf,"r");
-    if (NULL!=infile) {
-      if (0==myid) {
-        sprintf(buf,"%s.head",infilename); 
-        have_header = read_header(&info, buf);
-        /* have_header==2 indicates header in separate file */
-        if (have_header) have_header++;
-      }
+    /* with bounds in the header, the files may come from any number
+       of CPUs; each CPU reads some of them and sends the atoms to
+       their owners */
+    n_chunks = read_chunks(infilename, &chunks);
+    if (n_chunks >= 0) {
+      if (0==myid) have_header = read_header(&info, infilename);
       MPI_Bcast( &have_header, 1, MPI_INT, 0, MPI_COMM_WORLD); 
-      /* When each cpu reads only part of the atoms, we have to add up the
-         number of atoms to get the correct natoms. We set a flag here. */
-      addnumber=1;
-      if (have_header) broadcast_header(&info);
+      if (0==have_header) error_str("File %s.head corrupt", infilename);
+      broadcast_header(&info);
+      have_header = 2;
+      chunk_input = block_input = 1;
+    }
+    else {
+      sprintf(buf,"%s.%u",infilename,myid); 
+      infile = fopen(buf,"r");
+      if (NULL!=infile) {
+        if (0==myid) {
+          sprintf(buf,"%s.head",infilename); 
+          have_header = read_header(&info, buf);
+          /* have_header==2 indicates header in separate file */
+          if (have_header) have_header++;
+        }
+        MPI_Bcast( &have_header, 1, MPI_INT, 0, MPI_COMM_WORLD); 
+        /* When each cpu reads only part of the atoms, we have to add up the
+           number of atoms to get the correct natoms. We set a flag here. */
+        addnumber=1;
+        if (have_header) broadcast_header(&info);
+      }
     }
   } else 
 #endif
+  if (2==parallel_input) {
+    /* binary file: each CPU reads a block of atoms and sends them to
+       their owners; ASCII files are read completely by each CPU */
+    if (0==myid) have_header = read_header(&info, infilename);
+    MPI_Bcast( &have_header, 1, MPI_INT, 0, MPI_COMM_WORLD); 
+    if (have_header) {
+      broadcast_header(&info);
+      if ('A' != info.format) {
+        block_input = 1;
+        /* compressed files are read by chunks */
+        if (0==info.zipped) {
+          inp_data  = read_atoms_block(infilename, &info, &inp_len);
+          mem_input = 1;
+        }
+      }
+    }
+  } else
   if (myid != my_inp_id) {
     recv_atoms();
     read_atoms_cleanup();
     return;
   }
 
-  if (NULL==infile) {
+  if ((NULL==infile) && (0==mem_input) && (0==chunk_input)) {
     infile = fopen(infilename,"r");
     if (NULL==infile) error_str("File %s not found", infilename);
     have_header = read_header( &info, infilename );
@@ -168,6 +410,11 @@ void read_atoms(str255 infilename)
         alloc_msgbuf(input_buf+i, inbuf_size);
     }
   }
+  else if (block_input) {
+    /* buffers grow as needed */
+    input_buf = (msgbuf *) calloc( num_cpus, sizeof(msgbuf) );
+    if (NULL==input_buf) error("cannot allocate input buffers");
+  }
 
 #else /* not MPI */
 
@@ -180,6 +427,7 @@ void read_atoms(str255 infilename)
   /* limited backwards compatibility */
   if (have_header==0) {
     info.format   = 'A';
+    info.zipped   = 0;
     info.n_number = 1;
     info.n_type   = 1;
     info.n_mass   = 1;
@@ -225,15 +473,74 @@ void read_atoms(str255 infilename)
 #endif
 
   /* read away header; if have_header==2, header is in separate file */
-  if (have_header==1) {
+  if ((have_header==1) && (NULL!=infile)) {
     do {
       char *s;
       s=fgets(buf,sizeof(buf),infile);
     } while (('#'!=buf[0]) || ('E'!=buf[1])); 
   }
 
+  /* compressed file: the records are read chunk by chunk */
+  if ((have_header) && (info.zipped)) {
+#ifdef ZLIB
+    /* with chunk input, the index is read with each file */
+    if (NULL!=infile) {
+      zip_hlen = (have_header==1) ? ftell(infile) : 0;
+      zip_idx  = read_zip_index(infile, &zip_end, info.endian!=is_big_endian);
+    }
+#ifdef MPI
+    /* with parallel_input 2, each CPU reads a block of chunks */
+    if ((block_input) && (0==chunk_input)) {
+      zip_next = (zip_end *  myid   ) / num_cpus;
+      zip_end  = (zip_end * (myid+1)) / num_cpus;
+    }
+#endif
+    mem_input = 1;
+#else
+    error("Compressed configuration requires option zlib");
+#endif
+  }
+
   /* Read the input file line by line */
-  while(!feof(infile)) {
+  while (1) {
+
+#if defined(MPI) && !defined(BG)
+    /* chunk input: open the next file when the last one is done */
+    if ((chunk_input) && (NULL==infile)) {
+      if (next_chunk == n_chunks) break;
+      sprintf(buf,"%s.%u",infilename,chunks[next_chunk++]);
+      infile = fopen(buf,"r");
+      if (NULL==infile) error_str("File %s not found", buf);
+#ifdef ZLIB
+      if (info.zipped) {
+        free(zip_idx);
+        zip_idx  = read_zip_index(infile,&zip_end,info.endian!=is_big_endian);
+        zip_next = 0;
+        inp_pos  = inp_len = 0;
+      }
+#endif
+    }
+#endif
+
+    if (mem_input) {
+#ifdef ZLIB
+      if ((inp_pos == inp_len) && (zip_next < zip_end)) {
+        inp_len = unzip_chunk(infile, zip_hlen, zip_idx[zip_next++],
+                    ((info.format=='B') || (info.format=='L')) ? 
+                    sizeof(i_or_d) : sizeof(i_or_f), 
+                    info.endian != is_big_endian, &inp_data, &inp_max);
+        inp_pos = 0;
+      }
+#endif
+      at_end = (inp_pos >= inp_len);
+    }
+    else at_end = feof(infile);
+    if (at_end) {
+      if (0==chunk_input) break;
+      fclose(infile);
+      infile = NULL;
+      continue;
+    }
 
     /* ASCII input */
     if (info.format == 'A') {
@@ -242,23 +549,28 @@ void read_atoms(str255 infilename)
       /* eat comments */
       while (('#'==buf[0]) && !feof(infile))
         if (NULL==fgets(buf,sizeof(buf),infile)) p=0;
-      if (p==0) break;
-#ifdef DOUBLE
-      p = sscanf( buf,
-       "%d %d %lf %lf %lf %lf %lf %lf %lf %lf %lf %lf %lf %lf %lf %lf %lf %lf",
-        &n,&s,&d[0],&d[1],&d[2],&d[3],&d[4],&d[5],&d[6],&d[7],&d[8],
-        &d[9],&d[10],&d[11],&d[12],&d[13],&d[14],&d[15]);
-#else
-      p = sscanf( buf,
-       "%d %d %f %f %f %f %f %f %f %f %f %f %f %f %f %f %f %f",
-        &n,&s,&d[0],&d[1],&d[2],&d[3],&d[4],&d[5],&d[6],&d[7],&d[8],
-        &d[9],&d[10],&d[11],&d[12],&d[13],&d[14],&d[15]);
+      if (p==0) {
+        /* with chunk input, the next file follows */
+        if ((chunk_input) && (feof(infile))) continue;
+        break;
+      }
+      p = ascii_scan_line(buf, &n, &s, d, MAX_ITEMS_CONFIG);
+#ifdef TIMING
+      io_bytes_in += strlen(buf);
 #endif
     }
     /* double precision input */
     else if ((info.format=='B') || (info.format=='L')) {
       i_or_d *data = (i_or_d *) buf;
+      if (mem_input) {
+        memcpy(buf, inp_data + inp_pos, sizeof(i_or_d) * (info.n_items-1));
+        inp_pos += sizeof(i_or_d) * (info.n_items-1);
+        p = info.n_items-1;
+      } else
       p = fread(buf, sizeof(i_or_d), info.n_items-1, infile);
+#ifdef TIMING
+      io_bytes_in += p * sizeof(i_or_d);
+#endif
       if (p>0) p++; /* first value contains two items */
       if (info.endian == is_big_endian) {
         n = data[0].i[0];
@@ -277,7 +589,15 @@ void read_atoms(str255 infilename)
     /* single precision input */
     else if ((info.format=='b') || (info.format=='l')) {
       i_or_f *data = (i_or_f *) buf;
+      if (mem_input) {
+        memcpy(buf, inp_data + inp_pos, sizeof(i_or_f) * info.n_items);
+        inp_pos += sizeof(i_or_f) * info.n_items;
+        p = info.n_items;
+      } else
       p = fread(buf, sizeof(i_or_f), info.n_items, infile);
+#ifdef TIMING
+      io_bytes_in += p * sizeof(i_or_f);
+#endif
       if (info.endian == is_big_endian) {
         n = data[0].i;
         s = data[1].i;
@@ -435,6 +755,16 @@ void read_atoms(str255 infilename)
 
 #ifdef MPI
 
+      /* block input: collect the atom for its owner; own atoms are
+         also exchanged, so that they stay in the order of the file */
+      if (block_input) {
+        b = input_buf + to_cpu;
+        if (b->n + atom_size > b->n_max)
+          realloc_msgbuf(b, 2 * b->n_max + 64 * atom_size);
+        copy_atom_cell_buf(b, to_cpu, input, 0);
+        count_atom = 1;
+      } else
+
       /* to_cpu is in my input group, but not myself */
       if ((inp_grp_size > 1) && (myid != to_cpu)) {
         b = input_buf + to_cpu;
@@ -486,9 +816,22 @@ void read_atoms(str255 infilename)
       }
     } /* (p>0) */
   } /* !feof(infile) */
-  fclose(infile);  
+  if (NULL!=infile) fclose(infile);
+  free(inp_data);
+#ifdef MPI
+  free(chunks);
+#endif
+#ifdef ZLIB
+  free(zip_idx);
+#endif
 
 #ifdef MPI
+  if (block_input) {
+    send_atoms_block(input_buf);
+    for (s=0; s<num_cpus; s++) 
+      if (input_buf[s].data) free_msgbuf(input_buf+s);
+    free(input_buf);
+  }
   if (inp_grp_size > 1) {
     /* The last buffer is sent with a different tag, which tells the
        target CPU that reading is finished; we increase the size by
@@ -526,7 +869,7 @@ void read_atoms_cleanup(void)
 #ifdef MPI
 
   /* Add the number of atoms read (and kept) by each CPU */
-  if (1==parallel_input) {
+  if (parallel_input) {
     MPI_Allreduce( &natoms,  &tmp, 1, MPI_LONG, MPI_SUM, cpugrid);
     natoms = tmp;
     MPI_Allreduce( &nactive, &tmp, 1, MPI_LONG, MPI_SUM, cpugrid);
@@ -688,251 +1031,372 @@ void recv_atoms(void)
 
 /******************************************************************************
 *
-*  filter function for write_config_select
-*  writes data of all atoms for checkpoints
+*  cna_crist_type - crystal type of an atom from its CNA signature:
+*  0 fcc, 1 hcp, 2 other 12-fold coordinated, 3 other
 *
 ******************************************************************************/
 
-void write_atoms_config(FILE *out)
-{
-  int i, k, n, len=0;
-  i_or_r *data;
 #ifdef CNA
-  int crist, nn, nn_other, nn_1421, nn_1422;
-#endif
 
-#ifdef HPO
-#define RESOL1 " %12.16f"
-#define RESOL2 " %12.16f %12.16f"
-#define RESOL3 " %12.16f %12.16f %12.16f"
-#else
-#define RESOL1 " %f"
-#define RESOL2 " %f %f"
-#define RESOL3 " %f %f %f"
+static int cna_crist_type(cell *p, int i)
+{
+  int nn, nn_other, nn_1421, nn_1422;
+
+  nn_other = MARK(p,i) % 100; 
+  nn_1422  = ( MARK(p,i) / 100 ) % 100;
+  nn_1421  = ( MARK(p,i) / 10000 ) % 100;
+  nn       = nn_1421 + nn_1422 + nn_other;
+
+  /* fcc */
+  if ( nn == 12 && nn_1421 == 12 )
+    return 0;
+  /* hcp */
+  else if ( nn == 12 && nn_1421 == 6 && nn_1422 == 6 )
+    return 1;
+  /* other 12 */
+  else if ( nn == 12 )
+    return 2;
+  /* other */
+  else
+    return 3;
+}
+
 #endif
 
-  for (k=0; k<NCELLS; k++) {
-    cell *p;
-    p = CELLPTR(k);
-    for (i=0; i<p->n; i++) {
+/******************************************************************************
+*
+*  write_atom_ascii - format the line of atom i of cell p into s, 
+*  return its length (at most ASCII_ROW_MAX characters)
+*
+*  Reals are written with ascii_fixed, like printf("%f"), or with HPO
+*  as the shortest representation which reads back to the same value.
+*
+******************************************************************************/
 
-#ifdef CNA
-      if (cna_crist>0) {
-	nn_other = MARK(p,i) % 100; 
-	nn_1422  = ( MARK(p,i) / 100 ) % 100;
-	nn_1421  = ( MARK(p,i) / 10000 ) % 100;
-	nn       = nn_1421 + nn_1422 + nn_other;
-	  
-	/* fcc */
-	if ( nn == 12 && nn_1421 == 12 )
-	  crist = 0;
-	/* hcp */
-	else if ( nn == 12 && nn_1421 == 6 && nn_1422 == 6 )
-	  crist = 1;
-	/* other 12 */
-	else if ( nn == 12 )
-	  crist = 2;
-	/* other */
-	else
-	  crist = 3;
-      }
-#endif
+#define ASCII_ROW_MAX 2048
 
-      if (binary_output) {
-        n = 0;
-        data = (i_or_r *) (outbuf+len);
-#ifdef DOUBLE
-        data[n  ].i[0] = NUMMER(p,i);
-        data[n++].i[1] = VSORTE(p,i);
+#ifdef HPO
+#define PUT_REAL(x) (s[n++] = ' ', n += ascii_short(s+n, (double) (x)))
 #else
-        data[n++].i    = NUMMER(p,i);
-        data[n++].i    = VSORTE(p,i);
+#define PUT_REAL(x) (s[n++] = ' ', n += ascii_fixed(s+n, (double) (x), 6))
 #endif
-        data[n++].r = MASSE(p,i);
-        data[n++].r = ORT(p,i,X);
-        data[n++].r = ORT(p,i,Y);
+#define PUT_INT(x)  (s[n++] = ' ', n += ascii_int(s+n, (long) (x)))
+
+static int write_atom_ascii(char *s, cell *p, int i)
+{
+  int n = 0;
+
+  n += ascii_int(s, NUMMER(p,i));
+  PUT_INT(VSORTE(p,i));
+  PUT_REAL(MASSE(p,i));
+  PUT_REAL(ORT(p,i,X));
+  PUT_REAL(ORT(p,i,Y));
 #ifndef TWOD
-        data[n++].r = ORT(p,i,Z);
+  PUT_REAL(ORT(p,i,Z));
 #endif
 #ifdef UNIAX
-        data[n++].r = ACHSE(p,i,X);
-        data[n++].r = ACHSE(p,i,Y);
-        data[n++].r = ACHSE(p,i,Z);
+  PUT_REAL(ACHSE(p,i,X));
+  PUT_REAL(ACHSE(p,i,Y));
+  PUT_REAL(ACHSE(p,i,Z));
 #endif
-        if (ensemble != ENS_CG) {
-          data[n++].r = (IMPULS(p,i,X) / MASSE(p,i));
-          data[n++].r = (IMPULS(p,i,Y) / MASSE(p,i));
+  if (ensemble != ENS_CG) {
+    PUT_REAL(IMPULS(p,i,X) / MASSE(p,i));
+    PUT_REAL(IMPULS(p,i,Y) / MASSE(p,i));
 #ifndef TWOD
-          data[n++].r = (IMPULS(p,i,Z) / MASSE(p,i));
+    PUT_REAL(IMPULS(p,i,Z) / MASSE(p,i));
 #endif
-	}
+  }
 #ifdef UNIAX
-        data[n++].r = DREH_IMPULS(p,i,X) / uniax_inert;
-        data[n++].r = DREH_IMPULS(p,i,Y) / uniax_inert;
-        data[n++].r = DREH_IMPULS(p,i,Z) / uniax_inert; 
+  PUT_REAL(DREH_IMPULS(p,i,X) / uniax_inert);
+  PUT_REAL(DREH_IMPULS(p,i,Y) / uniax_inert);
+  PUT_REAL(DREH_IMPULS(p,i,Z) / uniax_inert);
 #endif
-        data[n++].r = POTENG(p,i);
+  PUT_REAL(POTENG(p,i));
 #if defined(VARCHG) || defined(EWALD) || defined(USEFCS)
-        data[n++].r = CHARGE(p,i);
+  PUT_REAL(CHARGE(p,i));
 #endif
 #ifdef NNBR
-        data[n++].r = (real) NBANZ(p,i);
+  PUT_INT(NBANZ(p,i));
 #endif
 #ifdef REFPOS
-        data[n++].r = REF_POS(p,i,X);
-        data[n++].r = REF_POS(p,i,Y);
+  PUT_REAL(REF_POS(p,i,X));
+  PUT_REAL(REF_POS(p,i,Y));
 #ifndef TWOD
-        data[n++].r = REF_POS(p,i,Z);
+  PUT_REAL(REF_POS(p,i,Z));
 #endif
 #endif
 #ifdef DISLOC
-        data[n++].r = ORT_REF(p,i,X);
-        data[n++].r = ORT_REF(p,i,Y);
+  PUT_REAL(ORT_REF(p,i,X));
+  PUT_REAL(ORT_REF(p,i,Y));
 #ifndef TWOD
-        data[n++].r = ORT_REF(p,i,Z);
+  PUT_REAL(ORT_REF(p,i,Z));
 #endif
-        data[n++].r = EPOT_REF(p,i);
+  PUT_REAL(EPOT_REF(p,i));
 #endif
 #if defined(EAM2) && !defined(NORHOH)
-        data[n++].r = EAM_RHO(p,i);
+  PUT_REAL(EAM_RHO(p,i));
 #ifdef EEAM
-        data[n++].r = EAM_P(p,i);
+  PUT_REAL(EAM_P(p,i));
 #endif
 #endif
+#if defined(DIPOLE) || defined(KERMODE)
+  PUT_REAL(DP_P_IND(p,i,X));
+  PUT_REAL(DP_P_IND(p,i,Y));
+  PUT_REAL(DP_P_IND(p,i,Z));
+#endif	/* DIPOLE */
 #ifdef DAMP
-        data[n++].r = DAMPF(p,i);
+  PUT_REAL(DAMPF(p,i));
 #endif
 #ifdef ADA
-#ifdef DOUBLE
-        data[n++].i[0] = ADATYPE(p,i);
-#else
-        data[n++].i = ADATYPE(p,i);
-#endif
+  PUT_INT(ADATYPE(p,i));
 #endif
 #ifdef NYETENSOR
-		nyeTensorInfo *info = NYE(p,i);
-		if (info != NULL){
-			data[n++].r = info->ls[0];
-			data[n++].r = info->ls[1];
-			data[n++].r = info->ls[2];
-			data[n++].r = info->bv[0];
-			data[n++].r = info->bv[1];
-			data[n++].r = info->bv[2];
-		} else {
-			data[n++].r	= 0.; data[n++].r = 0.; data[n++].r = 0.;
-			data[n++].r	= 0.; data[n++].r = 0.; data[n++].r = 0.;
-		}
+  {
+    nyeTensorInfo *info = NYE(p,i);
+    if (info != NULL) {
+      PUT_REAL(info->ls[0]); PUT_REAL(info->ls[1]); PUT_REAL(info->ls[2]);
+      PUT_REAL(info->bv[0]); PUT_REAL(info->bv[1]); PUT_REAL(info->bv[2]);
+    } else {
+      strcpy(s+n, " 0. 0. 0. 0. 0. 0.");
+      n += 18;
+    }
+  }
 #endif
 #ifdef CNA
-	if (cna_crist>0) {	  
-	  data[n++].r = (real) crist;
-	}
+  if (cna_crist>0) 
+    PUT_INT(cna_crist_type(p,i));
 #endif
 #ifdef LOADBALANCE
-	if (lb_writeStatus)
-	  data[n++].r = (real) myid;
+  if (lb_writeStatus)
+    PUT_INT(myid);
 #endif
 #ifdef VISCOUS
-	 data[n++].r = p->viscous_friction[i];
+  PUT_REAL(p->viscous_friction[i]);
 #endif
-        len += n * sizeof(i_or_r);
+  s[n++] = '\n';
+  return n;
+}
+
+#undef PUT_REAL
+#undef PUT_INT
+
+/******************************************************************************
+*
+*  write_atoms_ascii - write all atoms as ASCII lines
+*
+*  With OpenMP, the cells are formatted in parallel, in batches which 
+*  fit into a scratch buffer, and then copied in order to outbuf.
+*
+******************************************************************************/
+
+static void write_atoms_ascii(FILE *out)
+{
+  int i, k, len=0;
+
+#ifdef _OPENMP
+  static char *scratch = NULL;
+  static long  scratch_size = 0;
+  static long *off = NULL;
+  static int   off_size = 0;
+  long *clen, m, l;
+  int   k1, j;
+
+  if (scratch_size < outbuf_size) {
+    free(scratch);
+    scratch_size = outbuf_size;
+    scratch = (char *) malloc(scratch_size);
+    if (NULL==scratch) error("cannot allocate ASCII scratch buffer");
+  }
+  if (off_size < 2 * NCELLS + 1) {
+    free(off);
+    off_size = 2 * NCELLS + 1;
+    off = (long *) malloc(off_size * sizeof(long));
+    if (NULL==off) error("cannot allocate ASCII scratch buffer");
+  }
+  clen = off + NCELLS + 1;
+
+  for (k=0; k<NCELLS; k=k1) {
+
+    /* choose a batch of cells, at least one, which fits */
+    off[0] = 0;
+    for (k1=k; k1<NCELLS; k1++) {
+      m = off[k1-k] + (long) CELLPTR(k1)->n * ASCII_ROW_MAX;
+      if (m > scratch_size) {
+        if (k1 > k) break;
+        free(scratch);
+        scratch_size = m;
+        scratch = (char *) malloc(scratch_size);
+        if (NULL==scratch) error("cannot allocate ASCII scratch buffer");
       }
-      else {
-        len += sprintf(outbuf+len, "%d %d", NUMMER(p,i), VSORTE(p,i));
-        len += sprintf(outbuf+len, RESOL1, MASSE(p,i));
-#ifdef TWOD
-        len += sprintf(outbuf+len, 
-          RESOL2, ORT(p,i,X), ORT(p,i,Y) );
+      off[k1-k+1] = m;
+    }
+
+    /* format the cells of the batch in parallel */
+#pragma omp parallel for schedule(dynamic) private(i,m)
+    for (j=0; j<k1-k; j++) {
+      cell *p = CELLPTR(k+j);
+      for (i=0, m=0; i<p->n; i++) m += write_atom_ascii(scratch+off[j]+m, p, i);
+      clen[j] = m;
+    }
+
+    /* copy them in order, line by line if outbuf is full */
+    for (j=0; j<k1-k; j++) {
+      char *s = scratch + off[j], *e = s + clen[j];
+      if (len + clen[j] < outbuf_size) {
+        memcpy(outbuf+len, s, clen[j]);
+        len += clen[j];
+      }
+      else while (s < e) {
+        l = (char *) memchr(s, '\n', e - s) - s + 1;
+        if (len + l >= outbuf_size) flush_outbuf(out,&len,OUTBUF_TAG);
+        memcpy(outbuf+len, s, l);
+        len += l;
+        s   += l;
+      }
+    }
+    if (len > outbuf_size - ASCII_ROW_MAX) flush_outbuf(out,&len,OUTBUF_TAG);
+  }
 #else
-        len += sprintf(outbuf+len, 
-          RESOL3, ORT(p,i,X), ORT(p,i,Y), ORT(p,i,Z) );
+  for (k=0; k<NCELLS; k++) {
+    cell *p = CELLPTR(k);
+    for (i=0; i<p->n; i++) {
+      len += write_atom_ascii(outbuf+len, p, i);
+      /* flush or send outbuf if it is full */
+      if (len > outbuf_size - ASCII_ROW_MAX) flush_outbuf(out,&len,OUTBUF_TAG);
+    }
+  }
 #endif
-#ifdef UNIAX
-        len += sprintf(outbuf+len, 
-          RESOL3, ACHSE(p,i,X), ACHSE(p,i,Y), ACHSE(p,i,Z) );
+  flush_outbuf(out,&len,OUTBUF_TAG+1);
+}
+
+/******************************************************************************
+*
+*  filter function for write_config_select
+*  writes data of all atoms for checkpoints
+*
+******************************************************************************/
+
+void write_atoms_config(FILE *out)
+{
+  int i, k, n, len=0;
+  i_or_r *data;
+
+  if (!binary_output) {
+    write_atoms_ascii(out);
+    return;
+  }
+
+/* error-bounded quantization of positions and velocities */
+#ifdef ZLIB
+#define QPOS(x) ((out_zip_pos > 0.0) ? out_zip_pos * rint((x) / out_zip_pos) : (x))
+#define QVEL(x) ((out_zip_vel > 0.0) ? out_zip_vel * rint((x) / out_zip_vel) : (x))
+#else
+#define QPOS(x) (x)
+#define QVEL(x) (x)
 #endif
-#ifdef TWOD
-        if (ensemble != ENS_CG)
-          len += sprintf(outbuf+len, RESOL2,
-            IMPULS(p,i,X) / MASSE(p,i), 
-            IMPULS(p,i,Y) / MASSE(p,i) );
+
+  for (k=0; k<NCELLS; k++) {
+    cell *p;
+    p = CELLPTR(k);
+    for (i=0; i<p->n; i++) {
+
+      n = 0;
+      data = (i_or_r *) (outbuf+len);
+#ifdef DOUBLE
+      data[n  ].i[0] = NUMMER(p,i);
+      data[n++].i[1] = VSORTE(p,i);
 #else
-        if (ensemble != ENS_CG)
-          len += sprintf(outbuf+len, RESOL3,
-            IMPULS(p,i,X) / MASSE(p,i), 
-            IMPULS(p,i,Y) / MASSE(p,i), 
-            IMPULS(p,i,Z) / MASSE(p,i) );
+      data[n++].i    = NUMMER(p,i);
+      data[n++].i    = VSORTE(p,i);
 #endif
+      data[n++].r = MASSE(p,i);
+      data[n++].r = QPOS( ORT(p,i,X) );
+      data[n++].r = QPOS( ORT(p,i,Y) );
+#ifndef TWOD
+      data[n++].r = QPOS( ORT(p,i,Z) );
+#endif
+#ifdef UNIAX
+      data[n++].r = ACHSE(p,i,X);
+      data[n++].r = ACHSE(p,i,Y);
+      data[n++].r = ACHSE(p,i,Z);
+#endif
+      if (ensemble != ENS_CG) {
+        data[n++].r = QVEL( IMPULS(p,i,X) / MASSE(p,i) );
+        data[n++].r = QVEL( IMPULS(p,i,Y) / MASSE(p,i) );
+#ifndef TWOD
+        data[n++].r = QVEL( IMPULS(p,i,Z) / MASSE(p,i) );
+#endif
+	}
 #ifdef UNIAX
-        len += sprintf(outbuf+len, RESOL3,
-          DREH_IMPULS(p,i,X) / uniax_inert,
-          DREH_IMPULS(p,i,Y) / uniax_inert,
-          DREH_IMPULS(p,i,Z) / uniax_inert ); 
+      data[n++].r = DREH_IMPULS(p,i,X) / uniax_inert;
+      data[n++].r = DREH_IMPULS(p,i,Y) / uniax_inert;
+      data[n++].r = DREH_IMPULS(p,i,Z) / uniax_inert; 
 #endif
-        len += sprintf(outbuf+len, RESOL1, POTENG(p,i));
+      data[n++].r = POTENG(p,i);
 #if defined(VARCHG) || defined(EWALD) || defined(USEFCS)
-        len += sprintf(outbuf+len, RESOL1, CHARGE(p,i));
+      data[n++].r = CHARGE(p,i);
 #endif
 #ifdef NNBR
-        len += sprintf(outbuf+len, " %d",  NBANZ(p,i));
+      data[n++].r = (real) NBANZ(p,i);
 #endif
 #ifdef REFPOS
-#ifdef TWOD
-        len += sprintf(outbuf+len, 
-          RESOL2, REF_POS(p,i,X), REF_POS(p,i,Y));
-#else
-        len += sprintf(outbuf+len, 
-          RESOL3, REF_POS(p,i,X), REF_POS(p,i,Y), REF_POS(p,i,Z));
+      data[n++].r = REF_POS(p,i,X);
+      data[n++].r = REF_POS(p,i,Y);
+#ifndef TWOD
+      data[n++].r = REF_POS(p,i,Z);
 #endif
 #endif
 #ifdef DISLOC
-#ifdef TWOD
-        len += sprintf(outbuf+len, 
-          RESOL2, ORT_REF(p,i,X), ORT_REF(p,i,Y));
-#else
-        len += sprintf(outbuf+len, 
-          RESOL3, ORT_REF(p,i,X), ORT_REF(p,i,Y), ORT_REF(p,i,Z));
+      data[n++].r = ORT_REF(p,i,X);
+      data[n++].r = ORT_REF(p,i,Y);
+#ifndef TWOD
+      data[n++].r = ORT_REF(p,i,Z);
 #endif
-        len += sprintf(outbuf+len, RESOL1, EPOT_REF(p,i));
+      data[n++].r = EPOT_REF(p,i);
 #endif
 #if defined(EAM2) && !defined(NORHOH)
-        len += sprintf(outbuf+len, RESOL1, EAM_RHO(p,i));
+      data[n++].r = EAM_RHO(p,i);
 #ifdef EEAM
-        len += sprintf(outbuf+len, RESOL1, EAM_P(p,i));
+      data[n++].r = EAM_P(p,i);
 #endif
 #endif
-#if defined(DIPOLE) || defined(KERMODE)
-	len += sprintf(outbuf+len, RESOL3, 
-		       DP_P_IND(p,i,X), DP_P_IND(p,i,Y), DP_P_IND(p,i,Z)); 
-#endif	/* DIPOLE */
 #ifdef DAMP
-        len += sprintf(outbuf+len, RESOL1, DAMPF(p,i));
+      data[n++].r = DAMPF(p,i);
 #endif
 #ifdef ADA
-        len += sprintf(outbuf+len, " %d", ADATYPE(p,i));
+#ifdef DOUBLE
+      data[n++].i[0] = ADATYPE(p,i);
+#else
+      data[n++].i = ADATYPE(p,i);
+#endif
 #endif
 #ifdef NYETENSOR
-        nyeTensorInfo *info = NYE(p,i);
-       	if (info != NULL) {
-       		len += sprintf(outbuf+len, RESOL3, info->ls[0], info->ls[1], info->ls[2] );
-       		len += sprintf(outbuf+len, RESOL3, info->bv[0], info->bv[1], info->bv[2] );
-       	} else {
-       		len += sprintf(outbuf + len," 0. 0. 0. 0. 0. 0.");
-       	}
+		nyeTensorInfo *info = NYE(p,i);
+		if (info != NULL){
+			data[n++].r = info->ls[0];
+			data[n++].r = info->ls[1];
+			data[n++].r = info->ls[2];
+			data[n++].r = info->bv[0];
+			data[n++].r = info->bv[1];
+			data[n++].r = info->bv[2];
+		} else {
+			data[n++].r	= 0.; data[n++].r = 0.; data[n++].r = 0.;
+			data[n++].r	= 0.; data[n++].r = 0.; data[n++].r = 0.;
+		}
 #endif
 #ifdef CNA
-	if (cna_crist>0) 
-	  len += sprintf(outbuf+len, " %d", crist);
+	if (cna_crist>0) {	  
+	  data[n++].r = (real) cna_crist_type(p,i);
+	}
 #endif
 #ifdef LOADBALANCE
 	if (lb_writeStatus)
-		len += sprintf(outbuf+len, " %i", myid);
+	  data[n++].r = (real) myid;
 #endif
 #ifdef VISCOUS
-		len += sprintf(outbuf+len, RESOL1, p->viscous_friction[i]);
+	 data[n++].r = p->viscous_friction[i];
 #endif
-        len += sprintf(outbuf+len,"\n");
-      }
+      len += n * sizeof(i_or_r);
       /* flush or send outbuf if it is full */
       if (len > outbuf_size - 256) flush_outbuf(out,&len,OUTBUF_TAG);
     }
@@ -950,6 +1414,9 @@ void write_itr_file(int fzhlr, int steps, char *suffix)
 {
   FILE *out;
   str255 fname;
+#ifdef ASYNC_IO
+  str255 tmpname;
+#endif
   int m, n;
 
   if (strcasecmp(suffix,"ss")==0) {
@@ -962,6 +1429,16 @@ void write_itr_file(int fzhlr, int steps, char *suffix)
     else                sprintf(fname,"%s-interm.itr",outfilename);
   }
 
+#ifdef ASYNC_IO
+  /* the checkpoint may still be pending in the output thread, so the
+     file is written under a temporary name, and renamed after it */
+  if (async_output > 0) {
+    if (snprintf(tmpname, sizeof(tmpname), "%s.tmp", fname)
+        >= (int) sizeof(tmpname)) error("file name too long");
+    out = fopen(tmpname,"w");
+  }
+  else
+#endif
   out = fopen(fname,"w");
   if (NULL == out) error("Cannot write iteration file.");
 
@@ -1083,6 +1560,9 @@ void write_itr_file(int fzhlr, int steps, char *suffix)
     fprintf(out,"avpos_npwrites \t%d\n",avpos_npwrites);
 #endif 
   fclose(out);
+#ifdef ASYNC_IO
+  if (async_output > 0) queue_rename(tmpname, fname);
+#endif
 }
 
 #ifdef AVPOS
@@ -691,6 +691,8 @@ int nyeDone;
        write_config( steps/checkpt_int, steps);
     if ((eng_int  > 0) && (0 == steps % eng_int )) write_eng_file(steps);
     if ((dist_int > 0) && (0 == steps % dist_int)) write_distrib(steps);
+    update_insitu(steps);
+    if ((traj_int > 0) && (0 == steps % traj_int)) write_traj(steps);
     if ((pic_int  > 0) && (0 == steps % pic_int )) write_pictures(steps);
 #ifdef EXTPOT
 #ifdef RELAX
@@ -870,6 +872,7 @@ int nyeDone;
   }
 
   imd_stop_timer(&time_main);
+  finish_insitu();
 #ifdef USEFCS
   fcs_cleanup();
 #endif
@@ -2001,6 +2004,13 @@ void do_boundaries(void)
       REF_POS(p,l,Z) += i * box_x.z;
 #endif
 #endif
+#ifdef DELTA
+      DLT_POS(p,l,X) += i * box_x.x;
+      DLT_POS(p,l,Y) += i * box_x.y;
+#ifndef TWOD
+      DLT_POS(p,l,Z) += i * box_x.z;
+#endif
+#endif
 #ifdef AVPOS
       SHEET(p,l,X)   -= i * box_x.x;
       SHEET(p,l,Y)   -= i * box_x.y;
@@ -2026,6 +2036,13 @@ void do_boundaries(void)
       REF_POS(p,l,Z) += i * box_y.z;
 #endif
 #endif
+#ifdef DELTA
+      DLT_POS(p,l,X) += i * box_y.x;
+      DLT_POS(p,l,Y) += i * box_y.y;
+#ifndef TWOD
+      DLT_POS(p,l,Z) += i * box_y.z;
+#endif
+#endif
 #ifdef AVPOS
       SHEET(p,l,X)   -= i * box_y.x;
       SHEET(p,l,Y)   -= i * box_y.y;
@@ -2048,6 +2065,11 @@ void do_boundaries(void)
       REF_POS(p,l,Y) += i * box_z.y;
       REF_POS(p,l,Z) += i * box_z.z;
 #endif
+#ifdef DELTA
+      DLT_POS(p,l,X) += i * box_z.x;
+      DLT_POS(p,l,Y) += i * box_z.y;
+      DLT_POS(p,l,Z) += i * box_z.z;
+#endif
 #ifdef AVPOS
       SHEET(p,l,X)   -= i * box_z.x;
       SHEET(p,l,Y)   -= i * box_z.y;
@@ -146,6 +146,13 @@ void init_io(void)
     inp_grp_size*= mult;
     my_inp_id    = 0;  while (my_inp_grp != io_grps[my_inp_id]) my_inp_id++;
   }
+  else if (parallel_input==2) {
+    /* one file, each CPU reads a block of it */
+    n_inp_grps   = num_cpus;
+    my_inp_grp   = myid;
+    my_inp_id    = myid;
+    inp_grp_size = 1;
+  }
   else {
     n_inp_grps   = 1;
     my_inp_grp   = 0;
@@ -161,6 +168,13 @@ void init_io(void)
     out_grp_size*= mult;
     my_out_id    = 0;  while (my_out_grp != io_grps[my_out_id]) my_out_id++;
   }
+  else if (parallel_output==2) {
+    /* one file, written collectively with MPI-IO */
+    n_out_grps   = 1;
+    my_out_grp   = 0;
+    my_out_id    = myid;
+    out_grp_size = 1;
+  }
   else {
     n_out_grps   = 1;
     my_out_grp   = 0;
@@ -194,7 +208,7 @@ void init_io(void)
 #else /* not BG */
 
   /* input parameters */
-  if (parallel_input==1) {
+  if ((parallel_input==1) || (parallel_input==2)) {
     n_inp_grps   = num_cpus;
     my_inp_grp   = myid;
     my_inp_id    = myid;
@@ -216,6 +230,13 @@ void init_io(void)
     my_out_id  = (int) (myid/outputgrpsize)*outputgrpsize;
     out_grp_size = outputgrpsize;
   }
+  else if (parallel_output==2) {
+    /* one file, written collectively with MPI-IO */
+    n_out_grps   = 1;
+    my_out_grp   = 0;
+    my_out_id    = myid;
+    out_grp_size = 1;
+  }
   else {
     n_out_grps   = 1;
     my_out_grp   = 0;
@@ -451,6 +472,18 @@ void copy_atom_cell_buf(msgbuf *to, int to_cpu, cell *p, int ind )
   to->data[ to->n++ ] = REF_POS(p,ind,Z);
 #endif
 #endif
+#ifdef DELTA
+  to->data[ to->n++ ] = DLT_POS(p,ind,X);
+  to->data[ to->n++ ] = DLT_POS(p,ind,Y);
+#ifndef TWOD
+  to->data[ to->n++ ] = DLT_POS(p,ind,Z);
+#endif
+  to->data[ to->n++ ] = DLT_VEL(p,ind,X);
+  to->data[ to->n++ ] = DLT_VEL(p,ind,Y);
+#ifndef TWOD
+  to->data[ to->n++ ] = DLT_VEL(p,ind,Z);
+#endif
+#endif
 #ifdef HC
   to->data[ to->n++ ] = HCAVENG(p,ind);
 #endif
@@ -668,6 +701,18 @@ void copy_atom_buf_cell(minicell *p, msgbuf *b, int start)
   REF_POS(to,ind,Z)  = b->data[j++];
 #endif
 #endif
+#ifdef DELTA
+  DLT_POS(to,ind,X)  = b->data[j++];
+  DLT_POS(to,ind,Y)  = b->data[j++];
+#ifndef TWOD
+  DLT_POS(to,ind,Z)  = b->data[j++];
+#endif
+  DLT_VEL(to,ind,X)  = b->data[j++];
+  DLT_VEL(to,ind,Y)  = b->data[j++];
+#ifndef TWOD
+  DLT_VEL(to,ind,Z)  = b->data[j++];
+#endif
+#endif
 #ifdef HC
   HCAVENG(to,ind)    = b->data[j++];
 #endif
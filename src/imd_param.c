@@ -478,6 +478,23 @@ int getparamfile(char *paramfname, int phase)
       /* upper right corner of distribution */
       getparam(token,&dist_ur,PARAM_REAL,DIM,DIM);
     }
+    else if (strcasecmp(token,"insitu_dist")==0) {
+      /* in-situ distribution, accumulated and reduced while running */
+      /* format: number quantity format interval dim.x dim.y (dim.z) */
+      getparam(token,&k,PARAM_INT,1,1);
+      if ((k < 0) || (k >= MAX_INSITU))
+        error("insitu_dist number out of range");
+      getparam(token,tmpstr,PARAM_STR,1,255);
+      insitu_quant[k] = insitu_quantity(tmpstr);
+      if (insitu_quant[k] < 0)
+        error_str("Unknown insitu_dist quantity %s", tmpstr);
+      getparam(token,&insitu_mode[k],PARAM_INT,1,1);
+      if ((insitu_mode[k] < DIST_FORMAT_BINARY) || 
+          (insitu_mode[k] > DIST_FORMAT_ASCII))
+        error("Unknown insitu_dist format");
+      getparam(token,&insitu_int[k],PARAM_INT,1,1);
+      getparam(token,&insitu_dim[k],PARAM_INT,DIM,DIM);
+    }
     else if (strcasecmp(token,"dist_Ekin_flag")==0) {
       /* write Ekin dist? */
       getparam(token,&dist_Ekin_flag,PARAM_INT,1,1);
@@ -543,6 +560,51 @@ int getparamfile(char *paramfname, int phase)
       /* size of neighbor list */
       getparam(token,&nbl_size,PARAM_REAL,1,1);
     }
+    else if (strcasecmp(token,"nbl_incremental")==0) {
+      /* incremental update of neighbor list */
+      getparam(token,&nbl_incremental,PARAM_INT,1,1);
+    }
+    else if (strcasecmp(token,"nbl_full")==0) {
+      /* full neighbor list without Newton's third law */
+      getparam(token,&nbl_full,PARAM_INT,1,1);
+#ifndef NBL_FULL
+      if (nbl_full) error("nbl_full is not supported with these options");
+#endif
+    }
+    else if (strcasecmp(token,"nbl_sort")==0) {
+      /* sort atoms in cells at every nbl_sort-th neighbor list rebuild */
+      getparam(token,&nbl_sort,PARAM_INT,1,1);
+    }
+    else if (strcasecmp(token,"nbl_hilbert")==0) {
+      /* order cells along a Hilbert curve */
+      getparam(token,&nbl_hilbert,PARAM_INT,1,1);
+    }
+    else if (strcasecmp(token,"nbl_cluster")==0) {
+      /* cluster pair list instead of atom pair list */
+      getparam(token,&nbl_cluster,PARAM_INT,1,1);
+#ifndef NBL_CLUSTER
+      if (nbl_cluster) error("nbl_cluster is not supported with these options");
+#endif
+    }
+    else if (strcasecmp(token,"nbl_overlap")==0) {
+      /* compute interior cells while the buffer cells are exchanged */
+      getparam(token,&nbl_overlap,PARAM_INT,1,1);
+#ifdef LOADBALANCE
+      if (nbl_overlap) error("nbl_overlap is not supported with LOADBALANCE");
+#endif
+    }
+#ifdef NBL
+    else if (strcasecmp(token,"nbl_autotune")==0) {
+      /* adjust nbl_margin every nbl_autotune neighbor list rebuilds */
+      getparam(token,&nbl_autotune,PARAM_INT,1,1);
+    }
+#endif
+#ifdef NBL_SIMD
+    else if (strcasecmp(token,"nbl_simd")==0) {
+      /* force kernel: 0 scalar, 1 blocked, 2 blocked with bitwise check */
+      getparam(token,&nbl_simd,PARAM_INT,1,1);
+    }
+#endif
 #endif
 #ifdef NEB
     else if (strcasecmp(token,"neb_nrep")==0) {
@@ -1811,7 +1873,8 @@ int getparamfile(char *paramfname, int phase)
       getparam(token,&cpu_dim,PARAM_INT,DIM,DIM);
     }
     else if (strcasecmp(token,"parallel_output")==0) {
-      /* parallel output flag */
+      /* parallel output: 0 one file, 1 one file per output group,
+         2 one file written collectively with MPI-IO */
       getparam(token,&parallel_output,PARAM_INT,1,1);
     }
     else if (strcasecmp(token,"outputgrpsize")==0) {
@@ -1821,18 +1884,83 @@ int getparamfile(char *paramfname, int phase)
 
 
     else if (strcasecmp(token,"parallel_input")==0) {
-      /* parallel input flag */
+      /* parallel input: 0 one reader, 1 per CPU files or every CPU
+         reads all, 2 every CPU reads a block of a binary file */
       getparam(token,&parallel_input,PARAM_INT,1,1);
     }
     else if (strcasecmp(token,"msgbuf_size")==0) {
       /* security factor of message buffer size */
       getparam(token,&msgbuf_size,PARAM_REAL,1,1);
     }
+    else if (strcasecmp(token,"direct_halo")==0) {
+      /* exchange buffer cells directly with all 26 neighbors;
+         1: messages, 2: shared memory between CPUs on a node */
+      getparam(token,&direct_halo,PARAM_INT,1,1);
+#if defined(TWOD) || defined(LOADBALANCE)
+      if (direct_halo) error("direct_halo is not supported with these options");
+#endif
+#if MPI_VERSION < 3
+      if (2==direct_halo) error("direct_halo 2 requires MPI-3");
+#endif
+    }
+    else if (strcasecmp(token,"direct_halo_node")==0) {
+      /* with direct_halo 2, at most this many CPUs of a node share
+         memory, which allows to test the mixed case on a single node */
+      getparam(token,&direct_halo_node,PARAM_INT,1,1);
+      if (direct_halo_node < 0) error("direct_halo_node must not be negative");
+    }
+#endif
+#ifdef ASYNC_IO
+    else if (strcasecmp(token,"async_output")==0) {
+      /* max. number of files pending in asynchronous output */
+      getparam(token,&async_output,PARAM_INT,1,1);
+      if (async_output < 0) error("async_output must not be negative");
+    }
 #endif
     else if (strcasecmp(token,"binary_output")==0) {
       /* binary output flag */
       getparam(token,&binary_output,PARAM_INT,1,1);
     }
+    else if (strcasecmp(token,"traj_int")==0) {
+      /* number of steps between frames of the trajectory file */
+      getparam(token,&traj_int,PARAM_INT,1,1);
+    }
+    else if (strcasecmp(token,"traj_blocks")==0) {
+      /* number of trajectory blocks per CPU in each direction */
+      getparam(token,&traj_blocks,PARAM_INT,DIM,DIM);
+    }
+#ifdef DELTA
+    else if (strcasecmp(token,"delta_checkpt")==0) {
+      /* every delta_checkpt-th checkpoint is full, the others are deltas */
+      getparam(token,&delta_checkpt,PARAM_INT,1,1);
+    }
+    else if (strcasecmp(token,"delta_eps_pos")==0) {
+      /* quantum of displacements in delta checkpoints */
+      getparam(token,&delta_eps_pos,PARAM_REAL,1,1);
+      if (delta_eps_pos <= 0.0) error("delta_eps_pos must be positive");
+    }
+    else if (strcasecmp(token,"delta_eps_vel")==0) {
+      /* quantum of velocity changes in delta checkpoints */
+      getparam(token,&delta_eps_vel,PARAM_REAL,1,1);
+      if (delta_eps_vel <= 0.0) error("delta_eps_vel must be positive");
+    }
+#endif
+#ifdef ZLIB
+    else if (strcasecmp(token,"compress_output")==0) {
+      /* zlib level (1-9) of binary checkpoints, 0 for no compression */
+      getparam(token,&compress_output,PARAM_INT,1,1);
+      if ((compress_output < 0) || (compress_output > 9))
+        error("compress_output must be between 0 and 9");
+    }
+    else if (strcasecmp(token,"compress_eps_pos")==0) {
+      /* max. error of positions in numbered compressed checkpoints */
+      getparam(token,&compress_eps_pos,PARAM_REAL,1,1);
+    }
+    else if (strcasecmp(token,"compress_eps_vel")==0) {
+      /* max. error of velocities in numbered compressed checkpoints */
+      getparam(token,&compress_eps_vel,PARAM_REAL,1,1);
+    }
+#endif
 #ifdef CORRELATE
     else if (strcasecmp(token,"correl_rmax")==0) {
       /* dimension of histogram in r domain */
@@ -3210,6 +3338,16 @@ else if (strcasecmp(token,"laser_rescale_mode")==0) {
     else if (strcasecmp(token,"ew_test")==0) {
       getparam(token,&ew_test,PARAM_INT,1,1);
     }
+#ifdef EWALD
+    /* SPME mesh instead of k-vector sum */
+    else if (strcasecmp(token,"ew_mesh")==0) {
+      getparam(token,&ew_mesh,PARAM_INT,3,3);
+    }
+    /* order of SPME B-splines */
+    else if (strcasecmp(token,"ew_order")==0) {
+      getparam(token,&ew_order,PARAM_INT,1,1);
+    }
+#endif
     /* potential table resolution */
     else if (strcasecmp(token,"coul_res")==0) {
       getparam(token,&coul_res,PARAM_REAL,1,1);
@@ -3929,11 +4067,22 @@ int read_parameters(char *paramfname, int phase)
       if (NULL==testfile) {
         sprintf(infilename,"%s.%05d.%s",outfilename,imdrestart,"chkpt");
         testfile = fopen(infilename,"r");
-        if (NULL==testfile) {
-          error_str("file %s not found", infilename);
-        } else {
-          fclose(testfile);
-        }
+      }
+#ifdef DELTA
+      /* or a delta checkpoint, which read_atoms recognizes */
+      if ((NULL==testfile) &&
+          (snprintf(infilename, sizeof(infilename), "%s.%d.%s",
+                    outfilename, imdrestart, "dchkpt")
+           < (int) sizeof(infilename)))
+        testfile = fopen(infilename,"r");
+      if ((NULL==testfile) &&
+          (snprintf(infilename, sizeof(infilename), "%s.%05d.%s",
+                    outfilename, imdrestart, "dchkpt")
+           < (int) sizeof(infilename)))
+        testfile = fopen(infilename,"r");
+#endif
+      if (NULL==testfile) {
+        error_str("file %s not found", infilename);
       } else {
         fclose(testfile);
       }
@@ -4038,6 +4187,10 @@ void broadcast_params() {
   MPI_Bcast( &dist_shear_aniso_flag, 1, MPI_INT, 0, MPI_COMM_WORLD);
   MPI_Bcast( &dist_dens_flag,        1, MPI_INT, 0, MPI_COMM_WORLD);
   MPI_Bcast( &dist_vxavg_flag,       1, MPI_INT, 0, MPI_COMM_WORLD);
+  MPI_Bcast( insitu_int,    MAX_INSITU, MPI_INT, 0, MPI_COMM_WORLD);
+  MPI_Bcast( insitu_quant,  MAX_INSITU, MPI_INT, 0, MPI_COMM_WORLD);
+  MPI_Bcast( insitu_mode,   MAX_INSITU, MPI_INT, 0, MPI_COMM_WORLD);
+  MPI_Bcast( insitu_dim, MAX_INSITU*DIM, MPI_INT, 0, MPI_COMM_WORLD);
   MPI_Bcast( &box_from_header,       1, MPI_INT, 0, MPI_COMM_WORLD);
 
 #ifdef TWOD
@@ -4210,6 +4363,16 @@ void broadcast_params() {
 #ifdef NBLIST
   MPI_Bcast( &nbl_margin,    1, REAL, 0, MPI_COMM_WORLD);
   MPI_Bcast( &nbl_size,      1, REAL, 0, MPI_COMM_WORLD);
+  MPI_Bcast( &nbl_incremental, 1, MPI_INT, 0, MPI_COMM_WORLD);
+  MPI_Bcast( &nbl_full,      1, MPI_INT, 0, MPI_COMM_WORLD);
+  MPI_Bcast( &nbl_sort,      1, MPI_INT, 0, MPI_COMM_WORLD);
+  MPI_Bcast( &nbl_hilbert,   1, MPI_INT, 0, MPI_COMM_WORLD);
+  MPI_Bcast( &nbl_cluster,   1, MPI_INT, 0, MPI_COMM_WORLD);
+  MPI_Bcast( &nbl_autotune,  1, MPI_INT, 0, MPI_COMM_WORLD);
+  MPI_Bcast( &nbl_overlap,   1, MPI_INT, 0, MPI_COMM_WORLD);
+#ifdef NBL_SIMD
+  MPI_Bcast( &nbl_simd,      1, MPI_INT, 0, MPI_COMM_WORLD);
+#endif
 #endif
 #ifdef VEC
   MPI_Bcast( &atoms_per_cpu, 1, MPI_INT, 0, MPI_COMM_WORLD);
@@ -4261,7 +4424,24 @@ void broadcast_params() {
   MPI_Bcast( &outputgrpsize, 1, MPI_INT, 0, MPI_COMM_WORLD);
   MPI_Bcast( &parallel_input,  1, MPI_INT, 0, MPI_COMM_WORLD);
   MPI_Bcast( &msgbuf_size,     1, REAL,    0, MPI_COMM_WORLD);
+  MPI_Bcast( &direct_halo,     1, MPI_INT, 0, MPI_COMM_WORLD);
+  MPI_Bcast( &direct_halo_node, 1, MPI_INT, 0, MPI_COMM_WORLD);
   MPI_Bcast( &binary_output,   1, MPI_INT, 0, MPI_COMM_WORLD);
+  MPI_Bcast( &traj_int,        1, MPI_INT, 0, MPI_COMM_WORLD);
+  MPI_Bcast( &traj_blocks,   DIM, MPI_INT, 0, MPI_COMM_WORLD);
+#ifdef DELTA
+  MPI_Bcast( &delta_checkpt,   1, MPI_INT, 0, MPI_COMM_WORLD);
+  MPI_Bcast( &delta_eps_pos,   1, REAL,    0, MPI_COMM_WORLD);
+  MPI_Bcast( &delta_eps_vel,   1, REAL,    0, MPI_COMM_WORLD);
+#endif
+#ifdef ZLIB
+  MPI_Bcast( &compress_output,  1, MPI_INT, 0, MPI_COMM_WORLD);
+  MPI_Bcast( &compress_eps_pos, 1, REAL,    0, MPI_COMM_WORLD);
+  MPI_Bcast( &compress_eps_vel, 1, REAL,    0, MPI_COMM_WORLD);
+#endif
+#ifdef ASYNC_IO
+  MPI_Bcast( &async_output,    1, MPI_INT, 0, MPI_COMM_WORLD);
+#endif
   MPI_Bcast( outfilename,            255, MPI_CHAR, 0, MPI_COMM_WORLD);
   MPI_Bcast( infilename,             255, MPI_CHAR, 0, MPI_COMM_WORLD);
   MPI_Bcast( potfilename,            255, MPI_CHAR, 0, MPI_COMM_WORLD);
@@ -4834,6 +5014,10 @@ void broadcast_params() {
   MPI_Bcast( &ew_kcut,            1,      REAL,    0, MPI_COMM_WORLD);
   MPI_Bcast( &ew_test,            1,      MPI_INT, 0, MPI_COMM_WORLD);
   MPI_Bcast( &ew_nmax,            1,      MPI_INT, 0, MPI_COMM_WORLD);
+#ifdef EWALD
+  MPI_Bcast( &ew_mesh,            3,      MPI_INT, 0, MPI_COMM_WORLD);
+  MPI_Bcast( &ew_order,           1,      MPI_INT, 0, MPI_COMM_WORLD);
+#endif
   MPI_Bcast( &coul_res,           1,      REAL,    0, MPI_COMM_WORLD);
   MPI_Bcast( &coul_begin,         1,      REAL,    0, MPI_COMM_WORLD);
 #endif
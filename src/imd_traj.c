@@ -0,0 +1,427 @@
+
+/******************************************************************************
+*
+* IMD -- The ITAP Molecular Dynamics Program
+*
+* Copyright 1996-2012 Institute for Theoretical and Applied Physics,
+* University of Stuttgart, D-70550 Stuttgart
+*
+******************************************************************************/
+
+/******************************************************************************
+*
+* imd_traj.c -- trajectory file with random access by step and region
+*
+*  Every traj_int steps, a frame is appended to outfilename.traj. The
+*  file starts with a header like that of a binary configuration, which
+*  describes the atom records (number, type, mass, position, velocity,
+*  Epot). Each CPU writes the atoms of a frame in blocks, traj_blocks
+*  per direction of its domain. The index is in outfilename.traj.idx,
+*  which, like the trajectory file, is only ever appended to:
+*
+*    TRAJ_MAGIC, length of the header of the trajectory file
+*    for each frame: step, number of blocks, box (DIM*DIM doubles),
+*      and for each block: offset, length and number of atoms
+*      (long long), lower and upper bounds of the scaled positions of
+*      its atoms (DIM doubles each)
+*
+*  The entry of a frame is appended only after its data is complete, so
+*  a run killed while writing a frame loses only that frame; an
+*  incomplete last entry is ignored. All values have the byte order of
+*  the header. With compress_output
+*  (option zlib), each block is a compressed chunk as in compressed
+*  configurations, and positions and velocities are quantized according
+*  to compress_eps_pos and compress_eps_vel. Empty blocks are not
+*  written. On restart, the frames before the restart step are kept,
+*  and both files are cut off behind them.
+*
+******************************************************************************/
+
+/******************************************************************************
+* $Revision$
+* $Date$
+******************************************************************************/
+
+#include "imd.h"
+
+typedef struct {
+  long long step, nblocks;
+  double    box[DIM*DIM];
+} traj_frame_t;
+
+typedef struct {
+  long long off, len, n;
+  double    lo[DIM], hi[DIM];
+} traj_block_t;
+
+/* maximal number of bytes per MPI_File_write_at_all */
+#define WRITE_CHUNK (1<<30)
+
+/* end of the data in the trajectory file, kept by CPU 0 */
+static long long traj_end=0;
+static int       traj_init=0;
+
+/******************************************************************************
+*
+*  write_header_traj - write the header of the trajectory file
+*
+******************************************************************************/
+
+static void write_header_traj(FILE *out)
+{
+  char   c;
+  time_t now;
+
+#ifdef DOUBLE
+  c = is_big_endian ? 'B' : 'L';
+#else
+  c = is_big_endian ? 'b' : 'l';
+#endif
+  fprintf(out, "#F %c 1 1 1 %d %d 1\n", c, DIM, DIM);
+#ifdef TWOD
+  fprintf(out, "#C number type mass x y vx vy Epot\n");
+  fprintf(out, "#X \t%.16e %.16e\n", box_x.x , box_x.y);
+  fprintf(out, "#Y \t%.16e %.16e\n", box_y.x , box_y.y);
+  fprintf(out, "##PBC %d %d\n", pbc_dirs.x, pbc_dirs.y);
+#else
+  fprintf(out, "#C number type mass x y z vx vy vz Epot\n");
+  fprintf(out, "#X \t%.16e %.16e %.16e\n", box_x.x , box_x.y , box_x.z);
+  fprintf(out, "#Y \t%.16e %.16e %.16e\n", box_y.x , box_y.y , box_y.z);
+  fprintf(out, "#Z \t%.16e %.16e %.16e\n", box_z.x , box_z.y , box_z.z);
+  fprintf(out, "##PBC %d %d %d\n", pbc_dirs.x, pbc_dirs.y, pbc_dirs.z);
+#endif
+#ifdef ZLIB
+  if (compress_output)
+    fprintf(out, "#K zlib %.16e %.16e\n",
+            zip_quantum(compress_eps_pos), zip_quantum(compress_eps_vel));
+#endif
+  fprintf(out, "## trajectory, frames every %d steps\n", traj_int);
+  time(&now);
+  fprintf(out, "## Generated on %s", ctime(&now) );
+  fprintf(out, "## by %s (version of %s)\n", progname, DATE);
+  fprintf(out, "#E\n");
+}
+
+/******************************************************************************
+*
+*  add_traj_index - append the entry of a frame to the index file
+*
+******************************************************************************/
+
+static void add_traj_index(char *iname, traj_frame_t *fr, traj_block_t *bl)
+{
+  FILE *f;
+
+  if (NULL == (f = fopen(iname, "ab")))
+    error_str("Cannot open trajectory index %s", iname);
+  if ((1 != fwrite(fr, sizeof(traj_frame_t), 1, f)) ||
+      (fr->nblocks != (long long)
+                      fwrite(bl, sizeof(traj_block_t), fr->nblocks, f)) ||
+      (fclose(f)))
+    error_str("Cannot write trajectory index %s", iname);
+}
+
+/******************************************************************************
+*
+*  init_traj - on restart, keep the frames of an existing trajectory
+*  file up to the restart step; otherwise start a new file
+*
+******************************************************************************/
+
+static void init_traj(char *fname, char *iname)
+{
+  traj_frame_t fr;
+  traj_block_t bl;
+  long long    t[2], keep=0, end=0, e, k;
+  FILE *f;
+
+  if ((imdrestart) && (NULL != (f = fopen(iname, "rb")))) {
+    if ((1==fread(t, sizeof(t), 1, f)) && (TRAJ_MAGIC==t[0])) {
+      keep = ftello(f);
+      end  = t[1];
+      /* keep the complete entries before the restart step */
+      while ((1==fread(&fr, sizeof(fr), 1, f)) && (fr.step < steps_min)) {
+        for (e=end, k=0; k<fr.nblocks; k++) {
+          if (1 != fread(&bl, sizeof(bl), 1, f)) break;
+          e = MAX(e, bl.off + bl.len);
+        }
+        if (k < fr.nblocks) break;
+        keep = ftello(f);
+        end  = e;
+      }
+    }
+    fclose(f);
+    if (keep > 0) {
+      if ((truncate(iname, (off_t) keep)) || (truncate(fname, (off_t) end)))
+        error_str("Cannot cut off trajectory file %s", fname);
+      traj_end  = end;
+      traj_init = 1;
+      return;
+    }
+  }
+  if (NULL == (f = fopen(fname, "wb")))
+    error_str("Cannot open trajectory file %s", fname);
+  write_header_traj(f);
+  traj_end = ftello(f);
+  fclose(f);
+  if (NULL == (f = fopen(iname, "wb")))
+    error_str("Cannot open trajectory index %s", iname);
+  t[0] = TRAJ_MAGIC;
+  t[1] = traj_end;
+  if ((1 != fwrite(t, sizeof(t), 1, f)) || (fclose(f)))
+    error_str("Cannot write trajectory index %s", iname);
+  traj_init = 1;
+}
+
+/******************************************************************************
+*
+*  traj_index - the block of an atom, and its scaled position
+*
+******************************************************************************/
+
+static int traj_index(cell *p, int i, double *s)
+{
+  ivektor b;
+  vektor  pos;
+
+  pos.x = ORT(p,i,X);
+  pos.y = ORT(p,i,Y);
+#ifndef TWOD
+  pos.z = ORT(p,i,Z);
+  s[2]  = SPROD(pos,tbox_z);
+#endif
+  s[0]  = SPROD(pos,tbox_x);
+  s[1]  = SPROD(pos,tbox_y);
+  b.x = (int) floor( (s[0] * cpu_dim.x - my_coord.x) * traj_blocks.x );
+  b.y = (int) floor( (s[1] * cpu_dim.y - my_coord.y) * traj_blocks.y );
+  b.x = MIN( MAX( b.x, 0 ), traj_blocks.x - 1 );
+  b.y = MIN( MAX( b.y, 0 ), traj_blocks.y - 1 );
+#ifdef TWOD
+  return b.x * traj_blocks.y + b.y;
+#else
+  b.z = (int) floor( (s[2] * cpu_dim.z - my_coord.z) * traj_blocks.z );
+  b.z = MIN( MAX( b.z, 0 ), traj_blocks.z - 1 );
+  return (b.x * traj_blocks.y + b.y) * traj_blocks.z + b.z;
+#endif
+}
+
+/******************************************************************************
+*
+*  write_traj - append the current configuration to the trajectory file
+*
+******************************************************************************/
+
+void write_traj(int steps)
+{
+  traj_frame_t  fr;
+  traj_block_t *bl;
+  i_or_r       *data;
+  char         *buf, *zbuf=NULL;
+  long         *fill;
+  long long     len, off=0, tot, base;
+  int           nb, nrec, rlen, m, b, i, k, d;
+  real          qpos=0.0, qvel=0.0;
+  double        s[DIM];
+  str255        fname, iname;
+#ifdef MPI
+  MPI_File      fh;
+  MPI_Status    status;
+  traj_block_t *all=NULL;
+  int          *cnt=NULL, *dsp=NULL;
+  long long     max, pos;
+#else
+  FILE         *out;
+#endif
+
+  is_big_endian = endian();
+  if ((snprintf(fname, sizeof(fname), "%s.traj",     outfilename)
+       >= (int) sizeof(fname)) ||
+      (snprintf(iname, sizeof(iname), "%s.traj.idx", outfilename)
+       >= (int) sizeof(iname)))
+    error("name of trajectory file too long");
+  if ((0==myid) && (!traj_init)) init_traj(fname, iname);
+
+#ifdef ZLIB
+  if (compress_output) {
+    qpos = zip_quantum(compress_eps_pos);
+    qvel = zip_quantum(compress_eps_vel);
+  }
+#endif
+#define QUANT(x,q) (((q) > 0.0) ? (q) * rint((x) / (q)) : (x))
+
+  /* number of items per record */
+#ifdef DOUBLE
+  nrec = 2 * DIM + 3;
+#else
+  nrec = 2 * DIM + 4;
+#endif
+  rlen = nrec * sizeof(i_or_r);
+
+#ifdef TWOD
+  nb   = traj_blocks.x * traj_blocks.y;
+#else
+  nb   = traj_blocks.x * traj_blocks.y * traj_blocks.z;
+#endif
+  bl   = (traj_block_t *) calloc( nb, sizeof(traj_block_t) );
+  fill = (long *) malloc( nb * sizeof(long) );
+  if ((NULL==bl) || (NULL==fill))
+    error("cannot allocate trajectory buffer");
+  for (b=0; b<nb; b++)
+    for (d=0; d<DIM; d++) {
+      bl[b].lo[d] =  1e300;
+      bl[b].hi[d] = -1e300;
+    }
+
+  /* count the atoms of the blocks, and their bounds */
+  for (k=0; k<NCELLS; k++) {
+    cell *p = CELLPTR(k);
+    for (i=0; i<p->n; i++) {
+      b = traj_index( p, i, s );
+      bl[b].n++;
+      for (d=0; d<DIM; d++) {
+        bl[b].lo[d] = MIN( bl[b].lo[d], s[d] );
+        bl[b].hi[d] = MAX( bl[b].hi[d], s[d] );
+      }
+    }
+  }
+  for (len=0, b=0; b<nb; b++) {
+    fill[b] = len;
+    len += bl[b].n * rlen;
+  }
+  buf = (char *) malloc( len + 1 );
+  if (NULL==buf) error("cannot allocate trajectory buffer");
+
+  /* pack the atom records, sorted by block */
+  for (k=0; k<NCELLS; k++) {
+    cell *p = CELLPTR(k);
+    for (i=0; i<p->n; i++) {
+      b = traj_index( p, i, s );
+      data = (i_or_r *) (buf + fill[b]);
+      fill[b] += rlen;
+      m = 0;
+#ifdef DOUBLE
+      data[m  ].i[0] = NUMMER(p,i);
+      data[m++].i[1] = VSORTE(p,i);
+#else
+      data[m++].i    = NUMMER(p,i);
+      data[m++].i    = VSORTE(p,i);
+#endif
+      data[m++].r = MASSE(p,i);
+      data[m++].r = QUANT( ORT(p,i,X), qpos );
+      data[m++].r = QUANT( ORT(p,i,Y), qpos );
+#ifndef TWOD
+      data[m++].r = QUANT( ORT(p,i,Z), qpos );
+#endif
+      data[m++].r = QUANT( IMPULS(p,i,X) / MASSE(p,i), qvel );
+      data[m++].r = QUANT( IMPULS(p,i,Y) / MASSE(p,i), qvel );
+#ifndef TWOD
+      data[m++].r = QUANT( IMPULS(p,i,Z) / MASSE(p,i), qvel );
+#endif
+      data[m++].r = POTENG(p,i);
+    }
+  }
+#undef QUANT
+
+  /* drop empty blocks, and compress the others */
+#ifdef ZLIB
+  if (compress_output) {
+    for (len=0, b=0; b<nb; b++) len += zip_bound( bl[b].n * rlen );
+    zbuf = (char *) malloc( len + 1 );
+    if (NULL==zbuf) error("cannot allocate trajectory buffer");
+  }
+#endif
+  for (len=0, off=0, m=0, b=0; b<nb; b++) {
+    if (0==bl[b].n) continue;
+    bl[m] = bl[b];
+    bl[m].off = len;
+    bl[m].len = bl[b].n * rlen;
+#ifdef ZLIB
+    if (compress_output)
+      bl[m].len = zip_chunk( buf + off, (int) bl[m].len, sizeof(real),
+                             zbuf + len, compress_output );
+#endif
+    off += bl[b].n * rlen;
+    len += bl[m].len;
+    m++;
+  }
+  if (zbuf) {
+    free(buf);
+    buf = zbuf;
+  }
+
+  fr.step    = steps;
+  fr.nblocks = m;
+  fr.box[0]  = box_x.x; fr.box[1] = box_x.y;
+#ifdef TWOD
+  fr.box[2]  = box_y.x; fr.box[3] = box_y.y;
+#else
+  fr.box[2]  = box_x.z;
+  fr.box[3]  = box_y.x; fr.box[4] = box_y.y; fr.box[5] = box_y.z;
+  fr.box[6]  = box_z.x; fr.box[7] = box_z.y; fr.box[8] = box_z.z;
+#endif
+
+#ifdef MPI
+
+  /* offsets by prefix sum behind the end of the previous frame */
+  off = 0;
+  MPI_Exscan( &len, &off, 1, MPI_LONG_LONG, MPI_SUM, cpugrid );
+  if (0==myid) off = 0;   /* MPI_Exscan leaves it undefined on CPU 0 */
+  MPI_Allreduce( &len, &tot, 1, MPI_LONG_LONG, MPI_SUM, cpugrid );
+  MPI_Allreduce( &len, &max, 1, MPI_LONG_LONG, MPI_MAX, cpugrid );
+  base = traj_end;
+  MPI_Bcast( &base, 1, MPI_LONG_LONG, 0, cpugrid );
+  for (b=0; b<m; b++) bl[b].off += base + off;
+
+  /* gather the block entries on CPU 0 */
+  if (0==myid) {
+    cnt = (int *) malloc( 2 * num_cpus * sizeof(int) );
+    if (NULL==cnt) error("cannot allocate trajectory index");
+    dsp = cnt + num_cpus;
+  }
+  k = m * sizeof(traj_block_t);
+  MPI_Gather( &k, 1, MPI_INT, cnt, 1, MPI_INT, 0, cpugrid );
+  if (0==myid) {
+    for (k=0, i=0; i<num_cpus; i++) { dsp[i] = k; k += cnt[i]; }
+    fr.nblocks = k / sizeof(traj_block_t);
+    all = (traj_block_t *) malloc( k + 1 );
+    if (NULL==all) error("cannot allocate trajectory index");
+  }
+  MPI_Gatherv( bl, m * sizeof(traj_block_t), MPI_CHAR,
+               all, cnt, dsp, MPI_CHAR, 0, cpugrid );
+
+  if (MPI_SUCCESS != MPI_File_open( cpugrid, fname, MPI_MODE_WRONLY,
+                                    MPI_INFO_NULL, &fh ))
+    error_str("Cannot open trajectory file %s with MPI-IO", fname);
+  /* in pieces of at most WRITE_CHUNK bytes, as many on all CPUs */
+  for (pos=0; pos < max; pos += WRITE_CHUNK) {
+    k = (int) MAX( 0, MIN( WRITE_CHUNK, len - pos ) );
+    MPI_File_write_at_all( fh, (MPI_Offset) (base + off + pos),
+                           buf + MIN(pos,len), k, MPI_CHAR, &status );
+  }
+  MPI_File_close( &fh );
+
+  /* the index entry follows once the data of the frame is complete */
+  if (0==myid) {
+    add_traj_index( iname, &fr, all );
+    traj_end = base + tot;
+    free(all);
+    free(cnt);
+  }
+
+#else
+
+  for (b=0; b<m; b++) bl[b].off += traj_end;
+  if (NULL == (out = fopen(fname, "r+b")))
+    error_str("Cannot open trajectory file %s", fname);
+  fseeko(out, (off_t) traj_end, SEEK_SET);
+  if (((len) && (1 != fwrite(buf, len, 1, out))) || (fclose(out)))
+    error_str("Cannot write trajectory file %s", fname);
+  add_traj_index( iname, &fr, bl );
+  traj_end += len;
+
+#endif
+
+  free(buf);
+  free(fill);
+  free(bl);
+}
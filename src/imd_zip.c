@@ -0,0 +1,177 @@
+/******************************************************************************
+*
+* IMD -- The ITAP Molecular Dynamics Program
+*
+* Copyright 1996-2012 Institute for Theoretical and Applied Physics,
+* University of Stuttgart, D-70550 Stuttgart
+*
+******************************************************************************/
+
+/******************************************************************************
+*
+* imd_zip.c -- compressed binary configurations (option zlib)
+*
+*  The data of a compressed configuration consists of chunks, each
+*  holding complete atom records. A chunk starts with two long long
+*  values, the raw and the compressed length, followed by the zlib
+*  stream of the raw data, with the bytes of its items shuffled into
+*  planes (all first bytes, all second bytes, ...). The chunks are
+*  followed by an index with the offsets of the chunks relative to the
+*  end of the header, the number of chunks, and ZIP_MAGIC. All
+*  values have the byte order of the configuration.
+*
+******************************************************************************/
+
+/******************************************************************************
+* $Revision$
+* $Date$
+******************************************************************************/
+
+#include "imd.h"
+#include <zlib.h>
+
+static char *zip_tmp=NULL, *zip_raw=NULL;
+static long zip_tmp_max=0, zip_raw_max=0;
+
+/******************************************************************************
+*
+*  grow_buf - make sure a buffer has at least len bytes
+*
+******************************************************************************/
+
+static void grow_buf(char **buf, long *max, long len)
+{
+  if (len <= *max) return;
+  *buf = (char *) realloc(*buf, len);
+  if (NULL==*buf) error("cannot allocate compression buffer");
+  *max = len;
+}
+
+/******************************************************************************
+*
+*  swap_ll - change byte order of a long long
+*
+******************************************************************************/
+
+static long long swap_ll(long long x)
+{
+  unsigned char *c = (unsigned char *) &x, t;
+  int i;
+
+  for (i=0; i<4; i++) {
+    t = c[i]; c[i] = c[7-i]; c[7-i] = t;
+  }
+  return x;
+}
+
+/******************************************************************************
+*
+*  zip_quantum - largest power of 2, by which a value can be rounded
+*  with an error of at most eps (0 if eps is 0)
+*
+******************************************************************************/
+
+real zip_quantum(real eps)
+{
+  int e;
+
+  if (eps <= 0.0) return 0.0;
+  frexp( 2.0 * eps, &e );
+  return (real) ldexp( 1.0, e-1 );
+}
+
+/******************************************************************************
+*
+*  zip_bound - maximal length of the chunk of len bytes
+*
+******************************************************************************/
+
+int zip_bound(int len)
+{
+  return (int) compressBound(len) + 2 * sizeof(long long);
+}
+
+/******************************************************************************
+*
+*  zip_chunk - compress len bytes of items of size el from in to out,
+*  with zlib level level; returns the length of the chunk
+*
+******************************************************************************/
+
+int zip_chunk(char *in, int len, int el, char *out, int level)
+{
+  long long h[2];
+  uLongf zlen = compressBound(len);
+  int    n = len / el, i, k;
+
+  grow_buf(&zip_tmp, &zip_tmp_max, len);
+  for (k=0; k<el; k++)
+    for (i=0; i<n; i++) zip_tmp[k*n+i] = in[i*el+k];
+  if (Z_OK != compress2( (Bytef *) out + sizeof(h), &zlen,
+                         (Bytef *) zip_tmp, len, level ))
+    error("compression of output failed");
+  h[0] = len;
+  h[1] = zlen;
+  memcpy(out, h, sizeof(h));
+  return (int) (zlen + sizeof(h));
+}
+
+/******************************************************************************
+*
+*  read_zip_index - read the chunk index of a compressed configuration;
+*  returns the offsets and sets the number of chunks
+*
+******************************************************************************/
+
+long long *read_zip_index(FILE *in, long long *nchunks, int swap)
+{
+  long long t[2], *idx;
+  long i;
+
+  if ((fseeko(in, -(off_t) sizeof(t), SEEK_END)) || (1!=fread(t,sizeof(t),1,in)))
+    error("cannot read index of compressed configuration");
+  if (swap) { t[0] = swap_ll(t[0]); t[1] = swap_ll(t[1]); }
+  if (ZIP_MAGIC != t[1]) error("compressed configuration has no index");
+  *nchunks = t[0];
+  idx = (long long *) malloc( (t[0]+1) * sizeof(long long) );
+  if (NULL==idx) error("cannot allocate index of compressed configuration");
+  fseeko(in, -(off_t) ((t[0] + 2) * sizeof(long long)), SEEK_END);
+  if (t[0] != (long long) fread(idx, sizeof(long long), t[0], in))
+    error("cannot read index of compressed configuration");
+  for (i=0; i<t[0]; i++) if (swap) idx[i] = swap_ll(idx[i]);
+  return idx;
+}
+
+/******************************************************************************
+*
+*  unzip_chunk - read the chunk at offset off behind the header of
+*  length hlen, and uncompress it into *buf, which is enlarged if
+*  necessary; returns the raw length
+*
+******************************************************************************/
+
+long unzip_chunk(FILE *in, long hlen, long long off, int el, int swap,
+                 char **buf, long *max)
+{
+  long long h[2];
+  uLongf len;
+  long   n, i, k;
+
+  if ((fseeko(in, (off_t) (hlen + off), SEEK_SET)) ||
+      (1 != fread(h, sizeof(h), 1, in)))
+    error("cannot read chunk of compressed configuration");
+  if (swap) { h[0] = swap_ll(h[0]); h[1] = swap_ll(h[1]); }
+  grow_buf(&zip_tmp, &zip_tmp_max, h[1]);
+  grow_buf(&zip_raw, &zip_raw_max, h[0]);
+  grow_buf(buf, max, h[0]);
+  if (h[1] != (long long) fread(zip_tmp, 1, h[1], in))
+    error("cannot read chunk of compressed configuration");
+  len = h[0];
+  if ((Z_OK != uncompress( (Bytef *) zip_raw, &len,
+                           (Bytef *) zip_tmp, h[1] )) || (len != h[0]))
+    error("corrupt chunk in compressed configuration");
+  n = len / el;
+  for (k=0; k<el; k++)
+    for (i=0; i<n; i++) (*buf)[i*el+k] = zip_raw[k*n+i];
+  return (long) len;
+}
@@ -162,6 +162,10 @@ INLINE static int MOD(shortint p, int q)
 #ifdef REFPOS
 #define REF_POS(cell,i,sub)     (atoms.refpos sub((cell)->ind[i]))
 #endif
+#ifdef DELTA
+#define DLT_POS(cell,i,sub)     (atoms.dltpos sub((cell)->ind[i]))
+#define DLT_VEL(cell,i,sub)     (atoms.dltvel sub((cell)->ind[i]))
+#endif
 #ifdef HC
 #define HCAVENG(cell,i)         (atoms.hcaveng[(cell)->ind[i]])
 #endif
@@ -296,6 +300,10 @@ INLINE static int MOD(shortint p, int q)
 #ifdef REFPOS
 #define REF_POS(cell,i,sub)     ((cell)->refpos sub(i))
 #endif
+#ifdef DELTA
+#define DLT_POS(cell,i,sub)     ((cell)->dltpos sub(i))
+#define DLT_VEL(cell,i,sub)     ((cell)->dltvel sub(i))
+#endif
 #ifdef HC
 #define HCAVENG(cell,i)         ((cell)->hcaveng[i])
 #endif
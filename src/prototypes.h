@@ -194,6 +194,11 @@ void do_embedding_energy(void);
 #ifdef NBLIST
 int  estimate_nblist_size(void);
 void make_nblist(void);
+void update_nblist(void);
+void color_nblist(void);
+void split_nbl_colors(void);
+void sort_cell_atoms(void);
+int  nbl_in_cell(int k);
 void check_nblist(void);
 void deallocate_nblist(void);
 #endif
@@ -256,6 +261,13 @@ void unpack_forces( msgbuf *b, int j, int k );
 void send_cells (void (*copy_func)  (int, int, int, int, int, int, vektor),
                  void (*pack_func)  (msgbuf*, int, int, int, vektor),
                  void (*unpack_func)(msgbuf*, int, int, int));
+#ifndef LOADBALANCE
+void send_cells_overlap(
+                 void (*copy_func)  (int, int, int, int, int, int, vektor),
+                 void (*pack_func)  (msgbuf*, int, int, int, vektor),
+                 void (*unpack_func)(msgbuf*, int, int, int),
+                 void (*work_func)  (int, int));
+#endif
 void sync_cells (void (*copy_func)  (int, int, int, int, int, int, vektor),
                  void (*pack_func)  (msgbuf*, int, int, int, vektor),
                  void (*unpack_func)(msgbuf*, int, int, int));
@@ -268,6 +280,14 @@ void unpack_cell  ( msgbuf *b, int k, int l, int m );
 void add_forces   ( int k, int l, int m, int r, int s, int t );
 void pack_forces  ( msgbuf *b, int k, int l, int m);
 void unpack_forces( msgbuf *b, int k, int l, int m );
+#ifdef NBLIST
+void copy_pos     ( int k, int l, int m, int r, int s, int t, vektor v );
+void pack_pos     ( msgbuf *b, int k, int l, int m, vektor v );
+void unpack_pos   ( msgbuf *b, int k, int l, int m );
+void copy_nblpos  ( int k, int l, int m, int r, int s, int t, vektor v );
+void pack_nblpos  ( msgbuf *b, int k, int l, int m, vektor v );
+void unpack_nblpos( msgbuf *b, int k, int l, int m );
+#endif
 #ifdef EAM2
 void copy_dF       ( int k, int l, int m, int r, int s, int t, vektor );
 void add_rho       ( int k, int l, int m, int r, int s, int t );
@@ -350,6 +370,32 @@ int  read_header(header_info_t *, str255);
 void broadcast_header(header_info_t *);
 #endif
 void flush_outbuf(FILE *out, int *len, int tag);
+#ifdef ASYNC_IO
+void queue_output(FILE *out, char *buf, long len);
+void queue_rename(char *from, char *to);
+void finish_output(void);
+#endif
+#ifdef ZLIB
+real zip_quantum(real eps);
+int  zip_bound(int len);
+int  zip_chunk(char *in, int len, int el, char *out, int level);
+long long *read_zip_index(FILE *in, long long *nchunks, int swap);
+long unzip_chunk(FILE *in, long hlen, long long off, int el, int swap,
+                 char **buf, long *max);
+#endif
+void write_traj(int steps);
+#ifdef DELTA
+/* delta checkpoints - file imd_delta.c */
+void set_delta_ref(void);
+int  write_delta(int fzhlr);
+int  is_delta_config(char *fname);
+void read_delta(char *infilename);
+#endif
+/* ASCII number conversion - file imd_ascii.c */
+int  ascii_int(char *s, long x);
+int  ascii_fixed(char *s, double x, int prec);
+int  ascii_short(char *s, double x);
+int  ascii_scan_line(char *buf, int *n, int *s, real *d, int max);
 void write_itr_file(int fzhlr, int steps,char *suffix);
 void write_config(int fzhlr, int steps);
 #ifdef RELAX
@@ -463,7 +509,11 @@ void write_distrib_density(int, int);
 void make_write_distrib_select(int, void (*fun)(float*, cell*, int), 
 			       int, int, char*, char*);
 void write_distrib_header(FILE*, int, int, char*);
+void write_distrib_header_dim(FILE*, int, int, char*, ivektor);
 void write_distrib(int);
+int  insitu_quantity(char*);
+void update_insitu(int);
+void finish_insitu(void);
 void dist_Ekin_fun       (float*, cell*, int);
 void dist_Epot_fun       (float*, cell*, int);
 void dist_Ekin_long_fun  (float*, cell*, int);
@@ -630,7 +680,10 @@ bb_neightab *alloc_bb_neightab(bb_neightab *bb_neigh, int count);
 void do_forces_ewald(int);
 void do_forces_ewald_real(void);
 void do_forces_ewald_fourier(void);
+void do_forces_ewald_spme(void);
 void init_ewald(void);
+void init_fft_3d(int nx, int ny, int nz, double *data);
+void fft_3d(double *data, int sign);
 #endif
 #if defined(EWALD) || defined(COULOMB)
 real erfc1(real x);
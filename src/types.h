@@ -257,6 +257,10 @@ typedef struct {
 #ifdef REFPOS
   real        *refpos;
 #endif
+#ifdef DELTA
+  real        *dltpos;
+  real        *dltvel;
+#endif
 #ifdef HC
   real        *hcaveng;
 #endif
@@ -334,6 +338,7 @@ typedef struct {
   int  n_vel;
   int  n_data;
   int  n_items;
+  int  zipped;
 #ifdef REFPOS
   int  n_refpos_x;
 #endif
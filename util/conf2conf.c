@@ -37,6 +37,11 @@ void usage(char *progname)
   printf("             -k         Compute Ekin from mass and velocities, and append it\n\n");
   printf("             -d <cols>  Comma separated indices of data columns to be\n");
   printf("                        included in output, like 0,2\n\n");
+  printf("             -t <step>  Input is a trajectory file, from which the frame\n");
+  printf("                        of step <step> is extracted\n\n");
+  printf("             -l <lo>    Comma separated lower and upper bounds of the\n");
+  printf("             -u <hi>    scaled positions of the atoms extracted from a\n");
+  printf("                        trajectory frame, like 0,0,0.5\n\n");
   printf("             -h         This help\n\n");
   exit(1);
 }
@@ -48,9 +53,13 @@ int main(int argc, char **argv)
   int  with_vel=0, with_Ekin=0, with_mass=0;
   int  n_data_out=0, data_out[MAX_ITEMS_CONFIG];
   int  i, p, n, my_endian, out_endian, len=0, natoms=0, have_header;
+  int  frame, with_region=0;
+  long long traj_step=-1;
+  double lo[3] = { -1e300, -1e300, -1e300 }, hi[3] = { 1e300, 1e300, 1e300 };
   FILE *infile, *outfile;
   header_info_t info;
   atom_t atom;
+  traj_t traj;
 
   /* parse command line options */
   progname = strdup(argv[0]);
@@ -88,6 +97,23 @@ int main(int argc, char **argv)
       argc -= 2;
       argv += 2;
     }
+    else if (argv[1][1]=='t') {
+      traj_step = atoll(argv[2]);
+      argc -= 2;
+      argv += 2;
+    }
+    else if ((argv[1][1]=='l') || (argv[1][1]=='u')) {
+      double *bound = (argv[1][1]=='l') ? lo : hi;
+      str = argv[2];
+      token = strtok(str, ",");
+      for (i=0; (i<3) && (token!=NULL); i++) {
+        bound[i] = atof(token);
+        token = strtok(NULL, ",");
+      }
+      with_region = 1;
+      argc -= 2;
+      argv += 2;
+    }
     else if (argv[1][1]=='h') {
       usage(progname);
     }
@@ -102,17 +128,35 @@ int main(int argc, char **argv)
   if ((format=='B') || (format=='b')) out_endian=1;
   else                                out_endian=0;
 
-  /* open input file */
-  infile = fopen(infilename,"r");
-  if (NULL==infile) error_str("Cannot open atoms file %s", infilename);
+  /* frame of a trajectory file, possibly only a region of it */
+  if (traj_step >= 0) {
+    open_traj(&traj, infilename);
+    frame = find_traj_frame(&traj, traj_step);
+    if (frame < 0) error_str("step not found in trajectory file %s", infilename);
+    info   = traj.info;
+    infile = read_traj_frame(&traj, frame, with_region ? lo : NULL, hi);
+  }
+  else {
+    if (with_region) error("Regions can only be extracted from trajectories");
+
+    /* open input file */
+    infile = fopen(infilename,"r");
+    if (NULL==infile) error_str("Cannot open atoms file %s", infilename);
 
-  /* read file header */
-  have_header = read_header(&info, infilename);
-  /* eat header, if there is one */
-  if (have_header) {
-    fgets(line,sizeof(line),infile);
-    while (('#'==line[0]) && ('E'!=line[1]) && !feof(infile)) {
+    /* read file header */
+    have_header = read_header(&info, infilename);
+    /* eat header, if there is one */
+    if (have_header) {
       fgets(line,sizeof(line),infile);
+      while (('#'==line[0]) && ('E'!=line[1]) && !feof(infile)) {
+        fgets(line,sizeof(line),infile);
+      }
+    }
+    /* uncompress compressed file */
+    if (info.zipped) {
+      FILE *zipfile = read_zip_config(&info, infile);
+      fclose(infile);
+      infile = zipfile;
     }
   }
   if ((with_Ekin) && ((info.n_mass==0) || (info.n_vel==0)))
@@ -155,10 +199,26 @@ int main(int argc, char **argv)
   }
   if (with_Ekin) fprintf(outfile, " Ekin");
   fprintf(outfile, "\n");
+  /* box of the trajectory frame */
+  if (traj_step >= 0) {
+    double *b = traj.frames[frame].box;
+    char   *c = "XYZ";
+    for (i=0; i<info.n_pos; i++) {
+      if (info.n_pos==2)
+        fprintf(outfile, "#%c \t%.16e %.16e\n", c[i], b[3*i], b[3*i+1]);
+      else
+        fprintf(outfile, "#%c \t%.16e %.16e %.16e\n", 
+                c[i], b[3*i], b[3*i+1], b[3*i+2]);
+    }
+    fprintf(outfile, "## frame of step %lld\n", traj_step);
+  }
   /* copy all other lines */
-  for (i=0; i<info.n_lines; i++) 
-    if ((info.lines[i][1] != 'F') && (info.lines[i][1] != 'C')
-      && (info.lines[i][1] != 'E')) fprintf(outfile, "%s", info.lines[i]);
+  for (i=0; i<info.n_lines; i++) {
+    char c = info.lines[i][1];
+    if ((c == 'F') || (c == 'C') || (c == 'E') || (c == 'K')) continue;
+    if ((traj_step >= 0) && ((c == 'X') || (c == 'Y') || (c == 'Z'))) continue;
+    fprintf(outfile, "%s", info.lines[i]);
+  }
   fprintf(outfile, "#E\n");
 
   /* process the config file */
@@ -166,6 +226,7 @@ int main(int argc, char **argv)
 
     p = read_atom(&info, infile, &atom);
     if (p==0) break;
+    if ((with_region) && (!in_traj_region(&traj, &atom, lo, hi))) continue;
     if (info.n_number == 0) atom.number = natoms++;
     if (info.n_vel == 2) atom.vel.z = 0.0;
     if (with_Ekin) atom.Ekin = 0.5 * atom.mass * SPROD(atom.vel,atom.vel);
@@ -294,6 +355,7 @@ int main(int argc, char **argv)
   fwrite(outbuf, sizeof(char), len, outfile);
   fclose(outfile);
   fclose(infile);
+  if (traj_step >= 0) close_traj(&traj);
  
   return 0;
 }
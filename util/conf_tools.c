@@ -26,6 +26,9 @@
 #include "misc.h"
 #include "util.h"
 #include "conf_tools.h"
+#ifdef ZLIB
+#include <zlib.h>
+#endif
 
 /******************************************************************************
 *
@@ -44,6 +47,8 @@ int read_header(header_info_t *info, str255 infilename)
   if (NULL==infile) error_str("cannot open input file %s", infilename);
 
   info->n_lines = 0;
+  info->zipped  = 0;
+  info->hlen    = 0;
   fgets(line, 255, infile);
   while (line[0]=='#') {
     /* format line */
@@ -75,9 +80,14 @@ int read_header(header_info_t *info, str255 infilename)
         info->contents[i] = strdup(token);
       }
     }
+    /* compressed data */
+    else if (line[1]=='K') {
+      info->zipped = 1;
+    }
     /* endheader line */
     else if (line[1]=='E') {
       if (have_format) have_header = 1;
+      info->hlen = ftell(infile);
     }
     info->lines[info->n_lines++] = strdup(line);
     fgets(line, 255, infile);
@@ -328,3 +338,361 @@ double SwappedDouble( double d )
   return dat2.d;
 }
 
+
+/******************************************************************************
+*
+*  swapped_ll - change byte order of a long long
+*
+******************************************************************************/
+
+static long long swapped_ll(long long x)
+{
+  unsigned char *c = (unsigned char *) &x, t;
+  int i;
+
+  for (i=0; i<4; i++) {
+    t = c[i]; c[i] = c[7-i]; c[7-i] = t;
+  }
+  return x;
+}
+
+/******************************************************************************
+*
+*  item_size - size of the items of a binary config file
+*
+******************************************************************************/
+
+static int item_size(header_info_t *info)
+{
+  if ((info->format=='B') || (info->format=='L')) return sizeof(double);
+  if ((info->format=='b') || (info->format=='l')) return sizeof(float);
+  error("compressed or trajectory file is not binary");
+  return 0;
+}
+
+/******************************************************************************
+*
+*  get_chunk - read the compressed chunk at offset off of a file, and 
+*  uncompress it to out; the chunk starts with the raw and the compressed
+*  length, followed by the zlib stream of the items, whose bytes are 
+*  shuffled into planes; returns the raw length
+*
+******************************************************************************/
+
+static long get_chunk(FILE *in, long long off, int el, int swap, char *out)
+{
+#ifdef ZLIB
+  static char *zbuf=NULL, *raw=NULL;
+  static long zmax=0, rmax=0;
+  long long   h[2];
+  uLongf      len;
+  long        n, i, k;
+
+  if ((fseeko(in, (off_t) off, SEEK_SET)) || (1 != fread(h, sizeof(h), 1, in)))
+    error("cannot read compressed chunk");
+  if (swap) { h[0] = swapped_ll(h[0]); h[1] = swapped_ll(h[1]); }
+  if (h[1] > zmax) {
+    zmax = h[1];
+    zbuf = (char *) realloc(zbuf, zmax);
+  }
+  if (h[0] > rmax) {
+    rmax = h[0];
+    raw  = (char *) realloc(raw, rmax);
+  }
+  if ((NULL==zbuf) || (NULL==raw)) error("cannot allocate chunk buffer");
+  if (h[1] != (long long) fread(zbuf, 1, h[1], in))
+    error("cannot read compressed chunk");
+  len = h[0];
+  if ((Z_OK != uncompress((Bytef *) raw, &len, (Bytef *) zbuf, h[1])) ||
+      (len != h[0]))
+    error("corrupt compressed chunk");
+  n = len / el;
+  for (k=0; k<el; k++)
+    for (i=0; i<n; i++) out[i*el+k] = raw[k*n+i];
+  return (long) len;
+#else
+  error("compressed files require compilation with zlib");
+  return 0;
+#endif
+}
+
+/******************************************************************************
+*
+*  open_buffer - open the data of len bytes in buf as a stream
+*
+******************************************************************************/
+
+static FILE *open_buffer(char *buf, long len)
+{
+  FILE *f;
+
+  /* an empty stream must still be readable */
+  if (0==len) buf[0] = 0;
+  f = fmemopen(buf, (len > 0) ? len : 1, "r");
+  if (NULL==f) error("cannot open atom data in memory");
+  if (0==len) fgetc(f);
+  return f;
+}
+
+/******************************************************************************
+*
+*  read_zip_config - read all chunks of a compressed config file, whose
+*  header has been read; returns a stream with the uncompressed atoms
+*
+******************************************************************************/
+
+FILE *read_zip_config(header_info_t *info, FILE *in)
+{
+  static char *buf=NULL;
+  long long   t[2], *idx, raw[2], tot=0;
+  int         el = item_size(info), swap = (info->endian != endian());
+  long        i, len=0;
+
+  /* the index: offsets of the chunks, number of chunks, "IMDZ" */
+  if ((fseeko(in, -(off_t) sizeof(t), SEEK_END)) || (1!=fread(t,sizeof(t),1,in)))
+    error("cannot read index of compressed config file");
+  if (swap) { t[0] = swapped_ll(t[0]); t[1] = swapped_ll(t[1]); }
+  if (0x5a444d49LL != t[1]) error("compressed config file has no index");
+  idx = (long long *) malloc( (t[0]+1) * sizeof(long long) );
+  if (NULL==idx) error("cannot allocate index");
+  fseeko(in, -(off_t) ((t[0] + 2) * sizeof(long long)), SEEK_END);
+  if (t[0] != (long long) fread(idx, sizeof(long long), t[0], in))
+    error("cannot read index of compressed config file");
+  for (i=0; i<t[0]; i++) {
+    if (swap) idx[i] = swapped_ll(idx[i]);
+    idx[i] += info->hlen;
+    fseeko(in, (off_t) idx[i], SEEK_SET);
+    if (1 != fread(raw, sizeof(raw), 1, in))
+      error("cannot read compressed chunk");
+    tot += swap ? swapped_ll(raw[0]) : raw[0];
+  }
+  free(buf);
+  buf = (char *) malloc( tot + 1 );
+  if (NULL==buf) error("cannot allocate buffer for compressed config file");
+  for (i=0; i<t[0]; i++)
+    len += get_chunk(in, idx[i], el, swap, buf + len);
+  free(idx);
+  return open_buffer(buf, len);
+}
+
+/******************************************************************************
+*
+*  open_traj - open a trajectory file and read its index, which is in
+*  the file with suffix .idx:
+*
+*    "IMDT", length of the header of the trajectory file
+*    for each frame: step, number of blocks, box (dim*dim doubles), and
+*      for each block: offset, length, number of atoms, lower and upper
+*      bounds of the scaled positions (dim doubles each)
+*
+*  An incomplete last entry, left by a run that was killed while
+*  writing a frame, is ignored.
+*
+******************************************************************************/
+
+void open_traj(traj_t *t, str255 fname)
+{
+  typedef union { long long i; double d; } word_t;
+  word_t    w[11], *u;
+  long long head[2], k, max_f=0, max_b=0;
+  int       swap, dim, nf, nb, i, j;
+  char      iname[260];
+  FILE      *idx;
+
+  if (0==read_header(&t->info, fname))
+    error_str("trajectory file %s has no header", fname);
+  item_size(&t->info);
+  dim  = t->info.n_pos;
+  swap = (t->info.endian != endian());
+  t->buf  = NULL;
+  t->file = fopen(fname, "rb");
+  if (NULL==t->file) error_str("cannot open trajectory file %s", fname);
+  snprintf(iname, sizeof(iname), "%s.idx", fname);
+  idx = fopen(iname, "rb");
+  if ((NULL==idx) || (1 != fread(head, sizeof(head), 1, idx)))
+    error_str("cannot read index of trajectory file %s", fname);
+  if (swap) head[0] = swapped_ll(head[0]);
+  if (0x54444d49LL != head[0])
+    error_str("trajectory file %s has no index", fname);
+
+  /* read the entries of the frames */
+  nf = 2 + dim*dim;
+  nb = 3 + 2*dim;
+  t->nframes = t->nblocks = 0;
+  t->frames  = NULL;
+  t->blocks  = NULL;
+  while (nf == (int) fread(w, sizeof(long long), nf, idx)) {
+    traj_frame_t *fr;
+    if (swap) for (i=0; i<nf; i++) w[i].i = swapped_ll(w[i].i);
+    if (t->nframes + 1 > max_f) {
+      max_f = 2 * max_f + 16;
+      t->frames = (traj_frame_t *)
+        realloc(t->frames, max_f * sizeof(traj_frame_t));
+    }
+    if (t->nblocks + w[1].i > max_b) {
+      max_b = 2 * max_b + w[1].i + 16;
+      t->blocks = (traj_block_t *)
+        realloc(t->blocks, max_b * sizeof(traj_block_t));
+    }
+    u = (word_t *) malloc( (w[1].i * nb + 1) * sizeof(long long) );
+    if ((NULL==t->frames) || (NULL==t->blocks) || (NULL==u))
+      error("cannot allocate trajectory index");
+    if (w[1].i * nb != (long long)
+                       fread(u, sizeof(long long), w[1].i * nb, idx)) {
+      free(u);
+      break;
+    }
+    fr = t->frames + t->nframes++;
+    fr->step    = w[0].i;
+    fr->nblocks = w[1].i;
+    fr->first   = t->nblocks;
+    for (i=0; i<9; i++) fr->box[i] = 0.0;
+    for (i=0; i<dim; i++)
+      for (j=0; j<dim; j++) fr->box[3*i+j] = w[2+dim*i+j].d;
+    for (k=0; k<fr->nblocks; k++) {
+      traj_block_t *bl = t->blocks + t->nblocks++;
+      word_t *v = u + k * nb;
+      if (swap) for (i=0; i<nb; i++) v[i].i = swapped_ll(v[i].i);
+      bl->off = v[0].i;
+      bl->len = v[1].i;
+      bl->n   = v[2].i;
+      for (i=0; i<3; i++) { bl->lo[i] = 0.0; bl->hi[i] = 1.0; }
+      for (i=0; i<dim; i++) bl->lo[i] = v[3+i].d;
+      for (i=0; i<dim; i++) bl->hi[i] = v[3+dim+i].d;
+    }
+    free(u);
+  }
+  fclose(idx);
+}
+
+/******************************************************************************
+*
+*  find_traj_frame - the frame of a step, or -1 if there is none
+*
+******************************************************************************/
+
+int find_traj_frame(traj_t *t, long long step)
+{
+  long long lo=0, hi=t->nframes-1, m;
+
+  /* the frames are ordered by step */
+  while (lo <= hi) {
+    m = (lo + hi) / 2;
+    if      (t->frames[m].step < step) lo = m + 1;
+    else if (t->frames[m].step > step) hi = m - 1;
+    else return (int) m;
+  }
+  return -1;
+}
+
+/******************************************************************************
+*
+*  read_traj_frame - read the blocks of a frame which overlap the region
+*  between the scaled positions lo and hi (all blocks if lo is NULL);
+*  returns a stream with their atoms, which may include atoms outside
+*  the region (see in_traj_region)
+*
+******************************************************************************/
+
+FILE *read_traj_frame(traj_t *t, int frame, double *lo, double *hi)
+{
+  traj_frame_t *fr = t->frames + frame;
+  traj_block_t *bl;
+  double *b = fr->box, *tb = t->tbox, vol;
+  char   *sel;
+  int    el = item_size(&t->info), swap = (t->info.endian != endian());
+  int    rlen, dim = t->info.n_pos, i, k;
+  long   len=0;
+
+  /* length of an atom record */
+  if (el == sizeof(double)) rlen = (t->info.n_items - 1) * el;
+  else                      rlen =  t->info.n_items      * el;
+
+  /* inverse box, for the scaled positions */
+  for (i=0; i<9; i++) tb[i] = 0.0;
+  if (dim==2) {
+    vol   = b[0] * b[4] - b[1] * b[3];
+    tb[0] =  b[4] / vol;  tb[1] = -b[3] / vol;
+    tb[3] = -b[1] / vol;  tb[4] =  b[0] / vol;
+  }
+  else {
+    for (i=0; i<3; i++) {
+      double *y = b + 3*((i+1)%3), *z = b + 3*((i+2)%3);
+      tb[3*i  ] = y[1] * z[2] - y[2] * z[1];
+      tb[3*i+1] = y[2] * z[0] - y[0] * z[2];
+      tb[3*i+2] = y[0] * z[1] - y[1] * z[0];
+    }
+    vol = b[0] * tb[0] + b[1] * tb[1] + b[2] * tb[2];
+    for (i=0; i<9; i++) tb[i] /= vol;
+  }
+
+  /* select the blocks */
+  sel = (char *) malloc( fr->nblocks + 1 );
+  if (NULL==sel) error("cannot allocate trajectory buffer");
+  for (k=0; k<fr->nblocks; k++) {
+    bl = t->blocks + fr->first + k;
+    sel[k] = 1;
+    if (lo) for (i=0; i<dim; i++)
+      if ((bl->hi[i] < lo[i]) || (bl->lo[i] > hi[i])) sel[k] = 0;
+    if (sel[k]) len += bl->n * rlen;
+  }
+  free(t->buf);
+  t->buf = (char *) malloc( len + 1 );
+  if (NULL==t->buf) error("cannot allocate trajectory buffer");
+
+  /* read them */
+  for (len=0, k=0; k<fr->nblocks; k++) {
+    bl = t->blocks + fr->first + k;
+    if (0==sel[k]) continue;
+    if (t->info.zipped) 
+      len += get_chunk(t->file, bl->off, el, swap, t->buf + len);
+    else {
+      if ((fseeko(t->file, (off_t) bl->off, SEEK_SET)) ||
+          (1 != fread(t->buf + len, bl->len, 1, t->file)))
+        error("cannot read block of trajectory file");
+      len += bl->len;
+    }
+  }
+  free(sel);
+  return open_buffer(t->buf, len);
+}
+
+/******************************************************************************
+*
+*  in_traj_region - whether an atom of the last frame read lies between
+*  the scaled positions lo and hi
+*
+******************************************************************************/
+
+int in_traj_region(traj_t *t, atom_t *atom, double *lo, double *hi)
+{
+  double s, p[3];
+  int    i, dim = t->info.n_pos;
+
+  p[0] = atom->pos.x;
+  p[1] = atom->pos.y;
+#ifdef TWOD
+  p[2] = 0.0;
+#else
+  p[2] = (dim==3) ? atom->pos.z : 0.0;
+#endif
+  for (i=0; i<dim; i++) {
+    s = t->tbox[3*i] * p[0] + t->tbox[3*i+1] * p[1] + t->tbox[3*i+2] * p[2];
+    if ((s < lo[i]) || (s > hi[i])) return 0;
+  }
+  return 1;
+}
+
+/******************************************************************************
+*
+*  close_traj - close a trajectory file
+*
+******************************************************************************/
+
+void close_traj(traj_t *t)
+{
+  fclose(t->file);
+  free(t->frames);
+  free(t->blocks);
+  free(t->buf);
+}
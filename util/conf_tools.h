@@ -54,6 +54,8 @@ typedef struct {
   int  n_data;
   int  n_items;
   int  n_lines;
+  int  zipped;
+  long hlen;
   char *contents[MAX_ITEMS_CONFIG];
   char *lines[MAX_LINES_HEADER];
 } header_info_t;
@@ -75,9 +77,37 @@ typedef union {
   double d;
 } i_or_d;
 
+/* trajectory files, written by IMD with parameter traj_int */
+
+typedef struct {
+  long long step, nblocks, first;  /* first: index of first block */
+  double    box[9];
+} traj_frame_t;
+
+typedef struct {
+  long long off, len, n;
+  double    lo[3], hi[3];          /* bounds of scaled positions */
+} traj_block_t;
+
+typedef struct {
+  header_info_t info;
+  FILE         *file;
+  long long     nframes, nblocks;
+  traj_frame_t *frames;
+  traj_block_t *blocks;
+  double        tbox[9];           /* inverse box of the last frame read */
+  char         *buf;               /* atom records of the last frame read */
+} traj_t;
+
 
 int    read_header(header_info_t *, str255);
 int    read_atom(header_info_t *, FILE *, atom_t *);
+FILE  *read_zip_config(header_info_t *, FILE *);
+void   open_traj(traj_t *, str255);
+int    find_traj_frame(traj_t *, long long);
+FILE  *read_traj_frame(traj_t *, int, double *, double *);
+int    in_traj_region(traj_t *, atom_t *, double *, double *);
+void   close_traj(traj_t *);
 int    SwappedInteger(int i);
 float  SwappedFloat(float f);
 double SwappedDouble(double d);
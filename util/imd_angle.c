@@ -36,7 +36,7 @@
 
 void usage(void)
 { 
-  printf("%s [-r<nnn>] [-A<nnn>] [-a<nnn>] [-e<nnn>] [-v] [-p paramter-file]\n",progname); 
+  printf("%s [-r<nnn>] [-t<nnn>] [-A<nnn>] [-a<nnn>] [-e<nnn>] [-v] [-p paramter-file]\n",progname); 
   exit(1); 
 }
 
@@ -35,7 +35,7 @@
 
 void usage(void)
 { 
-  printf("%s [-r <nnn>] [-A <nnn>] [-a <nnn>] [-e <nnn>] [-v] [-f] [-g] [-l <nnn> <nnn> <nnn>] [-n <nnn>] [-u <nnn> <nnn> <nnn>] [-w <nnn>] [-W <n> <n> <n> <n>] [-p paramter-file]\n", progname); 
+  printf("%s [-r <nnn>] [-t <nnn>] [-A <nnn>] [-a <nnn>] [-e <nnn>] [-v] [-f] [-g] [-l <nnn> <nnn> <nnn>] [-n <nnn>] [-u <nnn> <nnn> <nnn>] [-w <nnn>] [-W <n> <n> <n> <n>] [-p paramter-file]\n", progname); 
   exit(1); 
 }
 
@@ -37,7 +37,7 @@
 
 void usage(void)
 { 
-  printf("%s [-r<nnn>] [-A<nnn>] [-v] [-p paramter-file]\n",progname); 
+  printf("%s [-r<nnn>] [-t<nnn>] [-A<nnn>] [-v] [-p paramter-file]\n",progname); 
   exit(1); 
 }
 
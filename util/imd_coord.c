@@ -43,7 +43,7 @@
 
 void usage(void)
 { 
-  printf("%s [-r<nnn>] [-A<nnn>] [-e<nnn>] [-C<nnn>] [-l] [-g] [-u] [-p paramter-file]\n",progname); 
+  printf("%s [-r<nnn>] [-t<nnn>] [-A<nnn>] [-e<nnn>] [-C<nnn>] [-l] [-g] [-u] [-p paramter-file]\n",progname); 
   exit(1); 
 }
 
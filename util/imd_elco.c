@@ -50,7 +50,7 @@
 
 void usage(void)
 { 
-  printf("%s [-r<nnn>] [-A<nnn>] [-v] [-e<nnn>] [-c] [-m] [-M] [-s] [-w<nn>] -p paramter-file]\n", progname); 
+  printf("%s [-r<nnn>] [-t<nnn>] [-A<nnn>] [-v] [-e<nnn>] [-c] [-m] [-M] [-s] [-w<nn>] -p paramter-file]\n", progname); 
   
   exit(1); 
 }
@@ -35,7 +35,7 @@
 
 void usage(void)
 { 
-  printf("%s [-r<nnn>] [-a<nnn>] [-e<nnn>] [-v] [-p paramter-file]\n",progname); 
+  printf("%s [-r<nnn>] [-t<nnn>] [-a<nnn>] [-e<nnn>] [-v] [-p paramter-file]\n",progname); 
   exit(1); 
 }
 
@@ -31,7 +31,7 @@
 
 void usage(void)
 { 
-  printf("%s [-a<nnn>] [-p paramter-file]\n",progname); 
+  printf("%s [-t<nnn>] [-a<nnn>] [-p paramter-file]\n",progname); 
   exit(1); 
 }
 
@@ -592,6 +592,8 @@ EXTERN char *paramfilename;  /* parameter file */
 /* Bookkeeping */
 EXTERN int  restart INIT(-1);
 EXTERN int  avpos   INIT(-1);
+EXTERN long traj_step INIT(-1);  /* step of trajectory frame to read */
+EXTERN str255 trajfilename;      /* trajectory file */
 EXTERN real r2_cut;
 #if defined(ANGLE) || defined(COORD) || defined(CNA) 
 EXTERN real r_min INIT(0.0);     /* default value */
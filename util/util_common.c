@@ -490,6 +490,26 @@ void read_box(str255 infilename)
   FILE   *infile;
   str255 line, fname;
 
+  /* box of a frame of the trajectory file */
+  if (traj_step >= 0) {
+    traj_t traj;
+    double *b;
+    int    f;
+    open_traj(&traj, trajfilename);
+    f = find_traj_frame(&traj, traj_step);
+    if (f < 0) error_str("step not found in trajectory file %s", trajfilename);
+    b = traj.frames[f].box;
+    box_x.x = b[0]; box_x.y = b[1];
+    box_y.x = b[3]; box_y.y = b[4];
+#ifndef TWOD
+    box_x.z = b[2];
+    box_y.z = b[5];
+    box_z.x = b[6]; box_z.y = b[7]; box_z.z = b[8];
+#endif
+    close_traj(&traj);
+    return;
+  }
+
   infile = fopen(infilename,"r");
   if (NULL==infile) error_str("cannot open input file %s", infilename);
   fgets(line, 255, infile);
@@ -529,24 +549,44 @@ void read_atoms(str255 infilename)
   ivektor cellc;
   header_info_t info;
   atom_t atom;
-
-  /* we first try the old checkpoint name, then the new */
-  infile = fopen(infilename,"r");
-  if ((NULL == infile) && (restart != -1)) {
-    infilename = strcat(infilename,".chkpt");
-    infile = fopen(infilename,"r");
+  traj_t traj;
+
+  /* a frame of the trajectory file */
+  if (traj_step >= 0) {
+    open_traj(&traj, trajfilename);
+    i = find_traj_frame(&traj, traj_step);
+    if (i < 0) error_str("step not found in trajectory file %s", trajfilename);
+    info   = traj.info;
+    infile = read_traj_frame(&traj, i, NULL, NULL);
+    have_header = 1;
+    natoms = 0;
   }
-  if (NULL==infile) error_str("Cannot open atoms file %s", infilename);
+  else {
+    /* we first try the old checkpoint name, then the new */
+    infile = fopen(infilename,"r");
+    if ((NULL == infile) && (restart != -1)) {
+      infilename = strcat(infilename,".chkpt");
+      infile = fopen(infilename,"r");
+    }
+    if (NULL==infile) error_str("Cannot open atoms file %s", infilename);
 
-  /* read file header */
-  have_header = read_header(&info, infilename);
-  natoms=0;
+    /* read file header */
+    have_header = read_header(&info, infilename);
+    natoms=0;
 
-  /* eat header, if there is one */
-  if (have_header) {
-    fgets(buf,sizeof(buf),infile);
-    while (('#'==buf[0]) && ('E'!=buf[1]) && !feof(infile)) {
+    /* eat header, if there is one */
+    if (have_header) {
       fgets(buf,sizeof(buf),infile);
+      while (('#'==buf[0]) && ('E'!=buf[1]) && !feof(infile)) {
+        fgets(buf,sizeof(buf),infile);
+      }
+    }
+
+    /* uncompress compressed config file */
+    if (info.zipped) {
+      FILE *zipfile = read_zip_config(&info, infile);
+      fclose(infile);
+      infile = zipfile;
     }
   }
  
@@ -643,6 +683,7 @@ void read_atoms(str255 infilename)
     }
   }
   fclose(infile);  
+  if (traj_step >= 0) close_traj(&traj);
 }
 
 /******************************************************************************
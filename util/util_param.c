@@ -60,6 +60,13 @@ void read_command_line(int argc, char **argv)
       read_arg_bool(&argc, &argv, &use_vtypes);
       break;
 
+#if !defined(PS) && !defined(STRAIN) && !defined(STRESS)
+      /* t - step of frame in trajectory file */
+    case 't':
+      read_arg_long(&argc, &argv, &traj_step);
+      break;
+#endif
+
 #if defined(ANGLE) || defined(PAIR) || defined(COORD) || defined(CNA) ||defined(REMAT)
       /* a - minimum radius */
     case 'a':
@@ -645,7 +652,12 @@ void read_parameters(void)
     }
   }
 #else
-  if (-1 != restart) {
+  if (-1 != traj_step) {
+    /* name of the frame, used for the output files */
+    sprintf(trajfilename,"%s.traj",outfilename);
+    sprintf(infilename,"%s.traj.%ld",outfilename,traj_step);
+  }
+  else if (-1 != restart) {
     sprintf(infilename,"%s.%u.chkpt",outfilename,restart);
     testfile = fopen(infilename,"r");
     if (NULL==testfile) { 